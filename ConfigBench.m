@@ -0,0 +1,602 @@
+/** Enterprise Control Configuration and Logging
+    -- configuration propagation benchmark
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/Foundation.h>
+
+#if     !defined(EC_DEFAULTS_PREFIX)
+#define EC_DEFAULTS_PREFIX nil
+#endif
+
+#import "EcProcess.h"
+#import "EcUserDefaults.h"
+#import "EcConfigDelta.h"
+#import "EcTest.h"
+
+#include <stdio.h>
+
+/* The per-change measurements (in seconds) for each stage a change
+ * passes through, in the order they are reported.
+ */
+static NSString	*stages[] = {
+  @"Total",		// Control starts reading to last client applied
+  @"Control",		// Control reading and building the change
+  @"ToCommand",		// Control sent to Command received
+  @"Command",		// Command building the change for its clients
+  @"ToClient",		// Command sent to last client received
+  @"Client",		// Slowest client applying the change
+  nil
+};
+
+static NSString*
+filler(unsigned seq, unsigned length)
+{
+  NSMutableString	*s = [NSMutableString stringWithCapacity: length];
+
+  while ([s length] < length)
+    {
+      [s appendFormat: @"%08x",
+	(unsigned)(seq * 2654435761U + [s length])];
+    }
+  [s deleteCharactersInRange: NSMakeRange(length, [s length] - length)];
+  return s;
+}
+
+/* Builds a value of roughly the requested size for change number seq.
+ * A Flat change replaces one large string, a Wide change alters one of
+ * many small entries (so deltas are much smaller than the value), and
+ * a Deep change replaces a string at the bottom of nested dictionaries.
+ */
+static id
+payload(NSString *shape, unsigned seq, unsigned size)
+{
+  if ([shape isEqual: @"Wide"])
+    {
+      NSMutableDictionary	*d = [NSMutableDictionary dictionary];
+      unsigned			count = size / 64;
+      unsigned			i;
+
+      if (0 == count)
+	{
+	  count = 1;
+	}
+      for (i = 0; i < count; i++)
+	{
+	  [d setObject: filler((i == seq % count) ? seq : 0, 48)
+		forKey: [NSString stringWithFormat: @"K%06u", i]];
+	}
+      return d;
+    }
+  else if ([shape isEqual: @"Deep"])
+    {
+      id	v = filler(seq, size);
+      unsigned	i;
+
+      for (i = 0; i < 8; i++)
+	{
+	  v = [NSDictionary dictionaryWithObjectsAndKeys:
+	    v, [NSString stringWithFormat: @"L%u", i],
+	    filler(0, 16), @"Pad",
+	    nil];
+	}
+      return v;
+    }
+  return filler(seq, size);
+}
+
+static double
+percentile(NSArray *sorted, double p)
+{
+  NSUInteger	count = [sorted count];
+  NSUInteger	index;
+
+  if (0 == count)
+    {
+      return 0.0;
+    }
+  index = (NSUInteger)(p * (count - 1) + 0.5);
+  return [[sorted objectAtIndex: index] doubleValue];
+}
+
+static double
+timeOf(NSDictionary *hop, NSString *key)
+{
+  return [[hop objectForKey: key] doubleValue];
+}
+
+static NSTask*
+launch(NSString *path, NSArray *args)
+{
+  NSTask	*t = AUTORELEASE([NSTask new]);
+
+  [t setLaunchPath: path];
+  [t setArguments: args];
+  [t setStandardInput: [NSFileHandle fileHandleWithNullDevice]];
+  [t setStandardOutput: [NSFileHandle fileHandleWithNullDevice]];
+  NS_DURING
+    [t launch];
+  NS_HANDLER
+    NSLog(@"Unable to launch %@: %@", path, localException);
+    t = nil;
+  NS_ENDHANDLER
+  return t;
+}
+
+static BOOL
+writeConfig(NSString *path, NSString *scope, NSString *shape,
+  unsigned seq, unsigned size)
+{
+  NSMutableDictionary	*general;
+  NSDictionary		*bench;
+
+  bench = [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedInt: seq], @"BenchSeq",
+    payload(shape, seq, size), @"BenchData",
+    nil];
+  general = [NSMutableDictionary dictionary];
+  if ([scope isEqual: @"One"])
+    {
+      [general setObject: [NSDictionary dictionary] forKey: @"*"];
+      [general setObject: bench forKey: @"BenchClient-0"];
+    }
+  else
+    {
+      [general setObject: bench forKey: @"*"];
+    }
+  return [[[NSDictionary dictionaryWithObject: general forKey: @"*"]
+    description] writeToFile: path atomically: YES];
+}
+
+static int
+client()
+{
+  int	status;
+
+  if (nil == [[EcProcess alloc] initWithDefaults: nil])
+    {
+      NSLog(@"Unable to create client process.");
+      return 1;
+    }
+  [EcProc ecRun];
+  status = [EcProc ecQuitStatus];
+  return status;
+}
+
+int
+main()
+{
+  CREATE_AUTORELEASE_POOL(arp);
+  NSUserDefaults	*defs;
+  NSFileManager		*mgr = [NSFileManager defaultManager];
+  NSMutableDictionary	*results;
+  NSMutableArray	*tasks;
+  NSMutableArray	*clients;
+  NSMutableArray	*names;
+  NSMutableArray	*lastIds;
+  NSString		*pref;
+  NSString		*shape;
+  NSString		*scope;
+  NSString		*dir;
+  NSString		*data;
+  NSString		*plist;
+  NSString		*tools;
+  NSString		*ctlName;
+  NSString		*cmdName;
+  NSString		*program;
+  id<EcTest>		control;
+  NSArray		*common;
+  double		bytesToCommand = 0.0;
+  double		bytesToClients = 0.0;
+  unsigned		mapped = 0;
+  unsigned		measured = 0;
+  unsigned		nClients;
+  unsigned		nChanges;
+  unsigned		size;
+  unsigned		seq;
+  unsigned		i;
+  NSTimeInterval	timeout;
+  BOOL			start;
+  int			res = 0;
+
+  [EcProcess class];            // Force linker to provide library
+
+  pref = EC_DEFAULTS_PREFIX;
+  if (nil == pref)
+    {
+      pref = @"";
+    }
+  defs = [NSUserDefaults userDefaultsWithPrefix: pref];
+
+  if ([defs boolForKey: @"BenchClient"])
+    {
+      res = client();
+      DESTROY(arp);
+      return res;
+    }
+
+  if ([defs boolForKey: @"Help"] || [defs boolForKey: @"help"]
+    || [[[NSProcessInfo processInfo] arguments] containsObject: @"--Help"]
+    || [[[NSProcessInfo processInfo] arguments] containsObject: @"--help"])
+    {
+      printf("Measure configuration propagation from Control to clients.\n");
+      printf("  -Clients N\tnumber of client processes (default 10).\n");
+      printf("  -Changes N\tnumber of changes to apply (default 20).\n");
+      printf("  -Size bytes\tapproximate size of each change (1024).\n");
+      printf("  -Shape S\tFlat, Wide or Deep (default Flat).\n");
+      printf("  -Scope S\tAll (every client) or One (default All).\n");
+      printf("  -Timeout secs\tlimit for each change to propagate (30).\n");
+      printf("  -Directory D\tscratch user directory (default temporary).\n");
+      printf("  -ControlName N\tname of Control server (BenchControl).\n");
+      printf("  -CommandName N\tname of Command server (BenchCommand).\n");
+      printf("  -Tools D\tdirectory containing Control and Command.\n");
+      printf("  -Start NO\tuse an already running Control and Command.\n");
+      printf("  -Keep YES\tleave the processes running on completion.\n");
+      printf("\n");
+      printf("  The Control and Command servers (and the clients, which\n");
+      printf("  are copies of this program) are run with the scratch user\n");
+      printf("  directory, and the Control server has ConfigTrace set so\n");
+      printf("  that each change records the time it reaches each hop.\n");
+      printf("  Times are reported in milliseconds.\n");
+      fflush(stdout);
+      DESTROY(arp);
+      return 0;
+    }
+
+  nClients = [defs objectForKey: @"Clients"]
+    ? (unsigned)[defs integerForKey: @"Clients"] : 10;
+  nChanges = [defs objectForKey: @"Changes"]
+    ? (unsigned)[defs integerForKey: @"Changes"] : 20;
+  size = [defs objectForKey: @"Size"]
+    ? (unsigned)[defs integerForKey: @"Size"] : 1024;
+  timeout = [defs objectForKey: @"Timeout"]
+    ? [defs doubleForKey: @"Timeout"] : 30.0;
+  shape = [defs stringForKey: @"Shape"];
+  if (nil == shape)
+    {
+      shape = @"Flat";
+    }
+  scope = [defs stringForKey: @"Scope"];
+  if (nil == scope)
+    {
+      scope = @"All";
+    }
+  ctlName = [defs stringForKey: @"ControlName"];
+  if (nil == ctlName)
+    {
+      ctlName = @"BenchControl";
+    }
+  cmdName = [defs stringForKey: @"CommandName"];
+  if (nil == cmdName)
+    {
+      cmdName = @"BenchCommand";
+    }
+  start = [defs objectForKey: @"Start"] ? [defs boolForKey: @"Start"] : YES;
+  if (0 == nClients || 0 == nChanges)
+    {
+      printf("Nothing to do.\n");
+      DESTROY(arp);
+      return 1;
+    }
+
+  dir = [defs stringForKey: @"Directory"];
+  if (nil == dir)
+    {
+      dir = [NSTemporaryDirectory() stringByAppendingPathComponent:
+	[NSString stringWithFormat: @"ConfigBench-%d",
+	[[NSProcessInfo processInfo] processIdentifier]]];
+    }
+  data = [[dir stringByAppendingPathComponent: @"Data"]
+    stringByAppendingPathComponent: @"Command"];
+  if (NO == [mgr createDirectoryAtPath: data
+	   withIntermediateDirectories: YES
+			    attributes: nil
+				 error: NULL])
+    {
+      printf("Unable to create %s\n", [data UTF8String]);
+      DESTROY(arp);
+      return 1;
+    }
+  plist = [data stringByAppendingPathComponent: @"Control.plist"];
+  seq = 0;
+  if (NO == writeConfig(plist, scope, shape, seq, size)
+    || NO == [@"{}" writeToFile:
+      [data stringByAppendingPathComponent: @"Operators.plist"]
+      atomically: YES])
+    {
+      printf("Unable to write configuration in %s\n", [data UTF8String]);
+      DESTROY(arp);
+      return 1;
+    }
+
+  program = [[NSBundle mainBundle] executablePath];
+  tools = [defs stringForKey: @"Tools"];
+  if (nil == tools)
+    {
+      tools = [program stringByDeletingLastPathComponent];
+    }
+  common = [NSArray arrayWithObjects:
+    @"-UserDirectory", dir,
+    @"-ControlName", ctlName,
+    @"-CommandName", cmdName,
+    @"-Daemon", @"NO",
+    nil];
+
+  tasks = [NSMutableArray array];
+  if (YES == start)
+    {
+      NSMutableArray	*args;
+      NSTask		*t;
+
+      args = [NSMutableArray arrayWithArray: common];
+      [args addObject: @"-ConfigTrace"];
+      [args addObject: @"YES"];
+      [args addObject: @"--Watched"];
+      t = launch([tools stringByAppendingPathComponent: @"Control"], args);
+      if (nil != t) [tasks addObject: t];
+      args = [NSMutableArray arrayWithArray: common];
+      [args addObject: @"--Watched"];
+      t = launch([tools stringByAppendingPathComponent: @"Command"], args);
+      if (nil != t) [tasks addObject: t];
+    }
+
+  control = EcTestConnect(ctlName, nil, timeout);
+  if (nil == control)
+    {
+      printf("Unable to contact %s\n", [ctlName UTF8String]);
+      res = 1;
+    }
+  else if (NO == start)
+    {
+      EcTestSetConfig(control, @"ConfigTrace", [NSNumber numberWithBool: YES]);
+    }
+
+  clients = [NSMutableArray array];
+  names = [NSMutableArray array];
+  lastIds = [NSMutableArray array];
+  for (i = 0; 0 == res && i < nClients; i++)
+    {
+      NSMutableArray	*args;
+      NSString		*name;
+      NSTask		*t;
+
+      name = [NSString stringWithFormat: @"BenchClient-%u", i];
+      args = [NSMutableArray arrayWithArray: common];
+      [args addObject: @"-BenchClient"];
+      [args addObject: @"YES"];
+      [args addObject: @"-ProgramName"];
+      [args addObject: @"BenchClient"];
+      [args addObject: @"-Instance"];
+      [args addObject: [NSString stringWithFormat: @"%u", i]];
+      t = launch(program, args);
+      if (nil != t) [tasks addObject: t];
+      [names addObject: name];
+    }
+  for (i = 0; 0 == res && i < nClients; i++)
+    {
+      NSString	*name = [names objectAtIndex: i];
+      id	c = EcTestConnect(name, nil, timeout);
+
+      if (nil == c)
+	{
+	  printf("Unable to contact %s\n", [name UTF8String]);
+	  res = 1;
+	}
+      else
+	{
+	  [clients addObject: c];
+	  [lastIds addObject: @""];
+	}
+      if ([scope isEqual: @"One"])
+	{
+	  break;	// Only the first client sees changes
+	}
+    }
+
+  results = [NSMutableDictionary dictionary];
+  for (i = 0; stages[i] != nil; i++)
+    {
+      [results setObject: [NSMutableArray array] forKey: stages[i]];
+    }
+
+  while (0 == res && seq < nChanges)
+    {
+      NSMutableArray	*traces;
+      NSTimeInterval	t0;
+      NSDate		*limit;
+      NSUInteger	pending;
+      NSUInteger	c;
+
+      seq++;
+      writeConfig(plist, scope, shape, seq, size);
+      t0 = [NSDate timeIntervalSinceReferenceDate];
+      [(id<CmdConfig>)control updateConfig: nil];
+
+      /* Wait for every client to have applied the change.  The times
+       * are taken from the trace, so the polling interval does not
+       * affect the results.
+       */
+      traces = [NSMutableArray arrayWithCapacity: [clients count]];
+      for (c = 0; c < [clients count]; c++)
+	{
+	  [traces addObject: [NSNull null]];
+	}
+      limit = [NSDate dateWithTimeIntervalSinceNow: timeout];
+      pending = [clients count];
+      while (pending > 0 && [limit timeIntervalSinceNow] > 0.0)
+	{
+	  for (c = 0; c < [clients count]; c++)
+	    {
+	      id<EcTest>	client = [clients objectAtIndex: c];
+	      NSDictionary	*trace;
+
+	      if ([traces objectAtIndex: c] != [NSNull null])
+		{
+		  continue;
+		}
+	      if ((unsigned)[EcTestGetConfig(client, @"BenchSeq") intValue]
+		!= seq)
+		{
+		  continue;
+		}
+	      trace = EcTestGetConfig(client, EC_CONFIG_TRACE);
+	      if (NO == [trace isKindOfClass: [NSDictionary class]]
+		|| [[trace objectForKey: @"Id"]
+		  isEqual: [lastIds objectAtIndex: c]])
+		{
+		  continue;
+		}
+	      [lastIds replaceObjectAtIndex: c
+				 withObject: [trace objectForKey: @"Id"]];
+	      [traces replaceObjectAtIndex: c withObject: trace];
+	      pending--;
+	    }
+	  if (pending > 0)
+	    {
+	      [NSThread sleepForTimeInterval: 0.005];
+	    }
+	}
+      if (pending > 0)
+	{
+	  printf("Change %u reached only %u of %u clients in %g seconds\n",
+	    seq, (unsigned)([clients count] - pending),
+	    (unsigned)[clients count], timeout);
+	  res = 1;
+	  break;
+	}
+
+      /* Attribute the delay to each hop.  Every client trace has the
+       * same Control and Command hops, so we take those from the first
+       * and the worst case of the client hops.
+       */
+      {
+	NSArray		*hops = [[traces objectAtIndex: 0] objectForKey: @"Hops"];
+	NSDictionary	*ctl;
+	NSDictionary	*cmd;
+	double		received = 0.0;
+	double		applied = 0.0;
+	double		apply = 0.0;
+
+	if ([hops count] < 3)
+	  {
+	    printf("Change %u has an incomplete trace: %s\n", seq,
+	      [[[traces objectAtIndex: 0] description] UTF8String]);
+	    res = 1;
+	    break;
+	  }
+	ctl = [hops objectAtIndex: 0];
+	cmd = [hops objectAtIndex: 1];
+	for (c = 0; c < [traces count]; c++)
+	  {
+	    NSDictionary	*hop;
+
+	    hop = [[[traces objectAtIndex: c] objectForKey: @"Hops"] lastObject];
+	    if (timeOf(hop, @"Received") > received)
+	      {
+		received = timeOf(hop, @"Received");
+	      }
+	    if (timeOf(hop, @"Applied") > applied)
+	      {
+		applied = timeOf(hop, @"Applied");
+	      }
+	    if (timeOf(hop, @"Applied") - timeOf(hop, @"Received") > apply)
+	      {
+		apply = timeOf(hop, @"Applied") - timeOf(hop, @"Received");
+	      }
+	    bytesToClients += [[hop objectForKey: @"Bytes"] doubleValue];
+	    if ([[hop objectForKey: @"Mapped"] boolValue])
+	      {
+		mapped++;
+	      }
+	  }
+	bytesToCommand += [[cmd objectForKey: @"Bytes"] doubleValue];
+
+	[[results objectForKey: @"Total"] addObject:
+	  [NSNumber numberWithDouble: applied - t0]];
+	[[results objectForKey: @"Control"] addObject:
+	  [NSNumber numberWithDouble:
+	    timeOf(ctl, @"Sent") - timeOf(ctl, @"Started")]];
+	[[results objectForKey: @"ToCommand"] addObject:
+	  [NSNumber numberWithDouble:
+	    timeOf(cmd, @"Received") - timeOf(ctl, @"Sent")]];
+	[[results objectForKey: @"Command"] addObject:
+	  [NSNumber numberWithDouble:
+	    timeOf(cmd, @"Sent") - timeOf(cmd, @"Received")]];
+	[[results objectForKey: @"ToClient"] addObject:
+	  [NSNumber numberWithDouble: received - timeOf(cmd, @"Sent")]];
+	[[results objectForKey: @"Client"] addObject:
+	  [NSNumber numberWithDouble: apply]];
+	measured++;
+      }
+    }
+
+  if (measured > 0)
+    {
+      printf("%u changes (%s, %u bytes) to %u clients\n", measured,
+	[shape UTF8String], size, (unsigned)[clients count]);
+      printf("%-10s %9s %9s %9s %9s\n", "Stage", "p50", "p90", "p99", "max");
+      for (i = 0; stages[i] != nil; i++)
+	{
+	  NSArray	*a = [results objectForKey: stages[i]];
+
+	  a = [a sortedArrayUsingSelector: @selector(compare:)];
+	  printf("%-10s %9.3f %9.3f %9.3f %9.3f\n", [stages[i] UTF8String],
+	    percentile(a, 0.5) * 1000.0, percentile(a, 0.9) * 1000.0,
+	    percentile(a, 0.99) * 1000.0, [[a lastObject] doubleValue] * 1000.0);
+	}
+      printf("Bytes per change: Control->Command %.0f,"
+	" Command->clients %.0f (%.0f per client, %u mapped updates)\n",
+	bytesToCommand / measured, bytesToClients / measured,
+	bytesToClients / measured / [clients count], mapped);
+    }
+
+  if (NO == [defs boolForKey: @"Keep"])
+    {
+      for (i = 0; i < [names count]; i++)
+	{
+	  EcTestShutdownByName([names objectAtIndex: i], nil, 10.0);
+	}
+      if (YES == start)
+	{
+	  EcTestShutdownByName(cmdName, nil, 10.0);
+	  EcTestShutdownByName(ctlName, nil, 10.0);
+	}
+      for (i = 0; i < [tasks count]; i++)
+	{
+	  NSTask	*t = [tasks objectAtIndex: i];
+
+	  if ([t isRunning])
+	    {
+	      [t terminate];
+	    }
+	}
+      if (nil == [defs stringForKey: @"Directory"])
+	{
+	  [mgr removeItemAtPath: dir error: NULL];
+	}
+    }
+
+  DESTROY(arp);
+  return res;
+}
@@ -72,6 +72,14 @@
           Control server does not need to read the master key from the
           terminal).
         </p>
+        <p>Metrics gathered by the processes on each host are aggregated by
+          the Command server for that host and passed to the Control server
+          every ten seconds.  The Control server archives them in fixed size
+          round-robin files in the Metrics subdirectory of its data directory
+          (ten second resolution for a day and one minute resolution for a
+          month) and they may be examined using the Console 'metrics'
+          command.
+        </p>
       </section>
 
       <section>
@@ -201,14 +209,19 @@
 #ifndef INCLUDED_ECCL_H
 #define INCLUDED_ECCL_H
 
+#import	<ECCL/EcAdmission.h>
 #import	<ECCL/EcAlarm.h>
 #import	<ECCL/EcAlarmDestination.h>
 #import	<ECCL/EcAlarmSinkSNMP.h>
 #import	<ECCL/EcAlerter.h>
 #import	<ECCL/EcBroadcastProxy.h>
+#import	<ECCL/EcConfigDelta.h>
+#import	<ECCL/EcConfigMap.h>
 #import	<ECCL/EcHost.h>
 #import	<ECCL/EcLogger.h>
+#import	<ECCL/EcMetrics.h>
 #import	<ECCL/EcProcess.h>
+#import	<ECCL/EcTrace.h>
 #import	<ECCL/EcUserDefaults.h>
 
 #endif
@@ -0,0 +1,96 @@
+/** Enterprise Control Configuration and Logging
+    -- registration admission and reconnect backoff
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#ifndef	INCLUDED_ECADMISSION_H
+#define	INCLUDED_ECADMISSION_H
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+@class	NSMutableDictionary;
+@class	NSString;
+
+/** <p>When a Command server restarts, every process on its host tries
+ * to register with it again, and when the Control server restarts every
+ * Command server does the same.  The EcAdmission class spreads that load.
+ * </p>
+ * <p>A client uses +delayFor:after: to decide when to retry a failed
+ * connection.  The delay grows exponentially with the number of failures
+ * and is scaled by a jitter derived from the client's name, so that
+ * processes which lost their server at the same moment retry at
+ * different (but reproducible) times.
+ * </p>
+ * <p>A server uses an instance to admit registrations at a configured
+ * rate (with a burst allowance).  A registration which can not be served
+ * at once is given a slot in a queue and told how long to wait; when the
+ * same name returns at its slot it is admitted without waiting again, so
+ * deferred clients are served in the order they first asked.
+ * </p>
+ */
+@interface EcAdmission : NSObject
+{
+  double		interval;	/* Seconds between admissions	*/
+  double		tolerance;	/* Burst allowance in seconds	*/
+  NSTimeInterval	next;		/* Theoretical next admission	*/
+  NSTimeInterval	purged;		/* When slots were last purged	*/
+  NSMutableDictionary	*slots;		/* Name -> reserved slot	*/
+  unsigned		admitted;
+  unsigned		deferred;
+}
+
+/** Returns the delay (in seconds) before the next attempt by the named
+ * client to connect after the given number of consecutive failures.<br />
+ * The delay doubles with each failure from one second up to a maximum
+ * of thirty, and is jittered down by up to half its value using a hash
+ * of the name and failure count.
+ */
++ (NSTimeInterval) delayFor: (NSString*)name after: (unsigned)failures;
+
+/** Returns a value in the range 0.0 to 1.0 (exclusive) computed from the
+ * name and count, which is the same in every process and every run.
+ */
++ (double) jitterFor: (NSString*)name count: (unsigned)count;
+
+/** Asks for admission of a registration by the named client.<br />
+ * Returns zero if the registration may proceed now, otherwise the number
+ * of seconds after which the client should try again.
+ */
+- (NSTimeInterval) admit: (NSString*)name;
+
+/** Initialises the receiver to admit up to rate registrations per second
+ * on average, with up to burst admitted at once after an idle period.
+ */
+- (id) initWithRate: (double)rate burst: (unsigned)burst;
+
+/** Changes the rate and burst allowance.  Slots already reserved in the
+ * queue are unaffected.
+ */
+- (void) setRate: (double)rate burst: (unsigned)burst;
+
+@end
+
+#endif
+
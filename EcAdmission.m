@@ -0,0 +1,173 @@
+/** Enterprise Control Configuration and Logging
+    -- registration admission and reconnect backoff
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/Foundation.h>
+
+#import "EcAdmission.h"
+
+/* A reserved slot not claimed within this many seconds is discarded (the
+ * client has either gone away or ignored the advice to wait).
+ */
+#define	SLOT_EXPIRY	30.0
+
+@implementation EcAdmission
+
++ (NSTimeInterval) delayFor: (NSString*)name after: (unsigned)failures
+{
+  NSTimeInterval	d = 30.0;
+
+  if (failures < 5)
+    {
+      d = (NSTimeInterval)(1 << failures);
+    }
+  return d * (1.0 - 0.5 * [self jitterFor: name count: failures]);
+}
+
++ (double) jitterFor: (NSString*)name count: (unsigned)count
+{
+  const unsigned char	*p = (const unsigned char*)[name UTF8String];
+  uint64_t		h = 0xcbf29ce484222325ULL;	// FNV-1a
+  unsigned		i;
+
+  if (0 != p)
+    {
+      while (*p != '\0')
+	{
+	  h ^= *p++;
+	  h *= 0x100000001b3ULL;
+	}
+    }
+  for (i = 0; i < 4; i++)
+    {
+      h ^= (count >> (i * 8)) & 0xff;
+      h *= 0x100000001b3ULL;
+    }
+  return (double)(h >> 11) / 9007199254740992.0;
+}
+
+- (NSTimeInterval) admit: (NSString*)name
+{
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  NSTimeInterval	slot;
+  NSNumber		*n;
+
+  if (now - purged > SLOT_EXPIRY && [slots count] > 0)
+    {
+      NSEnumerator	*e = [[slots allKeys] objectEnumerator];
+      NSString		*k;
+
+      while (nil != (k = [e nextObject]))
+	{
+	  if ([[slots objectForKey: k] doubleValue] < now - SLOT_EXPIRY)
+	    {
+	      [slots removeObjectForKey: k];
+	    }
+	}
+      purged = now;
+    }
+
+  if (nil != (n = [slots objectForKey: name]))
+    {
+      /* This client has a place in the queue; admit it if its slot is
+       * due (allowing for timer inaccuracy), otherwise remind it.
+       */
+      slot = [n doubleValue];
+      if (slot - now <= interval)
+	{
+	  [slots removeObjectForKey: name];
+	  admitted++;
+	  return 0.0;
+	}
+      deferred++;
+      return slot - now;
+    }
+
+  if (next < now)
+    {
+      next = now;
+    }
+  if (next - now <= tolerance)
+    {
+      next += interval;
+      admitted++;
+      return 0.0;
+    }
+
+  /* Reserve the next free slot so that clients told to wait come back
+   * one at a time rather than together.
+   */
+  slot = next - tolerance;
+  next += interval;
+  [slots setObject: [NSNumber numberWithDouble: slot] forKey: name];
+  deferred++;
+  return slot - now;
+}
+
+- (void) dealloc
+{
+  DESTROY(slots);
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  return [NSString stringWithFormat:
+    @"%.1f/sec (burst %u) admitted %u, deferred %u, queued %u",
+    1.0 / interval, (unsigned)(tolerance / interval + 1.5),
+    admitted, deferred, (unsigned)[slots count]];
+}
+
+- (id) init
+{
+  return [self initWithRate: 20.0 burst: 20];
+}
+
+- (id) initWithRate: (double)rate burst: (unsigned)burst
+{
+  if (nil != (self = [super init]))
+    {
+      slots = [NSMutableDictionary new];
+      [self setRate: rate burst: burst];
+    }
+  return self;
+}
+
+- (void) setRate: (double)rate burst: (unsigned)burst
+{
+  if (rate < 0.1)
+    {
+      rate = 0.1;
+    }
+  if (burst < 1)
+    {
+      burst = 1;
+    }
+  interval = 1.0 / rate;
+  tolerance = interval * (burst - 1);
+}
+
+@end
+
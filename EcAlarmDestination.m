@@ -32,6 +32,7 @@
 #import "EcProcess.h"
 #import "EcAlarm.h"
 #import	"EcAlarmDestination.h"
+#import	"EcTrace.h"
 
 
 @interface	EcAlarmDestination (Private)
@@ -937,7 +938,9 @@
       return;
     }
   NS_DURING
+    EC_TRACE_BEGIN("alarm forward")
     [[self _connect] alarm: event];
+    EC_TRACE_END
     if (YES == _debug)
       {
         NSLog(@"%@ %@", NSStringFromSelector(_cmd), event);
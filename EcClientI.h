@@ -29,8 +29,13 @@
 #import	<Foundation/NSObject.h>
 
 #import	"EcProcess.h"
+#import	"EcMetrics.h"
 
+@class	NSArray;
 @class	NSData;
+@class	NSMapTable;
+@class	NSMutableArray;
+@class	NSMutableDictionary;
 @class	NSMutableSet;
 @class	NSString;
 
@@ -49,15 +54,36 @@
   unsigned	revSequence;		/* Last gnip sent BY client.	*/
   NSMutableSet	*files;			/* Want update info for these.	*/
   NSData	*config;		/* Config info for client.	*/
+  NSDictionary	*configInfo;		/* Config last sent to client.	*/
+  uint64_t	configVersion;		/* Version of configInfo.	*/
+  int		configDeltas;		/* Client accepts deltas?	*/
+  int		configMapped;		/* Client reads mapped config?	*/
   BOOL		transient;              /* Is this a transient client?  */
   BOOL		unregistered;           /* Has client unregistered?     */
   int           processIdentifier;	/* Process ID if known (or 0).	*/
+  uint64_t	beats;			/* Last heartbeat count seen.	*/
+  NSTimeInterval beatChanged;		/* When the count last changed.	*/
+  BOOL		stalled;		/* Hung by heartbeat?		*/
+  BOOL		slow;			/* Slow to answer pings?	*/
+  uint32_t	pings[EC_METRIC_BUCKETS]; /* Round trip times (ms).	*/
+  uint32_t	pingCount;		/* Total of pings[]		*/
+  double	pingMax;		/* Longest round trip (ms)	*/
+  double	pingLatest;		/* Last round trip (ms) or -1	*/
+  double	pingAverage;		/* Moving average (ms)		*/
+  double	pingUsual;		/* Slow moving average (ms)	*/
 }
 - (NSComparisonResult) compare: (EcClientI*)other;
 - (NSData*) config;
 - (NSDate*) delayed;
 - (NSMutableSet*) files;
 - (BOOL) gnip: (unsigned)seq;
+/* Records the heartbeat count and timestamp read from the slot for this
+ * client in the shared heartbeat table, and returns the time for which
+ * the count has not changed (zero if it has just changed).
+ */
+- (NSTimeInterval) heartbeat: (uint64_t)count
+		       stamp: (NSTimeInterval)stamp
+			  at: (NSTimeInterval)now;
 - (id) initFor: (id)obj
           name: (NSString*)n
 	  with: (id<CmdClient>)svr;
@@ -65,16 +91,85 @@
 - (NSString*) name;
 - (id) obj;
 - (void) ping;
+/* Returns an exponentially weighted moving average of the round trip
+ * times of recent pings (in milliseconds), or zero if there are none.
+ */
+- (double) pingAverage;
+/* Returns the round trip time (in milliseconds) of the ping answered by
+ * the most recent call to -gnip:, or a negative value if that call did
+ * not answer an outstanding ping.
+ */
+- (double) pingLatest;
+/* Returns an estimate of the round trip time (in milliseconds) below
+ * which the fraction (0.0 to 1.0) of recent pings were answered.
+ */
+- (double) pingPercentile: (double)fraction;
+/* Returns a short description of the ping round trip times, or an empty
+ * string if no ping has been answered.
+ */
+- (NSString*) pingSummary;
 - (int) processIdentifier;
 - (NSDate*) recovered;
 - (void) setConfig: (NSData*)c;
+- (void) setConfigInfo: (NSDictionary*)info version: (uint64_t)v;
+- (void) setConfigInfo: (NSDictionary*)info
+	       version: (uint64_t)v
+		  data: (NSData*)d;
 - (void) setName: (NSString*)n;
 - (void) setObj: (id)o;
 - (void) setProcessIdentifier: (int)p;
 - (void) setServer: (id<CmdClient>)s;
+- (void) setSlow: (BOOL)flag;
+- (void) setStalled: (BOOL)flag;
 - (void) setTransient: (BOOL)flag;
 - (void) setUnregistered: (BOOL)flag;
+- (BOOL) slow;
+- (BOOL) stalled;
 - (BOOL) transient;
 - (BOOL) unregistered;
+- (BOOL) updateConfig: (NSDictionary*)info version: (uint64_t)v;
+- (BOOL) updateConfig: (NSDictionary*)info
+	      version: (uint64_t)v
+	       mapped: (NSString*)path;
 @end
 
+/* The EcClientRegistry class holds the clients of a server in name order
+ * (as used for numeric indexes in commands) and indexes them by proxy,
+ * by name (ignoring case), by process ID and by name prefix, so that
+ * finding the sender of a message does not mean scanning every client.
+ * Where two clients share a key, the one earlier in name order is found
+ * (as with a linear search of the ordered list).
+ * The name, proxy and process ID of a client must not be changed while
+ * it is in a registry.
+ */
+@interface	EcClientRegistry : NSObject
+{
+  NSMutableArray	*list;		/* Clients in name order	*/
+  NSMutableArray	*keys;		/* Lowercase names in order	*/
+  NSMutableArray	*folded;	/* Clients in order of keys	*/
+  NSMutableDictionary	*byName;	/* Lowercase name -> client	*/
+  NSMapTable		*byObject;	/* Proxy -> client		*/
+  NSMapTable		*byPid;		/* Process ID -> client		*/
+}
+- (void) addObject: (EcClientI*)c;
+- (NSArray*) allObjects;
+- (NSUInteger) count;
+- (NSUInteger) indexOfObjectIdenticalTo: (EcClientI*)c;
+- (EcClientI*) objectAtIndex: (NSUInteger)i;
+
+/* Returns the client whose name matches s exactly (ignoring case), or
+ * the first one whose name starts with s.  If s starts with a digit and
+ * is a valid index into the list, the client at that index is returned.
+ */
+- (EcClientI*) objectForAbbreviation: (NSString*)s;
+
+/* Returns the clients (in name order) whose names start with s, or the
+ * client at the index given by a numeric value of s.
+ */
+- (NSMutableArray*) objectsForAbbreviation: (NSString*)s;
+- (EcClientI*) objectForName: (NSString*)s;
+- (EcClientI*) objectForProcessIdentifier: (int)p;
+- (EcClientI*) objectForProxy: (id)o;
+- (void) removeObjectAtIndex: (NSUInteger)i;
+- (void) removeObjectIdenticalTo: (EcClientI*)c;
+@end
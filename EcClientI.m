@@ -32,6 +32,9 @@
 
 #import "EcProcess.h"
 #import "EcClientI.h"
+#import "EcConfigDelta.h"
+
+#include <ctype.h>
 
 
 @implementation EcClientI
@@ -43,6 +46,11 @@
 
 - (NSData*) config
 {
+  if (nil == config && nil != configInfo)
+    {
+      config = RETAIN([EcConfigDelta dataForConfig: configInfo
+					   version: configVersion]);
+    }
   return config;
 }
 
@@ -75,6 +83,7 @@
   DESTROY(delayed);
   DESTROY(recovered);
   DESTROY(config);
+  DESTROY(configInfo);
   DESTROY(files);
   DESTROY(name);
   DESTROY(obj);
@@ -102,6 +111,39 @@
 	}
     }
   revSequence = s;
+  pingLatest = -1.0;
+  if (nil != outstanding && s == fwdSequence)
+    {
+      double	ms = -1000.0 * [outstanding timeIntervalSinceNow];
+      unsigned	i;
+
+      if (ms < 0.0) ms = 0.0;
+      pingLatest = ms;
+      if (ms > pingMax) pingMax = ms;
+      if (0 == pingCount)
+	{
+	  pingAverage = pingUsual = ms;
+	}
+      else
+	{
+	  pingAverage += (ms - pingAverage) * 0.2;
+	  pingUsual += (ms - pingUsual) * 0.01;
+	}
+      /* Halve the histogram from time to time so that its percentiles
+       * describe the last thousand or so pings rather than all of them.
+       */
+      if (pingCount >= 1000)
+	{
+	  pingCount = 0;
+	  for (i = 0; i < EC_METRIC_BUCKETS; i++)
+	    {
+	      pings[i] /= 2;
+	      pingCount += pings[i];
+	    }
+	}
+      pings[[EcMetrics bucketForValue: ms]]++;
+      pingCount++;
+    }
   if (nil == recovered && nil != delayed)
     {
       /* We were in a sequence of delayed pings, so we need to record
@@ -128,6 +170,7 @@
   if (self != nil)
     {
       files = [NSMutableSet new];
+      pingLatest = -1.0;
       [self setObj: o];
       [self setName: n];
       [self setServer: s];
@@ -150,6 +193,43 @@
   return obj;
 }
 
+- (double) pingAverage
+{
+  return pingAverage;
+}
+
+- (double) pingLatest
+{
+  return pingLatest;
+}
+
+- (double) pingPercentile: (double)fraction
+{
+  NSMutableArray	*b;
+  unsigned		i;
+
+  b = [NSMutableArray arrayWithCapacity: EC_METRIC_BUCKETS];
+  for (i = 0; i < EC_METRIC_BUCKETS; i++)
+    {
+      [b addObject: [NSNumber numberWithUnsignedInt: pings[i]]];
+    }
+  return [EcMetrics percentile: fraction
+			    of: [NSDictionary dictionaryWithObjectsAndKeys:
+    b, @"B", [NSNumber numberWithDouble: pingMax], @"M", nil]];
+}
+
+- (NSString*) pingSummary
+{
+  if (0 == pingCount)
+    {
+      return @"";
+    }
+  return [NSString stringWithFormat:
+    @"ping %.1f/%.1f/%.1fms (p50/p90/p99) avg %.1fms usual %.1fms",
+    [self pingPercentile: 0.5], [self pingPercentile: 0.9],
+    [self pingPercentile: 0.99], pingAverage, pingUsual];
+}
+
 - (void) ping
 {
   if (fwdSequence == revSequence)
@@ -188,6 +268,26 @@
     }
 }
 
+- (NSTimeInterval) heartbeat: (uint64_t)count
+		       stamp: (NSTimeInterval)stamp
+			  at: (NSTimeInterval)now
+{
+  if (0.0 == beatChanged)
+    {
+      /* First sight of this client's slot; the timestamp tells us when it
+       * last beat (unless the clocks disagree).
+       */
+      beats = count;
+      beatChanged = (stamp > 0.0 && stamp < now) ? stamp : now;
+    }
+  else if (count != beats)
+    {
+      beats = count;
+      beatChanged = now;
+    }
+  return now - beatChanged;
+}
+
 - (int) processIdentifier
 {
   return processIdentifier;
@@ -201,6 +301,30 @@
 - (void) setConfig: (NSData*)c
 {
   ASSIGN(config, c);
+  DESTROY(configInfo);
+}
+
+/* Records the configuration (and its version) as having been sent to the
+ * client.  The serialized form is only built if the client asks for a
+ * full update.
+ */
+- (void) setConfigInfo: (NSDictionary*)info version: (uint64_t)v
+{
+  ASSIGN(configInfo, info);
+  configVersion = v;
+  DESTROY(config);
+}
+
+/* As above, but with the serialized form already built (and possibly
+ * shared with other clients).
+ */
+- (void) setConfigInfo: (NSDictionary*)info
+	       version: (uint64_t)v
+		  data: (NSData*)d
+{
+  ASSIGN(configInfo, info);
+  configVersion = v;
+  ASSIGN(config, d);
 }
 
 - (void) setName: (NSString*)n
@@ -223,6 +347,16 @@
   theServer = s;
 }
 
+- (void) setSlow: (BOOL)flag
+{
+  slow = flag ? YES : NO;
+}
+
+- (void) setStalled: (BOOL)flag
+{
+  stalled = flag ? YES : NO;
+}
+
 - (void) setTransient: (BOOL)flag
 {
   transient = flag ? YES : NO;
@@ -236,6 +370,16 @@
     }
 }
 
+- (BOOL) slow
+{
+  return slow;
+}
+
+- (BOOL) stalled
+{
+  return stalled;
+}
+
 - (BOOL) transient
 {
   return transient;
@@ -245,6 +389,456 @@
 {
   return unregistered;
 }
+
+- (BOOL) updateConfig: (NSDictionary*)info version: (uint64_t)v
+{
+  return [self updateConfig: info version: v mapped: nil];
+}
+
+/* Sends the configuration to the client unless it is unchanged since the
+ * last update (a new EC_CONFIG_TRACE alone is not a change).  If the
+ * configuration has been published in a mapped file at path, a client
+ * able to read the file is simply told to do so.
+ * Otherwise a client which accepts deltas is sent only the changes since
+ * the version it was last sent.
+ */
+- (BOOL) updateConfig: (NSDictionary*)info
+	      version: (uint64_t)v
+	       mapped: (NSString*)path
+{
+  NSData	*delta = nil;
+
+  if (nil != configInfo && [EcConfigDelta config: configInfo isEqualTo: info])
+    {
+      return NO;	// Unchanged (or only the trace changed)
+    }
+  if (nil != path && 0 == configMapped)
+    {
+      NS_DURING
+	{
+	  if ([obj respondsToSelector: @selector(updateConfigMapped:)])
+	    {
+	      configMapped = 1;
+	    }
+	  else
+	    {
+	      configMapped = -1;
+	    }
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"Checking for mapped config in %@ - %@",
+	    name, localException);
+	}
+      NS_ENDHANDLER
+    }
+  if (nil != path && configMapped > 0)
+    {
+      [self setConfigInfo: info version: v];
+      [obj updateConfigMapped: path];
+      return YES;
+    }
+  if (0 == configDeltas)
+    {
+      NS_DURING
+	{
+	  if ([obj respondsToSelector: @selector(updateConfigDelta:)])
+	    {
+	      configDeltas = 1;
+	    }
+	  else
+	    {
+	      configDeltas = -1;
+	    }
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"Checking for config deltas in %@ - %@",
+	    name, localException);
+	}
+      NS_ENDHANDLER
+    }
+  if (configDeltas > 0 && nil != configInfo)
+    {
+      delta = [EcConfigDelta deltaFrom: configInfo
+			       version: configVersion
+				    to: info
+			       version: v];
+    }
+  [self setConfigInfo: info version: v];
+  if (nil == delta)
+    {
+      [obj updateConfig: [self config]];
+    }
+  else
+    {
+      [obj updateConfigDelta: delta];
+    }
+  return YES;
+}
 @end
 
 
+/* Returns the first position in the sorted array of strings at which
+ * key could be inserted (ie the first element not less than key).
+ */
+static NSUInteger
+lowerBound(NSArray *a, NSString *key)
+{
+  NSUInteger	lo = 0;
+  NSUInteger	hi = [a count];
+
+  while (lo < hi)
+    {
+      NSUInteger	mid = (lo + hi) / 2;
+
+      if ([[a objectAtIndex: mid] compare: key options: NSLiteralSearch]
+	== NSOrderedAscending)
+	{
+	  lo = mid + 1;
+	}
+      else
+	{
+	  hi = mid;
+	}
+    }
+  return lo;
+}
+
+/* Returns the first position in the name ordered array of clients whose
+ * name is not less than key.
+ */
+static NSUInteger
+namePosition(NSArray *a, NSString *key)
+{
+  NSUInteger	lo = 0;
+  NSUInteger	hi = [a count];
+
+  while (lo < hi)
+    {
+      NSUInteger	mid = (lo + hi) / 2;
+
+      if ([[[a objectAtIndex: mid] name] compare: key] == NSOrderedAscending)
+	{
+	  lo = mid + 1;
+	}
+      else
+	{
+	  hi = mid;
+	}
+    }
+  return lo;
+}
+
+@implementation	EcClientRegistry
+
+- (void) addObject: (EcClientI*)c
+{
+  NSString	*name = [c name];
+  NSString	*key = [name lowercaseString];
+  NSUInteger	count;
+  NSUInteger	pos;
+  EcClientI	*o;
+  id		p;
+  int		pid;
+
+  /* Clients with the same name are kept in the order they were added.
+   */
+  count = [list count];
+  pos = namePosition(list, name);
+  while (pos < count && [c compare: [list objectAtIndex: pos]]
+    != NSOrderedAscending)
+    {
+      pos++;
+    }
+  [list insertObject: c atIndex: pos];
+
+  /* The prefix index is ordered by lowercase name, then by name order,
+   * so the first of a run of matching keys is the first in the list.
+   */
+  count = [keys count];
+  pos = lowerBound(keys, key);
+  while (pos < count && [[keys objectAtIndex: pos] isEqual: key]
+    && [c compare: [folded objectAtIndex: pos]] != NSOrderedAscending)
+    {
+      pos++;
+    }
+  [keys insertObject: key atIndex: pos];
+  [folded insertObject: c atIndex: pos];
+
+  o = [byName objectForKey: key];
+  if (nil == o || [c compare: o] == NSOrderedAscending)
+    {
+      [byName setObject: c forKey: key];
+    }
+  if (nil != (p = [c obj]))
+    {
+      o = [byObject objectForKey: p];
+      if (nil == o || [c compare: o] == NSOrderedAscending)
+	{
+	  [byObject setObject: c forKey: p];
+	}
+    }
+  if (0 != (pid = [c processIdentifier]))
+    {
+      o = (EcClientI*)NSMapGet(byPid, (void*)(intptr_t)pid);
+      if (nil == o || [c compare: o] == NSOrderedAscending)
+	{
+	  NSMapInsert(byPid, (void*)(intptr_t)pid, (void*)c);
+	}
+    }
+}
+
+- (NSArray*) allObjects
+{
+  return AUTORELEASE([list copy]);
+}
+
+- (NSUInteger) count
+{
+  return [list count];
+}
+
+- (void) dealloc
+{
+  DESTROY(byPid);
+  DESTROY(byObject);
+  DESTROY(byName);
+  DESTROY(folded);
+  DESTROY(keys);
+  DESTROY(list);
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  return [list description];
+}
+
+- (NSUInteger) indexOfObjectIdenticalTo: (EcClientI*)c
+{
+  NSString	*name = [c name];
+  NSUInteger	count = [list count];
+  NSUInteger	pos;
+
+  for (pos = namePosition(list, name); pos < count; pos++)
+    {
+      EcClientI	*o = [list objectAtIndex: pos];
+
+      if (o == c)
+	{
+	  return pos;
+	}
+      if (NO == [[o name] isEqual: name])
+	{
+	  break;
+	}
+    }
+  return NSNotFound;
+}
+
+- (id) init
+{
+  if (nil != (self = [super init]))
+    {
+      list = [[NSMutableArray alloc] initWithCapacity: 10];
+      keys = [[NSMutableArray alloc] initWithCapacity: 10];
+      folded = [[NSMutableArray alloc] initWithCapacity: 10];
+      byName = [[NSMutableDictionary alloc] initWithCapacity: 10];
+      /* Proxies are keyed by identity so that looking one up does not
+       * send a -hash message to the remote process.
+       */
+      byObject = [[NSMapTable alloc]
+	initWithKeyOptions: NSPointerFunctionsObjectPointerPersonality
+	valueOptions: NSPointerFunctionsObjectPersonality
+	capacity: 10];
+      byPid = [[NSMapTable alloc]
+	initWithKeyOptions: NSPointerFunctionsIntegerPersonality
+	| NSPointerFunctionsOpaqueMemory
+	valueOptions: NSPointerFunctionsObjectPersonality
+	capacity: 10];
+    }
+  return self;
+}
+
+- (EcClientI*) objectAtIndex: (NSUInteger)i
+{
+  return [list objectAtIndex: i];
+}
+
+- (EcClientI*) objectForAbbreviation: (NSString*)s
+{
+  NSString	*key;
+  NSUInteger	count;
+  NSUInteger	pos;
+  EcClientI	*best = nil;
+
+  /*
+   *	Special case - a numeric value is used as an index into the array.
+   */
+  if (isdigit(*[s cString]))
+    {
+      int	i = [s intValue];
+
+      if (i >= 0 && i < (int)[list count])
+	{
+	  return [list objectAtIndex: i];
+	}
+    }
+
+  key = [s lowercaseString];
+  count = [keys count];
+  pos = lowerBound(keys, key);
+  if (pos < count && [[keys objectAtIndex: pos] isEqual: key])
+    {
+      return [folded objectAtIndex: pos];	// Exact match
+    }
+  while (pos < count && [[keys objectAtIndex: pos] hasPrefix: key])
+    {
+      EcClientI	*o = [folded objectAtIndex: pos++];
+
+      if (nil == best || [o compare: best] == NSOrderedAscending)
+	{
+	  best = o;
+	}
+    }
+  return best;
+}
+
+- (NSMutableArray*) objectsForAbbreviation: (NSString*)s
+{
+  NSMutableArray	*r = [NSMutableArray arrayWithCapacity: 4];
+
+  /*
+   *	Special case - a numeric value is used as an index into the array.
+   */
+  if (isdigit(*[s cString]))
+    {
+      int	i = [s intValue];
+
+      if (i >= 0 && i < (int)[list count])
+	{
+	  [r addObject: [list objectAtIndex: i]];
+	}
+    }
+  else
+    {
+      NSString		*key = [s lowercaseString];
+      NSUInteger	count = [keys count];
+      NSUInteger	pos = lowerBound(keys, key);
+
+      while (pos < count && [[keys objectAtIndex: pos] hasPrefix: key])
+	{
+	  [r addObject: [folded objectAtIndex: pos++]];
+	}
+      [r sortUsingSelector: @selector(compare:)];
+    }
+  return r;
+}
+
+- (EcClientI*) objectForName: (NSString*)s
+{
+  return [byName objectForKey: [s lowercaseString]];
+}
+
+- (EcClientI*) objectForProcessIdentifier: (int)p
+{
+  if (0 == p)
+    {
+      return nil;
+    }
+  return (EcClientI*)NSMapGet(byPid, (void*)(intptr_t)p);
+}
+
+- (EcClientI*) objectForProxy: (id)o
+{
+  if (nil == o)
+    {
+      return nil;
+    }
+  return [byObject objectForKey: o];
+}
+
+- (void) removeObjectAtIndex: (NSUInteger)i
+{
+  [self removeObjectIdenticalTo: [list objectAtIndex: i]];
+}
+
+- (void) removeObjectIdenticalTo: (EcClientI*)c
+{
+  NSUInteger	pos = [self indexOfObjectIdenticalTo: c];
+  NSUInteger	count;
+  NSString	*key;
+  id		p;
+  int		pid;
+
+  if (NSNotFound == pos)
+    {
+      return;
+    }
+  RETAIN(c);
+  [list removeObjectAtIndex: pos];
+
+  key = [[c name] lowercaseString];
+  count = [keys count];
+  for (pos = lowerBound(keys, key); pos < count; pos++)
+    {
+      if ([folded objectAtIndex: pos] == c)
+	{
+	  [keys removeObjectAtIndex: pos];
+	  [folded removeObjectAtIndex: pos];
+	  break;
+	}
+    }
+
+  /* Where the client was indexed, the next client sharing its key (if
+   * any) takes its place.  Names are found from the prefix index, but
+   * shared proxies and process IDs are rare enough to search for.
+   */
+  if ([byName objectForKey: key] == c)
+    {
+      pos = lowerBound(keys, key);
+      if (pos < [keys count] && [[keys objectAtIndex: pos] isEqual: key])
+	{
+	  [byName setObject: [folded objectAtIndex: pos] forKey: key];
+	}
+      else
+	{
+	  [byName removeObjectForKey: key];
+	}
+    }
+  if (nil != (p = [c obj]) && [byObject objectForKey: p] == c)
+    {
+      [byObject removeObjectForKey: p];
+      count = [list count];
+      for (pos = 0; pos < count; pos++)
+	{
+	  EcClientI	*o = [list objectAtIndex: pos];
+
+	  if ([o obj] == p)
+	    {
+	      [byObject setObject: o forKey: p];
+	      break;
+	    }
+	}
+    }
+  pid = [c processIdentifier];
+  if (0 != pid && (EcClientI*)NSMapGet(byPid, (void*)(intptr_t)pid) == c)
+    {
+      NSMapRemove(byPid, (void*)(intptr_t)pid);
+      count = [list count];
+      for (pos = 0; pos < count; pos++)
+	{
+	  EcClientI	*o = [list objectAtIndex: pos];
+
+	  if ([o processIdentifier] == pid)
+	    {
+	      NSMapInsert(byPid, (void*)(intptr_t)pid, (void*)o);
+	      break;
+	    }
+	}
+    }
+  RELEASE(c);
+}
+
+@end
@@ -36,13 +36,26 @@
 #endif
 
 #import "EcProcess.h"
+#import "EcAdmission.h"
 #import "EcAlarm.h"
 #import "EcClientI.h"
+#import "EcConfigDelta.h"
+#import "EcConfigMap.h"
+#import "EcHeartbeat.h"
 #import "EcHost.h"
+#import "EcMetrics.h"
+#import "EcPidWatch.h"
+#import "EcProcUsage.h"
+#import "EcSpawnTask.h"
 #import "NSFileHandle+Printf.h"
 
 #import "config.h"
 
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
 #define	DLY	300.0
 #define	FIB	0.1
 
@@ -70,12 +83,187 @@ restartStatus(int terminationStatus)
     }
 }
 
+/* Returns the percentage of the last ten seconds for which some tasks were
+ * stalled on the resource whose pressure file is given, or a negative value
+ * if pressure stall information is not available.
+ */
+static double
+pressureStall(const char *path)
+{
+#if	defined(__linux__)
+  char		buf[256];
+  char		*ptr;
+  FILE		*f;
+  size_t	len;
+
+  if (NULL == (f = fopen(path, "r")))
+    {
+      return -1.0;
+    }
+  len = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[len] = '\0';
+  if (strncmp(buf, "some ", 5) != 0
+    || NULL == (ptr = strstr(buf, "avg10=")))
+    {
+      return -1.0;
+    }
+  return strtod(ptr + 6, 0);
+#else
+  return -1.0;
+#endif
+}
+
+/* Returns the one minute load average divided by the number of processors,
+ * or a negative value if it is not known.
+ */
+static double
+loadPerProcessor()
+{
+#if	defined(__linux__)
+  char		buf[128];
+  FILE		*f;
+  size_t	len;
+  NSUInteger	cpus = [[NSProcessInfo processInfo] activeProcessorCount];
+
+  if (NULL == (f = fopen("/proc/loadavg", "r")))
+    {
+      return -1.0;
+    }
+  len = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[len] = '\0';
+  return strtod(buf, 0) / (cpus > 0 ? cpus : 1);
+#else
+  return -1.0;
+#endif
+}
+
+/* Returns the time (in clock ticks since boot) at which the process started,
+ * or zero if it is not known.  This lets us tell whether a process ID from
+ * the journal has been reused by another process.
+ */
+static unsigned long long
+pidStartTime(int pid)
+{
+#if	defined(__linux__)
+  char		buf[1024];
+  char		*ptr;
+  FILE		*f;
+  size_t	len;
+  int		field;
+
+  snprintf(buf, sizeof(buf), "/proc/%d/stat", pid);
+  if (NULL == (f = fopen(buf, "r")))
+    {
+      return 0;
+    }
+  len = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[len] = '\0';
+
+  /* The process name is in brackets and may contain spaces, so we count
+   * fields from the closing bracket (which ends the second field) up to
+   * the start time, which is field 22.
+   */
+  if (NULL == (ptr = strrchr(buf, ')')))
+    {
+      return 0;
+    }
+  for (field = 2; field < 22 && NULL != ptr; field++)
+    {
+      ptr = strchr(ptr + 1, ' ');
+    }
+  if (NULL == ptr)
+    {
+      return 0;
+    }
+  return strtoull(ptr + 1, 0, 10);
+#else
+  return 0;
+#endif
+}
+
+/* Appends a record of the state of the named process to the journal.
+ * A nil state records the removal of the process.
+ */
+static void
+journalAppend(NSString *name, NSDictionary *state)
+{
+  NSMutableDictionary	*m;
+  NSMutableData		*d;
+  NSData		*r;
+  uint32_t		len;
+
+  if (nil == journalHandle)
+    {
+      return;
+    }
+  m = [NSMutableDictionary dictionaryWithCapacity: 3];
+  [m setObject: [NSNumber numberWithUnsignedLongLong: ++journalSeq]
+	forKey: @"Seq"];
+  [m setObject: name forKey: @"Name"];
+  if (nil != state)
+    {
+      [m setObject: state forKey: @"State"];
+    }
+  r = [NSPropertyListSerialization
+    dataFromPropertyList: m
+    format: NSPropertyListBinaryFormat_v1_0
+    errorDescription: 0];
+  len = NSSwapHostIntToBig((uint32_t)[r length]);
+  d = [NSMutableData dataWithCapacity: [r length] + 4];
+  [d appendBytes: &len length: 4];
+  [d appendData: r];
+
+  /* The record is written in a single operation, so a crash can at worst
+   * leave a truncated record at the end of the file, which is ignored
+   * when the journal is read.
+   */
+  NS_DURING
+    {
+      [journalHandle writeData: d];
+      journalCount++;
+    }
+  NS_HANDLER
+    {
+      NSLog(@"Unable to write to journal %@: %@", journalPath, localException);
+    }
+  NS_ENDHANDLER
+}
+
 static const NSTimeInterval   day = 24.0 * 60.0 * 60.0;
 
 static int	tStatus = 0;
 
 static NSTimeInterval	pingTime = 240.0;
 
+static NSTimeInterval	heartbeatTime = 15.0;
+
+static NSTimeInterval	pingSlowTime = 2.0;
+
+/* Resource usage of managed processes and of the host is sampled from /proc
+ * every usageTime seconds.  A process using more than usageCPU percent of a
+ * CPU, or a host with more than usageCPU percent of its CPU capacity busy
+ * or a disk busy for more than usageIO percent of the time, for longer than
+ * usageSustain seconds raises an alarm.  The alarm is cleared once the
+ * usage falls below 80 percent of the limit.
+ */
+static NSTimeInterval	usageTime = 5.0;
+static double		usageCPU = 90.0;
+static double		usageIO = 90.0;
+static NSTimeInterval	usageSustain = 300.0;
+
+/* Registered clients are pinged from a timing wheel of PING_SLOTS slots
+ * turned every PING_TICK seconds.  Each client is checked and pinged once
+ * per revolution, but the clients are spread evenly over the slots so the
+ * pings go out steadily rather than in a burst.
+ */
+#define	PING_SLOTS	50
+#define	PING_TICK	0.1
+static NSMutableArray	*pingWheel = nil;	// Arrays of clients
+static unsigned		pingHand = 0;		// Next slot due
+
 static int	comp_len = 0;
 
 static int	comp(NSString *s0, NSString *s1)
@@ -132,6 +320,47 @@ cmdWord(NSArray* a, unsigned int pos)
     }
 }
 
+/* Returns the configuration with the time it is being sent on added to
+ * our own (last) hop of its trace, or the configuration unchanged if it
+ * is not being traced or the hop has already been stamped.
+ */
+static NSDictionary*
+traceSent(NSDictionary *conf, NSString *name)
+{
+  NSMutableDictionary	*m;
+  NSMutableDictionary	*hop;
+  NSMutableArray	*hops;
+  NSDictionary		*trace;
+
+  trace = [conf objectForKey: EC_CONFIG_TRACE];
+  if (NO == [trace isKindOfClass: [NSDictionary class]])
+    {
+      return conf;
+    }
+  hops = [trace objectForKey: @"Hops"];
+  if (NO == [hops isKindOfClass: [NSArray class]] || 0 == [hops count])
+    {
+      return conf;
+    }
+  hop = [hops lastObject];
+  if (NO == [hop isKindOfClass: [NSDictionary class]]
+    || NO == [name isEqual: [hop objectForKey: @"Name"]]
+    || nil != [hop objectForKey: @"Sent"])
+    {
+      return conf;
+    }
+  hop = AUTORELEASE([hop mutableCopy]);
+  [hop setObject: [NSNumber numberWithDouble:
+    [NSDate timeIntervalSinceReferenceDate]] forKey: @"Sent"];
+  hops = AUTORELEASE([hops mutableCopy]);
+  [hops replaceObjectAtIndex: [hops count] - 1 withObject: hop];
+  trace = AUTORELEASE([trace mutableCopy]);
+  [(NSMutableDictionary*)trace setObject: hops forKey: @"Hops"];
+  m = AUTORELEASE([conf mutableCopy]);
+  [m setObject: trace forKey: EC_CONFIG_TRACE];
+  return AUTORELEASE([m copy]);
+}
+
 static BOOL                     debug = YES;
 static NSTimeInterval           dumpTime = 30.0;
 static NSTimeInterval           quitTime = 120.0;
@@ -143,13 +372,57 @@ static NSDate                   *terminateBy = nil;
 
 static NSUInteger               launchLimit = 0;
 static BOOL                     launchEnabled = NO;
+static BOOL                     launchSpawn = YES;	// Use EcSpawnTask
+
+/* When LaunchLimit is configured as 'Auto' the launch limit is a budget
+ * adjusted between launchLimitMin and launchLimitMax according to the load
+ * on the host and the time recent launches took to register.
+ */
+static BOOL                     launchAdaptive = NO;
+static NSUInteger               launchLimitMin = 1;
+static NSUInteger               launchLimitMax = 20;
+static NSString                 *launchLimitReason = nil;
+static NSTimeInterval           launchLimitChecked = 0.0;
+static NSTimeInterval           launchLimitLowered = 0.0;
+static NSTimeInterval           launchStartupRecent = 0.0;	// Fast EWMA
+static NSTimeInterval           launchStartupUsual = 0.0;	// Slow EWMA
 static NSMutableDictionary	*launchInfo = nil;
 static NSArray                  *launchOrder = nil;
-static NSMutableArray	        *launchQueue = nil;
+static NSMutableArray	        *launchQueue = nil;	// Ready, by priority
+static NSMutableDictionary	*launchRanks = nil;	// Name -> priority
+static NSMutableDictionary	*launchDependents = nil;// Name -> dependents
+static NSString			*launchPlan = nil;	// Last plan logged
+
+/* The supervision state of the LaunchInfo objects is kept in a snapshot
+ * file and a journal of the changes made since the snapshot was written,
+ * so that a restarted Command server can carry on supervising processes
+ * launched by its predecessor.  Each journal record is a big-endian 32bit
+ * length followed by a binary property list holding a sequence number, the
+ * process name and the state of the process (absent if it was removed).
+ */
+static NSFileHandle             *journalHandle = nil;
+static NSString                 *journalPath = nil;
+static NSString                 *snapshotPath = nil;
+static uint64_t                 journalSeq = 0;
+static NSUInteger               journalCount = 0;
+
+/* After a restart, a live process adopted from the journal is given this
+ * long to register with us by itself before we try to contact it.
+ */
+static NSTimeInterval           adoptGrace = 30.0;
+
+/* Metrics gathered from the clients on this host (and from this process)
+ * awaiting forwarding to the Control server, and the start of the interval
+ * in which they were gathered.
+ */
+static EcMetrics                *hostMetrics = nil;
+static NSTimeInterval           metricsStart = 0.0;
 
 typedef enum {
   ACLaunchFailed,       // Must be first
   ACProcessHung,        
+  ACProcessSlow,
+  ACProcessBusy,
   ACProcessLost         // Must be last
 } AlarmCode;
 
@@ -170,6 +443,16 @@ ACStrings(AlarmCode ac, NSString **problem, NSString **repair)
         *repair = @"Check logs and deal with cause of unresponsiveness";
         break;
 
+      case ACProcessSlow:
+        *problem = @"Process slow";
+        *repair = @"Check logs and deal with cause of slow responses";
+        break;
+
+      case ACProcessBusy:
+        *problem = @"Process busy";
+        *repair = @"Check logs and deal with cause of excessive CPU usage";
+        break;
+
       case ACProcessLost:
         *problem = @"Process lost";
         *repair = @"Check logs and deal with cause of shutdown/crash";
@@ -248,6 +531,17 @@ desiredName(Desired state)
    */
   NSTask		*task;
 
+  /** The last task launched using EcSpawnTask (kept so that the next
+   * launch can share its argument and environment arrays).
+   */
+  EcSpawnTask		*spawned;
+
+  /** Watches for the end of a process we did not launch ourselves (one
+   * which was started externally or adopted from an earlier Command
+   * server), since no task will tell us when it ends.
+   */
+  EcPidWatch		*watch;
+
   /** The client instance representing a registered distributed objects
    * connection from the process into the Command server.
    */ 
@@ -362,6 +656,37 @@ desiredName(Desired state)
    */
   NSTimeInterval        queuedDate;             // When queued for launch
 
+  /** Set while the process is in the launch queue.  A queued process whose
+   * dependencies have not registered is blocked; it is not examined when
+   * the queue is processed, but moves to the ready queue (which is kept in
+   * launch order) as soon as the last of its dependencies registers.
+   */
+  BOOL			queued;
+  BOOL			blocked;
+
+  /** How long the last launch took from starting the task to the process
+   * registering with the Command server (zero if not known).
+   */
+  NSTimeInterval	startupTime;
+
+  /** The PingTime, HungTime, HeartbeatTime and PingSlowTime from the
+   * configuration (zero, or -1 for HungTime, if not configured), parsed
+   * when the configuration is set rather than on every check.
+   */
+  NSTimeInterval	confPingTime;
+  NSTimeInterval	confHungTime;
+  NSTimeInterval	confHeartbeatTime;
+  NSTimeInterval	confPingSlowTime;
+
+  /** The resource usage most recently sampled from /proc for the process
+   * (nil if it is not running), the time since which its CPU usage has
+   * been over the alarm limit (zero if it is not), and whether we have
+   * raised an alarm for that.
+   */
+  EcProcessUsage	*usage;
+  NSTimeInterval	busyDate;
+  BOOL			busy;
+
   /** Once a process has been active for a while it is considered stable.
    * A stable process will, if it terminates without shutting down cleanly,
    * be elegible for immediate autolaunch.
@@ -421,14 +746,65 @@ desiredName(Desired state)
   /* Flag to detect recursive call to -starting:
    */
   BOOL		inStarting;
+
+  /** Set when the process was found running (from the journal) as the
+   * Command server started, and cleared once it registers or is given up
+   * on.  While it is set we wait for the process to register by itself.
+   */
+  NSTimeInterval	adoptedDate;
+
+  /** The start time of the process with the ID in startPid, used to
+   * detect reuse of the process ID when the journal is read.
+   */
+  int			startPid;
+  unsigned long long	startTime;
+
+  /** The state last written to the journal.
+   */
+  NSDictionary		*journaled;
 }
 + (NSString*) description;
 + (LaunchInfo*) existing: (NSString*)name;
 + (LaunchInfo*) find: (NSString*)abbreviation;
 + (LaunchInfo*) launchInfo: (NSString*)name;
 + (NSUInteger) launching;
+/** In adaptive mode, adjusts the launch limit (at most once a second).
+ * The limit is halved when the host is under pressure (from the PSI
+ * figures for CPU and IO, or the load average where those are not
+ * available) or when processes are taking much longer than usual to
+ * register, and is raised by one when the host is idle and all the
+ * allowed launches are in use.
+ */
++ (void) limitLaunches;
+/** Records the time a launch took to register, for adaptive mode.
+ */
++ (void) launchTook: (NSTimeInterval)ti;
+/** Writes a snapshot of the state of all processes and empties the journal.
+ */
++ (void) journalCheckpoint;
+/** Writes the state of any process which has changed to the journal.
+ */
++ (void) journalChanges;
+/** Restores the state of processes from the snapshot and journal in the
+ * directory and adopts any processes which are still running, then opens
+ * the journal to record subsequent changes.
+ */
++ (void) journalRestore: (NSString*)directory;
 + (NSArray*) names;
+/** Rebuilds the launch graph (the priority of each process and the
+ * processes depending on it) after a configuration change, and logs the
+ * critical path if it has changed.
+ */
++ (void) plan;
+/** Returns a description of the longest chain of dependencies, with the
+ * time the launches along it last took.
+ */
++ (NSString*) criticalPath;
 + (void) processQueue;
+/** Checks adopted processes which have not registered, giving up on any
+ * which have died or taken too long, so that they are handled normally.
+ */
++ (void) reconcileAdopted;
 + (void) remove: (NSString*)name;
 /** Adds an alarm to the list raised (removes if a clear is passed in)
  * creating the array if it does not exist (even if a clear is passed in).
@@ -443,29 +819,74 @@ desiredName(Desired state)
 - (NSArray*) alarms;
 - (BOOL) autolaunch;
 - (void) awakened;
+/** Returns YES if a 'Process busy' alarm has been raised for the process.
+ */
+- (BOOL) busy;
+/** Returns the time since which the process has been using more CPU than
+ * the alarm limit, or zero if it is not doing so.
+ */
+- (NSTimeInterval) busyDate;
 - (BOOL) checkActive;
 - (BOOL) checkProcess;
 - (void) clearClient: (EcClientI*)c cleanly: (BOOL)unregisteredOrTransient;
 - (void) clearHung;
 - (EcClientI*) client;
+/** Removes the receiver from the launch queue.
+ */
+- (void) dequeue;
+/** Adds the receiver to the launch queue, as blocked if any of its
+ * dependencies have not registered.
+ */
+- (void) enqueue;
 - (NSDictionary*) configuration;
 - (NSTimeInterval) delay;
 - (Desired) desired;
 - (BOOL) disabled;
 - (NSTimeInterval) hungDate;
+/** Returns the configured HungTime, or a negative value if there is none.
+ */
+- (NSTimeInterval) hungLimit;
+/** Returns the configured HeartbeatTime, or zero if there is none.
+ */
+- (NSTimeInterval) heartbeatLimit;
+/** Returns the configured PingTime, or zero if there is none.
+ */
+- (NSTimeInterval) pingLimit;
+/** Returns the configured PingSlowTime, or zero if there is none.
+ */
+- (NSTimeInterval) pingSlowLimit;
 - (BOOL) isActive;
 - (BOOL) isDumped;
 - (BOOL) isStarting;
 - (BOOL) isStopping;
+/** Writes the state of the process to the journal if it has changed.
+ */
+- (void) journal;
+/** Returns the supervision state of the process to be journalled.
+ */
+- (NSDictionary*) journalState;
 - (BOOL) launch;
 - (BOOL) manual;
 - (BOOL) mayBecomeStable;
 - (BOOL) mayCoreDump;
 - (NSString*) name;
 - (int) processIdentifier;
+/** Called when a watched process (one not launched by us) ends.
+ */
+- (void) processExited: (EcPidWatch*)w;
 - (void) progress;
 - (NSString*) reasonToPreventLaunch;
 - (void) resetDelay;
+/** Restores the state read from the journal, adopting the process if it
+ * is still running.
+ */
+- (void) restoreState: (NSDictionary*)state;
+/** Samples the resource usage of the process from /proc, returning nil
+ * if the process is not running or cannot be sampled.
+ */
+- (EcProcessUsage*) sampleUsage;
+- (void) setBusy: (BOOL)flag;
+- (void) setBusyDate: (NSTimeInterval)t;
 - (void) setClient: (EcClientI*)c;
 - (void) setConfiguration: (NSDictionary*)c;
 - (void) setDesired: (Desired)state;
@@ -526,9 +947,33 @@ desiredName(Desired state)
 
 - (void) stopping: (NSTimer*)t;
 - (NSTask*) task;
+/** Moves the receiver from blocked to the ready queue if all of its
+ * dependencies have registered.
+ */
+- (void) unblock;
 - (NSArray*) unfulfilled;
+/** Returns the resource usage last sampled for the process, or nil.
+ */
+- (EcProcessUsage*) usage;
+/** Starts watching the process with our identifier for its end, if it
+ * is not a task we launched.
+ */
+- (void) watchProcess;
 @end
 
+/* Orders processes with the highest CPU usage first.
+ */
+static NSComparisonResult
+usageOrder(id a, id b, void *context)
+{
+  double	ca = [[a usage] cpu];
+  double	cb = [[b usage] cpu];
+
+  if (ca > cb) return NSOrderedAscending;
+  if (ca < cb) return NSOrderedDescending;
+  return NSOrderedSame;
+}
+
 /* Special configuration options are:
  *
  * CompressDebugAfter
@@ -572,15 +1017,73 @@ desiredName(Desired state)
  *   which an alert should be raised. Defaults to 10.
  *   Minimum 2, Maximum 90.
  *
+ * RegistrationRate
+ *   The average number of new client registrations served per second
+ *   (each needs its configuration built).  Clients arriving faster are
+ *   told to back off until a queued slot.  Defaults to 20.
+ *
+ * RegistrationBurst
+ *   The number of registrations which may be served at once after a
+ *   quiet period.  Defaults to 20.
+ *
+ * SpawnLaunch
+ *   A boolean saying whether processes are launched using the lightweight
+ *   EcSpawnTask launcher (which supports the Affinity, Nice and Limits
+ *   launch options) rather than NSTask.  Defaults to YES.
+ *
+ * CommandPingSlowTime
+ *   The number of seconds which the moving average of the round trip
+ *   times of the pings to a client process may reach before a 'Process
+ *   slow' alarm is raised for it (the alarm is cleared once the average
+ *   falls below half this).  May be overridden by PingSlowTime in the
+ *   launch configuration of a process.
+ *   Defaults to 2, minimum 0.1, maximum 600.
+ *
+ * CommandHeartbeatTime
+ *   The number of seconds for which a client process may go without
+ *   updating its slot in the shared heartbeat table (Heartbeat.map in the
+ *   data directory) before it is considered hung.  May be overridden by
+ *   HeartbeatTime in the launch configuration of a process.
+ *   Defaults to 15, minimum 2, maximum 600.
+ *
+ * CommandUsageTime
+ *   The number of seconds between samples of the CPU, memory and disk
+ *   usage of the managed processes (from /proc/pid/stat, statm and io)
+ *   and of the host (from /proc/stat, meminfo and diskstats).  Since the
+ *   samples are taken by the Command server, they are available for a
+ *   process which is hung or unable to report on itself.
+ *   Defaults to 5, minimum 1, maximum 300.
+ *
+ * CommandUsageCPU
+ *   The percentage of a CPU which a process, or of the total CPU capacity
+ *   which the host, may use for longer than CommandUsageSustain before
+ *   an alarm is raised.
+ *   Defaults to 90, minimum 10, maximum 100.
+ *
+ * CommandUsageIO
+ *   The percentage of time for which the busiest disk of the host may
+ *   have I/O in progress for longer than CommandUsageSustain before an
+ *   alarm is raised.
+ *   Defaults to 90, minimum 10, maximum 100.
+ *
+ * CommandUsageSustain
+ *   The number of seconds for which usage must stay over the limits
+ *   above before an alarm is raised.  Each alarm is cleared once the
+ *   usage falls below 80 percent of its limit.
+ *   Defaults to 300, minimum 10, maximum 3600.
+ *
  */
+@class	RollingRestart;
+
 @interface	EcCommand : EcProcess <Command>
 {
   NSString		*host;
   id<Control>		control;
-  NSMutableArray	*clients;
+  EcClientRegistry	*clients;
   NSTimer		*timer;
   NSString		*logname;
-  NSMutableDictionary	*config;
+  NSDictionary		*config;
+  NSString		*configSource;	// Digest identifying config source
   NSDictionary		*environment;
   NSTimer		*terminating;
   NSDate		*outstanding;
@@ -597,6 +1100,27 @@ desiredName(Desired state)
   NSInteger		logCompressAfter;
   NSInteger		logDeleteAfter;
   BOOL                  sweeping;
+  NSMutableDictionary	*controlInfo;	// Config last received from Control
+  uint64_t		controlVersion;	// Version of controlInfo
+  uint64_t		configVersion;	// Version of config sent to clients
+  NSMutableDictionary	*configBlobs;	// Name -> [info, data] for clients
+  uint64_t		configBlobsVersion;	// Version of configBlobs
+  EcAdmission		*registrations;	// Paces new client registrations
+  NSTimeInterval	controlRetryAt;	// Earliest retry to Control
+  unsigned		controlRetries;	// Consecutive Control failures
+  NSTimeInterval	controlReceived;	// When controlInfo arrived
+  NSUInteger		controlBytes;	// Size of message carrying it
+  EcHeartbeat		*heartbeats;	// Shared table of client beats
+  NSTimer		*beatTimer;	// Scans heartbeats every second
+  NSTimer		*pingTimer;	// Turns the ping wheel
+  RollingRestart	*rolling;	// Rolling restart in progress
+  NSTimer		*rollTimer;	// Advances the rolling restart
+  EcHostUsage		*hostUsage;	// Samples host CPU/memory/disks
+  NSTimer		*usageTimer;	// Samples resource usage
+  NSTimeInterval	cpuBusyDate;	// Host CPU over limit since
+  NSTimeInterval	ioBusyDate;	// Host disk over limit since
+  EcAlarm		*cpuAlarm;	// Host CPU saturated
+  EcAlarm		*ioAlarm;	// Host disk I/O saturated
 }
 - (void) alarmCode: (AlarmCode)ac
           procName: (NSString*)name
@@ -618,19 +1142,24 @@ desiredName(Desired state)
 - (void) command: (NSData*)dat
 	      to: (NSString*)t
 	    from: (NSString*)f;
+- (NSData*) configurationData: (NSDictionary**)info for: (NSString*)name;
 - (NSData *) configurationFor: (NSString *)name;
+- (NSMutableDictionary*) configurationInfoFor: (NSString *)name;
 - (BOOL) connection: (NSConnection*)ancestor
   shouldMakeNewConnection: (NSConnection*)newConn;
 - (id) connectionBecameInvalid: (NSNotification*)notification;
 - (NSDictionary*) environment;
-- (NSMutableArray*) findAll: (NSArray*)a
+- (NSMutableArray*) findAll: (EcClientRegistry*)a
 	     byAbbreviation: (NSString*)s;
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
        byAbbreviation: (NSString*)s;
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
                byName: (NSString*)s;
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
              byObject: (id)s;
+- (void) heartbeats: (NSTimer*)t;
+- (void) pingWheelAdd: (EcClientI*)r;
+- (void) pingWheelTurn: (NSTimer*)t;
 - (NSString*) host;
 - (void) housekeeping: (NSTimer*)t;
 - (void) _housekeeping: (NSTimer*)t;
@@ -653,7 +1182,9 @@ desiredName(Desired state)
 	       type: (EcLogType)t
 	       name: (NSString*)c;
 - (NSString*) makeSpace;
-- (void) newConfig: (NSMutableDictionary*)newConfig;
+- (void) metrics: (NSData*)data from: (NSString*)name;
+- (void) metricsForward: (NSDate*)now;
+- (void) newConfig: (NSDictionary*)newConfig;
 - (NSFileHandle*) openLog: (NSString*)lname;
 - (void) pingControl;
 - (NSString*) quit: (NSString*)name exact: (BOOL)isFullName;
@@ -662,19 +1193,174 @@ desiredName(Desired state)
                 identifier: (int)p
 		      name: (NSString*)n
 		 transient: (BOOL)t;
+- (void) registrationLimits;
 - (void) removeClient: (EcClientI*)o cleanly: (BOOL)ok;
 - (void) reply: (NSString*) msg to: (NSString*)n from: (NSString*)c;
+- (void) rolled: (NSString*)pattern succeeded: (BOOL)ok;
+- (NSString*) rolling: (NSArray*)cmd from: (NSString*)f;
+- (void) rollOn: (NSTimer*)t;
 - (void) terminate: (NSDate*)by;
 - (void) _terminate: (NSTimer*)t;
 - (NSMutableArray*) unconfiguredClients;
 - (void) unregisterByObject: (byref id)obj status: (int)s;
 - (void) update;
 - (void) updateConfig: (NSData*)data;
+- (void) usageSample: (NSTimer*)t;
+- (void) usageStart;
+- (oneway void) updateConfigDelta: (NSData*)data;
+- (void) updateConfigInfo: (NSMutableDictionary*)info;
 - (void) woken: (id)obj;
 @end
 
 
 
+/* Returns the position of the named process in the launch order.
+ */
+static NSUInteger
+launchRank(NSString *name)
+{
+  NSNumber	*n = [launchRanks objectForKey: name];
+
+  return (nil == n) ? NSNotFound : [n unsignedIntegerValue];
+}
+
+/* Returns the position in the ready queue after any process launched
+ * before (or along with) the one with the given rank.
+ */
+static NSUInteger
+readyPosition(NSUInteger rank)
+{
+  NSUInteger	lo = 0;
+  NSUInteger	hi = [launchQueue count];
+
+  while (lo < hi)
+    {
+      NSUInteger	mid = (lo + hi) / 2;
+
+      if (launchRank([[launchQueue objectAtIndex: mid] name]) <= rank)
+	{
+	  lo = mid + 1;
+	}
+      else
+	{
+	  hi = mid;
+	}
+    }
+  return lo;
+}
+
+static NSComparisonResult
+rankOrder(id a, id b, void *context)
+{
+  NSUInteger	ra = launchRank([a name]);
+  NSUInteger	rb = launchRank([b name]);
+
+  if (ra < rb) return NSOrderedAscending;
+  if (ra > rb) return NSOrderedDescending;
+  return NSOrderedSame;
+}
+
+/* Returns the names of processes in the Launch config whose dependencies
+ * form a cycle (so that none of them could ever be launched).
+ * Processes are removed in dependency order (Kahn's algorithm); those
+ * left are in a cycle or depend on one, and the latter are then peeled
+ * off (they are reported as depending on a removed process later).
+ */
+static NSArray*
+launchCycles(NSDictionary *md)
+{
+  NSMutableDictionary	*pending;
+  NSMutableDictionary	*dependents;
+  NSMutableArray	*ready;
+  NSMutableSet		*left;
+  NSEnumerator		*e;
+  NSString		*k;
+  BOOL			peeled;
+
+  pending = [NSMutableDictionary dictionaryWithCapacity: [md count]];
+  dependents = [NSMutableDictionary dictionaryWithCapacity: [md count]];
+  ready = [NSMutableArray arrayWithCapacity: [md count]];
+  e = [md keyEnumerator];
+  while (nil != (k = [e nextObject]))
+    {
+      NSEnumerator	*de;
+      NSString		*d;
+      unsigned		count = 0;
+
+      de = [[[md objectForKey: k] objectForKey: @"Deps"] objectEnumerator];
+      while (nil != (d = [de nextObject]))
+	{
+	  NSMutableArray	*a;
+
+	  if (nil == [md objectForKey: d])
+	    {
+	      continue;
+	    }
+	  if (nil == (a = [dependents objectForKey: d]))
+	    {
+	      a = [NSMutableArray arrayWithCapacity: 4];
+	      [dependents setObject: a forKey: d];
+	    }
+	  [a addObject: k];
+	  count++;
+	}
+      [pending setObject: [NSNumber numberWithUnsignedInt: count] forKey: k];
+      if (0 == count)
+	{
+	  [ready addObject: k];
+	}
+    }
+
+  while ([ready count] > 0)
+    {
+      NSEnumerator	*de;
+      NSString		*d;
+
+      k = [ready lastObject];
+      [ready removeLastObject];
+      [pending removeObjectForKey: k];
+      de = [[dependents objectForKey: k] objectEnumerator];
+      while (nil != (d = [de nextObject]))
+	{
+	  unsigned	count = [[pending objectForKey: d] unsignedIntValue] - 1;
+
+	  [pending setObject: [NSNumber numberWithUnsignedInt: count]
+		      forKey: d];
+	  if (0 == count)
+	    {
+	      [ready addObject: d];
+	    }
+	}
+    }
+
+  left = [NSMutableSet setWithArray: [pending allKeys]];
+  do
+    {
+      peeled = NO;
+      e = [[left allObjects] objectEnumerator];
+      while (nil != (k = [e nextObject]))
+	{
+	  NSEnumerator	*de = [[dependents objectForKey: k] objectEnumerator];
+	  NSString	*d;
+
+	  while (nil != (d = [de nextObject]))
+	    {
+	      if ([left containsObject: d])
+		{
+		  break;
+		}
+	    }
+	  if (nil == d)
+	    {
+	      [left removeObject: k];	// Nothing in a cycle depends on it
+	      peeled = YES;
+	    }
+	}
+    }
+  while (YES == peeled);
+  return [[left allObjects] sortedArrayUsingSelector: @selector(compare:)];
+}
+
 @implementation	LaunchInfo
 
 + (NSString*) description
@@ -727,8 +1413,105 @@ desiredName(Desired state)
 	}
     }
   return [NSString stringWithFormat: @"LaunchInfo alive:%u, starting:%u,"
-    @" stopping:%u disabled:%u, suspended:%u, launchable:%u (auto:%u)\n",
-    alive, starting, stopping, disabled, suspended, launchable, autolaunch];
+    @" stopping:%u disabled:%u, suspended:%u, launchable:%u (auto:%u)\n"
+    @"Launch limit: %u (%@)\n"
+    @"Launch critical path: %@\n",
+    alive, starting, stopping, disabled, suspended, launchable, autolaunch,
+    (unsigned)launchLimit, launchLimitReason, [self criticalPath]];
+}
+
++ (NSString*) criticalPath
+{
+  NSMutableDictionary	*cost;
+  NSMutableDictionary	*chain;
+  NSMutableArray	*todo;
+  NSEnumerator		*e;
+  NSString		*k;
+  NSArray		*best = nil;
+  NSTimeInterval	bestCost = -1.0;
+
+  /* The longest path through the (acyclic) dependency graph, measured by
+   * the time each launch last took, found by visiting each process after
+   * its dependencies.
+   */
+  cost = [NSMutableDictionary dictionaryWithCapacity: [launchInfo count]];
+  chain = [NSMutableDictionary dictionaryWithCapacity: [launchInfo count]];
+  todo = [NSMutableArray arrayWithArray: [launchInfo allKeys]];
+  while ([todo count] > 0)
+    {
+      LaunchInfo	*l;
+      NSArray		*deps;
+      NSArray		*longest = nil;
+      NSTimeInterval	t = 0.0;
+      NSUInteger	i;
+
+      k = [todo lastObject];
+      if (nil != [cost objectForKey: k])
+	{
+	  [todo removeLastObject];
+	  continue;
+	}
+      l = [launchInfo objectForKey: k];
+      deps = [[l configuration] objectForKey: @"Deps"];
+      for (i = 0; i < [deps count]; i++)
+	{
+	  NSString	*d = [deps objectAtIndex: i];
+
+	  if (nil != [launchInfo objectForKey: d]
+	    && nil == [cost objectForKey: d])
+	    {
+	      break;
+	    }
+	}
+      if (i < [deps count])
+	{
+	  if ([todo count] > [launchInfo count] * 2)
+	    {
+	      return @"unknown (dependency cycle)";
+	    }
+	  [todo addObject: [deps objectAtIndex: i]];
+	  continue;	// Visit the dependency first
+	}
+      [todo removeLastObject];
+      for (i = 0; i < [deps count]; i++)
+	{
+	  NSString	*d = [deps objectAtIndex: i];
+	  NSNumber	*n = [cost objectForKey: d];
+
+	  if (nil != n && (nil == longest || [n doubleValue] > t
+	    || ([n doubleValue] == t
+	      && [[chain objectForKey: d] count] > [longest count])))
+	    {
+	      t = [n doubleValue];
+	      longest = [chain objectForKey: d];
+	    }
+	}
+      t += l->startupTime;
+      longest = (nil == longest) ? [NSArray arrayWithObject: k]
+	: [longest arrayByAddingObject: k];
+      [cost setObject: [NSNumber numberWithDouble: t] forKey: k];
+      [chain setObject: longest forKey: k];
+    }
+
+  e = [chain keyEnumerator];
+  while (nil != (k = [e nextObject]))
+    {
+      NSTimeInterval	t = [[cost objectForKey: k] doubleValue];
+      NSArray		*a = [chain objectForKey: k];
+
+      if (t > bestCost || (t == bestCost && [a count] > [best count]))
+	{
+	  bestCost = t;
+	  best = a;
+	}
+    }
+  if (nil == best)
+    {
+      return @"none";
+    }
+  return [NSString stringWithFormat: @"%@ (%u processes, %.1fs)",
+    [best componentsJoinedByString: @" -> "], (unsigned)[best count],
+    bestCost];
 }
 
 + (LaunchInfo*) existing: (NSString*)name
@@ -794,6 +1577,203 @@ desiredName(Desired state)
     }
 }
 
++ (void) journalChanges
+{
+  ENTER_POOL
+  NSEnumerator  *e = [launchInfo objectEnumerator];
+  LaunchInfo    *l;
+
+  while (nil != (l = [e nextObject]))
+    {
+      [l journal];
+    }
+  LEAVE_POOL
+}
+
++ (void) journalCheckpoint
+{
+  ENTER_POOL
+  NSMutableDictionary	*states;
+  NSMutableDictionary	*m;
+  NSEnumerator  	*e;
+  LaunchInfo    	*l;
+  NSData		*d;
+
+  if (nil == journalHandle)
+    {
+      LEAVE_POOL
+      return;
+    }
+  states = [NSMutableDictionary dictionaryWithCapacity: [launchInfo count]];
+  e = [launchInfo objectEnumerator];
+  while (nil != (l = [e nextObject]))
+    {
+      NSDictionary	*s = [l journalState];
+
+      ASSIGN(l->journaled, s);
+      [states setObject: s forKey: l->name];
+    }
+  m = [NSMutableDictionary dictionaryWithCapacity: 3];
+  [m setObject: states forKey: @"States"];
+  [m setObject: [NSNumber numberWithUnsignedLongLong: journalSeq]
+	forKey: @"Seq"];
+  [m setObject: [NSDate date] forKey: @"Saved"];
+  d = [NSPropertyListSerialization
+    dataFromPropertyList: m
+    format: NSPropertyListBinaryFormat_v1_0
+    errorDescription: 0];
+
+  /* The snapshot records the last sequence number it includes, so if we
+   * crash before the journal is emptied the old records are skipped.
+   */
+  if (YES == [d writeToFile: snapshotPath atomically: YES])
+    {
+      NS_DURING
+	{
+	  [journalHandle truncateFileAtOffset: 0];
+	  journalCount = 0;
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"Unable to empty journal %@: %@", journalPath, localException);
+	}
+      NS_ENDHANDLER
+    }
+  else
+    {
+      NSLog(@"Unable to write snapshot %@", snapshotPath);
+    }
+  LEAVE_POOL
+}
+
++ (void) journalRestore: (NSString*)directory
+{
+  ENTER_POOL
+  NSMutableDictionary	*states;
+  NSDictionary		*snap;
+  NSEnumerator		*e;
+  NSString		*k;
+  NSData		*d;
+  uint64_t		seq = 0;
+  NSUInteger		adopted = 0;
+
+  ASSIGN(snapshotPath,
+    [directory stringByAppendingPathComponent: @"CommandState.plist"]);
+  ASSIGN(journalPath,
+    [directory stringByAppendingPathComponent: @"CommandState.journal"]);
+
+  states = [NSMutableDictionary dictionaryWithCapacity: 32];
+  d = [NSData dataWithContentsOfFile: snapshotPath];
+  if (nil != d)
+    {
+      snap = [NSPropertyListSerialization
+	propertyListWithData: d
+	options: NSPropertyListImmutable
+	format: 0
+	error: 0];
+      if ([snap isKindOfClass: [NSDictionary class]]
+	&& [[snap objectForKey: @"States"] isKindOfClass: [NSDictionary class]])
+	{
+	  [states addEntriesFromDictionary: [snap objectForKey: @"States"]];
+	  seq = [[snap objectForKey: @"Seq"] unsignedLongLongValue];
+	}
+    }
+  journalSeq = seq;
+
+  d = [NSData dataWithContentsOfFile: journalPath];
+  if (nil != d)
+    {
+      const uint8_t	*b = (const uint8_t*)[d bytes];
+      NSUInteger	length = [d length];
+      NSUInteger	pos = 0;
+
+      while (length - pos >= 4)
+	{
+	  NSDictionary	*r;
+	  NSData	*rd;
+	  uint32_t	len;
+	  uint64_t	rseq;
+
+	  memcpy(&len, b + pos, 4);
+	  len = NSSwapBigIntToHost(len);
+	  pos += 4;
+	  if (len > length - pos)
+	    {
+	      break;	// Truncated by a crash
+	    }
+	  rd = [NSData dataWithBytesNoCopy: (void*)(b + pos)
+				    length: len
+			      freeWhenDone: NO];
+	  pos += len;
+	  r = [NSPropertyListSerialization
+	    propertyListWithData: rd
+	    options: NSPropertyListImmutable
+	    format: 0
+	    error: 0];
+	  if (NO == [r isKindOfClass: [NSDictionary class]]
+	    || nil == (k = [r objectForKey: @"Name"]))
+	    {
+	      break;	// Corrupt record
+	    }
+	  rseq = [[r objectForKey: @"Seq"] unsignedLongLongValue];
+	  if (rseq > journalSeq)
+	    {
+	      journalSeq = rseq;
+	    }
+	  if (rseq <= seq)
+	    {
+	      continue;	// Already in the snapshot
+	    }
+	  if (nil == [r objectForKey: @"State"])
+	    {
+	      [states removeObjectForKey: k];
+	    }
+	  else
+	    {
+	      [states setObject: [r objectForKey: @"State"] forKey: k];
+	    }
+	}
+    }
+
+  e = [states keyEnumerator];
+  while (nil != (k = [e nextObject]))
+    {
+      NSDictionary	*s = [states objectForKey: k];
+      LaunchInfo	*l;
+
+      if ([s isKindOfClass: [NSDictionary class]])
+	{
+	  l = [self launchInfo: k];
+	  [l restoreState: s];
+	  if (l->adoptedDate > 0.0)
+	    {
+	      adopted++;
+	    }
+	}
+    }
+  if ([states count] > 0)
+    {
+      NSLog(@"Restored state of %u processes (%u running)",
+	(unsigned)[states count], (unsigned)adopted);
+    }
+
+  if (NO == [[NSFileManager defaultManager] fileExistsAtPath: journalPath])
+    {
+      [[NSData data] writeToFile: journalPath atomically: NO];
+    }
+  ASSIGN(journalHandle, [NSFileHandle fileHandleForUpdatingAtPath: journalPath]);
+  if (nil == journalHandle)
+    {
+      NSLog(@"Unable to open journal %@", journalPath);
+    }
+  else
+    {
+      [journalHandle seekToEndOfFile];
+      [self journalCheckpoint];
+    }
+  LEAVE_POOL
+}
+
 + (LaunchInfo*) launchInfo: (NSString*)name
 {
   LaunchInfo	*l = [launchInfo objectForKey: name];
@@ -802,6 +1782,7 @@ desiredName(Desired state)
     {
       l = [self new];
       l->desired = None;
+      l->confHungTime = -1.0;
       ASSIGNCOPY(l->name, name);
       [launchInfo setObject: l forKey: l->name];
     }
@@ -830,19 +1811,207 @@ desiredName(Desired state)
   return found;
 }
 
++ (void) launchTook: (NSTimeInterval)ti
+{
+  if (ti <= 0.0)
+    {
+      return;
+    }
+  if (0.0 == launchStartupUsual)
+    {
+      launchStartupRecent = launchStartupUsual = ti;
+    }
+  else
+    {
+      launchStartupRecent += (ti - launchStartupRecent) * 0.3;
+      launchStartupUsual += (ti - launchStartupUsual) * 0.05;
+    }
+}
+
++ (void) limitLaunches
+{
+  NSTimeInterval	now;
+  NSString		*why = nil;
+  NSUInteger		old = launchLimit;
+  double		cpu;
+  double		io;
+  double		load;
+  BOOL			busy = NO;
+  BOOL			idle = NO;
+
+  if (NO == launchAdaptive)
+    {
+      return;
+    }
+  now = [NSDate timeIntervalSinceReferenceDate];
+  if (now - launchLimitChecked < 1.0)
+    {
+      return;
+    }
+  launchLimitChecked = now;
+
+  cpu = pressureStall("/proc/pressure/cpu");
+  io = pressureStall("/proc/pressure/io");
+  if (cpu >= 0.0 || io >= 0.0)
+    {
+      double	worst = (cpu > io) ? cpu : io;
+
+      if (worst > 40.0)
+	{
+	  busy = YES;
+	  why = [NSString stringWithFormat: @"%@ pressure %.1f%%",
+	    (cpu > io) ? @"cpu" : @"io", worst];
+	}
+      else if (worst < 10.0)
+	{
+	  idle = YES;
+	  why = [NSString stringWithFormat: @"pressure cpu %.1f%% io %.1f%%",
+	    cpu, io];
+	}
+    }
+  else if ((load = loadPerProcessor()) >= 0.0)
+    {
+      if (load > 1.5)
+	{
+	  busy = YES;
+	  why = [NSString stringWithFormat: @"load %.2f per cpu", load];
+	}
+      else if (load < 0.7)
+	{
+	  idle = YES;
+	  why = [NSString stringWithFormat: @"load %.2f per cpu", load];
+	}
+    }
+  else
+    {
+      idle = YES;	// No load figures; go by registration times
+    }
+
+  /* Processes taking much longer than usual to register means that the
+   * launches are competing with each other (or something else) even if
+   * the system figures don't show it.
+   */
+  if (NO == busy && launchStartupRecent > 2.0 * launchStartupUsual
+    && launchStartupRecent > 5.0)
+    {
+      busy = YES;
+      idle = NO;
+      why = [NSString stringWithFormat:
+	@"registration taking %.1fs (usually %.1fs)",
+	launchStartupRecent, launchStartupUsual];
+    }
+
+  /* Lower the limit quickly, but give each reduction time to take effect
+   * before making another.  Raise it slowly, and only when it is holding
+   * launches back.
+   */
+  if (YES == busy)
+    {
+      if (now - launchLimitLowered >= 10.0 && launchLimit > launchLimitMin)
+	{
+	  launchLimit = launchLimit / 2;
+	  if (launchLimit < launchLimitMin)
+	    {
+	      launchLimit = launchLimitMin;
+	    }
+	  launchLimitLowered = now;
+	}
+    }
+  else if (YES == idle && launchLimit < launchLimitMax
+    && [self launching] >= launchLimit)
+    {
+      launchLimit++;
+    }
+  if (nil == why)
+    {
+      why = @"holding";
+    }
+  why = [NSString stringWithFormat: @"adaptive %u-%u, %@",
+    (unsigned)launchLimitMin, (unsigned)launchLimitMax, why];
+  ASSIGN(launchLimitReason, why);
+  if (launchLimit != old)
+    {
+      NSLog(@"Launch limit changed from %u to %u (%@)",
+	(unsigned)old, (unsigned)launchLimit, why);
+    }
+}
+
 + (NSArray*) names
 {
   return [launchInfo allKeys];
 }
 
-/* Check each process in the queue to see if it may now be launched.
- * Launch each process which may do so (removing it from the queue).
++ (void) plan
+{
+  NSEnumerator	*e;
+  LaunchInfo	*l;
+  NSString	*k;
+  NSUInteger	i;
+
+  ASSIGN(launchRanks,
+    [NSMutableDictionary dictionaryWithCapacity: [launchOrder count]]);
+  for (i = 0; i < [launchOrder count]; i++)
+    {
+      [launchRanks setObject: [NSNumber numberWithUnsignedInteger: i]
+		      forKey: [launchOrder objectAtIndex: i]];
+    }
+
+  ASSIGN(launchDependents,
+    [NSMutableDictionary dictionaryWithCapacity: [launchInfo count]]);
+  e = [launchInfo objectEnumerator];
+  while (nil != (l = [e nextObject]))
+    {
+      NSEnumerator	*de;
+      NSString		*d;
+
+      de = [[[l configuration] objectForKey: @"Deps"] objectEnumerator];
+      while (nil != (d = [de nextObject]))
+	{
+	  NSMutableArray	*a = [launchDependents objectForKey: d];
+
+	  if (nil == a)
+	    {
+	      a = [NSMutableArray arrayWithCapacity: 4];
+	      [launchDependents setObject: a forKey: d];
+	    }
+	  [a addObject: [l name]];
+	}
+    }
+
+  /* The priorities and dependencies may have changed, so the queue must
+   * be put in order and each queued process checked.
+   */
+  [launchQueue sortUsingFunction: rankOrder context: 0];
+  e = [[launchInfo allValues] objectEnumerator];
+  while (nil != (l = [e nextObject]))
+    {
+      if (YES == l->queued)
+	{
+	  [l dequeue];
+	  [l enqueue];
+	}
+    }
+
+  k = [self criticalPath];
+  if (NO == [k isEqual: launchPlan])
+    {
+      ASSIGN(launchPlan, k);
+      NSLog(@"Launch critical path: %@", k);
+    }
+}
+
+/* Check each process in the ready queue (in launch order) to see if it
+ * may now be launched.  Launch each process which may do so (removing it
+ * from the queue).  Processes waiting for dependencies to register are
+ * not in the ready queue, so they cost nothing here.
  */
 + (void) processQueue
 {
   ENTER_POOL
   NSUInteger            count;
 
+  [self limitLaunches];
+
   /* We work with a copy of the queue in case the process of launching
    * causes the queue contents to be changed.
    */
@@ -854,35 +2023,70 @@ desiredName(Desired state)
       for (index = 0; index < count; index++)
         {
           LaunchInfo        *l = [q objectAtIndex: index];
+          NSString  	    *r;
 
-          if ([launchQueue containsObject: l])
+          if (NO == l->queued || YES == l->blocked)
             {
-              NSString  *r = [l reasonToPreventLaunch];
-
-              if (nil == r)
-                {
-                  [launchQueue removeObject: l];
-                  l->queuedDate = 0.0;
-                  [l starting: nil];
-                }
+              continue;
+            }
+          r = [l reasonToPreventLaunch];
+          if (NO == l->queued)
+            {
+              continue;		// Should not have been in the queue
+            }
+          if (nil == r)
+            {
+              [l dequeue];
+              l->queuedDate = 0.0;
+              [l starting: nil];
+            }
+          else if ([[l unfulfilled] count] > 0)
+            {
+              /* A dependency has gone away; wait for it to register.
+               */
+              [l dequeue];
+              [l enqueue];
             }
         }
     }
   LEAVE_POOL
 }
 
++ (void) reconcileAdopted
+{
+  ENTER_POOL
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  NSEnumerator  	*e = [[launchInfo allValues] objectEnumerator];
+  LaunchInfo    	*l;
+
+  while (nil != (l = [e nextObject]))
+    {
+      if (l->adoptedDate > 0.0 && nil == l->client
+	&& (now >= l->adoptedDate + adoptGrace || NO == [l checkProcess]))
+	{
+	  NSLog(@"Adopted process %@ did not register itself", l->name);
+	  l->adoptedDate = 0.0;
+	  [l progress];
+	}
+    }
+  LEAVE_POOL
+}
+
 + (void) remove: (NSString*)name
 {
   LaunchInfo	*l = [launchInfo objectForKey: name];
 
   if (l != nil)
     {
+      journalAppend(name, nil);
       /* Detach the removed object from its client, destroy the task,
        * and cancel timers/notifications so that the removed object
        * will not try to manage anything before it is deallocated.
        */
       [[NSNotificationCenter defaultCenter] removeObserver: l];
+      [l dequeue];
       l->client = nil;
+      [l->watch invalidate];
       [l taskCleanup: l->task];
       [l->startingTimer invalidate];
       l->startingTimer = nil;
@@ -984,11 +2188,35 @@ desiredName(Desired state)
   awakenedDate = [NSDate timeIntervalSinceReferenceDate];
 }
 
+- (BOOL) busy
+{
+  return busy;
+}
+
+- (NSTimeInterval) busyDate
+{
+  return busyDate;
+}
+
 /* Check to see if there is an active process connected (or which connects
  * when we contact it and ask it to).
  */
 - (BOOL) checkActive
 {
+  if (nil == client && adoptedDate > 0.0)
+    {
+      /* A process adopted when the Command server started is expected to
+       * register by itself, so we don't contact it while it is running and
+       * has time to do so.  This avoids every process on the host being
+       * contacted at once when the Command server is restarted.
+       */
+      if ([NSDate timeIntervalSinceReferenceDate] < adoptedDate + adoptGrace
+	&& YES == [self checkProcess])
+	{
+	  return YES;
+	}
+      adoptedDate = 0.0;
+    }
   if ([self hungDate] > 0.0 && identifier > 0)
     {
       /* A hung process may be considered active but there is no point
@@ -1063,16 +2291,23 @@ desiredName(Desired state)
 {
   if (identifier > 0)
     {
-      if (kill(identifier, 0) == 0)
+      if (nil != watch && [watch processIdentifier] == identifier)
+        {
+          /* The watch refers to the process itself, so unlike kill()
+           * it can not be fooled by the process ID being reused.
+           */
+          if (NO == [watch hasExited])
+            {
+              return YES;
+            }
+        }
+      else if (kill(identifier, 0) == 0)
 	{
 	  return YES;
 	}
-      else
-	{
-          /* Process has terminated.
-           */
-	  identifier = 0;
-	}
+      /* Process has terminated.
+       */
+      identifier = 0;
     }
   return NO;
 }
@@ -1144,11 +2379,58 @@ desiredName(Desired state)
   RELEASE(client);
   RELEASE(name);
   RELEASE(conf);
+  RELEASE(journaled);
+  RELEASE(spawned);
+  RELEASE(usage);
+  [watch invalidate];
+  RELEASE(watch);
   if (task)
     {
       [self taskCleanup: task];
     }
-  [super dealloc];
+  [super dealloc];
+}
+
+- (void) dequeue
+{
+  if (YES == queued)
+    {
+      queued = NO;
+      if (NO == blocked)
+	{
+	  NSUInteger	i = readyPosition(launchRank(name));
+
+	  /* Search back through processes of equal rank.
+	   */
+	  while (i-- > 0)
+	    {
+	      if ([launchQueue objectAtIndex: i] == self)
+		{
+		  [launchQueue removeObjectAtIndex: i];
+		  break;
+		}
+	    }
+	}
+      blocked = NO;
+    }
+}
+
+- (void) enqueue
+{
+  if (NO == queued)
+    {
+      queued = YES;
+      if ([[self unfulfilled] count] > 0)
+	{
+	  blocked = YES;
+	}
+      else
+	{
+	  blocked = NO;
+	  [launchQueue insertObject: self
+			    atIndex: readyPosition(launchRank(name))];
+	}
+    }
 }
 
 /* The next delay for launching this process.  If Time is configured,
@@ -1249,6 +2531,18 @@ desiredName(Desired state)
     {
       [m appendFormat: @"  Last ping response at %@\n",
 	date(pingDate)];
+      if ([[client pingSummary] length] > 0)
+        {
+          [m appendFormat: @"  Round trip %@\n", [client pingSummary]];
+        }
+    }
+  if (nil != usage)
+    {
+      [m appendFormat: @"  Usage %@\n", usage];
+      if (busyDate > 0.0)
+        {
+          [m appendFormat: @"  CPU over limit since %@\n", date(busyDate)];
+        }
     }
   if (stoppingDate > 0.0)
     {
@@ -1270,11 +2564,31 @@ desiredName(Desired state)
   return [[conf objectForKey: @"Disabled"] boolValue];
 }
 
+- (NSTimeInterval) heartbeatLimit
+{
+  return confHeartbeatTime;
+}
+
 - (NSTimeInterval) hungDate
 {
   return hungDate;
 }
 
+- (NSTimeInterval) hungLimit
+{
+  return confHungTime;
+}
+
+- (NSTimeInterval) pingLimit
+{
+  return confPingTime;
+}
+
+- (NSTimeInterval) pingSlowLimit
+{
+  return confPingSlowTime;
+}
+
 /* Returns YES if the client is in a state where it can be sent commands.
  */
 - (BOOL) isActive
@@ -1361,6 +2675,56 @@ valgrindLog(NSString *name)
   return [NSFileHandle fileHandleForUpdatingAtPath: path];
 }
 
+- (void) journal
+{
+  NSDictionary	*s;
+
+  if (nil == journalHandle)
+    {
+      return;
+    }
+  s = [self journalState];
+  if (NO == [s isEqual: journaled])
+    {
+      ASSIGN(journaled, s);
+      journalAppend(name, s);
+    }
+}
+
+- (NSDictionary*) journalState
+{
+  NSMutableDictionary	*m = [NSMutableDictionary dictionaryWithCapacity: 16];
+
+  if (identifier != startPid)
+    {
+      startPid = identifier;
+      startTime = (identifier > 0) ? pidStartTime(identifier) : 0;
+    }
+  [m setObject: [NSNumber numberWithInt: desired] forKey: @"Desired"];
+  [m setObject: [NSNumber numberWithBool: manual] forKey: @"Manual"];
+  [m setObject: [NSNumber numberWithInt: identifier] forKey: @"Pid"];
+  [m setObject: [NSNumber numberWithUnsignedLongLong: startTime]
+	forKey: @"PidStart"];
+  [m setObject: [NSNumber numberWithDouble: launchDate] forKey: @"Launched"];
+  [m setObject: [NSNumber numberWithDouble: registrationDate]
+	forKey: @"Registered"];
+  [m setObject: [NSNumber numberWithDouble: awakenedDate]
+	forKey: @"Awakened"];
+  [m setObject: [NSNumber numberWithDouble: stableDate] forKey: @"Stable"];
+  [m setObject: [NSNumber numberWithDouble: hungDate] forKey: @"Hung"];
+  [m setObject: [NSNumber numberWithDouble: deferredDate]
+	forKey: @"Deferred"];
+  [m setObject: [NSNumber numberWithDouble: fib0] forKey: @"Fib0"];
+  [m setObject: [NSNumber numberWithDouble: fib1] forKey: @"Fib1"];
+  [m setObject: [NSNumber numberWithUnsignedInt: terminationCount]
+	forKey: @"Terminations"];
+  if (nil != stoppedReason)
+    {
+      [m setObject: stoppedReason forKey: @"StoppedReason"];
+    }
+  return m;
+}
+
 /* This method should only ever be called from the -starting: method (when
  * the instance has permission to launch).  To initiate the startup process
  * the -start method is called, and to progress startup the -starting: method
@@ -1510,10 +2874,32 @@ valgrindLog(NSString *name)
                 self, task, [NSThread callStackSymbols]);
               DESTROY(task);
             }
-	  task = [NSTask new];
+	  task = (YES == launchSpawn) ? [EcSpawnTask new] : [NSTask new];
           [task setArguments: args];
 	  [task setEnvironment: env];
 	  [task setLaunchPath: prog];
+          if ([task isKindOfClass: [EcSpawnTask class]])
+            {
+              EcSpawnTask       *t = (EcSpawnTask*)task;
+              id                o;
+
+              o = [conf objectForKey: @"Affinity"];
+              if ([o isKindOfClass: [NSArray class]])
+                {
+                  [t setAffinity: o];
+                }
+              o = [conf objectForKey: @"Nice"];
+              if ([o respondsToSelector: @selector(intValue)])
+                {
+                  [t setNice: [o intValue]];
+                }
+              o = [conf objectForKey: @"Limits"];
+              if ([o isKindOfClass: [NSDictionary class]])
+                {
+                  [t setLimits: o];
+                }
+              [t shareImage: spawned];
+            }
 
 	  if ([home isKindOfClass: [NSString class]]
 	    && [(home = [home stringByTrimmingSpaces]) length] > 0)
@@ -1883,6 +3269,13 @@ valgrindLog(NSString *name)
               [[p fileHandleForWriting]
                 writeInBackgroundAndNotify: hiddenArguments];
 	      identifier =  [task processIdentifier];
+              if ([task isKindOfClass: [EcSpawnTask class]])
+                {
+                  ASSIGN(spawned, (EcSpawnTask*)task);
+                  [command ecMetric: @"SpawnLatency"
+                             sample: [spawned latency] * 1000.0];
+                }
+	      [self journal];
 	      [[command logFile] printf:
 		@"%@ launched %@ with %@ and hidden values for %@\n",
 		[NSDate date], prog, args, [hide allKeys]];
@@ -1959,19 +3352,19 @@ valgrindLog(NSString *name)
 
   if (NO == [self isStarting])
     {
-      if ([launchQueue containsObject: self])
+      if (YES == queued)
         {
           NSLog(@"Found object which is not starting in queue: %@", self);
-          [launchQueue removeObject: self];
+          [self dequeue];
           queuedDate = 0.0;
         }
     }
   else if ([self isStopping])
     {
-      if ([launchQueue containsObject: self])
+      if (YES == queued)
         {
           NSLog(@"Found object which is stopping in queue: %@", self);
-          [launchQueue removeObject: self];
+          [self dequeue];
           queuedDate = 0.0;
         }
     }
@@ -2025,6 +3418,36 @@ valgrindLog(NSString *name)
   return identifier;
 }
 
+- (void) processExited: (EcPidWatch*)w
+{
+  if (w != watch)
+    {
+      return;
+    }
+  DESTROY(watch);
+  if (nil != task || identifier != [w processIdentifier])
+    {
+      return;
+    }
+  NSLog(@"Process %@ (pid %d) has ended", name, identifier);
+  identifier = 0;
+  if (nil != client)
+    {
+      /* Rather than waiting for the loss of the connection to be noticed,
+       * we invalidate it so that the loss of the client is handled now.
+       */
+      [[(NSDistantObject*)[client obj] connectionForProxy] invalidate];
+    }
+  else if (adoptedDate > 0.0)
+    {
+      [LaunchInfo reconcileAdopted];
+    }
+  else if ([self isStopping])
+    {
+      [self stopping: nil];
+    }
+}
+
 /* Check the current state, and if it's not the same as the desired state
  * start moving towards that desired state (unless already moving).
  */
@@ -2275,7 +3698,7 @@ valgrindLog(NSString *name)
     }
   clientLostDate = 0.0;
   clientQuitDate = 0.0;
-  [launchQueue removeObject: self];
+  [self dequeue];
   [self clearHung];
   pingDate = 0.0;
   queuedDate = 0.0;
@@ -2285,6 +3708,11 @@ valgrindLog(NSString *name)
        * this process has completed.  Alarms will be cleared when the
        * new process becomes stable.
        */
+      if (launchDate > 0.0)
+        {
+          startupTime = [NSDate timeIntervalSinceReferenceDate] - launchDate;
+          [LaunchInfo launchTook: startupTime];
+        }
       [startingTimer invalidate];
       startingTimer = nil;
       startingDate = 0.0;
@@ -2300,9 +3728,88 @@ valgrindLog(NSString *name)
       [self stop];
     }
   [self progress];
+
+  /* Processes waiting for this one may be ready to launch now.
+   */
+  {
+    NSEnumerator	*e;
+    NSString		*n;
+
+    e = [[launchDependents objectForKey: name] objectEnumerator];
+    while (nil != (n = [e nextObject]))
+      {
+	[[LaunchInfo existing: n] unblock];
+      }
+  }
   [LaunchInfo processQueue];    // Maybe we can launch more now
 }
 
+- (void) restoreState: (NSDictionary*)state
+{
+  int			pid = [[state objectForKey: @"Pid"] intValue];
+  unsigned long long	start;
+  int			d = [[state objectForKey: @"Desired"] intValue];
+
+  start = [[state objectForKey: @"PidStart"] unsignedLongLongValue];
+  desired = (Dead == d || Live == d) ? (Desired)d : None;
+  manual = [[state objectForKey: @"Manual"] boolValue];
+  terminationCount = [[state objectForKey: @"Terminations"] unsignedIntValue];
+  deferredDate = [[state objectForKey: @"Deferred"] doubleValue];
+  fib0 = [[state objectForKey: @"Fib0"] doubleValue];
+  fib1 = [[state objectForKey: @"Fib1"] doubleValue];
+  ASSIGN(stoppedReason, [state objectForKey: @"StoppedReason"]);
+  identifier = 0;
+  startPid = 0;
+  startTime = 0;
+  if (pid > 0 && kill(pid, 0) == 0
+    && (0 == start || pidStartTime(pid) == start))
+    {
+      /* The process we were supervising is still running, so we keep its
+       * history (in particular whether it is stable and hung) and wait for
+       * it to register with us.
+       */
+      identifier = pid;
+      startPid = pid;
+      startTime = start;
+      adoptedDate = [NSDate timeIntervalSinceReferenceDate];
+      launchDate = [[state objectForKey: @"Launched"] doubleValue];
+      registrationDate = [[state objectForKey: @"Registered"] doubleValue];
+      awakenedDate = [[state objectForKey: @"Awakened"] doubleValue];
+      stableDate = [[state objectForKey: @"Stable"] doubleValue];
+      hungDate = [[state objectForKey: @"Hung"] doubleValue];
+      [self watchProcess];
+    }
+  DESTROY(journaled);
+}
+
+- (EcProcessUsage*) sampleUsage
+{
+  if (identifier <= 0)
+    {
+      DESTROY(usage);
+    }
+  else if (nil == usage || [usage processIdentifier] != identifier
+    || NO == [usage sample])
+    {
+      /* A new process (or the first sample of this one) so the usage
+       * starts afresh.
+       */
+      ASSIGN(usage, [EcProcessUsage usageFor: identifier]);
+      busyDate = 0.0;
+    }
+  return usage;
+}
+
+- (void) setBusy: (BOOL)flag
+{
+  busy = flag;
+}
+
+- (void) setBusyDate: (NSTimeInterval)t
+{
+  busyDate = t;
+}
+
 /* When process startup has completed and the client has registered itself
  * with the Command server, the registration process will call this method.
  * Here we should do all the work associated with completion of the startup
@@ -2336,15 +3843,31 @@ valgrindLog(NSString *name)
     }
   registrationDate = [NSDate timeIntervalSinceReferenceDate];
   identifier = newPid;
+  [self watchProcess];
+  adoptedDate = 0.0;
   [self started];
+  [self journal];
 }
 
 - (void) setConfiguration: (NSDictionary*)c
 {
   BOOL	wasDisabled = [self disabled];
   BOOL	wasAuto = [self autolaunch];
+  id	o;
 
   ASSIGNCOPY(conf, c);
+  o = [conf objectForKey: @"PingTime"];
+  confPingTime = [o respondsToSelector: @selector(intValue)]
+    ? (NSTimeInterval)[o intValue] : 0.0;
+  o = [conf objectForKey: @"HungTime"];
+  confHungTime = [o respondsToSelector: @selector(intValue)]
+    ? (NSTimeInterval)[o intValue] : -1.0;
+  o = [conf objectForKey: @"HeartbeatTime"];
+  confHeartbeatTime = [o respondsToSelector: @selector(intValue)]
+    ? (NSTimeInterval)[o intValue] : 0.0;
+  o = [conf objectForKey: @"PingSlowTime"];
+  confPingSlowTime = [o respondsToSelector: @selector(doubleValue)]
+    ? [o doubleValue] : 0.0;
   if ([self disabled])
     {
       if (NO == wasDisabled)
@@ -2450,6 +3973,7 @@ valgrindLog(NSString *name)
             }
 	}
     }
+  [self journal];
 }
 
 - (void) setDumped: (BOOL)dumped
@@ -2482,6 +4006,7 @@ valgrindLog(NSString *name)
 - (void) setManual: (BOOL)f
 {
   manual = f;
+  [self journal];
 }
 
 - (void) setPing
@@ -2492,6 +4017,7 @@ valgrindLog(NSString *name)
 - (void) setProcessIdentifier: (int)p
 {
   identifier = p;
+  [self watchProcess];
 }
 
 - (void) setStable: (BOOL)s
@@ -2505,6 +4031,7 @@ valgrindLog(NSString *name)
       stableDate = [NSDate timeIntervalSinceReferenceDate];
       [self resetDelay];
     }
+  [self journal];
 }
 
 - (void) setTerminationStatus: (int)s
@@ -2630,7 +4157,7 @@ valgrindLog(NSString *name)
       [startingTimer invalidate];
       startingTimer = nil;
       startingDate = 0.0;
-      [launchQueue removeObject: self];
+      [self dequeue];
       if (identifier > 0)
         {
           if (task != nil)
@@ -2717,14 +4244,14 @@ valgrindLog(NSString *name)
 	    {
 	      /* We are able to launch now
 	       */
-	      [launchQueue removeObject: self];
+	      [self dequeue];
 	      queuedDate = 0.0;
 	      terminationDate = 0.0;
 	      terminationStatusKnown = NO;
 	      if (NO == [self launch])
 		{
 		  ti = [self delay];        // delay between launch attempts
-		  [launchQueue addObject: self];
+		  [self enqueue];
 		  queuedDate = [NSDate timeIntervalSinceReferenceDate];
 		  [command logChange: @"queued (launch failed)" for: name];
 		}
@@ -2744,7 +4271,7 @@ valgrindLog(NSString *name)
 	      BOOL  		alreadyQueued;
 	      NSTimeInterval    now;
 
-	      alreadyQueued = [launchQueue containsObject: self];
+	      alreadyQueued = queued;
 	      now = [NSDate timeIntervalSinceReferenceDate];
 	      if (deferredDate > 0.0 && now < deferredDate)
 		{
@@ -2754,7 +4281,7 @@ valgrindLog(NSString *name)
 		  ti = deferredDate - now;
 		  if (NO == alreadyQueued)
 		    {
-		      [launchQueue addObject: self];
+		      [self enqueue];
 		      queuedDate = [NSDate timeIntervalSinceReferenceDate];
 		    }
 		}
@@ -2765,12 +4292,16 @@ valgrindLog(NSString *name)
 		   * started and specify a timer for checking again.
 		   */
 		  startingDate = [NSDate timeIntervalSinceReferenceDate];
-		  ti = 1.0;
 		  if (NO == alreadyQueued)
 		    {
-		      [launchQueue addObject: self];
+		      [self enqueue];
 		      queuedDate = [NSDate timeIntervalSinceReferenceDate];
 		    }
+		  /* A process waiting for dependencies is moved to the
+		   * ready queue when they register, so it need only be
+		   * checked occasionally.
+		   */
+		  ti = (YES == blocked) ? 30.0 : 1.0;
 		}
 	      if (NO == alreadyQueued)
 		{
@@ -3204,6 +4735,7 @@ valgrindLog(NSString *name)
                 procName: name
                  addText: text];
     }
+  [self journal];
   [self progress];
   [LaunchInfo processQueue];
 }
@@ -3288,12 +4820,12 @@ valgrindLog(NSString *name)
         {
           ti = 0.001;
         }
-      if (nil == client && nil == task && ti > 0.1)
+      if (nil == client && nil == task && nil == watch && ti > 0.1)
         {
           /* This can happen if a process was launched externally and
            * connected to the Command server (so we know its PID).
-           * We will not be notified when the process dies so we must
-           * poll frequently for it.
+           * Unless we can watch it, we will not be notified when the
+           * process dies so we must poll frequently for it.
            */
           ti = 0.1;
         }
@@ -3351,100 +4883,389 @@ valgrindLog(NSString *name)
           NS_ENDHANDLER
         }
     }
-
-  if (t == task)
+
+  if (t == task)
+    {
+      DESTROY(task);
+    }
+}
+
+- (void) taskTerminated: (NSNotification*)n
+{
+  NSTask        *t = (NSTask*)[n object];
+
+  if (nil == t)
+    {
+      /* For a fake termination, use existing task, if any.
+       */
+      t = task;
+    }
+
+  if (t == task)
+    {
+      terminationCount++;
+      if (NSTaskTerminationReasonUncaughtSignal == [task terminationReason])
+	{
+	  terminationSignal = [task terminationStatus];
+	  terminationStatus = 0;
+	}
+      else
+	{
+	  terminationSignal = 0;
+	  terminationStatus = [task terminationStatus];
+	  /* This is an 8-bit value for the OS on Linux and won't have
+	   * been sign-extended when placed in an integer.  So lets
+	   * convert it to a negative integer when necessary.
+	   */
+	  if (terminationStatus > 127 && terminationStatus < 256)
+	    {
+	      terminationStatus = terminationStatus - 256;
+	    }
+	}
+      terminationStatusKnown = YES;
+      terminationDate = [NSDate timeIntervalSinceReferenceDate];
+      launchDate = 0.0;
+      if (terminationSignal != 0)
+        {
+          NSLog(@"Termination signal %d for %@ (pid %d)%@",
+            terminationSignal, name, identifier,
+            ([t isKindOfClass: [EcSpawnTask class]]
+              && [(EcSpawnTask*)t coreDumped]) ? @" core dumped" : @"");
+        }
+      else if (terminationStatus != 0)
+        {
+          NSLog(@"Termination status %d for %@ (pid %d)",
+            terminationStatus, name, identifier);
+        }
+      identifier = 0;
+      [self taskCleanup: t];
+      [self stopping: nil];
+    }
+  else if (t)
+    {
+      [self taskCleanup: t];
+    }
+}
+
+- (void) taskWritten: (NSNotification*)n
+{
+  NSFileHandle  *fh = (NSFileHandle*)[n object];
+
+  [[NSNotificationCenter defaultCenter]
+    removeObserver: self
+              name: GSFileHandleWriteCompletionNotification
+            object: fh];
+  NS_DURING
+    {
+      [fh closeFile];
+    }
+  NS_HANDLER
+  NS_ENDHANDLER
+}
+
+- (void) unblock
+{
+  if (YES == queued && YES == blocked && 0 == [[self unfulfilled] count])
+    {
+      blocked = NO;
+      [launchQueue insertObject: self
+			atIndex: readyPosition(launchRank(name))];
+    }
+}
+
+- (NSArray*) unfulfilled
+{
+  NSMutableArray    *d = [[conf objectForKey: @"Deps"] mutableCopy];
+  NSUInteger        c = [d count];
+
+  while (c-- > 0)
+    {
+      NSString      *n = [d objectAtIndex: c];
+      LaunchInfo    *l = [LaunchInfo existing: n];
+
+      if ([l client] != nil)
+        {
+          [d removeObjectAtIndex: c];
+        }
+    }
+  return AUTORELEASE(d);
+}
+
+- (EcProcessUsage*) usage
+{
+  return usage;
+}
+
+- (void) watchProcess
+{
+  if (nil == task && identifier > 0
+    && (nil == watch || [watch processIdentifier] != identifier))
+    {
+      [watch invalidate];
+      ASSIGN(watch, [EcPidWatch watch: identifier
+			       target: self
+			     selector: @selector(processExited:)]);
+    }
+}
+
+@end
+
+/* A rolling restart of a group of the processes on this host.  The
+ * processes are restarted in batches of at most 'window' at a time, and
+ * the next batch is not started until every process in the current one
+ * has registered again and become stable.  A batch is made smaller where
+ * needed so that the number of processes of the group which are not
+ * available (not yet stable) stays within the 'unavailable' budget.
+ */
+@interface	RollingRestart : NSObject
+{
+  NSString		*pattern;	// What the operator asked for
+  NSString		*requester;	// Console to report to
+  NSArray		*group;		// Names of all the processes
+  NSMutableArray	*pending;	// Names yet to be restarted
+  NSMutableDictionary	*active;	// Name -> pid before restart
+  NSUInteger		window;		// Maximum batch size
+  NSUInteger		budget;		// Maximum unavailable
+  NSTimeInterval	timeout;	// Allowed for each batch
+  NSTimeInterval	started;
+  NSTimeInterval	batchStarted;	// Or start of wait for budget
+  unsigned		batches;
+  unsigned		restarted;
+  unsigned		skipped;
+  NSString		*waiting;	// Why we are waiting (or nil)
+  NSString		*failure;	// Why we gave up (or nil)
+}
+- (NSString*) failure;
+- (id) initWithNames: (NSArray*)names
+	     pattern: (NSString*)p
+		from: (NSString*)f
+	      window: (NSUInteger)w
+	      budget: (NSUInteger)b
+	     timeout: (NSTimeInterval)t;
+- (NSString*) pattern;
+- (NSString*) requester;
+/** Advances the restart; returns YES once it has finished (or failed).
+ */
+- (BOOL) step: (NSTimeInterval)now;
+- (void) stop: (NSString*)reason;
+@end
+
+@implementation	RollingRestart
+
+- (void) dealloc
+{
+  DESTROY(pattern);
+  DESTROY(requester);
+  DESTROY(group);
+  DESTROY(pending);
+  DESTROY(active);
+  DESTROY(waiting);
+  DESTROY(failure);
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  NSMutableString	*m;
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+
+  m = [NSMutableString stringWithFormat:
+    @"Rolling restart of '%@' (%u processes, window %u, unavailable %u)"
+    @" running for %d seconds:\n"
+    @"  %u restarted in %u batches, %u in progress, %u pending,"
+    @" %u skipped.\n",
+    pattern, (unsigned)[group count], (unsigned)window, (unsigned)budget,
+    (int)(now - started), restarted, batches, (unsigned)[active count],
+    (unsigned)[pending count], skipped];
+  if ([active count] > 0)
+    {
+      [m appendFormat: @"  Restarting: %@\n",
+	[[[active allKeys] sortedArrayUsingSelector: @selector(compare:)]
+	  componentsJoinedByString: @", "]];
+    }
+  if (nil != failure)
+    {
+      [m appendFormat: @"  Abandoned: %@\n", failure];
+    }
+  else if (nil != waiting)
+    {
+      [m appendFormat: @"  Waiting %@\n", waiting];
+    }
+  return m;
+}
+
+- (NSString*) failure
+{
+  return failure;
+}
+
+- (id) initWithNames: (NSArray*)names
+	     pattern: (NSString*)p
+		from: (NSString*)f
+	      window: (NSUInteger)w
+	      budget: (NSUInteger)b
+	     timeout: (NSTimeInterval)t
+{
+  if (nil != (self = [super init]))
+    {
+      ASSIGNCOPY(pattern, p);
+      ASSIGNCOPY(requester, f);
+      ASSIGNCOPY(group, names);
+      pending = [names mutableCopy];
+      active = [NSMutableDictionary new];
+      window = (w > 0) ? w : 1;
+      budget = (b > 0) ? b : window;
+      timeout = (t > 0.0) ? t : 600.0;
+      started = [NSDate timeIntervalSinceReferenceDate];
+    }
+  return self;
+}
+
+- (NSString*) pattern
+{
+  return pattern;
+}
+
+- (NSString*) requester
+{
+  return requester;
+}
+
+- (BOOL) step: (NSTimeInterval)now
+{
+  NSEnumerator	*e;
+  NSString	*n;
+  NSUInteger	unavailable = 0;
+  NSUInteger	count;
+  NSUInteger	inBatch;
+
+  if (nil != failure)
+    {
+      return YES;
+    }
+
+  /* A process in the current batch is done once it is running again (as
+   * a new process) and has become stable.
+   */
+  inBatch = [active count];
+  e = [[active allKeys] objectEnumerator];
+  while ((n = [e nextObject]) != nil)
+    {
+      LaunchInfo	*l = [LaunchInfo existing: n];
+      int		old = [[active objectForKey: n] intValue];
+
+      if ([l processIdentifier] > 0 && [l processIdentifier] != old
+	&& [l stable])
+	{
+	  [active removeObjectForKey: n];
+	  restarted++;
+	}
+      else if (nil == l || [l disabled] || Dead == [l desired])
+	{
+	  /* Stopped by the operator or removed from the config while
+	   * we were restarting it.
+	   */
+	  [active removeObjectForKey: n];
+	  skipped++;
+	}
+    }
+  if ([active count] > 0)
     {
-      DESTROY(task);
+      if (now - batchStarted > timeout)
+	{
+	  [self stop: [NSString stringWithFormat:
+	    @"batch %u not stable within %g seconds", batches, timeout]];
+	  return YES;
+	}
+      ASSIGN(waiting, @"for the batch to become stable");
+      return NO;
     }
-}
-
-- (void) taskTerminated: (NSNotification*)n
-{
-  NSTask        *t = (NSTask*)[n object];
-
-  if (nil == t)
+  if (inBatch > 0)
     {
-      /* For a fake termination, use existing task, if any.
+      /* The batch has just finished, so any wait for the unavailable
+       * count to fall is timed from now rather than from batch start.
        */
-      t = task;
+      batchStarted = 0.0;
+      DESTROY(waiting);
+    }
+  if (0 == [pending count])
+    {
+      DESTROY(waiting);
+      return YES;
     }
 
-  if (t == task)
+  /* Count the processes of the group (other than those stopped on
+   * purpose) which are not currently available.
+   */
+  e = [group objectEnumerator];
+  while ((n = [e nextObject]) != nil)
     {
-      terminationCount++;
-      if (NSTaskTerminationReasonUncaughtSignal == [task terminationReason])
+      LaunchInfo	*l = [LaunchInfo existing: n];
+
+      if (nil == l || [l disabled] || Dead == [l desired])
 	{
-	  terminationSignal = [task terminationStatus];
-	  terminationStatus = 0;
+	  continue;
 	}
-      else
+      if (NO == [l isActive] || NO == [l stable])
 	{
-	  terminationSignal = 0;
-	  terminationStatus = [task terminationStatus];
-	  /* This is an 8-bit value for the OS on Linux and won't have
-	   * been sign-extended when placed in an integer.  So lets
-	   * convert it to a negative integer when necessary.
-	   */
-	  if (terminationStatus > 127 && terminationStatus < 256)
-	    {
-	      terminationStatus = terminationStatus - 256;
-	    }
+	  unavailable++;
 	}
-      terminationStatusKnown = YES;
-      terminationDate = [NSDate timeIntervalSinceReferenceDate];
-      launchDate = 0.0;
-      if (terminationSignal != 0)
-        {
-          NSLog(@"Termination signal %d for %@ (pid %d)",
-            terminationSignal, name, identifier);
-        }
-      else if (terminationStatus != 0)
-        {
-          NSLog(@"Termination status %d for %@ (pid %d)",
-            terminationStatus, name, identifier);
-        }
-      identifier = 0;
-      [self taskCleanup: t];
-      [self stopping: nil];
     }
-  else if (t)
+  count = (budget > unavailable) ? budget - unavailable : 0;
+  if (count > window)
     {
-      [self taskCleanup: t];
+      count = window;
+    }
+  if (0 == count)
+    {
+      if (nil == waiting || 0.0 == batchStarted)
+	{
+	  batchStarted = now;
+	}
+      if (now - batchStarted > timeout)
+	{
+	  [self stop: [NSString stringWithFormat:
+	    @"%u processes unavailable for over %g seconds",
+	    (unsigned)unavailable, timeout]];
+	  return YES;
+	}
+      ASSIGN(waiting, ([NSString stringWithFormat:
+	@"for unavailable processes (%u) to fall below %u",
+	(unsigned)unavailable, (unsigned)budget]));
+      return NO;
     }
-}
-
-- (void) taskWritten: (NSNotification*)n
-{
-  NSFileHandle  *fh = (NSFileHandle*)[n object];
 
-  [[NSNotificationCenter defaultCenter]
-    removeObserver: self
-              name: GSFileHandleWriteCompletionNotification
-            object: fh];
-  NS_DURING
+  batches++;
+  batchStarted = now;
+  DESTROY(waiting);
+  while (count > 0 && [pending count] > 0)
     {
-      [fh closeFile];
+      LaunchInfo	*l;
+
+      n = AUTORELEASE(RETAIN([pending objectAtIndex: 0]));
+      [pending removeObjectAtIndex: 0];
+      l = [LaunchInfo existing: n];
+      if (NO == [l isActive] || [l disabled] || Dead == [l desired])
+	{
+	  skipped++;
+	  continue;
+	}
+      [active setObject: [NSNumber numberWithInt: [l processIdentifier]]
+		 forKey: n];
+      [l restart: [NSString stringWithFormat:
+	@"Console 'rolling %@' from '%@'", pattern, requester]];
+      count--;
     }
-  NS_HANDLER
-  NS_ENDHANDLER
+  return NO;
 }
 
-- (NSArray*) unfulfilled
+- (void) stop: (NSString*)reason
 {
-  NSMutableArray    *d = [[conf objectForKey: @"Deps"] mutableCopy];
-  NSUInteger        c = [d count];
-
-  while (c-- > 0)
+  if (nil == failure)
     {
-      NSString      *n = [d objectAtIndex: c];
-      LaunchInfo    *l = [LaunchInfo existing: n];
-
-      if ([l client] != nil)
-        {
-          [d removeObjectAtIndex: c];
-        }
+      ASSIGNCOPY(failure, reason);
+      [pending removeAllObjects];
     }
-  return AUTORELEASE(d);
 }
 
 @end
@@ -3498,7 +5319,8 @@ valgrindLog(NSString *name)
     withEventType: EcAlarmEventTypeProcessingError
     probableCause: EcAlarmSoftwareProgramError
     specificProblem: problem
-    perceivedSeverity: EcAlarmSeverityCritical
+    perceivedSeverity: (ACProcessSlow == ac || ACProcessBusy == ac)
+      ? EcAlarmSeverityMajor : EcAlarmSeverityCritical
     proposedRepairAction: repair
     additionalText: additional];
   [[LaunchInfo existing: name] alarm: a];	// Update launch info
@@ -3605,6 +5427,12 @@ valgrindLog(NSString *name)
 	  [self alarm: a];
 	}
     }
+  /* With the alarms cleared, the state which raised them must be reset
+   * so that they can be raised again if the problem recurs.
+   */
+  [[l client] setSlow: NO];
+  [l setBusy: NO];
+  [l setBusyDate: 0.0];
   LEAVE_POOL
 }
 
@@ -3744,6 +5572,17 @@ NSLog(@"Problem %@", localException);
       logDeleteAfter = logCompressAfter;
     }
 
+  [self registrationLimits];
+
+  if (nil == [defs objectForKey: @"SpawnLaunch"])
+    {
+      launchSpawn = YES;
+    }
+  else
+    {
+      launchSpawn = [defs boolForKey: @"SpawnLaunch"];
+    }
+
   return nil;
 }
 
@@ -3777,6 +5616,42 @@ NSLog(@"Problem %@", localException);
   /* Start housekeeping timer.
    */
   [self _housekeeping: nil];
+
+  /* Start the ping wheel turning.
+   */
+  pingTimer = [NSTimer scheduledTimerWithTimeInterval: PING_TICK
+					       target: self
+					     selector: @selector(pingWheelTurn:)
+					     userInfo: nil
+					      repeats: YES];
+
+  /* Create (or take over) the heartbeat table our clients update, and
+   * start scanning it.  Without it we rely on pings alone.
+   */
+  if (nil == heartbeats)
+    {
+      NSString	*path;
+
+      path = [[self cmdDataDirectory]
+        stringByAppendingPathComponent: @"Heartbeat.map"];
+      heartbeats = RETAIN([EcHeartbeat mapFile: path slots: 1024]);
+      if (nil == heartbeats)
+        {
+          NSLog(@"Unable to create heartbeat table at %@", path);
+        }
+      else
+        {
+          beatTimer = [NSTimer scheduledTimerWithTimeInterval: 1.0
+            target: self
+            selector: @selector(heartbeats:)
+            userInfo: nil
+            repeats: YES];
+        }
+    }
+
+  /* Start sampling the resource usage of our processes and the host.
+   */
+  [self usageStart];
 }
 
 - (void) enableLaunching
@@ -3824,48 +5699,81 @@ NSLog(@"Problem %@", localException);
   return lf;
 }
 
-- (void) newConfig: (NSMutableDictionary*)newConfig
+- (void) newConfig: (NSDictionary*)newConfig
 {
-  NSString	*diskCache;
-  NSData	*data;
+  EcConfigMap	*compiled = nil;
+  NSString	*mapped;
+  NSString	*source;
+  BOOL		changed;
 
-  diskCache = [[self cmdDataDirectory]
-    stringByAppendingPathComponent: @"CommandConfig.cache"];
+  mapped = [[self cmdDataDirectory]
+    stringByAppendingPathComponent: @"CommandConfig.map"];
+  source = [controlInfo objectForKey: EC_CONFIG_SOURCE];
 
-  if (NO == [newConfig isKindOfClass: [NSMutableDictionary class]]
+  if (NO == [newConfig isKindOfClass: [NSDictionary class]]
     || 0 == [newConfig count])
     {
-      /* If we are called with a nil argument, we must obtain the config
-       * from local disk cache (if available).
+      /* If we are called with a nil argument, we must use the config we
+       * last published (if available).  The file is mapped and each
+       * section is parsed only when it is needed.
        */
-      if (nil != (data = [NSData dataWithContentsOfFile: diskCache]))
-	{
-	  newConfig = [NSPropertyListSerialization
-	    propertyListWithData: data
-	    options: NSPropertyListMutableContainers
-	    format: 0
-	    error: 0];
-	}
-      if (NO == [newConfig isKindOfClass: [NSMutableDictionary class]]
-	|| 0 == [newConfig count])
+      compiled = [EcConfigMap mapFile: mapped];
+      if (0 == [compiled count])
 	{
 	  return;
 	}
+      newConfig = [compiled dictionary];
+      source = [compiled source];
+    }
+  else if (nil != source && [source isEqual: configSource])
+    {
+      /* The Control server has sent the configuration that our current
+       * one was built from (eg when we register after a restart), so
+       * there is nothing to do.
+       */
+      return;
+    }
+
+  /* Comparing a mapped configuration would parse every section of it,
+   * so where both the old and new configurations carry the digest of
+   * their source, we compare those instead.
+   */
+  if (nil == config)
+    {
+      changed = YES;
+    }
+  else if (nil != source && nil != configSource)
+    {
+      changed = [source isEqual: configSource] ? NO : YES;
     }
   else
     {
-      data = nil;
+      changed = [config isEqual: newConfig] ? NO : YES;
     }
 
-  if (nil == config || [config isEqual: newConfig] == NO)
+  if (YES == changed)
     {
       NSMutableDictionary	*m;
       NSDictionary		*d;
       NSArray			*a;
       unsigned			i;
+      NSUInteger		old;
       NSString      		*err = nil;
 
       ASSIGN(config, newConfig);
+      ASSIGN(configSource, source);
+      if (nil != compiled && [compiled version] > configVersion)
+	{
+	  configVersion = [compiled version];
+	}
+      else
+	{
+	  /* The version must increase, so a cached config which is older
+	   * than the one we have must be published again.
+	   */
+	  compiled = nil;
+	  configVersion++;
+	}
       /* Get the specific Command server config
        */
       d = [config objectForKey: [self cmdName]];
@@ -3896,6 +5804,7 @@ NSLog(@"Problem %@", localException);
 	    }
 	}
       d = m;
+      old = launchLimit;
       launchLimit = 0;
       if ([d isKindOfClass: [NSDictionary class]] == YES)
 	{
@@ -3953,6 +5862,98 @@ NSLog(@"Problem %@", localException);
               pingTime = 120.0;
             }
 
+          /* The average ping round trip time at which a process is
+           * considered slow defaults to 2 seconds but may be configured
+           * in the range from 0.1 to 600
+           */
+          ti = [[d objectForKey: @"CommandPingSlowTime"] doubleValue];
+          if (ti == ti && ti > 0.0)
+            {
+              if (ti < 0.1) ti = 0.1;
+              if (ti > 600.0) ti = 600.0;
+              pingSlowTime = ti;
+            }
+          else
+            {
+              pingSlowTime = 2.0;
+            }
+
+          /* The time a process may go without a heartbeat defaults to
+           * 15 seconds but may be configured in the range from 2 to 600
+           */
+          ti = [[d objectForKey: @"CommandHeartbeatTime"] doubleValue];
+          if (ti == ti && ti > 0.0)
+            {
+              if (ti < 2.0) ti = 2.0;
+              if (ti > 600.0) ti = 600.0;
+              heartbeatTime = ti;
+            }
+          else
+            {
+              heartbeatTime = 15.0;
+            }
+
+          /* Resource usage is sampled every 5 seconds by default, but the
+           * interval may be configured in the range from 1 to 300.
+           */
+          ti = [[d objectForKey: @"CommandUsageTime"] doubleValue];
+          if (ti == ti && ti > 0.0)
+            {
+              if (ti < 1.0) ti = 1.0;
+              if (ti > 300.0) ti = 300.0;
+              usageTime = ti;
+            }
+          else
+            {
+              usageTime = 5.0;
+            }
+          if (nil != usageTimer && [usageTimer timeInterval] != usageTime)
+            {
+              [self usageStart];
+            }
+
+          /* The CPU and disk busy percentages at which alarms are raised
+           * default to 90 and may be configured in the range 10 to 100.
+           */
+          ti = [[d objectForKey: @"CommandUsageCPU"] doubleValue];
+          if (ti == ti && ti > 0.0)
+            {
+              if (ti < 10.0) ti = 10.0;
+              if (ti > 100.0) ti = 100.0;
+              usageCPU = ti;
+            }
+          else
+            {
+              usageCPU = 90.0;
+            }
+          ti = [[d objectForKey: @"CommandUsageIO"] doubleValue];
+          if (ti == ti && ti > 0.0)
+            {
+              if (ti < 10.0) ti = 10.0;
+              if (ti > 100.0) ti = 100.0;
+              usageIO = ti;
+            }
+          else
+            {
+              usageIO = 90.0;
+            }
+
+          /* The time usage must stay over a limit before an alarm is
+           * raised defaults to 300 seconds but may be configured in the
+           * range from 10 to 3600.
+           */
+          ti = [[d objectForKey: @"CommandUsageSustain"] doubleValue];
+          if (ti == ti && ti > 0.0)
+            {
+              if (ti < 10.0) ti = 10.0;
+              if (ti > 3600.0) ti = 3600.0;
+              usageSustain = ti;
+            }
+          else
+            {
+              usageSustain = 300.0;
+            }
+
           /* The time allowed for a process to core dump defaults to 30 seconds
            * but may be configured in the range from 10 to 60
            */
@@ -3987,15 +5988,52 @@ NSLog(@"Problem %@", localException);
            * any one time.  Once the launch limit is reached we should
            * launch new tasks as and when launching tasks complete their
            * startup and register with this process.
+           * If the limit is 'Auto' it is adjusted to suit the load on
+           * the host, between LaunchLimitMin and LaunchLimitMax.
            */
-	  i = [[[d objectForKey: @"LaunchLimit"] description] intValue];
-          if (i <= 0)
+          o = [d objectForKey: @"LaunchLimit"];
+          if ([o isKindOfClass: [NSString class]]
+            && [o caseInsensitiveCompare: @"Auto"] == NSOrderedSame)
             {
-              launchLimit = 20;
+              NSUInteger        cpus;
+              NSUInteger        was = launchAdaptive ? old : 0;
+
+              cpus = [[NSProcessInfo processInfo] activeProcessorCount];
+              if (0 == cpus) cpus = 1;
+	      i = [[[d objectForKey: @"LaunchLimitMin"] description] intValue];
+              launchLimitMin = (i > 0) ? (NSUInteger)i : 1;
+	      i = [[[d objectForKey: @"LaunchLimitMax"] description] intValue];
+              launchLimitMax = (i > 0) ? (NSUInteger)i : cpus * 4;
+              if (launchLimitMax < launchLimitMin)
+                {
+                  launchLimitMax = launchLimitMin;
+                }
+              /* Keep the current budget if we were already adaptive,
+               * otherwise start with one launch per processor.
+               */
+              launchLimit = (was > 0) ? was : cpus;
+              if (launchLimit < launchLimitMin) launchLimit = launchLimitMin;
+              if (launchLimit > launchLimitMax) launchLimit = launchLimitMax;
+              launchAdaptive = YES;
+              launchLimitChecked = 0.0;
+              ASSIGN(launchLimitReason, ([NSString stringWithFormat:
+                @"adaptive %u-%u", (unsigned)launchLimitMin,
+                (unsigned)launchLimitMax]));
             }
           else
             {
-              launchLimit = (NSUInteger)i;
+	      i = [[o description] intValue];
+              if (i <= 0)
+                {
+                  launchLimit = 20;
+                  ASSIGN(launchLimitReason, @"default");
+                }
+              else
+                {
+                  launchLimit = (NSUInteger)i;
+                  ASSIGN(launchLimitReason, @"configured");
+                }
+              launchAdaptive = NO;
             }
 
 	  missing = AUTORELEASE([[LaunchInfo names] mutableCopy]);
@@ -4145,6 +6183,18 @@ NSLog(@"Problem %@", localException);
 		      EConf(@"Bad 'Launch' SetE for %@", k);
 		      continue;
 		    }
+		  o = [d objectForKey: @"Affinity"];
+		  if (o != nil && [o isKindOfClass: [NSArray class]] == NO)
+		    {
+		      EConf(@"Bad 'Launch' Affinity for %@", k);
+		      continue;
+		    }
+		  o = [d objectForKey: @"Limits"];
+		  if (o != nil && [o isKindOfClass: [NSDictionary class]] == NO)
+		    {
+		      EConf(@"Bad 'Launch' Limits for %@", k);
+		      continue;
+		    }
 		  o = [d objectForKey: @"Deps"];
 		  if (o != nil)
 		    {
@@ -4187,6 +6237,18 @@ NSLog(@"Problem %@", localException);
                             }
                         }
                     }
+
+                  /* Processes whose dependencies form a cycle could
+                   * never be launched.  Removing them means that any
+                   * processes depending on them are removed above.
+                   */
+                  e = [launchCycles(md) objectEnumerator];
+                  while (nil != (k = [e nextObject]))
+                    {
+                      EConf(@"Bad 'Launch' Deps for %@"
+                        @" (dependency cycle)", k);
+                      [md removeObjectForKey: k];
+                    }
                 }
               conf = md;
 
@@ -4295,6 +6357,7 @@ NSLog(@"Problem %@", localException);
                 }
               ASSIGNCOPY(launchOrder, newOrder);
             }
+          [LaunchInfo plan];
 
 	  o = [d objectForKey: @"SetE"];
           if (o != nil && NO == [o isKindOfClass: [NSDictionary class]])
@@ -4365,7 +6428,29 @@ NSLog(@"Problem %@", localException);
 	  EConf(@"No '%@' information in latest config update", [self cmdName]);
 	}
 
-      a = [NSArray arrayWithArray: clients];
+      /* Publish the configuration for all the processes on this host,
+       * so that clients able to map the file need only be told to read
+       * their sections from it.  The file also serves as our cache of the
+       * configuration for use when we restart.
+       * The file carries the trace, so our hop is stamped with the time
+       * the change is sent on just before the file is written (a config
+       * read back from the file is not stamped again).
+       */
+      if (nil == compiled)
+	{
+	  ASSIGN(config, traceSent(config, [self cmdName]));
+	}
+      if (nil == compiled
+	&& NO == [EcConfigMap writeConfig: config
+				  version: configVersion
+				   source: source
+				   toFile: mapped])
+	{
+	  NSLog(@"Unable to publish mapped config at %@", mapped);
+	  mapped = nil;
+	}
+
+      a = [clients allObjects];
       i = [a count];
       while (i-- > 0)
 	{ 
@@ -4375,12 +6460,11 @@ NSLog(@"Problem %@", localException);
 	    {
 	      NS_DURING
 		{
-		  NSData	*d = [self configurationFor: [c name]];
+		  NSDictionary	*d = [self configurationInfoFor: [c name]];
 
 		  if (nil != d)
 		    {
-		      [c setConfig: d];
-		      [[c obj] updateConfig: d];
+		      [c updateConfig: d version: configVersion mapped: mapped];
 		    }
 		}
 	      NS_HANDLER
@@ -4390,17 +6474,6 @@ NSLog(@"Problem %@", localException);
 	      NS_ENDHANDLER
 	    }
 	}
-      if (nil == data)
-	{
-	  /* Need to update on-disk cache
-	   */
-	  data = [NSPropertyListSerialization
-	    dataFromPropertyList: newConfig
-	    format: NSPropertyListBinaryFormat_v1_0
-	    errorDescription: 0];
-	  [data writeToFile: diskCache atomically: YES];
-	}
-
       if ([err length] > 0)
 	{
 	  EcAlarm       *a;
@@ -4458,15 +6531,89 @@ NSLog(@"Problem %@", localException);
 	  [control cmdPing: self sequence: ++fwdSequence extra: nil];
 	}
       NS_HANDLER
-	{
-	  NSLog(@"Ping to control server - %@", localException);
-	}
+	{
+	  NSLog(@"Ping to control server - %@", localException);
+	}
+      NS_ENDHANDLER
+    }
+  else
+    {
+      NSLog(@"Ping to control server when one is already in progress.");
+    }
+}
+
+- (void) metrics: (NSData*)data from: (NSString*)name
+{
+  NSDictionary  *delta;
+
+  delta = [NSPropertyListSerialization propertyListWithData: data
+                                                    options: 0
+                                                     format: 0
+                                                      error: 0];
+  if ([delta isKindOfClass: [NSDictionary class]])
+    {
+      /* Keep the metrics of each process, and also merge them into
+       * host-wide totals (recorded as if from a process named '*').
+       */
+      [hostMetrics merge: delta prefix: name];
+      [hostMetrics merge: delta prefix: @"*"];
+    }
+}
+
+- (void) metricsForward: (NSDate*)now
+{
+  NSTimeInterval        ti = [now timeIntervalSince1970];
+  NSDictionary          *delta;
+
+  if (0.0 == metricsStart)
+    {
+      metricsStart = ti;
+      return;
+    }
+  if (ti - metricsStart < 10.0)
+    {
+      return;
+    }
+
+  /* Our own metrics are handled just like those of a client.
+   */
+  delta = [[self ecMetrics] takeDelta];
+  if (nil != delta)
+    {
+      [hostMetrics merge: delta prefix: [self cmdName]];
+      [hostMetrics merge: delta prefix: @"*"];
+    }
+
+  /* Take the delta for the whole host even if we can't forward it, so that
+   * metrics don't build up while the Control server is unavailable.
+   */
+  delta = [hostMetrics takeDelta];
+  if (nil != delta && nil != control)
+    {
+      NSMutableDictionary       *m;
+      NSData                    *d;
+
+      m = [NSMutableDictionary dictionaryWithCapacity: 3];
+      [m setObject: [NSNumber numberWithDouble: metricsStart]
+            forKey: @"Start"];
+      [m setObject: [NSNumber numberWithDouble: ti - metricsStart]
+            forKey: @"Interval"];
+      [m setObject: delta forKey: @"Series"];
+      d = [NSPropertyListSerialization
+        dataFromPropertyList: m
+        format: NSPropertyListBinaryFormat_v1_0
+        errorDescription: 0];
+      NS_DURING
+        {
+          [control metrics: d from: host];
+        }
+      NS_HANDLER
+        {
+          NSLog(@"Exception sending metrics to Control: %@", localException);
+        }
       NS_ENDHANDLER
     }
-  else
-    {
-      NSLog(@"Ping to control server when one is already in progress.");
-    }
+  metricsStart = ti;
 }
 
 - (oneway void) cmdGnip: (id <CmdPing>)from
@@ -4506,6 +6653,49 @@ NSLog(@"Problem %@", localException);
 	{
           NSString      *n = [r name];
 	  LaunchInfo	*l = [LaunchInfo existing: n];
+          double        rtt = [r pingLatest];
+
+          if (nil != data)
+            {
+              [self metrics: data from: n];
+            }
+          if (rtt >= 0.0)
+            {
+              NSTimeInterval    slowTime = [l pingSlowLimit];
+
+              [hostMetrics sample: rtt
+                              for: [n stringByAppendingString: @"/PingRTT"]];
+              [hostMetrics sample: rtt for: @"*/PingRTT"];
+
+              /* Raise an alarm while the process is answering pings much
+               * more slowly than it should, long before it would be
+               * considered hung.
+               */
+              if (slowTime <= 0.0)
+                {
+                  slowTime = pingSlowTime;      // Default
+                }
+              if (NO == [r slow] && [r pingAverage] > slowTime * 1000.0)
+                {
+                  NSString      *m;
+
+                  [r setSlow: YES];
+                  m = [NSString stringWithFormat:
+                    @"average ping response %.1fs (limit %gs)",
+                    [r pingAverage] / 1000.0, slowTime];
+                  [self alarmCode: ACProcessSlow
+                         procName: n
+                          addText: m];
+                }
+              else if (YES == [r slow]
+                && [r pingAverage] < slowTime * 500.0)
+                {
+                  [r setSlow: NO];
+                  [self clearCode: ACProcessSlow
+                         procName: n
+                          addText: @"ping responses are timely again"];
+                }
+            }
 
 	  [l setPing];	// Record the fact that we have a ping response.
 	  if ([l hungDate] > 0.0)
@@ -4574,6 +6764,7 @@ NSLog(@"Problem %@", localException);
 	}
       NS_ENDHANDLER
     }
+  [LaunchInfo journalCheckpoint];
   exit(sig);
 }
 
@@ -4727,7 +6918,7 @@ NSLog(@"Problem %@", localException);
 	    {
 	      m = @"Commands are -\n"
 	      @"Help\tAlarms\tArchive\tClear\tControl\tLaunch\tList\tMemory\t"
-              @"Quit\tRestart\tStatus\tTell\n\n"
+              @"Quit\tRestart\tRolling\tStatus\tTell\n\n"
 	      @"Type 'help' followed by a command word for details.\n"
 	      @"A command line consists of a sequence of words, "
 	      @"the first of which is the command to be executed. "
@@ -4818,6 +7009,18 @@ NSLog(@"Problem %@", localException);
 		      @"Restart self\n"
 		      @"Shuts down and starts Command server for this host.\n";
 		}
+	      else if (comp(wd, @"Rolling") >= 0)
+		{
+		  m = @"Rolling 'name' [window N] [unavailable M] [timeout S]\n"
+		      @"Restarts the named client processes (or all) in "
+		      @"batches of at most N (default 1), waiting for each "
+		      @"batch to become stable before starting the next, and "
+		      @"never letting more than M (default N) of them be "
+		      @"unavailable at once.  Gives up if a batch is not "
+		      @"stable within S seconds (default 600).\n"
+		      @"Rolling\nReports progress of the rolling restart.\n"
+		      @"Rolling stop\nAbandons the rolling restart.\n";
+		}
               else if (comp(wd, @"Resume") >= 0)
                 {
                   m = @"Resumes the launching/relaunching of tasks.\n"
@@ -4825,8 +7028,11 @@ NSLog(@"Problem %@", localException);
                 }
 	      else if (comp(wd, @"Status") >= 0)
 		{
-		  m = @"Status\nReports the status of the Command server.\n"
-		      @"Status name\nReports launch status of the process.\n";
+		  m = @"Status\nReports the status of the Command server, "
+		      @"including the resource usage of the host and of the "
+		      @"processes using the most CPU.\n"
+		      @"Status name\nReports launch status and resource "
+		      @"usage of the process.\n";
 		}
               else if (comp(wd, @"Suspend") >= 0)
                 {
@@ -5019,9 +7225,14 @@ NSLog(@"Problem %@", localException);
                         {
                           s = " hung";
                         }
+                      else if ([c slow])
+                        {
+                          s = " slow";
+                        }
 		      m = [NSString stringWithFormat:
-			@"%@%2d.   %-32.32s (pid:%d%s)\n",
-			m, i, [[c name] cString], [c processIdentifier], s];
+			@"%@%2d.   %-32.32s (pid:%d%s) %@\n",
+			m, i, [[c name] cString], [c processIdentifier], s,
+                        [c pingSummary]];
 		    }
 		}
 	    }
@@ -5068,8 +7279,8 @@ NSLog(@"Problem %@", localException);
 	  else if (comp(wd, @"limit") >= 0)
 	    {
 	      m = [NSString stringWithFormat:
-		@"Limit of concurrent launch attempts is: %u\n",
-		(unsigned)launchLimit]; 	
+		@"Limit of concurrent launch attempts is: %u (%@)\n",
+		(unsigned)launchLimit, launchLimitReason]; 	
 	    }
 	  else if (comp(wd, @"order") >= 0)
 	    {
@@ -5222,7 +7433,7 @@ NSLog(@"Problem %@", localException);
 		}
 	      else if (comp(wd, @"all") == 0)
 		{
-		  a = AUTORELEASE([clients mutableCopy]);
+		  a = [NSMutableArray arrayWithArray: [clients allObjects]];
                   reason = [NSString stringWithFormat:
                     @"Console 'restart all' from '%@'", f];
                 }
@@ -5295,6 +7506,10 @@ NSLog(@"Problem %@", localException);
 	      m = @"Restart what?.\n";
 	    }
 	}
+      else if (matchCmd(wd, @"rolling", allow))
+	{
+	  m = [self rolling: cmd from: f];
+	}
       else if (matchCmd(wd, @"resume", allow))
         {
           if (NO == launchEnabled)
@@ -5381,7 +7596,7 @@ NSLog(@"Problem %@", localException);
 	      if (comp(dest, @"all") == 0)
 		{
 		  unsigned	i;
-		  NSArray	*a = [NSArray arrayWithArray: clients];
+		  NSArray	*a = [clients allObjects];
 
 		  for (i = 0; i < [a count]; i++)
 		    {
@@ -5513,95 +7728,65 @@ NSLog(@"Problem %@", localException);
 
 - (NSData *) configurationFor: (NSString *)name
 {
-  NSMutableDictionary *dict;
-  NSString	*base;
-  NSRange	r;
-  id		o;
-  
-  if (nil == config || 0 == [name length])
+  NSMutableDictionary	*dict = [self configurationInfoFor: name];
+
+  if (nil == dict)
     {
-      return nil;	// Not available
+      return nil;
     }
+  return [NSPropertyListSerialization
+    dataFromPropertyList: dict
+    format: NSPropertyListBinaryFormat_v1_0
+    errorDescription: 0];
+}
 
-  r = [name rangeOfString: @"-"
-		  options: NSBackwardsSearch | NSLiteralSearch];
-  if (r.length > 0)
-    {
-      NSString		*inst = [name substringFromIndex: NSMaxRange(r)];
-      NSUInteger	len = [inst length];
+/* Returns the serialized configuration for the named client and sets
+ * *info to the configuration itself.  The pair is cached until the
+ * configuration version changes, so a burst of registrations (eg. after
+ * we restart) shares the work and the memory for each client name.
+ */
+- (NSData*) configurationData: (NSDictionary**)info for: (NSString*)name
+{
+  NSDictionary	*d;
+  NSData	*data;
+  NSArray	*a;
 
-      base = [name substringToIndex: r.location];
-      if ([inst length] == 0)
-	{
-	  base = nil;		// Not an instance ID after hyphen
-	}
-      else
-        {
-	  while (len-- > 0)
-	    {
-	      if (!isdigit([inst characterAtIndex: len]))
-		{
-		  base = nil;	// not positive integer after hyphen
-		  break;
-		}
-	    }
-        }
-    }
-  else
+  if (configBlobsVersion != configVersion)
     {
-      base = nil;
+      [configBlobs removeAllObjects];
+      configBlobsVersion = configVersion;
     }
-
-  dict = [NSMutableDictionary dictionaryWithCapacity: 2];
-  o = [config objectForKey: @"*"];
-  if (o != nil)
+  if (nil != (a = [configBlobs objectForKey: name]))
     {
-      [dict setObject: o forKey: @"*"];
+      *info = [a objectAtIndex: 0];
+      return [a objectAtIndex: 1];
     }
-
-  o = [config objectForKey: name];		// Lookup config
-  if (base != nil)
+  if (nil == (d = [self configurationInfoFor: name]))
     {
-      if (nil == o)
-	{
-	  /* No instance specific config found for process,
-	   * try using the base process name without instance ID.
-	   */
-	  o = [config objectForKey: base];
-	}
-      else
-	{
-	  id	tmp;
-
-	  /* We found instance specific configuration for the process,
-	   * so we merge by taking values from generic process config
-	   * (if any) and overwriting them with instance specific values.
-	   */
-	  tmp = [config objectForKey: base];
-	  if ([tmp isKindOfClass: [NSDictionary class]]
-	    && [o isKindOfClass: [NSDictionary class]])
-	    {
-	      tmp = [[tmp mutableCopy] autorelease];
-	      [tmp addEntriesFromDictionary: o];
-	      o = tmp;
-	    }
-	}
+      *info = nil;
+      return nil;
     }
-  if (o != nil)
+  data = [EcConfigDelta dataForConfig: d version: configVersion];
+  if (nil == configBlobs)
     {
-      [dict setObject: o forKey: name];
+      configBlobs = [NSMutableDictionary new];
     }
+  [configBlobs setObject: [NSArray arrayWithObjects: d, data, nil]
+		  forKey: name];
+  *info = d;
+  return data;
+}
 
-  o = [config objectForKey: @"Operators"];
-  if (o != nil)
+/* Returns the configuration to be sent to the named client (general
+ * config, the config for the process and the operators).
+ */
+- (NSMutableDictionary*) configurationInfoFor: (NSString *)name
+{
+  if (nil == config || 0 == [name length])
     {
-      [dict setObject: o forKey: @"Operators"];
+      return nil;	// Not available
     }
-
-  return [NSPropertyListSerialization
-    dataFromPropertyList: dict
-    format: NSPropertyListBinaryFormat_v1_0
-    errorDescription: 0];
+  return [EcConfigMap configurationFor: name in: config];
 }
 
 - (BOOL) connection: (NSConnection*)ancestor
@@ -5638,13 +7823,16 @@ NSLog(@"Problem %@", localException);
 	  [[self logFile]
 	    puts: @"Lost connection to control server.\n"];
 	  DESTROY(control);
+	  controlRetries = 0;
+	  controlRetryAt = [NSDate timeIntervalSinceReferenceDate]
+	    + [EcAdmission delayFor: host after: 0];
 	}
 
       /* Remove any clients using this connection from the active list.
        * Clients which have not been registered (or which have been
        * unregistered) will not be in the list.
        */
-      c = AUTORELEASE([clients mutableCopy]);
+      c = [NSMutableArray arrayWithArray: [clients allObjects]];
       i = [c count];
       while (i-- > 0)
 	{
@@ -5703,13 +7891,18 @@ NSLog(@"Problem %@", localException);
 {
   static BOOL	trying = NO;
 
-  if (nil == control && NO == trying)
+  /* After a failure we wait for a jittered, increasing, delay so that
+   * Command servers do not all hit a restarted Control server together.
+   */
+  if (nil == control && NO == trying
+    && [NSDate timeIntervalSinceReferenceDate] >= controlRetryAt)
     {
       static NSString	*oldHost = nil;
       static NSString	*oldName = nil;
       NSUserDefaults	*defs;
       NSString		*ctlName;
       NSString		*ctlHost;
+      NSTimeInterval	retry = 0.0;
       id		c;
 
       trying = YES;
@@ -5814,7 +8007,17 @@ NSLog(@"Problem %@", localException);
                     options: NSPropertyListMutableContainers
                     format: 0
                     error: 0];
-                  if ([conf objectForKey: @"rejected"] == nil)
+                  if ([conf objectForKey: @"retry"] != nil)
+                    {
+                      /* Control is admitting Command servers at a steady
+                       * rate and has reserved us a slot.
+                       */
+                      retry = [[conf objectForKey: @"retry"] doubleValue];
+                      NSLog(@"Registering %@ with Control server:"
+                        @" deferred for %.1fs", host, retry);
+                      DESTROY(control);
+                    }
+                  else if ([conf objectForKey: @"rejected"] == nil)
                     {
                       [self updateConfig: dat];
                       NSLog(@"Registered %@ with Control server", host);
@@ -5839,6 +8042,27 @@ NSLog(@"Problem %@", localException);
               [self update];
             }
         }
+      if (nil == control && retry > 0.0)
+	{
+	  /* Come back at the slot Control reserved for us (it is kept for
+	   * us, so there is no need to back off further).
+	   */
+	  controlRetryAt = [NSDate timeIntervalSinceReferenceDate] + retry;
+	}
+      else if (nil == control)
+	{
+	  controlRetryAt = [NSDate timeIntervalSinceReferenceDate]
+	    + [EcAdmission delayFor: host after: controlRetries];
+	  if (controlRetries < 32)
+	    {
+	      controlRetries++;
+	    }
+	}
+      else
+	{
+	  controlRetries = 0;
+	  controlRetryAt = 0.0;
+	}
       trying = NO;
     }
   return (nil == control) ? NO : YES;
@@ -5851,7 +8075,20 @@ NSLog(@"Problem %@", localException);
     {
       [timer invalidate];
     }
+  [beatTimer invalidate];
+  [pingTimer invalidate];
+  [rollTimer invalidate];
+  DESTROY(rolling);
+  [usageTimer invalidate];
+  DESTROY(hostUsage);
+  DESTROY(cpuAlarm);
+  DESTROY(ioAlarm);
+  DESTROY(heartbeats);
   DESTROY(control);
+  DESTROY(controlInfo);
+  DESTROY(configSource);
+  DESTROY(configBlobs);
+  DESTROY(registrations);
   RELEASE(host);
   RELEASE(clients);
   RELEASE(launchInfo);
@@ -5871,6 +8108,73 @@ NSLog(@"Problem %@", localException);
       [m appendString: @"  Launching is currently suspended.\n"];
     }
   [m appendFormat: @"  %@\n", [LaunchInfo description]];
+  if (YES == launchSpawn)
+    {
+      [m appendFormat: @"  Launches %@\n", [EcSpawnTask statistics]];
+    }
+  if ([EcPidWatch available])
+    {
+      [m appendFormat: @"  Supervision by pidfd (%u processes watched)\n",
+        [EcPidWatch count]];
+    }
+  else
+    {
+      [m appendString: @"  Supervision by polling (no pidfd support)\n"];
+    }
+  if (nil == heartbeats)
+    {
+      [m appendString: @"  Heartbeats not available\n"];
+    }
+  else
+    {
+      [m appendFormat: @"  Heartbeats from %u processes (timeout %gs)\n",
+        [heartbeats count], heartbeatTime];
+    }
+  if (nil == hostUsage)
+    {
+      [m appendString: @"  Resource usage not available\n"];
+    }
+  else
+    {
+      NSMutableArray    *a = [NSMutableArray array];
+      NSEnumerator      *e = [launchInfo objectEnumerator];
+      LaunchInfo        *l;
+      double            cpu = 0.0;
+      double            rss = 0.0;
+      double            rd = 0.0;
+      double            wr = 0.0;
+      NSUInteger        i;
+
+      [m appendFormat: @"  Host %@\n", hostUsage];
+      while (nil != (l = [e nextObject]))
+        {
+          EcProcessUsage        *u = [l usage];
+
+          if (nil != u)
+            {
+              [a addObject: l];
+              cpu += [u cpu];
+              rss += [u rss];
+              rd += [u readRate];
+              wr += [u writeRate];
+            }
+        }
+      [m appendFormat: @"  Usage of %u processes (every %gs) CPU %.1f%%,"
+        @" RSS %.1fMB, disk read %.1fKB/s, write %.1fKB/s\n",
+        (unsigned)[a count], usageTime, cpu, rss / 1048576.0,
+        rd / 1024.0, wr / 1024.0];
+      [a sortUsingFunction: usageOrder context: 0];
+      for (i = 0; i < [a count] && i < 5; i++)
+        {
+          l = [a objectAtIndex: i];
+          if ([[l usage] cpu] < 1.0)
+            {
+              break;
+            }
+          [m appendFormat: @"    %@ %@\n", [l name], [l usage]];
+        }
+    }
+  [m appendFormat: @"  Registrations %@\n", registrations];
   [m appendFormat: @"  Debug Compress/Delete after %d/%d days.\n",
     (int)debCompressAfter, (int)debDeleteAfter];
   [m appendFormat: @"  Log Compress/Delete after %d/%d days.\n",
@@ -5883,113 +8187,28 @@ NSLog(@"Problem %@", localException);
   return environment;
 }
 
-- (NSMutableArray*) findAll: (NSArray*)a
+- (NSMutableArray*) findAll: (EcClientRegistry*)a
 	     byAbbreviation: (NSString*)s
 {
-  NSMutableArray	*r = [NSMutableArray arrayWithCapacity: 4];
-  int			i;
-
-  /*
-   *	Special case - a numeric value is used as an index into the array.
-   */
-  if (isdigit(*[s cString]))
-    {
-      i = [s intValue];
-      if (i >= 0 && i < (int)[a count])
-	{
-	  [r addObject: [a objectAtIndex: i]];
-	}
-    }
-  else
-    {
-      EcClientI	*o;
-
-      for (i = 0; i < (int)[a count]; i++)
-	{
-	  o = (EcClientI*)[a objectAtIndex: i];
-	  if (comp(s, [o name]) == 0 || comp_len == (int)[s length])
-	    {
-	      [r addObject: o];
-	    }
-	}
-    }
-  return r;
+  return [a objectsForAbbreviation: s];
 }
 
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
        byAbbreviation: (NSString*)s
 {
-  EcClientI	*o;
-  int		i;
-  int		best_pos = -1;
-  int		best_len = 0;
-
-  /*
-   *	Special case - a numeric value is used as an index into the array.
-   */
-  if (isdigit(*[s cString]))
-    {
-      i = [s intValue];
-      if (i >= 0 && i < (int)[a count])
-	{
-	  return (EcClientI*)[a objectAtIndex: i];
-	}
-    }
-
-  for (i = 0; i < (int)[a count]; i++)
-    {
-      o = (EcClientI*)[a objectAtIndex: i];
-      if (comp(s, [o name]) == 0)
-	{
-	  return o;
-	}
-      if (comp_len > best_len)
-	{
-	  best_len = comp_len;
-	  best_pos = i;
-	}
-    }
-  if (best_pos >= 0)
-    {
-      return (EcClientI*)[a objectAtIndex: best_pos];
-    }
-  return nil;
+  return [a objectForAbbreviation: s];
 }
 
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
 		byName: (NSString*)s
 {
-  EcClientI	*o;
-  int		i;
-
-  for (i = 0; i < (int)[a count]; i++)
-    {
-      o = (EcClientI*)[a objectAtIndex: i];
-
-      if (comp([o name], s) == 0)
-	{
-	  return o;
-	}
-    }
-  return nil;
+  return [a objectForName: s];
 }
 
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
              byObject: (id)s
 {
-  EcClientI	*o;
-  int		i;
-
-  for (i = 0; i < (int)[a count]; i++)
-    {
-      o = (EcClientI*)[a objectAtIndex: i];
-
-      if ([o obj] == s)
-	{
-	  return o;
-	}
-    }
-  return nil;
+  return [a objectForProxy: s];
 }
 
 - (void) flush
@@ -6045,6 +8264,10 @@ NSLog(@"Problem %@", localException);
   if (nil != (self = [super initWithDefaults: defs]))
     {
       [LaunchInfo class];
+      if (nil == hostMetrics)
+        {
+          hostMetrics = [EcMetrics new];
+        }
       debUncompressed = 0.0;
       debUndeleted = 0.0;
       logUncompressed = 0.0;
@@ -6059,7 +8282,15 @@ NSLog(@"Problem %@", localException);
 	  exit(0);
 	}
       host = RETAIN([[NSHost currentHost] wellKnownName]);
-      clients = [[NSMutableArray alloc] initWithCapacity: 10];
+      clients = [EcClientRegistry new];
+
+      /* Pick up supervision of the processes we were managing when we
+       * last ran, then start with the configuration we had at that point
+       * so that we can launch processes without waiting for the Control
+       * server.
+       */
+      [LaunchInfo journalRestore: [self cmdDataDirectory]];
+      [self newConfig: nil];
     }
   return self;
 }
@@ -6330,6 +8561,33 @@ NSLog(@"Problem %@", localException);
       return [obj config];
     }
 
+  /* A new registration needs its configuration built, so when many
+   * clients arrive together (eg. after we restart) they are admitted at
+   * a steady rate and the rest are given a slot to come back at.
+   */
+  if (nil == registrations)
+    {
+      [self registrationLimits];
+    }
+  if (nil == [self findIn: clients byName: n])
+    {
+      NSTimeInterval	wait = [registrations admit: n];
+
+      if (wait > 0.0)
+	{
+	  [self logChange: @"back-off" for: n];
+	  dict = [NSMutableDictionary dictionaryWithCapacity: 2];
+	  [dict setObject: @"registration queue busy."
+		   forKey: @"back-off"];
+	  [dict setObject: [NSNumber numberWithDouble: wait]
+		   forKey: @"retry"];
+	  return [NSPropertyListSerialization
+	    dataFromPropertyList: dict
+	    format: NSPropertyListBinaryFormat_v1_0
+	    errorDescription: 0];
+	}
+    }
+
   /*
    *	Create a new reference for this client.
    */
@@ -6337,13 +8595,13 @@ NSLog(@"Problem %@", localException);
 
   if (nil == [self findIn: clients byName: n])
     {
-      NSData		*d;
+      NSDictionary	*d;
+      NSData		*data;
 
+      [obj setProcessIdentifier: p];
       [clients addObject: obj];
+      [self pingWheelAdd: obj];
       RELEASE(obj);
-      [clients sortUsingSelector: @selector(compare:)];
-
-      [obj setProcessIdentifier: p];
 
       if (nil == l)
 	{
@@ -6359,10 +8617,10 @@ NSLog(@"Problem %@", localException);
 	}
       [l setClient: obj];
       [self logChange: @"registered" for: [l name]];
-      d = [self configurationFor: n];
+      data = [self configurationData: &d for: n];
       if (nil != d)
 	{
-	  [obj setConfig: d];
+	  [obj setConfigInfo: d version: configVersion data: data];
 	}
       return [obj config];
     }
@@ -6423,7 +8681,176 @@ NSLog(@"Problem %@", localException);
     {
       [l restart: reason];
     }
-  return YES;
+  return YES;
+}
+
+- (NSString*) rolling: (NSArray*)cmd from: (NSString*)f
+{
+  NSString		*wd = cmdWord(cmd, 1);
+  NSMutableArray	*names;
+  NSArray		*a;
+  NSUInteger		window = 1;
+  NSUInteger		budget = 0;
+  NSTimeInterval	timeout = 600.0;
+  NSUInteger		index;
+
+  if ([wd length] == 0)
+    {
+      if (nil == rolling)
+	{
+	  return @"No rolling restart in progress.\n";
+	}
+      return [NSString stringWithFormat: @"%@", rolling];
+    }
+  if (comp(wd, @"stop") == 0)
+    {
+      if (nil == rolling)
+	{
+	  return @"No rolling restart in progress.\n";
+	}
+      [rolling stop: [NSString stringWithFormat:
+	@"stopped by Console 'rolling stop' from '%@'", f]];
+      [self rollOn: nil];
+      return @"Rolling restart stopped.\n";
+    }
+  /* A command we reject is not reported to Control; it did not start a
+   * rolling restart here, so it must not end one Control is waiting for.
+   */
+  if (nil != rolling)
+    {
+      return [NSString stringWithFormat:
+	@"A rolling restart is already in progress -\n%@", rolling];
+    }
+
+  for (index = 2; index + 1 < [cmd count]; index += 2)
+    {
+      NSString	*key = [cmd objectAtIndex: index];
+      int	val = [[cmd objectAtIndex: index + 1] intValue];
+
+      if (comp(key, @"window") >= 0 && val > 0)
+	{
+	  window = val;
+	}
+      else if (comp(key, @"unavailable") >= 0 && val > 0)
+	{
+	  budget = val;
+	}
+      else if (comp(key, @"timeout") >= 0 && val > 0)
+	{
+	  timeout = val;
+	}
+      else
+	{
+	  return [NSString stringWithFormat:
+	    @"Bad option '%@ %@' for rolling restart.\n",
+	    key, [cmd objectAtIndex: index + 1]];
+	}
+    }
+  if (index < [cmd count])
+    {
+      return [NSString stringWithFormat:
+	@"Missing value for '%@' in rolling restart.\n",
+	[cmd objectAtIndex: index]];
+    }
+  if (0 == budget)
+    {
+      budget = window;
+    }
+
+  if (comp(wd, @"all") == 0)
+    {
+      a = [clients allObjects];
+    }
+  else
+    {
+      a = [self findAll: clients byAbbreviation: wd];
+    }
+  names = [NSMutableArray arrayWithCapacity: [a count]];
+  for (index = 0; index < [a count]; index++)
+    {
+      NSString		*n = [[a objectAtIndex: index] name];
+      LaunchInfo	*l = [LaunchInfo existing: n];
+
+      if ([l isActive] && NO == [names containsObject: n])
+	{
+	  [names addObject: n];
+	}
+    }
+  if (0 == [names count])
+    {
+      /* Nothing here matches, which is not an error when Control is
+       * rolling the pattern across all hosts.
+       */
+      [self rolled: wd succeeded: YES];
+      return [NSString stringWithFormat:
+	@"Nothing to restart as '%@'\n", wd];
+    }
+  [names sortUsingSelector: @selector(compare:)];
+
+  rolling = [[RollingRestart alloc] initWithNames: names
+					  pattern: wd
+					     from: f
+					   window: window
+					   budget: budget
+					  timeout: timeout];
+  [rollTimer invalidate];
+  rollTimer = [NSTimer scheduledTimerWithTimeInterval: 1.0
+					       target: self
+					     selector: @selector(rollOn:)
+					     userInfo: nil
+					      repeats: YES];
+  [self rollOn: nil];
+  return [NSString stringWithFormat:
+    @"Rolling restart of %u processes started (window %u, unavailable %u,"
+    @" timeout %g).\n", (unsigned)[names count], (unsigned)window,
+    (unsigned)budget, timeout];
+}
+
+- (void) rollOn: (NSTimer*)t
+{
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  RollingRestart	*r = rolling;
+  NSString		*m;
+  BOOL			ok;
+
+  if (nil == r || NO == [r step: now])
+    {
+      return;
+    }
+
+  /* The restart has finished (or been abandoned); report to whoever
+   * asked for it and tell Control so that it can move on to another host.
+   */
+  [rollTimer invalidate];
+  rollTimer = nil;
+  rolling = nil;
+  AUTORELEASE(r);
+  ok = (nil == [r failure]) ? YES : NO;
+  m = [NSString stringWithFormat: @"%@ %@\n%@",
+    host, (YES == ok) ? @"completed" : @"failed", r];
+  NSLog(@"%@", m);
+  [self information: m from: nil to: [r requester] type: LT_CONSOLE];
+  [self rolled: [r pattern] succeeded: ok];
+}
+
+- (void) rolled: (NSString*)pattern succeeded: (BOOL)ok
+{
+  /* Control ignores this unless it is coordinating a rolling restart
+   * across hosts and is waiting for this one.
+   */
+  if ([self contactControl])
+    {
+      NS_DURING
+	{
+	  [control rolling: pattern succeeded: ok on: self];
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"Exception reporting rolling restart to Control: %@",
+	    localException);
+	}
+      NS_ENDHANDLER
+    }
 }
 
 - (NSString*) makeSpace
@@ -6822,83 +9249,19 @@ NSLog(@"Problem %@", localException);
       static unsigned	pingControlCount = 0;
       NSFileManager	*mgr;
       NSDictionary	*d;
-      NSMutableArray    *a;
       NSString          *s;
       float		f;
-      unsigned		count;
       BOOL		lost = NO;
 
       inTimeout = YES;
       [self contactControl];
 
-      a = AUTORELEASE([clients mutableCopy]);
-      count = [a count];
-      while (count-- > 0)
+      [LaunchInfo reconcileAdopted];
+      [LaunchInfo journalChanges];
+      if (journalCount >= 256)
 	{
-	  EcClientI	        *r = [a objectAtIndex: count];
-	  LaunchInfo            *l = [LaunchInfo existing: [r name]];
-	  NSDate	        *d = [r outstanding];
-          NSString              *s;
-          NSTimeInterval        delay = 0.0;
-	  
-	  if ([clients indexOfObjectIdenticalTo: r] == NSNotFound)
-	    {
-	      continue;
-	    }
-          s = [[l configuration] objectForKey: @"PingTime"];
-          if ([s respondsToSelector: @selector(intValue)])
-            {
-              delay = (NSTimeInterval)[s intValue];
-            }
-          if (delay <= 0.0)
-            {
-              delay = pingTime;        // Default
-            }
-	  if (d != nil && [d timeIntervalSinceDate: now] < -delay)
-	    {
-	      if ([l hungDate] > 0.0)
-                {
-                  id    r;
-
-                  /* We have what looks like a hung process:
-                   * See if it is not yet stopping and is configured to
-                   * restart after an interval when hung.
-                   */
-                  if (NO == [l isStopping]
-                    && (r = [[l configuration] objectForKey: @"HungTime"])
-                    && [r respondsToSelector: @selector(intValue)])
-                    {
-                      NSTimeInterval    ti;
-
-                      /* See how long the process has been hung for,
-                       * and if it exceeds the time allowed, restart.
-                       */
-                      ti = [now timeIntervalSinceReferenceDate];
-                      ti -= [l hungDate];
-                      if (ti > (NSTimeInterval)[r intValue])
-                        {
-                          [self hungRestart: l];
-                        }
-                    }
-                }
-              else
-		{
-		  NSString	*m;
-
-		  [l setHung: NO];
-		  m = [NSString stringWithFormat:
-		    @"failed to respond for over %d seconds", (int)delay];
-		  [self alarmCode: ACProcessHung
-			 procName: [r name]
-			  addText: m];
-		  m = [NSString stringWithFormat: cmdLogFormat(LT_CONSOLE,
-		    @"Client '%@' failed to respond for over %d seconds"),
-		    [r name], (int)delay];
-		  [self information: m from: nil to: nil type: LT_CONSOLE];
-		}
-	    }
+	  [LaunchInfo journalCheckpoint];
 	}
-      [a removeAllObjects];
 
       if (control != nil && outstanding != nil
 	&& [outstanding timeIntervalSinceDate: now] < -pingTime)
@@ -6916,19 +9279,8 @@ NSLog(@"Problem %@", localException);
 	{
 	  [self update];
 	}
-      /* We ping each client in turn.
+      /* Clients are checked and pinged by the ping wheel.
        */
-      a = AUTORELEASE([clients mutableCopy]);
-      count = [a count];
-      while (count-- > 0)
-	{
-	  EcClientI	*r = [a objectAtIndex: count];
-
-          if ([clients indexOfObjectIdenticalTo: r] != NSNotFound)
-            {
-              [r ping];
-            }
-	}
       // Ping the control server too - once every four times.
       pingControlCount++;
       if (pingControlCount >= 4)
@@ -6940,6 +9292,10 @@ NSLog(@"Problem %@", localException);
 	  [self pingControl];
 	}
 
+      /* Pass on aggregated metrics (at most once every ten seconds).
+       */
+      [self metricsForward: now];
+
       /* See if the filesystem containing our logging directory has enough
        * space.
        */
@@ -7147,6 +9503,209 @@ NSLog(@"Problem %@", localException);
     }
 }
 
+- (void) pingWheelAdd: (EcClientI*)r
+{
+  NSUInteger	best;
+  NSUInteger	least;
+  unsigned	start;
+  unsigned	i;
+
+  if (nil == pingWheel)
+    {
+      pingWheel = [[NSMutableArray alloc] initWithCapacity: PING_SLOTS];
+      for (i = 0; i < PING_SLOTS; i++)
+	{
+	  [pingWheel addObject: [NSMutableArray array]];
+	}
+    }
+
+  /* Use the least busy slot, starting the search at a point jittered
+   * by the name of the client so that clients registering together are
+   * scattered over the wheel.
+   */
+  start = (unsigned)([EcAdmission jitterFor: [r name] count: pingHand]
+    * PING_SLOTS) % PING_SLOTS;
+  best = start;
+  least = NSNotFound;
+  for (i = 0; i < PING_SLOTS; i++)
+    {
+      unsigned		index = (start + i) % PING_SLOTS;
+      NSUInteger	c = [[pingWheel objectAtIndex: index] count];
+
+      if (c < least)
+	{
+	  least = c;
+	  best = index;
+	}
+    }
+  [[pingWheel objectAtIndex: best] addObject: r];
+}
+
+- (void) pingWheelTurn: (NSTimer*)t
+{
+  NSMutableArray	*slot;
+  NSTimeInterval	now;
+  NSUInteger		count;
+
+  if (nil == pingWheel || YES == [self ecIsQuitting])
+    {
+      return;
+    }
+  slot = [pingWheel objectAtIndex: pingHand];
+  pingHand = (pingHand + 1) % PING_SLOTS;
+  if (0 == (count = [slot count]))
+    {
+      return;
+    }
+  now = [NSDate timeIntervalSinceReferenceDate];
+  ENTER_POOL
+  while (count-- > 0)
+    {
+      EcClientI		*r = [slot objectAtIndex: count];
+      LaunchInfo	*l;
+      NSDate		*d;
+      NSTimeInterval	delay;
+
+      /* Clients are dropped from the wheel when next due after they
+       * have been removed.
+       */
+      if (YES == [r unregistered])
+	{
+	  [slot removeObjectAtIndex: count];
+	  continue;
+	}
+      l = [LaunchInfo existing: [r name]];
+      d = [r outstanding];
+      delay = [l pingLimit];
+      if (delay <= 0.0)
+	{
+	  delay = pingTime;        // Default
+	}
+      if (d != nil && now - [d timeIntervalSinceReferenceDate] > delay)
+	{
+	  if ([l hungDate] > 0.0)
+	    {
+	      /* We have what looks like a hung process:
+	       * See if it is not yet stopping and is configured to
+	       * restart after an interval when hung.
+	       */
+	      if (NO == [l isStopping] && [l hungLimit] >= 0.0
+		&& now - [l hungDate] > [l hungLimit])
+		{
+		  [self hungRestart: l];
+		}
+	    }
+	  else
+	    {
+	      NSString	*m;
+
+	      [l setHung: NO];
+	      m = [NSString stringWithFormat:
+		@"failed to respond for over %d seconds", (int)delay];
+	      [self alarmCode: ACProcessHung
+		     procName: [r name]
+		      addText: m];
+	      m = [NSString stringWithFormat: cmdLogFormat(LT_CONSOLE,
+		@"Client '%@' failed to respond for over %d seconds"),
+		[r name], (int)delay];
+	      [self information: m from: nil to: nil type: LT_CONSOLE];
+	    }
+	}
+      if (NO == [r unregistered])
+	{
+	  [r ping];
+	}
+    }
+  LEAVE_POOL
+}
+
+- (void) heartbeats: (NSTimer*)t
+{
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  unsigned		count = [heartbeats slots];
+  unsigned		i;
+
+  if (YES == [self ecIsQuitting])
+    {
+      return;
+    }
+  for (i = 0; i < count; i++)
+    {
+      EcClientI		*r;
+      LaunchInfo	*l;
+      NSTimeInterval	when;
+      NSTimeInterval	stalled;
+      NSTimeInterval	delay;
+      uint64_t		beats;
+      id		o;
+      int		p;
+
+      if (0 == (p = [heartbeats processAtSlot: i beats: &beats when: &when]))
+	{
+	  continue;
+	}
+      if (nil == (r = [clients objectForProcessIdentifier: p]))
+	{
+	  /* Free a slot left behind by a process which has ended without
+	   * being removed (eg. one which never registered with us).
+	   */
+	  if (kill(p, 0) < 0 && ESRCH == errno)
+	    {
+	      [heartbeats releaseSlot: i];
+	    }
+	  continue;
+	}
+      stalled = [r heartbeat: beats stamp: when at: now];
+      l = [LaunchInfo existing: [r name]];
+      delay = [l heartbeatLimit];
+      if (delay <= 0.0)
+	{
+	  delay = heartbeatTime;	// Default
+	}
+
+      if (stalled <= delay)
+	{
+	  if (YES == [r stalled] && 0.0 == stalled)
+	    {
+	      /* Beating again, so the process is no longer hung.
+	       */
+	      [r setStalled: NO];
+	      if ([l hungDate] > 0.0)
+		{
+		  [l clearHung];
+		}
+	    }
+	}
+      else if ([l hungDate] > 0.0)
+	{
+	  /* Still hung: restart if configured to do so after an interval
+	   * and the process is not already stopping.
+	   */
+	  if (NO == [l isStopping] && [l hungLimit] >= 0.0
+	    && now - [l hungDate] > [l hungLimit])
+	    {
+	      [self hungRestart: l];
+	    }
+	}
+      else if (NO == [r stalled] && NO == [l isStopping])
+	{
+	  NSString	*m;
+
+	  [r setStalled: YES];
+	  [l setHung: NO];
+	  m = [NSString stringWithFormat:
+	    @"no heartbeat for over %d seconds", (int)delay];
+	  [self alarmCode: ACProcessHung
+		 procName: [r name]
+		  addText: m];
+	  m = [NSString stringWithFormat: cmdLogFormat(LT_CONSOLE,
+	    @"Client '%@' has had no heartbeat for over %d seconds"),
+	    [r name], (int)delay];
+	  [self information: m from: nil to: nil type: LT_CONSOLE];
+	}
+    }
+}
+
 static NSMapTable	*dumpTasks = nil;
 
 - (void) hungDump: (LaunchInfo*)l
@@ -7342,6 +9901,27 @@ static NSMapTable	*dumpTasks = nil;
   return a;
 }
 
+- (void) registrationLimits
+{
+  NSUserDefaults	*defs = [self cmdDefaults];
+  double		rate = [defs doubleForKey: @"RegistrationRate"];
+  NSInteger		burst = [defs integerForKey: @"RegistrationBurst"];
+
+  if (rate <= 0.0)
+    {
+      rate = 20.0;
+    }
+  if (burst < 1)
+    {
+      burst = 20;
+    }
+  if (nil == registrations)
+    {
+      registrations = [EcAdmission new];
+    }
+  [registrations setRate: rate burst: (unsigned)burst];
+}
+
 - (void) removeClient: (EcClientI*)o cleanly: (BOOL)ok
 {
   NSString      *name = AUTORELEASE(RETAIN([o name]));
@@ -7353,6 +9933,10 @@ static NSMapTable	*dumpTasks = nil;
     {
       [clients removeObjectAtIndex: i];
     }
+  /* If the process is still running it will claim a new slot the next
+   * time it beats.
+   */
+  [heartbeats releaseProcess: [o processIdentifier]];
   if (ok)
     {
       [self logChange: @"unregistered" for: name];
@@ -7425,11 +10009,7 @@ NSLog(@"Unregister with status %d", s);
 - (void) updateConfig: (NSData*)data
 {
   NSMutableDictionary	*info;
-  NSMutableDictionary	*dict;
-  NSMutableDictionary	*newConfig;
-  NSDictionary		*operators;
-  NSEnumerator		*enumerator;
-  NSString		*key;
+  uint64_t		version;
 
   /* Ignore invalid/empty configuration
    */
@@ -7437,6 +10017,8 @@ NSLog(@"Unregister with status %d", s);
     {
       return;
     }
+  controlReceived = [NSDate timeIntervalSinceReferenceDate];
+  controlBytes = [data length];
   info = [NSPropertyListSerialization
     propertyListWithData: data
     options: NSPropertyListMutableContainers
@@ -7447,6 +10029,61 @@ NSLog(@"Unregister with status %d", s);
     {
       return;
     }
+  version = [EcConfigDelta takeVersion: info];
+  ASSIGN(controlInfo, info);
+  controlVersion = version;
+  [self updateConfigInfo: info];
+}
+
+/* Applies a delta from the Control server to the configuration it last
+ * sent.  If the delta is not against that version (or does not produce
+ * the expected result) we ask for the full configuration instead.
+ */
+- (oneway void) updateConfigDelta: (NSData*)data
+{
+  NSMutableDictionary	*delta;
+  NSMutableDictionary	*info;
+
+  controlReceived = [NSDate timeIntervalSinceReferenceDate];
+  controlBytes = [data length];
+  delta = [NSPropertyListSerialization
+    propertyListWithData: data
+    options: NSPropertyListMutableContainers
+    format: 0
+    error: 0];
+  info = [EcConfigDelta apply: delta to: controlInfo version: controlVersion];
+  if (nil == info)
+    {
+      NSLog(@"Unable to apply config delta from %llu (have %llu)",
+	[[delta objectForKey: @"Base"] unsignedLongLongValue],
+	(unsigned long long)controlVersion);
+      NS_DURING
+	{
+	  [control requestConfigFor: self];
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"Requesting config from Control server: %@", localException);
+	}
+      NS_ENDHANDLER
+      return;
+    }
+  ASSIGN(controlInfo, info);
+  controlVersion = [[delta objectForKey: @"Version"] unsignedLongLongValue];
+  [self updateConfigInfo: info];
+}
+
+/* Builds the configuration for this host from the information supplied
+ * by the Control server.
+ */
+- (void) updateConfigInfo: (NSMutableDictionary*)info
+{
+  NSMutableDictionary	*dict;
+  NSMutableDictionary	*newConfig;
+  NSDictionary		*operators;
+  NSDictionary		*trace;
+  NSEnumerator		*enumerator;
+  NSString		*key;
 
   newConfig = [NSMutableDictionary dictionaryWithCapacity: 32];
   /*
@@ -7500,6 +10137,12 @@ NSLog(@"Unregister with status %d", s);
 	    {
 	      NSEnumerator	*another = [general keyEnumerator];
 
+	      /* The host specific dictionary is shared with the info
+	       * from the Control server (to which later deltas apply),
+	       * so we must merge into a copy.
+	       */
+	      partial = AUTORELEASE([partial mutableCopy]);
+	      [newConfig setObject: partial forKey: app];
 	      /*
 	       *	Merge in any values for this application which
 	       *	exist in the general stuff, but not in the host
@@ -7534,11 +10177,206 @@ NSLog(@"Unregister with status %d", s);
     }
   [self ecOperators: operators];
 
+  /* If the change is being traced, add our hop and pass the trace on
+   * to the clients.  The time we send it on is added once -newConfig:
+   * has finished building the configuration.
+   */
+  trace = [info objectForKey: EC_CONFIG_TRACE];
+  if (nil != trace)
+    {
+      trace = [EcConfigDelta trace: trace addHop:
+	[NSDictionary dictionaryWithObjectsAndKeys:
+	  [self cmdName], @"Name",
+	  host, @"Host",
+	  [NSNumber numberWithDouble: controlReceived], @"Received",
+	  [NSNumber numberWithUnsignedInteger: controlBytes], @"Bytes",
+	  nil]];
+      if (nil != trace)
+	{
+	  [newConfig setObject: trace forKey: EC_CONFIG_TRACE];
+	}
+    }
+
   /* Finally, replace old config with new if they differ.
    */
   [self newConfig: newConfig];
 }
 
+- (void) usageSample: (NSTimer*)t
+{
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  NSEnumerator		*e;
+  LaunchInfo		*l;
+
+  ENTER_POOL
+  e = [launchInfo objectEnumerator];
+  while (nil != (l = [e nextObject]))
+    {
+      EcProcessUsage	*u = [l sampleUsage];
+      NSString		*n = [l name];
+      double		cpu;
+
+      if ((nil == u || 0.0 == [u interval]) && YES == [l busy])
+        {
+          /* The busy process has ended (even if it has been replaced).
+           */
+          [l setBusy: NO];
+          [l setBusyDate: 0.0];
+          [self clearCode: ACProcessBusy
+                 procName: n
+                  addText: @"process is no longer running"];
+        }
+      if (nil == u || 0.0 == [u interval])
+        {
+          continue;     // No rates until we have two samples
+        }
+      cpu = [u cpu];
+      [hostMetrics sample: cpu for: [n stringByAppendingString: @"/CPU"]];
+      [hostMetrics sample: [u rss] / 1048576.0
+                      for: [n stringByAppendingString: @"/RSS"]];
+
+      /* A process which keeps a CPU busy for a long time is probably
+       * looping, whether or not it still responds to pings.
+       */
+      if (cpu >= usageCPU)
+        {
+          if (0.0 == [l busyDate])
+            {
+              [l setBusyDate: now];
+            }
+          else if (NO == [l busy] && now - [l busyDate] >= usageSustain)
+            {
+              NSString  *m;
+
+              [l setBusy: YES];
+              m = [NSString stringWithFormat:
+                @"CPU usage %.1f%% (limit %g%%) for %d seconds",
+                cpu, usageCPU, (int)(now - [l busyDate])];
+              [self alarmCode: ACProcessBusy procName: n addText: m];
+            }
+        }
+      else if (cpu < usageCPU * 0.8)
+        {
+          [l setBusyDate: 0.0];
+          if (YES == [l busy])
+            {
+              [l setBusy: NO];
+              [self clearCode: ACProcessBusy
+                     procName: n
+                      addText: @"CPU usage is normal again"];
+            }
+        }
+    }
+
+  if (YES == [hostUsage sample] && [hostUsage interval] > 0.0)
+    {
+      double    cpu = [hostUsage cpuBusy];
+      double    io = [hostUsage diskBusy];
+
+      [hostMetrics sample: cpu for: @"Host/CPU"];
+      [hostMetrics sample: [hostUsage cpuWait] for: @"Host/IOWait"];
+      [hostMetrics sample: io for: @"Host/DiskBusy"];
+      [hostMetrics sample: [hostUsage memAvailable] / 1048576.0
+                      for: @"Host/MemAvailable"];
+
+      if (cpu >= usageCPU)
+        {
+          if (0.0 == cpuBusyDate)
+            {
+              cpuBusyDate = now;
+            }
+          else if (nil == cpuAlarm && now - cpuBusyDate >= usageSustain)
+            {
+              NSString  *m;
+
+              m = [NSString stringWithFormat:
+                @"CPU %.1f%% busy (limit %g%%) for %d seconds",
+                cpu, usageCPU, (int)(now - cpuBusyDate)];
+              cpuAlarm = RETAIN([EcAlarm alarmForManagedObject: nil
+                at: nil
+                withEventType: EcAlarmEventTypeProcessingError
+                probableCause: EcAlarmCpuCyclesLimitExceeded
+                specificProblem: @"Host CPU saturated"
+                perceivedSeverity: EcAlarmSeverityMajor
+                proposedRepairAction: @"Find and deal with the processes"
+                  @" using the CPU, or move load to other hosts"
+                additionalText: m]);
+              [self alarm: cpuAlarm];
+            }
+        }
+      else if (cpu < usageCPU * 0.8)
+        {
+          cpuBusyDate = 0.0;
+          if (nil != cpuAlarm)
+            {
+              EcAlarm   *a = [cpuAlarm clear];
+
+              DESTROY(cpuAlarm);
+              [self alarm: a];
+            }
+        }
+
+      if (io >= usageIO)
+        {
+          if (0.0 == ioBusyDate)
+            {
+              ioBusyDate = now;
+            }
+          else if (nil == ioAlarm && now - ioBusyDate >= usageSustain)
+            {
+              NSString  *m;
+
+              m = [NSString stringWithFormat:
+                @"disk %@ %.1f%% busy (limit %g%%) for %d seconds",
+                [hostUsage diskName], io, usageIO, (int)(now - ioBusyDate)];
+              ioAlarm = RETAIN([EcAlarm alarmForManagedObject: nil
+                at: nil
+                withEventType: EcAlarmEventTypeQualityOfService
+                probableCause: EcAlarmResourceAtOrNearingCapacity
+                specificProblem: @"Host disk I/O saturated"
+                perceivedSeverity: EcAlarmSeverityMajor
+                proposedRepairAction: @"Find and deal with the processes"
+                  @" performing I/O (see 'status' for their rates)"
+                additionalText: m]);
+              [self alarm: ioAlarm];
+            }
+        }
+      else if (io < usageIO * 0.8)
+        {
+          ioBusyDate = 0.0;
+          if (nil != ioAlarm)
+            {
+              EcAlarm   *a = [ioAlarm clear];
+
+              DESTROY(ioAlarm);
+              [self alarm: a];
+            }
+        }
+    }
+  LEAVE_POOL
+}
+
+- (void) usageStart
+{
+  [usageTimer invalidate];
+  usageTimer = nil;
+  if (nil == hostUsage)
+    {
+      hostUsage = [EcHostUsage new];
+    }
+  if (NO == [hostUsage sample])
+    {
+      NSLog(@"Resource usage is not available (unable to read /proc/stat)");
+      DESTROY(hostUsage);
+      return;
+    }
+  usageTimer = [NSTimer scheduledTimerWithTimeInterval: usageTime
+                                                target: self
+                                              selector: @selector(usageSample:)
+                                              userInfo: nil
+                                               repeats: YES];
+}
+
 - (void) woken: (id)obj
 {
   EcClientI     *o = [self findIn: clients byObject: obj];
@@ -0,0 +1,164 @@
+/** Enterprise Control Configuration and Logging
+    -- versioned configuration deltas
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#ifndef	INCLUDED_ECCONFIGDELTA_H
+#define	INCLUDED_ECCONFIGDELTA_H
+
+#import <Foundation/NSObject.h>
+
+@class	NSData;
+@class	NSDictionary;
+@class	NSMutableDictionary;
+@class	NSString;
+
+/** The key under which the version number of a configuration is stored
+ * in the top level dictionary of a full configuration update.
+ */
+#define	EC_CONFIG_VERSION	@"EcConfigVersion"
+
+/** The key under which the Control server stores a digest identifying
+ * the configuration it sends to a Command server.  The digest changes
+ * whenever the configuration for the host changes.
+ */
+#define	EC_CONFIG_SOURCE	@"EcConfigSource"
+
+/** <p>The key under which a configuration may carry a trace of its
+ * propagation.  When the Control server is run with the ConfigTrace
+ * default set, each configuration change it sends out carries a trace
+ * dictionary containing an Id (unique to the change) and an array of
+ * Hops.  Each process the change passes through appends a hop
+ * dictionary with its Name and Host and some of -
+ * </p>
+ * <deflist>
+ *   <term>Started</term>
+ *   <desc>When the Control server began reading its configuration.</desc>
+ *   <term>Received</term>
+ *   <desc>When the change arrived.</desc>
+ *   <term>Bytes</term>
+ *   <desc>The size of the message which carried the change.</desc>
+ *   <term>Mapped</term>
+ *   <desc>Set if the change was read from a mapped configuration file
+ *   (in which case Bytes is zero).</desc>
+ *   <term>Sent</term>
+ *   <desc>When the change was passed on to the next hop.</desc>
+ *   <term>Applied</term>
+ *   <desc>When a client process finished its -cmdUpdate: method.</desc>
+ * </deflist>
+ * <p>Times are in seconds since the reference date, so the delay of a
+ * hop between hosts includes any difference between their clocks.<br />
+ * A client process keeps the trace of the last change it received and
+ * returns it from EcTestGetConfig() when asked for this key.
+ * </p>
+ */
+#define	EC_CONFIG_TRACE		@"EcConfigTrace"
+
+/** <p>The EcConfigDelta class provides the encoding used to pass
+ * configuration from the Control server to Command servers and from
+ * Command servers to their clients.
+ * </p>
+ * <p>Each configuration sent carries a version number (which increases
+ * each time the sender's configuration changes).  A full configuration
+ * is the usual configuration dictionary with the version stored under
+ * the EC_CONFIG_VERSION key.  Once a receiver holds a version, later
+ * changes are sent as a delta against that version: a dictionary
+ * containing -
+ * </p>
+ * <deflist>
+ *   <term>Base</term>
+ *   <desc>The version the delta must be applied to.</desc>
+ *   <term>Version</term>
+ *   <desc>The version produced by applying the delta.</desc>
+ *   <term>Set</term>
+ *   <desc>The keys whose values are new or replaced.</desc>
+ *   <term>Remove</term>
+ *   <desc>An array of the keys which have been removed.</desc>
+ *   <term>Changed</term>
+ *   <desc>A delta (containing only Set, Remove and Changed) for each key
+ *   whose value is a dictionary in both the old and new configuration.
+ *   </desc>
+ *   <term>Hashes</term>
+ *   <desc>The digest of the new value of each top level key modified by
+ *   the delta.</desc>
+ * </deflist>
+ * <p>A receiver whose version differs from the base (or whose result
+ * does not match the hashes) discards the delta and asks the sender for
+ * a full configuration using the -requestConfigFor: method.
+ * </p>
+ */
+@interface EcConfigDelta : NSObject
+
+/** Applies the delta to a configuration whose version is given, and
+ * returns the resulting configuration (without a version number).<br />
+ * Unmodified parts of the configuration are shared with the original.
+ * <br />
+ * Returns nil if the delta does not apply to the version, or if the
+ * result does not match the digests in the delta (in which case the
+ * receiver needs a full configuration).
+ */
++ (NSMutableDictionary*) apply: (NSDictionary*)delta
+			    to: (NSDictionary*)config
+		       version: (uint64_t)version;
+
+/** Returns the serialized form of a full configuration carrying the
+ * specified version number.
+ */
++ (NSData*) dataForConfig: (NSDictionary*)config version: (uint64_t)version;
+
+/** Returns the serialized delta to change the old configuration (with
+ * the base version) to the new one (with the new version), or nil if the
+ * two configurations are equal.
+ */
++ (NSData*) deltaFrom: (NSDictionary*)old
+	      version: (uint64_t)base
+		   to: (NSDictionary*)config
+	      version: (uint64_t)version;
+
+/** Returns YES if the two configurations are equal apart from the value
+ * of their EC_CONFIG_TRACE keys, so that a sender need not pass on a
+ * change in the trace alone.
+ */
++ (BOOL) config: (NSDictionary*)a isEqualTo: (NSDictionary*)b;
+
+/** Returns the hexadecimal digest of a property list.  Dictionaries are
+ * digested in key order, so equal property lists have equal digests no
+ * matter how they were built.
+ */
++ (NSString*) digest: (id)plist;
+
+/** Returns a copy of the trace with the hop appended, or nil if the trace
+ * is not a dictionary.
+ */
++ (NSDictionary*) trace: (NSDictionary*)trace addHop: (NSDictionary*)hop;
+
+/** Removes the version number from a full configuration and returns it
+ * (or zero if the configuration does not have a version).
+ */
++ (uint64_t) takeVersion: (NSMutableDictionary*)config;
+
+@end
+
+#endif
+
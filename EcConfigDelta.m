@@ -0,0 +1,422 @@
+/** Enterprise Control Configuration and Logging
+    -- versioned configuration deltas
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/Foundation.h>
+
+#import "EcConfigDelta.h"
+
+static Class	arrayClass = Nil;
+static Class	dataClass = Nil;
+static Class	dictionaryClass = Nil;
+static Class	stringClass = Nil;
+
+static NSComparisonResult
+keyOrder(id a, id b, void *context)
+{
+  return [[a description] compare: [b description]];
+}
+
+/* Appends a tagged, length prefixed encoding of the property list to the
+ * data, so that different property lists can not produce the same bytes.
+ */
+static void
+digestAppend(NSMutableData *m, id o)
+{
+  char		buf[32];
+  int		len;
+
+  if ([o isKindOfClass: stringClass])
+    {
+      NSData	*d = [o dataUsingEncoding: NSUTF8StringEncoding];
+
+      len = snprintf(buf, sizeof(buf), "s%lu:", (unsigned long)[d length]);
+      [m appendBytes: buf length: len];
+      [m appendData: d];
+    }
+  else if ([o isKindOfClass: dataClass])
+    {
+      len = snprintf(buf, sizeof(buf), "d%lu:", (unsigned long)[o length]);
+      [m appendBytes: buf length: len];
+      [m appendData: o];
+    }
+  else if ([o isKindOfClass: arrayClass])
+    {
+      NSUInteger	c = [o count];
+      NSUInteger	i;
+
+      len = snprintf(buf, sizeof(buf), "a%lu:", (unsigned long)c);
+      [m appendBytes: buf length: len];
+      for (i = 0; i < c; i++)
+	{
+	  digestAppend(m, [o objectAtIndex: i]);
+	}
+    }
+  else if ([o isKindOfClass: dictionaryClass])
+    {
+      NSArray		*keys;
+      NSUInteger	c = [o count];
+      NSUInteger	i;
+
+      keys = [[o allKeys] sortedArrayUsingFunction: keyOrder context: 0];
+      len = snprintf(buf, sizeof(buf), "D%lu:", (unsigned long)c);
+      [m appendBytes: buf length: len];
+      for (i = 0; i < c; i++)
+	{
+	  id	k = [keys objectAtIndex: i];
+
+	  digestAppend(m, k);
+	  digestAppend(m, [o objectForKey: k]);
+	}
+    }
+  else
+    {
+      NSData	*d;
+
+      /* Numbers and dates are digested using their text form.
+       */
+      d = [[o description] dataUsingEncoding: NSUTF8StringEncoding];
+      len = snprintf(buf, sizeof(buf), "o%lu:", (unsigned long)[d length]);
+      [m appendBytes: buf length: len];
+      [m appendData: d];
+    }
+}
+
+/* Returns the delta to change the old dictionary into the new one, or nil
+ * if they are equal.
+ */
+static NSMutableDictionary*
+diff(NSDictionary *old, NSDictionary *new)
+{
+  NSMutableDictionary	*set = nil;
+  NSMutableDictionary	*changed = nil;
+  NSMutableArray	*remove = nil;
+  NSMutableDictionary	*result;
+  NSEnumerator		*enumerator;
+  id			key;
+
+  enumerator = [new keyEnumerator];
+  while (nil != (key = [enumerator nextObject]))
+    {
+      id	n = [new objectForKey: key];
+      id	o = [old objectForKey: key];
+
+      if (o == n || [o isEqual: n])
+	{
+	  continue;
+	}
+      if ([o isKindOfClass: dictionaryClass]
+	&& [n isKindOfClass: dictionaryClass])
+	{
+	  NSMutableDictionary	*d = diff(o, n);
+
+	  if (nil != d)
+	    {
+	      if (nil == changed)
+		{
+		  changed = [NSMutableDictionary dictionary];
+		}
+	      [changed setObject: d forKey: key];
+	    }
+	}
+      else
+	{
+	  if (nil == set)
+	    {
+	      set = [NSMutableDictionary dictionary];
+	    }
+	  [set setObject: n forKey: key];
+	}
+    }
+  enumerator = [old keyEnumerator];
+  while (nil != (key = [enumerator nextObject]))
+    {
+      if (nil == [new objectForKey: key])
+	{
+	  if (nil == remove)
+	    {
+	      remove = [NSMutableArray array];
+	    }
+	  [remove addObject: key];
+	}
+    }
+  if (nil == set && nil == changed && nil == remove)
+    {
+      return nil;
+    }
+  result = [NSMutableDictionary dictionaryWithCapacity: 6];
+  if (nil != set)
+    {
+      [result setObject: set forKey: @"Set"];
+    }
+  if (nil != changed)
+    {
+      [result setObject: changed forKey: @"Changed"];
+    }
+  if (nil != remove)
+    {
+      [result setObject: remove forKey: @"Remove"];
+    }
+  return result;
+}
+
+/* Returns the result of applying the delta to the dictionary, copying
+ * only the dictionaries which are modified.
+ */
+static NSMutableDictionary*
+patch(NSDictionary *config, NSDictionary *delta)
+{
+  NSMutableDictionary	*m;
+  NSEnumerator		*enumerator;
+  NSDictionary		*d;
+  id			key;
+
+  if (nil == config)
+    {
+      m = [NSMutableDictionary dictionary];
+    }
+  else
+    {
+      m = AUTORELEASE([config mutableCopy]);
+    }
+  [m removeObjectsForKeys: [delta objectForKey: @"Remove"]];
+  d = [delta objectForKey: @"Set"];
+  if ([d isKindOfClass: dictionaryClass])
+    {
+      [m addEntriesFromDictionary: d];
+    }
+  d = [delta objectForKey: @"Changed"];
+  enumerator = [d keyEnumerator];
+  while (nil != (key = [enumerator nextObject]))
+    {
+      id	o = [m objectForKey: key];
+
+      if (NO == [o isKindOfClass: dictionaryClass])
+	{
+	  return nil;
+	}
+      if (nil == (o = patch(o, [d objectForKey: key])))
+	{
+	  return nil;
+	}
+      [m setObject: o forKey: key];
+    }
+  return m;
+}
+
+@implementation EcConfigDelta
+
++ (void) initialize
+{
+  if (Nil == arrayClass)
+    {
+      arrayClass = [NSArray class];
+      dataClass = [NSData class];
+      dictionaryClass = [NSDictionary class];
+      stringClass = [NSString class];
+    }
+}
+
++ (NSMutableDictionary*) apply: (NSDictionary*)delta
+			    to: (NSDictionary*)config
+		       version: (uint64_t)version
+{
+  NSMutableDictionary	*m;
+  NSDictionary		*hashes;
+  NSEnumerator		*enumerator;
+  NSString		*key;
+
+  if (0 == version || nil == config
+    || NO == [delta isKindOfClass: dictionaryClass]
+    || [[delta objectForKey: @"Base"] unsignedLongLongValue] != version)
+    {
+      return nil;
+    }
+  if (nil == (m = patch(config, delta)))
+    {
+      return nil;
+    }
+  hashes = [delta objectForKey: @"Hashes"];
+  enumerator = [hashes keyEnumerator];
+  while (nil != (key = [enumerator nextObject]))
+    {
+      NSString	*h = [self digest: [m objectForKey: key]];
+
+      if (NO == [h isEqual: [hashes objectForKey: key]])
+	{
+	  return nil;
+	}
+    }
+  return m;
+}
+
++ (NSData*) dataForConfig: (NSDictionary*)config version: (uint64_t)version
+{
+  NSMutableDictionary	*m;
+
+  m = [NSMutableDictionary dictionaryWithCapacity: [config count] + 1];
+  [m addEntriesFromDictionary: config];
+  [m setObject: [NSNumber numberWithUnsignedLongLong: version]
+	forKey: EC_CONFIG_VERSION];
+  return [NSPropertyListSerialization
+    dataFromPropertyList: m
+    format: NSPropertyListBinaryFormat_v1_0
+    errorDescription: 0];
+}
+
++ (NSData*) deltaFrom: (NSDictionary*)old
+	      version: (uint64_t)base
+		   to: (NSDictionary*)config
+	      version: (uint64_t)version
+{
+  NSMutableDictionary	*delta = diff(old, config);
+  NSMutableDictionary	*hashes;
+  NSEnumerator		*enumerator;
+  NSString		*key;
+
+  if (nil == delta)
+    {
+      return nil;
+    }
+
+  /* Every top level value which is set or changed has its digest sent
+   * so that the receiver can check it has the same result.
+   */
+  hashes = [NSMutableDictionary dictionaryWithCapacity: 8];
+  enumerator = [[delta objectForKey: @"Set"] keyEnumerator];
+  while (nil != (key = [enumerator nextObject]))
+    {
+      [hashes setObject: [self digest: [config objectForKey: key]]
+		 forKey: key];
+    }
+  enumerator = [[delta objectForKey: @"Changed"] keyEnumerator];
+  while (nil != (key = [enumerator nextObject]))
+    {
+      [hashes setObject: [self digest: [config objectForKey: key]]
+		 forKey: key];
+    }
+  [delta setObject: hashes forKey: @"Hashes"];
+  [delta setObject: [NSNumber numberWithUnsignedLongLong: base]
+	    forKey: @"Base"];
+  [delta setObject: [NSNumber numberWithUnsignedLongLong: version]
+	    forKey: @"Version"];
+  return [NSPropertyListSerialization
+    dataFromPropertyList: delta
+    format: NSPropertyListBinaryFormat_v1_0
+    errorDescription: 0];
+}
+
++ (BOOL) config: (NSDictionary*)a isEqualTo: (NSDictionary*)b
+{
+  NSEnumerator	*enumerator;
+  NSUInteger	ca;
+  NSUInteger	cb;
+  id		key;
+
+  if (a == b)
+    {
+      return YES;
+    }
+  if (nil == a || nil == b)
+    {
+      return NO;
+    }
+  ca = [a count];
+  if (nil != [a objectForKey: EC_CONFIG_TRACE])
+    {
+      ca--;
+    }
+  cb = [b count];
+  if (nil != [b objectForKey: EC_CONFIG_TRACE])
+    {
+      cb--;
+    }
+  if (ca != cb)
+    {
+      return NO;
+    }
+  enumerator = [a keyEnumerator];
+  while (nil != (key = [enumerator nextObject]))
+    {
+      id	o;
+
+      if ([key isEqual: EC_CONFIG_TRACE])
+	{
+	  continue;
+	}
+      o = [b objectForKey: key];
+      if (nil == o || NO == [o isEqual: [a objectForKey: key]])
+	{
+	  return NO;
+	}
+    }
+  return YES;
+}
+
++ (NSString*) digest: (id)plist
+{
+  NSMutableData	*m = [NSMutableData dataWithCapacity: 1024];
+
+  digestAppend(m, plist);
+  return [[m md5Digest] hexadecimalRepresentation];
+}
+
++ (NSDictionary*) trace: (NSDictionary*)trace addHop: (NSDictionary*)hop
+{
+  NSMutableDictionary	*m;
+  NSArray		*hops;
+
+  if (NO == [trace isKindOfClass: dictionaryClass])
+    {
+      return nil;
+    }
+  hops = [trace objectForKey: @"Hops"];
+  if (NO == [hops isKindOfClass: arrayClass])
+    {
+      hops = [NSArray array];
+    }
+  m = AUTORELEASE([trace mutableCopy]);
+  [m setObject: [hops arrayByAddingObject: hop] forKey: @"Hops"];
+  return AUTORELEASE([m copy]);
+}
+
++ (uint64_t) takeVersion: (NSMutableDictionary*)config
+{
+  id		o = [config objectForKey: EC_CONFIG_VERSION];
+  uint64_t	v = 0;
+
+  if (nil != o)
+    {
+      if ([o respondsToSelector: @selector(unsignedLongLongValue)])
+	{
+	  v = [o unsignedLongLongValue];
+	}
+      [config removeObjectForKey: EC_CONFIG_VERSION];
+    }
+  return v;
+}
+
+@end
+
@@ -0,0 +1,132 @@
+/** Enterprise Control Configuration and Logging
+    -- host-wide mapped configuration
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#ifndef	INCLUDED_ECCONFIGMAP_H
+#define	INCLUDED_ECCONFIGMAP_H
+
+#import <Foundation/NSObject.h>
+
+@class	NSArray;
+@class	NSData;
+@class	NSDictionary;
+@class	NSMutableDictionary;
+@class	NSString;
+
+/** <p>The Command server publishes the merged configuration for its host
+ * as a file which client processes map into memory read-only.  The file
+ * holds a header giving the configuration version, a sorted index of the
+ * top level keys (process names, '*' and 'Operators'), and the value for
+ * each key as a separate binary property list.  A client therefore only
+ * parses the sections it needs, and the file pages are shared by every
+ * process on the host.
+ * </p>
+ * <p>Only the serialized form is shared.  The sections a process uses
+ * are parsed into ordinary objects in its own memory and copied into its
+ * user defaults, so each process still holds a private copy of its own
+ * configuration.  What the mapping saves is the transfer of the whole
+ * configuration to every process, and the parsing of the sections other
+ * processes use.
+ * </p>
+ * <p>A file is never modified once written; a new version is written to
+ * a temporary file and renamed into place, so an existing mapping stays
+ * valid and consistent.  Clients are told of a new version by the
+ * -updateConfigMapped: method of the CmdConfigMapped protocol, and check
+ * the version in the header before using the new mapping.
+ * </p>
+ * <p>The header may also hold a digest identifying the source from which
+ * the configuration was built, so that a process loading the file at
+ * startup can tell whether it is still current without reading the
+ * whole configuration.
+ * </p>
+ */
+@interface EcConfigMap : NSObject
+{
+  NSData	*data;
+  uint64_t	version;
+  unsigned	count;
+  unsigned	header;
+}
+
+/** Returns the configuration for the named process (general config, the
+ * config for the process, the operators and any EC_CONFIG_TRACE) from a
+ * source which may be an NSDictionary or an EcConfigMap instance.<br />
+ * For a process with an instance number (name-N) the config for the
+ * base name is merged with any config specific to the instance.
+ */
++ (NSMutableDictionary*) configurationFor: (NSString*)name in: (id)source;
+
+/** Maps the file at path and returns an instance for accessing it, or nil
+ * if the file does not exist or is not a valid mapped configuration.
+ */
++ (EcConfigMap*) mapFile: (NSString*)path;
+
+/** Writes the configuration (which must have string keys) with the
+ * version to the file at path, replacing any existing file atomically.
+ */
++ (BOOL) writeConfig: (NSDictionary*)config
+	     version: (uint64_t)version
+	      toFile: (NSString*)path;
+
+/** Writes the configuration as above, storing the hexadecimal MD5 source
+ * digest (which may be nil) in the header.
+ */
++ (BOOL) writeConfig: (NSDictionary*)config
+	     version: (uint64_t)version
+	      source: (NSString*)source
+	      toFile: (NSString*)path;
+
+/** Returns the top level keys (read from the index without parsing any
+ * of the values).
+ */
+- (NSArray*) allKeys;
+
+/** Returns the number of top level keys in the configuration.
+ */
+- (NSUInteger) count;
+
+/** Returns a dictionary holding the configuration, in which each value
+ * is parsed from the file the first time it is asked for.
+ */
+- (NSDictionary*) dictionary;
+
+/** Parses and returns the (immutable) value stored for key, or nil if
+ * there is no such key.
+ */
+- (id) objectForKey: (NSString*)key;
+
+/** Returns the hexadecimal source digest stored when the file was
+ * written, or nil if there was none.
+ */
+- (NSString*) source;
+
+/** Returns the version of the configuration.
+ */
+- (uint64_t) version;
+
+@end
+
+#endif
+
@@ -0,0 +1,506 @@
+/** Enterprise Control Configuration and Logging
+    -- host-wide mapped configuration
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/Foundation.h>
+
+#import "EcConfigMap.h"
+#import "EcConfigDelta.h"
+
+#include <ctype.h>
+
+/* The file starts with a header of MAP_HEADER bytes -
+ *   the magic bytes 'ECCM'
+ *   the format number (32 bits)
+ *   the configuration version (64 bits)
+ *   the number of keys (32 bits)
+ *   reserved (32 bits)
+ *   the MD5 digest of the source of the configuration (128 bits, zero
+ *   if there is none)
+ * The header of a format 1 file has no source digest and is MAP_HEADER1
+ * bytes.  The header is followed by an index entry of MAP_ENTRY bytes for each key (in order of
+ * the UTF-8 bytes of the keys) holding the offset and length of the key
+ * and the offset and length of the value (32 bits each).
+ * All numbers are big-endian.
+ */
+#define	MAP_MAGIC	"ECCM"
+#define	MAP_FORMAT	2
+#define	MAP_HEADER1	24
+#define	MAP_HEADER	40
+#define	MAP_ENTRY	16
+
+static inline uint32_t
+get32(const uint8_t *p)
+{
+  uint32_t	v;
+
+  memcpy(&v, p, sizeof(v));
+  return NSSwapBigIntToHost(v);
+}
+
+static inline void
+put32(NSMutableData *m, uint32_t v)
+{
+  v = NSSwapHostIntToBig(v);
+  [m appendBytes: &v length: sizeof(v)];
+}
+
+static NSComparisonResult
+byteOrder(id a, id b, void *context)
+{
+  NSUInteger	al = [a length];
+  NSUInteger	bl = [b length];
+  int		r = memcmp([a bytes], [b bytes], (al < bl) ? al : bl);
+
+  if (r < 0 || (0 == r && al < bl))
+    {
+      return NSOrderedAscending;
+    }
+  if (r > 0 || (0 == r && al > bl))
+    {
+      return NSOrderedDescending;
+    }
+  return NSOrderedSame;
+}
+
+/* A dictionary whose values are parsed from the mapped file the first
+ * time they are asked for.
+ */
+@interface	EcConfigMapDictionary : NSDictionary
+{
+  EcConfigMap		*map;
+  NSMutableDictionary	*parsed;
+}
+- (id) initWithMap: (EcConfigMap*)m;
+@end
+
+@implementation	EcConfigMapDictionary
+
+- (NSUInteger) count
+{
+  return [map count];
+}
+
+- (void) dealloc
+{
+  DESTROY(map);
+  DESTROY(parsed);
+  [super dealloc];
+}
+
+- (id) initWithMap: (EcConfigMap*)m
+{
+  /* NSDictionary's -init would call the abstract designated initialiser,
+   * so we set up the instance directly.
+   */
+  ASSIGN(map, m);
+  parsed = [[NSMutableDictionary alloc] initWithCapacity: [m count]];
+  return self;
+}
+
+- (NSEnumerator*) keyEnumerator
+{
+  return [[map allKeys] objectEnumerator];
+}
+
+- (id) objectForKey: (id)key
+{
+  id	o = [parsed objectForKey: key];
+
+  if (nil == o && [key isKindOfClass: [NSString class]])
+    {
+      if (nil != (o = [map objectForKey: key]))
+	{
+	  [parsed setObject: o forKey: key];
+	}
+    }
+  return o;
+}
+
+@end
+
+@implementation EcConfigMap
+
++ (NSMutableDictionary*) configurationFor: (NSString*)name in: (id)source
+{
+  NSMutableDictionary	*dict;
+  NSString		*base;
+  NSRange		r;
+  id			o;
+
+  r = [name rangeOfString: @"-"
+		  options: NSBackwardsSearch | NSLiteralSearch];
+  if (r.length > 0)
+    {
+      NSString		*inst = [name substringFromIndex: NSMaxRange(r)];
+      NSUInteger	len = [inst length];
+
+      base = [name substringToIndex: r.location];
+      if ([inst length] == 0)
+	{
+	  base = nil;		// Not an instance ID after hyphen
+	}
+      else
+        {
+	  while (len-- > 0)
+	    {
+	      if (!isdigit([inst characterAtIndex: len]))
+		{
+		  base = nil;	// not positive integer after hyphen
+		  break;
+		}
+	    }
+        }
+    }
+  else
+    {
+      base = nil;
+    }
+
+  dict = [NSMutableDictionary dictionaryWithCapacity: 2];
+  o = [source objectForKey: @"*"];
+  if (o != nil)
+    {
+      [dict setObject: o forKey: @"*"];
+    }
+
+  o = [source objectForKey: name];		// Lookup config
+  if (base != nil)
+    {
+      if (nil == o)
+	{
+	  /* No instance specific config found for process,
+	   * try using the base process name without instance ID.
+	   */
+	  o = [source objectForKey: base];
+	}
+      else
+	{
+	  id	tmp;
+
+	  /* We found instance specific configuration for the process,
+	   * so we merge by taking values from generic process config
+	   * (if any) and overwriting them with instance specific values.
+	   */
+	  tmp = [source objectForKey: base];
+	  if ([tmp isKindOfClass: [NSDictionary class]]
+	    && [o isKindOfClass: [NSDictionary class]])
+	    {
+	      tmp = [[tmp mutableCopy] autorelease];
+	      [tmp addEntriesFromDictionary: o];
+	      o = tmp;
+	    }
+	}
+    }
+  if (o != nil)
+    {
+      [dict setObject: o forKey: name];
+    }
+
+  o = [source objectForKey: @"Operators"];
+  if (o != nil)
+    {
+      [dict setObject: o forKey: @"Operators"];
+    }
+
+  /* Pass on the trace of the change which produced the configuration.
+   */
+  o = [source objectForKey: EC_CONFIG_TRACE];
+  if (o != nil)
+    {
+      [dict setObject: o forKey: EC_CONFIG_TRACE];
+    }
+  return dict;
+}
+
++ (EcConfigMap*) mapFile: (NSString*)path
+{
+  EcConfigMap	*m;
+  NSData	*d;
+  const uint8_t	*b;
+  NSUInteger	length;
+  unsigned	header;
+  unsigned	n;
+  unsigned	i;
+
+  d = [NSData dataWithContentsOfMappedFile: path];
+  length = [d length];
+  if (length < MAP_HEADER1)
+    {
+      return nil;
+    }
+  b = (const uint8_t*)[d bytes];
+  if (memcmp(b, MAP_MAGIC, 4) != 0)
+    {
+      return nil;
+    }
+  if (get32(b + 4) == MAP_FORMAT)
+    {
+      header = MAP_HEADER;
+    }
+  else if (get32(b + 4) == 1)
+    {
+      header = MAP_HEADER1;
+    }
+  else
+    {
+      return nil;
+    }
+  n = get32(b + 16);
+  if (length < header || (length - header) / MAP_ENTRY < n)
+    {
+      return nil;
+    }
+  for (i = 0; i < n; i++)
+    {
+      const uint8_t	*e = b + header + i * MAP_ENTRY;
+      uint32_t		ko = get32(e);
+      uint32_t		kl = get32(e + 4);
+      uint32_t		vo = get32(e + 8);
+      uint32_t		vl = get32(e + 12);
+
+      if (ko > length || kl > length - ko || vo > length || vl > length - vo)
+	{
+	  return nil;
+	}
+    }
+  m = AUTORELEASE([self new]);
+  ASSIGN(m->data, d);
+  m->version = ((uint64_t)get32(b + 8) << 32) | get32(b + 12);
+  m->count = n;
+  m->header = header;
+  return m;
+}
+
++ (BOOL) writeConfig: (NSDictionary*)config
+	     version: (uint64_t)version
+	      toFile: (NSString*)path
+{
+  return [self writeConfig: config version: version source: nil toFile: path];
+}
+
++ (BOOL) writeConfig: (NSDictionary*)config
+	     version: (uint64_t)version
+	      source: (NSString*)source
+	      toFile: (NSString*)path
+{
+  NSData		*digest = nil;
+  NSMutableData		*m;
+  NSMutableArray	*keys;
+  NSMutableArray	*values;
+  NSEnumerator		*enumerator;
+  NSString		*key;
+  uint32_t		offset;
+  unsigned		n;
+  unsigned		i;
+
+  if (nil != source)
+    {
+      digest = AUTORELEASE([[NSData alloc]
+	initWithHexadecimalRepresentation: source]);
+      if ([digest length] != 16)
+	{
+	  return NO;
+	}
+    }
+  keys = [NSMutableArray arrayWithCapacity: [config count]];
+  enumerator = [config keyEnumerator];
+  while (nil != (key = [enumerator nextObject]))
+    {
+      if (NO == [key isKindOfClass: [NSString class]])
+	{
+	  return NO;
+	}
+      [keys addObject: [key dataUsingEncoding: NSUTF8StringEncoding]];
+    }
+  [keys sortUsingFunction: byteOrder context: 0];
+  n = [keys count];
+  values = [NSMutableArray arrayWithCapacity: n];
+  for (i = 0; i < n; i++)
+    {
+      NSData	*v;
+
+      key = [[NSString alloc] initWithData: [keys objectAtIndex: i]
+				  encoding: NSUTF8StringEncoding];
+      v = [NSPropertyListSerialization
+	dataFromPropertyList: [config objectForKey: key]
+	format: NSPropertyListBinaryFormat_v1_0
+	errorDescription: 0];
+      RELEASE(key);
+      if (nil == v)
+	{
+	  return NO;
+	}
+      [values addObject: v];
+    }
+
+  m = [NSMutableData dataWithCapacity: 64 * 1024];
+  [m appendBytes: MAP_MAGIC length: 4];
+  put32(m, MAP_FORMAT);
+  put32(m, (uint32_t)(version >> 32));
+  put32(m, (uint32_t)version);
+  put32(m, n);
+  put32(m, 0);
+  if (nil == digest)
+    {
+      [m increaseLengthBy: 16];
+    }
+  else
+    {
+      [m appendData: digest];
+    }
+  offset = MAP_HEADER + n * MAP_ENTRY;
+  for (i = 0; i < n; i++)
+    {
+      uint32_t	kl = [[keys objectAtIndex: i] length];
+      uint32_t	vl = [[values objectAtIndex: i] length];
+
+      put32(m, offset);
+      put32(m, kl);
+      put32(m, offset + kl);
+      put32(m, vl);
+      offset += kl + vl;
+    }
+  for (i = 0; i < n; i++)
+    {
+      [m appendData: [keys objectAtIndex: i]];
+      [m appendData: [values objectAtIndex: i]];
+    }
+
+  /* The atomic write goes to a temporary file which is then renamed, so
+   * processes which have the old file mapped are unaffected.
+   */
+  return [m writeToFile: path atomically: YES];
+}
+
+- (NSArray*) allKeys
+{
+  const uint8_t		*b = (const uint8_t*)[data bytes];
+  NSMutableArray	*a = [NSMutableArray arrayWithCapacity: count];
+  unsigned		i;
+
+  for (i = 0; i < count; i++)
+    {
+      const uint8_t	*e = b + header + i * MAP_ENTRY;
+      NSString		*k;
+
+      k = [[NSString alloc] initWithBytes: b + get32(e)
+				   length: get32(e + 4)
+				 encoding: NSUTF8StringEncoding];
+      if (nil != k)
+	{
+	  [a addObject: k];
+	  RELEASE(k);
+	}
+    }
+  return a;
+}
+
+- (NSUInteger) count
+{
+  return count;
+}
+
+- (void) dealloc
+{
+  DESTROY(data);
+  [super dealloc];
+}
+
+- (NSDictionary*) dictionary
+{
+  return AUTORELEASE([[EcConfigMapDictionary alloc] initWithMap: self]);
+}
+
+- (id) objectForKey: (NSString*)key
+{
+  const uint8_t	*b = (const uint8_t*)[data bytes];
+  const char	*k = [key UTF8String];
+  NSUInteger	kl = strlen(k);
+  unsigned	lo = 0;
+  unsigned	hi = count;
+
+  while (lo < hi)
+    {
+      unsigned		mid = (lo + hi) / 2;
+      const uint8_t	*e = b + header + mid * MAP_ENTRY;
+      uint32_t		el = get32(e + 4);
+      int		r;
+
+      r = memcmp(b + get32(e), k, (el < kl) ? el : kl);
+      if (0 == r)
+	{
+	  r = (el < kl) ? -1 : ((el > kl) ? 1 : 0);
+	}
+      if (r < 0)
+	{
+	  lo = mid + 1;
+	}
+      else if (r > 0)
+	{
+	  hi = mid;
+	}
+      else
+	{
+	  NSData	*v;
+
+	  /* Parse directly from the mapped pages; the parser copies what
+	   * it needs, so nothing refers to the mapping afterwards.
+	   */
+	  v = [[NSData alloc] initWithBytesNoCopy: (void*)(b + get32(e + 8))
+					   length: get32(e + 12)
+				     freeWhenDone: NO];
+	  AUTORELEASE(v);
+	  return [NSPropertyListSerialization
+	    propertyListWithData: v
+	    options: NSPropertyListImmutable
+	    format: 0
+	    error: 0];
+	}
+    }
+  return nil;
+}
+
+- (NSString*) source
+{
+  static const uint8_t	none[16] = { 0 };
+  const uint8_t		*b = (const uint8_t*)[data bytes];
+  NSData		*d;
+
+  if (header < MAP_HEADER || memcmp(b + MAP_HEADER1, none, 16) == 0)
+    {
+      return nil;
+    }
+  d = [NSData dataWithBytes: b + MAP_HEADER1 length: 16];
+  return [d hexadecimalRepresentation];
+}
+
+- (uint64_t) version
+{
+  return version;
+}
+
+@end
+
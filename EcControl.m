@@ -29,11 +29,15 @@
 
 #import <Foundation/Foundation.h>
 
+#import "EcAdmission.h"
 #import "EcAlarm.h"
 #import "EcAlarmSinkSNMP.h"
 #import "EcAlerter.h"
 #import "EcClientI.h"
+#import "EcConfigDelta.h"
+#import "EcConfigMap.h"
 #import "EcHost.h"
+#import "EcMetrics.h"
 #import "EcProcess.h"
 #import "EcUserDefaults.h"
 #import "NSFileHandle+Printf.h"
@@ -127,10 +131,13 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 @interface	CommandInfo : EcClientI
 {
   NSArray	*servers;
+  NSString	*sliceHash;	/* Digest of config slice last sent.	*/
 }
 - (NSString*) serverByAbbreviation: (NSString*)s;
 - (NSArray*) servers;
 - (void) setServers: (NSArray*)s;
+- (void) setSliceHash: (NSString*)h;
+- (NSString*) sliceHash;
 @end
 
 @implementation CommandInfo
@@ -138,6 +145,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 - (void) dealloc
 {
   DESTROY(servers);
+  DESTROY(sliceHash);
   [super dealloc];
 }
 
@@ -191,6 +199,83 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 {
   ASSIGN(servers, s);
 }
+
+- (void) setSliceHash: (NSString*)h
+{
+  ASSIGN(sliceHash, h);
+}
+
+- (NSString*) sliceHash
+{
+  return sliceHash;
+}
+@end
+
+
+/* Cached state of a file read by an include directive (or one of the top
+ * level configuration files).  The generation is incremented whenever the
+ * parsed content of the file changes.
+ */
+@interface	IncludeFile : NSObject
+{
+@public
+  NSDate		*modified;	/* Modification date when read	*/
+  unsigned long long	size;		/* File size when read		*/
+  NSString		*digest;	/* MD5 of the file contents	*/
+  id			plist;		/* Parsed contents or nil	*/
+  NSString		*failure;	/* Parse error (nil if unreadable) */
+  unsigned		generation;
+  unsigned		checked;	/* Reload the file was checked	*/
+}
+@end
+
+@implementation	IncludeFile
+- (void) dealloc
+{
+  DESTROY(modified);
+  DESTROY(digest);
+  DESTROY(plist);
+  DESTROY(failure);
+  [super dealloc];
+}
+@end
+
+/* The result of expanding the includes in an array or dictionary, along
+ * with the generations of the files included directly at that level and
+ * the trees built for the nested arrays and dictionaries.  The result is
+ * reused for as long as none of those files has changed.
+ */
+@interface	IncludeTree : NSObject
+{
+@public
+  id			result;
+  NSMutableDictionary	*files;		/* Path -> generation		*/
+  NSMutableArray	*children;
+  unsigned		used;		/* Last reload using the tree	*/
+  unsigned		checked;	/* Last reload validating it	*/
+  BOOL			valid;
+  BOOL			failed;		/* An include failed		*/
+}
+@end
+
+@implementation	IncludeTree
+- (void) dealloc
+{
+  DESTROY(result);
+  DESTROY(files);
+  DESTROY(children);
+  [super dealloc];
+}
+
+- (id) init
+{
+  if (nil != (self = [super init]))
+    {
+      files = [NSMutableDictionary new];
+      children = [NSMutableArray new];
+    }
+  return self;
+}
 @end
 
 
@@ -403,14 +488,18 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 @interface	EcControl : EcProcess <Control>
 {
   NSFileManager		*mgr;
-  NSMutableArray	*commands;
-  NSMutableArray	*consoles;
+  EcClientRegistry	*commands;
+  EcClientRegistry	*consoles;
   NSString		*logname;
   NSDictionary		*config;
   NSDictionary		*controlConfig;
   NSMutableDictionary	*operators;
-  NSMutableDictionary	*fileBodies;
-  NSMutableDictionary	*fileDates;
+  NSMutableDictionary	*includeFiles;	/* Path -> IncludeFile		*/
+  NSMapTable		*includeTrees;	/* Source -> IncludeTree	*/
+  IncludeTree		*includeBuilding;
+  unsigned		includeEpoch;
+  EcConfigMap		*includeCompiled;	/* Files cached at last run */
+  BOOL			includeChanged;
   NSTimer		*timer;
   NSTimer		*terminating;
   unsigned		commandPingPosition;
@@ -419,6 +508,22 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
   NSString		*configIncludeFailed;
   NSRegularExpression	*alarmFilter;
   EcAlerter		*alerter;
+  NSMutableDictionary	*metricArchives;
+  uint64_t		configVersion;
+  NSMutableDictionary	*sectionHashes;
+  NSDictionary		*sliceOperators;
+  NSString		*operatorsHash;
+  NSMutableDictionary	*sliceBlobs;	/* Hash -> [slice, data]	*/
+  uint64_t		sliceBlobsVersion;
+  EcAdmission		*registrations;	/* Paces Command registrations	*/
+  NSDictionary		*configTrace;	/* Trace of the latest change	*/
+  NSArray		*rollCommand;	/* Rolling restart sent to hosts */
+  NSString		*rollConsole;	/* Console which asked for it	*/
+  NSMutableArray	*rollQueue;	/* Hosts not yet started	*/
+  NSMutableDictionary	*rollActive;	/* Host name -> CommandInfo	*/
+  NSMutableArray	*rollDone;	/* Hosts completed		*/
+  NSMutableArray	*rollFailed;	/* Hosts which failed		*/
+  NSUInteger		rollWidth;	/* Hosts to restart at once	*/
 }
 - (NSFileHandle*) openLog: (NSString*)lname;
 - (oneway void) cmdGnip: (id <CmdPing>)from
@@ -430,38 +535,57 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 - (oneway void) cmdQuit: (NSInteger)status;
 - (void) command: (NSData*)dat
 	    from: (NSString*)f;
+- (NSData*) configSliceData: (NSDictionary**)slice
+			for: (NSString*)name
+		       hash: (NSString**)hash;
+- (NSMutableDictionary*) configSliceFor: (NSString*)name
+				   hash: (NSString**)hash;
 - (BOOL) connection: (NSConnection*)ancestor
   shouldMakeNewConnection: (NSConnection*)newConn;
 - (id) connectionBecameInvalid: (NSNotification*)notification;
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
         byAbbreviation: (NSString*)s;
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
 		byName: (NSString*)s;
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
 	      byObject: (id)s;
 - (void) information: (NSString*)inf
 		type: (EcLogType)t
 		  to: (NSString*)to
 		from: (NSString*)from;
 - (NSString*) messageForAlarm: (EcAlarm*)alarm;
+- (oneway void) metrics: (NSData*)delta from: (NSString*)host;
+- (NSString*) metricsReport: (NSString*)spec since: (NSString*)when;
+- (void) operatorsChanged;
 - (NSData*) registerCommand: (id<Command>)c
 		       name: (NSString*)n;
 - (NSString*) registerConsole: (id<Console>)c
 		         name: (NSString*)n
 			 pass: (NSString*)p;
+- (void) registrationLimits;
 - (void) reply: (NSString*) msg to: (NSString*)n from: (NSString*)c;
 - (void) reportAlarm: (EcAlarm*)alarm
 	 withMessage: (NSString*)message
            isCleared: (BOOL)cleared
             reminder: (int)reminder;
 - (void) reportAlarms;
+- (void) rollCheck;
+- (void) rolled: (NSString*)n succeeded: (BOOL)ok;
+- (NSString*) rolling: (NSMutableArray*)cmd from: (NSString*)f;
+- (void) rollNext;
 - (void) servers: (NSData*)d
 	      on: (id<Command>)s;
+- (void) sliceHashes;
 - (void) timedOut: (NSTimer*)t;
 - (void) unregister: (id)obj;
 - (BOOL) update;
 - (void) updateConfig: (NSData*)dummy;
 - (id) getInclude: (id)s;
+- (void) includeBegin;
+- (IncludeFile*) includeFile: (NSString*)path;
+- (void) includeSave;
+- (BOOL) includeTreeValid: (IncludeTree*)t;
+- (void) includeTreeUsed: (IncludeTree*)t;
 - (id) recursiveInclude: (id)o;
 - (id) tryInclude: (id)s multi: (BOOL*)flag;
 @end
@@ -533,7 +657,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
   if (EcAlarmSeverityCleared != severity
     && EcAlarmSeverityIndeterminate != severity) 
     {
-      NSArray		*a = [NSArray arrayWithArray: consoles];
+      NSArray		*a = [consoles allObjects];
       NSUInteger	i = [a count];
 
       /*
@@ -689,6 +813,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
   [self ecDoLock];
   ASSIGN(alarmFilter, re);
   [self ecUnLock];
+  [self registrationLimits];
 }
 
 - (oneway void) cmdGnip: (id <CmdPing>)from
@@ -845,6 +970,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	    {
 	      [d setObject: [cmd objectAtIndex: 2] forKey: @"Password"];
 	      [operators setObject: d forKey: s];
+	      [self operatorsChanged];
 	      p = [operators description];
 	      path = [[self cmdDataDirectory] stringByAppendingPathComponent:
 		@"Operators.plist"];
@@ -919,7 +1045,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	   */
 	  if (hname == nil)
 	    {
-	      hosts = [NSArray arrayWithArray: commands];
+	      hosts = [commands allObjects];
 	    }
 	  else
 	    {
@@ -1081,7 +1207,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 		}
 	      else
 		{
-		  NSArray	*hosts = [[commands copy] autorelease];
+		  NSArray	*hosts = [commands allObjects];
 		  NSUInteger	i;
 
 		  m = [NSString stringWithFormat:
@@ -1176,11 +1302,11 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	    {
 	      m = @"Commands are -\n"
 	      @"Help\tAlarms\tArchive\tClear\tConfig\tConnect\t"
-	      @"Flush\tHost\tList\tMemory\tOn\t"
+	      @"Flush\tHost\tList\tMemory\tMetrics\tOn\t"
 #if     !defined(HAVE_LIBCRYPT)
 	      @"Password\t"
 #endif
-	      @"Repeat\tRestart\tQuit\tSet\tStatus\t"
+	      @"Repeat\tRestart\tRolling\tQuit\tSet\tStatus\t"
 	      @"Suppress\tTell\tUnset\n\n"
 	      @"Type 'help' followed by a command word for details.\n"
 	      @"Use 'tell xxx help' to get help for a specific client.\n"
@@ -1280,6 +1406,23 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 		  m = @"Memory\nDisplays recent memory allocation stats.\n"
 		      @"Memory all\nDisplays all memory allocation stats.\n";
 		}
+	      else if (comp(wd, @"Metrics") >= 0)
+		{
+		  m = @"Metrics\nLists the hosts for which metrics are "
+		      @"archived.\n"
+		      @"Metrics host\nLists the processes on the host.\n"
+		      @"Metrics host/process\nLists the metrics archived "
+		      @"for the process (a process of '*' holds the totals "
+		      @"for the whole host).\n"
+		      @"Metrics host/process/name [since]\nDisplays the "
+		      @"archived values of the metric since the specified "
+		      @"time (default the last ten minutes).\n"
+		      @"The time may be given as a number of seconds, "
+		      @"minutes, hours or days ago (eg 90s, 30m, 2h, 7d) "
+		      @"or as a date (YYYY-MM-DD).\n"
+		      @"Values are at ten second resolution for the last "
+		      @"day and one minute resolution for the last month.\n";
+		}
 	      else if (comp(wd, @"On") >= 0)
 		{
 		  m = @"On host ...\nSends a command to the named host.\n"
@@ -1317,6 +1460,22 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 		      @"NB. On a system using encryption with EcControlKey,\n"
 		      @"restarting the server does not require key re-entry.\n";
 		}
+	      else if (comp(wd, @"Rolling") >= 0)
+		{
+		  m = @"Rolling 'name' [window N] [unavailable M] "
+		      @"[timeout S] [hosts H]\n"
+		      @"Performs a rolling restart of the named client "
+		      @"processes (or all) on each host in turn, H hosts "
+		      @"at a time (default 1).  Each host restarts its "
+		      @"processes in batches of N, waiting for each batch "
+		      @"to become stable and keeping at most M of them "
+		      @"unavailable (see 'on host help rolling').  The limit "
+		      @"M applies to each host separately, so it may not be "
+		      @"combined with H greater than 1.  A failure on any "
+		      @"host stops further hosts from being started.\n"
+		      @"Rolling\nReports progress of the rolling restart.\n"
+		      @"Rolling stop\nStops the rolling restart.\n";
+		}
 	      else if (comp(wd, @"Set") >= 0)
 		{
 		  m = @"Set\n"
@@ -1515,6 +1674,10 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	      m = [NSString stringWithCString: list];
 	    }
 	}
+      else if (matchCmd(wd, @"metrics", allow))
+	{
+	  m = [self metricsReport: cmdWord(cmd, 1) since: cmdWord(cmd, 2)];
+	}
       else if (matchCmd(wd, @"quit", allow))
 	{
 	  m = @"Try 'help quit' for information about shutting down.\n";
@@ -1545,7 +1708,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	  else if ([wd length] > 0 && comp(wd, @"all") == 0)
 	    {
               NSUInteger        i;
-              NSArray           *hosts = [[commands copy] autorelease];
+              NSArray           *hosts = [commands allObjects];
 
 	      for (i = 0; i < [hosts count]; i++)
 		{
@@ -1577,6 +1740,10 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
                 @" or 'on host restart ...\n";
             }
         }
+      else if (matchCmd(wd, @"rolling", allow))
+	{
+	  m = [self rolling: cmd from: [console name]];
+	}
       else if (matchCmd(wd, @"set", allow))
 	{
 	  m = @"ok - set confirmed.\n";
@@ -1694,7 +1861,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
                * host using 'on host tell ...' should be forwarded to each
                * Command server.
                */
-	      a = [NSArray arrayWithArray: commands];
+	      a = [commands allObjects];
 	      for (i = 0; i < [a count]; i++)
 		{
 		  CommandInfo*	c = (CommandInfo*)[a objectAtIndex: i];
@@ -1796,6 +1963,97 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
     }
 }
 
+/* Returns the serialized slice of the configuration for the named host
+ * and sets *slice and *hash as -configSliceFor:hash: would.  The result
+ * is cached (by slice digest) until the configuration version changes,
+ * so Command servers reconnecting together share the serialization.
+ */
+- (NSData*) configSliceData: (NSDictionary**)slice
+			for: (NSString*)name
+		       hash: (NSString**)hash
+{
+  NSMutableDictionary	*dict;
+  NSData		*data;
+  NSArray		*a;
+
+  if (sliceBlobsVersion != configVersion)
+    {
+      [sliceBlobs removeAllObjects];
+      sliceBlobsVersion = configVersion;
+    }
+  dict = [self configSliceFor: name hash: hash];
+  if (nil != (a = [sliceBlobs objectForKey: *hash]))
+    {
+      *slice = [a objectAtIndex: 0];
+      return [a objectAtIndex: 1];
+    }
+  data = [EcConfigDelta dataForConfig: dict version: configVersion];
+  if (nil == sliceBlobs)
+    {
+      sliceBlobs = [NSMutableDictionary new];
+    }
+  [sliceBlobs setObject: [NSArray arrayWithObjects: dict, data, nil]
+		 forKey: *hash];
+  *slice = dict;
+  return data;
+}
+
+/* Returns the slice of the configuration needed by the named host
+ * (the general section, the host's own section and the operators) and
+ * sets *hash to a digest of the slice content.  The digest is built
+ * from the digests cached by -sliceHashes and -operatorsChanged, so it
+ * is cheap to obtain however large the slice is.
+ */
+- (NSMutableDictionary*) configSliceFor: (NSString*)name
+				   hash: (NSString**)hash
+{
+  NSMutableDictionary	*dict;
+  NSString		*generalHash = @"";
+  NSString		*hostHash = @"";
+  NSString		*opsHash = @"";
+  NSString		*digest;
+  NSHost		*h;
+  id			o;
+
+  dict = [NSMutableDictionary dictionaryWithCapacity: 4];
+  o = [config objectForKey: @"*"];
+  if (o != nil)
+    {
+      [dict setObject: o forKey: @"*"];
+      generalHash = [sectionHashes objectForKey: @"*"];
+    }
+  h = [NSHost hostWithWellKnownName: name];
+  if (nil == h)
+    {
+      h = [NSHost hostWithName: name];
+    }
+  // Configuration keys may be NSHost objects
+  o = [config objectForKey: (NSString*)h];
+  if (o != nil)
+    {
+      [dict setObject: o forKey: name];
+      hostHash = [sectionHashes objectForKey: h];
+    }
+  if (sliceOperators != nil)
+    {
+      [dict setObject: sliceOperators forKey: @"Operators"];
+      opsHash = operatorsHash;
+    }
+  digest = [EcConfigDelta digest: [NSArray arrayWithObjects: name,
+    (generalHash ? generalHash : @""), (hostHash ? hostHash : @""),
+    (opsHash ? opsHash : @""), nil]];
+
+  /* The Command server keeps the digest with its cached configuration
+   * so that, after a restart, it can tell whether that is still current.
+   */
+  [dict setObject: digest forKey: EC_CONFIG_SOURCE];
+  if (0 != hash)
+    {
+      *hash = digest;
+    }
+  return dict;
+}
+
 - (BOOL) connection: (NSConnection*)ancestor
   shouldMakeNewConnection: (NSConnection*)newConn
 {
@@ -1913,93 +2171,49 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
       [timer invalidate];
     }
   DESTROY(mgr);
-  DESTROY(fileBodies);
-  DESTROY(fileDates);
+  DESTROY(includeFiles);
+  DESTROY(includeTrees);
+  DESTROY(includeCompiled);
   DESTROY(operators);
   DESTROY(config);
+  DESTROY(sectionHashes);
+  DESTROY(sliceOperators);
+  DESTROY(operatorsHash);
+  DESTROY(sliceBlobs);
+  DESTROY(configTrace);
+  DESTROY(rollCommand);
+  DESTROY(rollConsole);
+  DESTROY(rollQueue);
+  DESTROY(rollActive);
+  DESTROY(rollDone);
+  DESTROY(rollFailed);
+  DESTROY(registrations);
   DESTROY(commands);
   DESTROY(consoles);
   DESTROY(configFailed);
   DESTROY(configIncludeFailed);
   DESTROY(alarmFilter);
   DESTROY(controlConfig);
+  DESTROY(metricArchives);
   [super dealloc];
 }
 
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
 	byAbbreviation: (NSString*)s
 {
-  EcClientI	*o;
-  int		i;
-  int		best_pos = -1;
-  int		best_len = 0;
-
-  /*
-   *	Special case - a numeric value is used as an index into the array.
-   */
-  if (isdigit(*[s cString]))
-    {
-      i = [s intValue];
-      if (i >= 0 && i < [a count])
-	{
-	  return (EcClientI*)[a objectAtIndex: i];
-	}
-    }
-
-  for (i = 0; i < [a count]; i++)
-    {
-      o = (EcClientI*)[a objectAtIndex: i];
-      if (comp(s, [o name]) == 0)
-	{
-	  return o;
-	}
-      if (comp_len > best_len)
-	{
-	  best_len = comp_len;
-	  best_pos = i;
-	}
-    }
-  if (best_pos >= 0)
-    {
-      return (EcClientI*)[a objectAtIndex: best_pos];
-    }
-  return nil;
+  return [a objectForAbbreviation: s];
 }
 
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
 		byName: (NSString*)s
 {
-  EcClientI	*o;
-  int		i;
-
-  for (i = 0; i < [a count]; i++)
-    {
-      o = (EcClientI*)[a objectAtIndex: i];
-
-      if (comp([o name], s) == 0)
-	{
-	  return o;
-	}
-    }
-  return nil;
+  return [a objectForName: s];
 }
 
-- (EcClientI*) findIn: (NSArray*)a
+- (EcClientI*) findIn: (EcClientRegistry*)a
 	      byObject: (id)s
 {
-  EcClientI	*o;
-  int		i;
-
-  for (i = 0; i < [a count]; i++)
-    {
-      o = (EcClientI*)[a objectAtIndex: i];
-
-      if ([o obj] == s)
-	{
-	  return o;
-	}
-    }
-  return nil;
+  return [a objectForProxy: s];
 }
 
 - (void) information: (NSString*)inf
@@ -2019,7 +2233,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
        * Work with a copy of the consoles array in case one goes away
        * or is added while we are doing this!
        */
-      a = [NSArray arrayWithArray: consoles];
+      a = [consoles allObjects];
       for (i = 0; i < [a count]; i++)
 	{
 	  ConsoleInfo	*c = [a objectAtIndex: i];
@@ -2117,16 +2331,28 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
   self = [super initWithDefaults: defs];
   if (self != nil)
     {
-      commands = [[NSMutableArray alloc] initWithCapacity: 10];
-      consoles = [[NSMutableArray alloc] initWithCapacity: 2];
+      commands = [EcClientRegistry new];
+      consoles = [EcClientRegistry new];
       logname = [[self cmdName] stringByAppendingPathExtension: @"log"];
       RETAIN(logname);
       mgr = [NSFileManager defaultManager];
       RETAIN(mgr);
+      includeFiles = [[NSMutableDictionary alloc] initWithCapacity: 8];
+      includeTrees = [[NSMapTable alloc]
+	initWithKeyOptions: NSPointerFunctionsObjectPointerPersonality
+	valueOptions: NSPointerFunctionsObjectPersonality
+	capacity: 64];
       if ([self cmdLogFile: logname] == nil)
 	{
 	  exit(0);
 	}
+
+      /* Load the files we had parsed when we last ran, so that we only
+       * need to parse the ones which have changed since then.
+       */
+      includeCompiled = RETAIN([EcConfigMap mapFile:
+	[[self cmdDataDirectory] stringByAppendingPathComponent:
+	@"ControlConfig.map"]]);
       [self update];
       if (configFailed != nil)
 	{
@@ -2138,8 +2364,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	  [self cmdQuit: 1];
 	  return nil;
 	}
-      fileBodies = [[NSMutableDictionary alloc] initWithCapacity: 8];
-      fileDates = [[NSMutableDictionary alloc] initWithCapacity: 8];
+      metricArchives = [[NSMutableDictionary alloc] initWithCapacity: 100];
 
       timer = [NSTimer scheduledTimerWithTimeInterval: 15.0
 					       target: self
@@ -2197,12 +2422,24 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
   return result;
 }
 
+/* Refreshes the copy of the operators (and its digest) used in the
+ * configuration slices.  Must be called whenever the operators change,
+ * since a Command server may register (and be sent its slice) before the
+ * next configuration update.  The operators dictionary may be modified in
+ * place (by the password command) so the slices must use a copy.
+ */
+- (void) operatorsChanged
+{
+  ASSIGNCOPY(sliceOperators, operators);
+  ASSIGN(operatorsHash, [EcConfigDelta digest: sliceOperators]);
+}
+
 - (void) quitAll
 {
   NSArray       *hosts;
   NSUInteger	i;
 
-  hosts = [[commands copy] autorelease];
+  hosts = [commands allObjects];
   i = [hosts count];
   while (i-- > 0)
     {
@@ -2231,12 +2468,14 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 		       name: (NSString*)n
 {
   NSMutableDictionary	*dict;
+  NSDictionary		*slice;
+  NSData		*data;
   CommandInfo		*obj;
   CommandInfo		*old;
   NSHost		*h;
+  NSString		*hash;
   NSString		*m;
   EcAlarm		*a;
-  id			o;
 
   if (nil == alerter)
     {
@@ -2254,6 +2493,37 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	}
     }
   [(NSDistantObject*)c setProtocolForProxy: @protocol(Command)];
+
+  /* When many Command servers connect together (eg. after we restart)
+   * they are admitted at a steady rate.  A deferred Command server is
+   * told when to come back for the slot reserved for it.  The reply also
+   * says it was rejected, so older Command servers (which do not know
+   * about the retry time) fall back to their own jittered backoff.
+   */
+  if (nil == registrations)
+    {
+      [self registrationLimits];
+    }
+  if (nil == [self findIn: commands byObject: c])
+    {
+      NSTimeInterval	wait = [registrations admit: n];
+
+      if (wait > 0.0)
+	{
+	  [[self cmdLogFile: logname]
+	    printf: @"Deferred registration of host '%@' for %.1fs at %@\n",
+	    n, wait, [NSDate date]];
+	  dict = [NSMutableDictionary dictionaryWithCapacity: 2];
+	  [dict setObject: @"registration queue busy."
+		   forKey: @"rejected"];
+	  [dict setObject: [NSNumber numberWithDouble: wait]
+		   forKey: @"retry"];
+	  return [NSPropertyListSerialization
+	    dataFromPropertyList: dict
+	    format: NSPropertyListBinaryFormat_v1_0
+	    errorDescription: 0];
+	}
+    }
   dict = [NSMutableDictionary dictionaryWithCapacity: 3];
 
   h = [NSHost hostWithWellKnownName: n];
@@ -2299,9 +2569,6 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 				    with: self];
 
       old = (CommandInfo*)[self findIn: commands byName: n];
-      [commands addObject: obj];
-      RELEASE(obj);
-      [commands sortUsingSelector: @selector(compare:)];
       if (nil == old)
         {
           m = [NSString stringWithFormat:
@@ -2311,12 +2578,17 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
         }
       else
         {
+          /* The old entry must leave the registry before its proxy is
+           * changed, since the registry is indexed by proxy.
+           */
+          [commands removeObjectIdenticalTo: old];
           [old setObj: nil];
           m = [NSString stringWithFormat:
               @"Re-registered host with name '%@' at %@\n",
                   n, [NSDate date]];
-          [commands removeObjectIdenticalTo: old];
         }
+      [commands addObject: obj];
+      RELEASE(obj);
       [self information: m
                    type: LT_CONSOLE
                      to: nil
@@ -2339,25 +2611,11 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
    *	Return configuration information - general stuff, plus
    *	host specific stuff.
    */
-  o = [config objectForKey: @"*"];
-  if (o != nil)
-    {
-      [dict setObject: o forKey: @"*"];
-    }
-  // Configuration keys may be NSHost objects
-  o = [config objectForKey: (NSString*)h];
-  if (o != nil)
-    {
-      [dict setObject: o forKey: n];
-    }
-  if (operators != nil)
-    {
-      [dict setObject: operators forKey: @"Operators"];
-    }
-  return [NSPropertyListSerialization
-    dataFromPropertyList: dict
-    format: NSPropertyListBinaryFormat_v1_0
-    errorDescription: 0];
+  obj = (CommandInfo*)[self findIn: commands byObject: c];
+  data = [self configSliceData: &slice for: n hash: &hash];
+  [obj setConfigInfo: slice version: configVersion data: data];
+  [obj setSliceHash: hash];
+  return [obj config];
 }
 
 - (NSString*) registerConsole: (id<Console>)c
@@ -2482,7 +2740,6 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
     }
   obj = [[ConsoleInfo alloc] initFor: c name: n with: self pass: p];
   [consoles addObject: obj];
-  [consoles sortUsingSelector: @selector(compare:)];
   RELEASE(obj);
   m = [NSString stringWithFormat:
     cmdLogFormat(LT_AUDIT, @"CONSOLE_LOGIN 1 Registered new console"
@@ -2499,98 +2756,346 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
   return nil;
 }
 
-- (void) reply: (NSString*) msg to: (NSString*)n from: (NSString*)c
-{
-  [self information: msg type: LT_CONSOLE to: n from: c];
-}
-
-- (NSString*) messageForAlarm: (EcAlarm*)alarm
+/* Sets the pace at which Command servers are admitted from the
+ * RegistrationRate (per second, default 10) and RegistrationBurst
+ * (default 10) user defaults.
+ */
+- (void) registrationLimits
 {
-  NSString      *additional;
-  NSString	*component;
-  NSString	*connector;
-  NSString	*instance;
-  NSString	*message;
-  NSString	*repair;
-  NSString	*spacing1;
-  NSString	*spacing2;
+  NSUserDefaults	*defs = [self cmdDefaults];
+  double		rate = [defs doubleForKey: @"RegistrationRate"];
+  NSInteger		burst = [defs integerForKey: @"RegistrationBurst"];
 
-  instance = [alarm moInstance];
-  if ([instance length] == 0)
+  if (rate <= 0.0)
     {
-      instance = @"";
-      connector = @"";
+      rate = 10.0;
     }
-  else
+  if (burst < 1)
     {
-      connector = @"-";
+      burst = 10;
     }
-
-  component = [alarm moComponent];
-  if (0 == [component length])
+  if (nil == registrations)
     {
-      component = @"";
+      registrations = [EcAdmission new];
     }
-  else
+  [registrations setRate: rate burst: (unsigned)burst];
+}
+
+- (void) reply: (NSString*) msg to: (NSString*)n from: (NSString*)c
+{
+  [self information: msg type: LT_CONSOLE to: n from: c];
+}
+
+static NSString*
+metricComponent(NSString *s)
+{
+  s = [s stringByReplacingString: @"/" withString: @"_"];
+  if ([s hasPrefix: @"."])
     {
-      component = [NSString stringWithFormat: @"(%@)", component];
+      s = [@"_" stringByAppendingString: [s substringFromIndex: 1]];
     }
+  return s;
+}
 
-  additional = [alarm additionalText];
-  if ([additional length] == 0)
+- (oneway void) metrics: (NSData*)delta from: (NSString*)host
+{
+  NSDictionary		*d;
+  NSDictionary		*series;
+  NSEnumerator		*e;
+  NSString		*k;
+  NSString		*dir;
+  NSTimeInterval	start;
+
+  if (nil == [self findIn: commands byName: host])
     {
-      additional = @"";
-      spacing1 = @"";
+      return;	// Ignore metrics from unregistered hosts.
     }
-  else
+  d = [NSPropertyListSerialization propertyListWithData: delta
+						options: 0
+						 format: 0
+						  error: 0];
+  if (NO == [d isKindOfClass: [NSDictionary class]])
     {
-      spacing1 = @": ";
+      return;
     }
-
-  repair = [alarm proposedRepairAction];
-  if ([repair length] == 0)
+  start = [[d objectForKey: @"Start"] doubleValue];
+  series = [d objectForKey: @"Series"];
+  if (start <= 0.0 || NO == [series isKindOfClass: [NSDictionary class]])
     {
-      repair = @"";
-      spacing2 = @"";
+      return;
     }
-  else
+  dir = [[self cmdDataDirectory] stringByAppendingPathComponent: @"Metrics"];
+  dir = [dir stringByAppendingPathComponent: metricComponent(host)];
+  e = [series keyEnumerator];
+  while (nil != (k = [e nextObject]))
     {
-      spacing2 = @", ";
-    }
+      NSString		*key = [NSString stringWithFormat: @"%@/%@", host, k];
+      EcMetricArchive	*a = [metricArchives objectForKey: key];
 
-  message = [NSString stringWithFormat: @"%@%@%@%@%@ - '%@%@%@%@' on %@",
-    [alarm specificProblem], spacing1,
-    additional, spacing2, repair,
-    [alarm moProcess], connector, instance,
-    component, [alarm moHost]];
+      if (nil == a)
+	{
+	  NSRange	r = [k rangeOfString: @"/"];
+	  NSString	*path;
 
-  return message;
+	  if (0 == r.length)
+	    {
+	      continue;	// Not a process/name key
+	    }
+	  path = [dir stringByAppendingPathComponent:
+	    metricComponent([k substringToIndex: r.location])];
+	  path = [path stringByAppendingPathComponent:
+	    metricComponent([k substringFromIndex: NSMaxRange(r)])];
+	  path = [path stringByAppendingPathExtension: @"rra"];
+	  a = [[EcMetricArchive alloc] initWithPath: path];
+	  [metricArchives setObject: a forKey: key];
+	  RELEASE(a);
+	}
+      [a record: [series objectForKey: k] at: start];
+    }
 }
 
-- (void) reportAlarm: (EcAlarm*)alarm
-	 withMessage: (NSString*)message
-           isCleared: (BOOL)cleared
-            reminder: (int)reminder
+- (NSString*) metricsReport: (NSString*)spec since: (NSString*)when
 {
-  NSString	*identifier;
-
-  identifier = [NSString stringWithFormat: @"%d", [alarm notificationID]];
-  if (cleared)
+  NSMutableString	*out = [NSMutableString string];
+  NSTimeInterval	now = [[NSDate date] timeIntervalSince1970];
+  NSTimeInterval	since;
+  NSString		*path;
+  NSArray		*parts;
+  NSArray		*samples;
+  EcMetricArchive	*a;
+  NSUInteger		count;
+  NSUInteger		i;
+
+  path = [[self cmdDataDirectory] stringByAppendingPathComponent: @"Metrics"];
+  parts = [spec length] > 0 ? [spec componentsSeparatedByString: @"/"] : nil;
+  if ([parts count] > 3)
     {
-      message = [NSString stringWithFormat: @"Clear %@ (%@)\n%@",
-	identifier,
-	[EcAlarm stringFromSeverity: [alarm perceivedSeverity]],
-	message];
+      return @"Metrics are specified as host/process/name\n";
     }
-  else
+
+  /* Match each part of the specification (case insensitively, since the
+   * Console converts simple words to lowercase) against the archive.
+   */
+  for (i = 0; i < [parts count]; i++)
     {
-      message = [NSString stringWithFormat: @"Alarm %@ (%@)\n%@",
-	identifier,
-	[EcAlarm stringFromSeverity: [alarm perceivedSeverity]],
-	message];
-    }
+      NSString		*want = metricComponent([parts objectAtIndex: i]);
+      NSEnumerator	*e;
+      NSString		*found = nil;
+      NSString		*n;
 
-  alarm = [[alarm copy] autorelease];
+      if (2 == i)
+	{
+	  want = [want stringByAppendingPathExtension: @"rra"];
+	}
+      e = [[mgr directoryContentsAtPath: path] objectEnumerator];
+      while (nil != (n = [e nextObject]))
+	{
+	  if ([n isEqualToString: want])
+	    {
+	      found = n;
+	      break;
+	    }
+	  if (nil == found && [n caseInsensitiveCompare: want] == NSOrderedSame)
+	    {
+	      found = n;
+	    }
+	}
+      if (nil == found)
+	{
+	  return [NSString stringWithFormat:
+	    @"No metrics found for '%@'\n", spec];
+	}
+      path = [path stringByAppendingPathComponent: found];
+    }
+
+  if ([parts count] < 3)
+    {
+      NSArray	*names;
+
+      names = [[mgr directoryContentsAtPath: path]
+	sortedArrayUsingSelector: @selector(compare:)];
+      if ([names count] == 0)
+	{
+	  return @"No metrics archived.\n";
+	}
+      [out appendString: (0 == [parts count]) ? @"Hosts -\n"
+	: ((1 == [parts count]) ? @"Processes -\n" : @"Metrics -\n")];
+      for (i = 0; i < [names count]; i++)
+	{
+	  NSString	*n = [names objectAtIndex: i];
+
+	  if (2 == [parts count])
+	    {
+	      n = [n stringByDeletingPathExtension];
+	    }
+	  [out appendFormat: @"  %@\n", n];
+	}
+      return out;
+    }
+
+  if ([when length] == 0)
+    {
+      since = now - 600.0;
+    }
+  else if ([when rangeOfString: @"-"].length > 0)
+    {
+      NSCalendarDate	*d;
+
+      d = [NSCalendarDate dateWithString: when calendarFormat: @"%Y-%m-%d"];
+      if (nil == d)
+	{
+	  return [NSString stringWithFormat:
+	    @"Bad date '%@' (expected YYYY-MM-DD)\n", when];
+	}
+      since = [d timeIntervalSince1970];
+    }
+  else
+    {
+      NSTimeInterval	ti = [when doubleValue];
+
+      switch ([when characterAtIndex: [when length] - 1])
+	{
+	  case 'd': ti *= 24.0;	// Fall through
+	  case 'h': ti *= 60.0;	// Fall through
+	  case 'm': ti *= 60.0;	break;
+	  default: break;
+	}
+      if (ti <= 0.0)
+	{
+	  return [NSString stringWithFormat:
+	    @"Bad time '%@' (expected eg 90s, 30m, 2h or 7d)\n", when];
+	}
+      since = now - ti;
+    }
+
+  a = AUTORELEASE([[EcMetricArchive alloc] initWithPath: path]);
+  samples = [a samplesSince: since];
+  count = [samples count];
+  [out appendFormat: @"Metrics for %@ since %@ (%g second resolution) -\n",
+    spec, [[NSDate dateWithTimeIntervalSince1970: since]
+    descriptionWithCalendarFormat: @"%Y-%m-%d %H:%M:%S"
+    timeZone: nil
+    locale: nil], [a resolutionSince: since]];
+  if (0 == count)
+    {
+      [out appendString: @"  No values recorded.\n"];
+      return out;
+    }
+  i = 0;
+  if (count > 500)
+    {
+      i = count - 500;
+      [out appendFormat: @"  (showing the latest 500 of %u values)\n",
+	(unsigned)count];
+    }
+  [out appendFormat: @"  %-19s %12s %14s %14s %14s\n",
+    "Time", "Count", "Sum", "Average", "Max"];
+  while (i < count)
+    {
+      NSDictionary	*s = [samples objectAtIndex: i++];
+      double		c = [[s objectForKey: @"C"] doubleValue];
+      double		t = [[s objectForKey: @"S"] doubleValue];
+      NSString		*d;
+
+      d = [[NSDate dateWithTimeIntervalSince1970:
+	[[s objectForKey: @"T"] doubleValue]]
+	descriptionWithCalendarFormat: @"%Y-%m-%d %H:%M:%S"
+	timeZone: nil
+	locale: nil];
+      [out appendFormat: @"  %-19s %12.0f %14.6g %14.6g %14.6g\n",
+	[d UTF8String], c, t, (c > 0.0 ? t / c : 0.0),
+	[[s objectForKey: @"M"] doubleValue]];
+    }
+  return out;
+}
+
+- (NSString*) messageForAlarm: (EcAlarm*)alarm
+{
+  NSString      *additional;
+  NSString	*component;
+  NSString	*connector;
+  NSString	*instance;
+  NSString	*message;
+  NSString	*repair;
+  NSString	*spacing1;
+  NSString	*spacing2;
+
+  instance = [alarm moInstance];
+  if ([instance length] == 0)
+    {
+      instance = @"";
+      connector = @"";
+    }
+  else
+    {
+      connector = @"-";
+    }
+
+  component = [alarm moComponent];
+  if (0 == [component length])
+    {
+      component = @"";
+    }
+  else
+    {
+      component = [NSString stringWithFormat: @"(%@)", component];
+    }
+
+  additional = [alarm additionalText];
+  if ([additional length] == 0)
+    {
+      additional = @"";
+      spacing1 = @"";
+    }
+  else
+    {
+      spacing1 = @": ";
+    }
+
+  repair = [alarm proposedRepairAction];
+  if ([repair length] == 0)
+    {
+      repair = @"";
+      spacing2 = @"";
+    }
+  else
+    {
+      spacing2 = @", ";
+    }
+
+  message = [NSString stringWithFormat: @"%@%@%@%@%@ - '%@%@%@%@' on %@",
+    [alarm specificProblem], spacing1,
+    additional, spacing2, repair,
+    [alarm moProcess], connector, instance,
+    component, [alarm moHost]];
+
+  return message;
+}
+
+- (void) reportAlarm: (EcAlarm*)alarm
+	 withMessage: (NSString*)message
+           isCleared: (BOOL)cleared
+            reminder: (int)reminder
+{
+  NSString	*identifier;
+
+  identifier = [NSString stringWithFormat: @"%d", [alarm notificationID]];
+  if (cleared)
+    {
+      message = [NSString stringWithFormat: @"Clear %@ (%@)\n%@",
+	identifier,
+	[EcAlarm stringFromSeverity: [alarm perceivedSeverity]],
+	message];
+    }
+  else
+    {
+      message = [NSString stringWithFormat: @"Alarm %@ (%@)\n%@",
+	identifier,
+	[EcAlarm stringFromSeverity: [alarm perceivedSeverity]],
+	message];
+    }
+
+  alarm = [[alarm copy] autorelease];
   if (cleared)
     {
       [alarm setExtra: @"Clear"];
@@ -2710,9 +3215,273 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
     }
 }
 
+/* A Command server asks for the full configuration when it is unable to
+ * apply a delta (its version differs from the base of the delta).
+ */
 - (oneway void) requestConfigFor: (id<CmdConfig>)c
 {
-  return;
+  CommandInfo	*info = (CommandInfo*)[self findIn: commands byObject: c];
+  NSData	*conf = [info config];
+
+  if (nil != conf)
+    {
+      NS_DURING
+	{
+	  [[info obj] updateConfig: conf];
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"Sending config to %@: %@", [info name], localException);
+	}
+      NS_ENDHANDLER
+    }
+}
+
+- (void) rollCheck
+{
+  NSEnumerator	*e;
+  NSString	*n;
+
+  /* A host whose Command server has gone away (or re-registered, and so
+   * lost its rolling restart) will never report, so we count it as failed.
+   */
+  e = [[rollActive allKeys] objectEnumerator];
+  while ((n = [e nextObject]) != nil)
+    {
+      if ([self findIn: commands byName: n] != [rollActive objectForKey: n])
+	{
+	  [self rolled: n succeeded: NO];
+	}
+    }
+}
+
+- (void) rolled: (NSString*)n succeeded: (BOOL)ok
+{
+  NSString	*m;
+
+  if (nil == [rollActive objectForKey: n])
+    {
+      return;
+    }
+  [rollActive removeObjectForKey: n];
+  if (YES == ok)
+    {
+      [rollDone addObject: n];
+      m = [NSString stringWithFormat:
+	@"Rolling restart completed on '%@' (%u hosts done, %u to go)\n",
+	n, (unsigned)[rollDone count],
+	(unsigned)([rollQueue count] + [rollActive count])];
+    }
+  else
+    {
+      [rollFailed addObject: n];
+      [rollQueue removeAllObjects];
+      m = [NSString stringWithFormat:
+	@"Rolling restart failed on '%@' - no more hosts will be started\n",
+	n];
+    }
+  [self information: m type: LT_CONSOLE to: rollConsole from: nil];
+  [self rollNext];
+}
+
+- (NSString*) rolling: (NSMutableArray*)cmd from: (NSString*)f
+{
+  NSString	*wd = cmdWord(cmd, 1);
+  NSArray	*a;
+  NSUInteger	index;
+  NSUInteger	hosts = 1;
+
+  if ([wd length] == 0)
+    {
+      if (nil == rollCommand)
+	{
+	  return @"No rolling restart in progress.\n";
+	}
+      return [NSString stringWithFormat:
+	@"Rolling restart '%@' from '%@'\n"
+	@"  In progress on: %@\n  Waiting: %@\n  Done: %@\n  Failed: %@\n",
+	[rollCommand componentsJoinedByString: @" "], rollConsole,
+	[[rollActive allKeys] componentsJoinedByString: @", "],
+	[rollQueue componentsJoinedByString: @", "],
+	[rollDone componentsJoinedByString: @", "],
+	[rollFailed componentsJoinedByString: @", "]];
+    }
+  if (comp(wd, @"stop") == 0)
+    {
+      NSData	*dat;
+      NSString	*n;
+
+      if (nil == rollCommand)
+	{
+	  return @"No rolling restart in progress.\n";
+	}
+      [rollQueue removeAllObjects];
+      dat = [NSPropertyListSerialization
+	dataFromPropertyList: cmd
+	format: NSPropertyListBinaryFormat_v1_0
+	errorDescription: 0];
+      a = [rollActive allKeys];
+      for (index = 0; index < [a count]; index++)
+	{
+	  CommandInfo	*c;
+
+	  n = [a objectAtIndex: index];
+	  c = [rollActive objectForKey: n];
+	  NS_DURING
+	    {
+	      [[c obj] command: dat to: nil from: f];
+	    }
+	  NS_HANDLER
+	    {
+	      NSLog(@"Caught: %@", localException);
+	    }
+	  NS_ENDHANDLER
+	}
+      return @"Rolling restart stopped; no more hosts will be started.\n";
+    }
+  if (nil != rollCommand)
+    {
+      return @"A rolling restart is already in progress.\n";
+    }
+
+  /* Strip out the number of hosts to work on at once, since that option
+   * is for us rather than for the Command servers.
+   */
+  for (index = 2; index + 1 < [cmd count]; index++)
+    {
+      if (comp([cmd objectAtIndex: index], @"hosts") >= 0)
+	{
+	  int	val = [[cmd objectAtIndex: index + 1] intValue];
+
+	  if (val > 0)
+	    {
+	      hosts = val;
+	    }
+	  [cmd removeObjectAtIndex: index + 1];
+	  [cmd removeObjectAtIndex: index];
+	  break;
+	}
+    }
+
+  /* Each Command server enforces its own limit on unavailable processes,
+   * so working on several hosts at once would multiply that limit.
+   */
+  if (hosts > 1)
+    {
+      for (index = 2; index + 1 < [cmd count]; index += 2)
+	{
+	  if (comp([cmd objectAtIndex: index], @"unavailable") >= 0)
+	    {
+	      return @"The unavailable limit applies to each host, so it"
+		@" may not be combined with more than one host at a time.\n";
+	    }
+	}
+    }
+
+  a = [commands allObjects];
+  if (0 == [a count])
+    {
+      return @"No hosts to restart on.\n";
+    }
+  rollQueue = [[NSMutableArray alloc] initWithCapacity: [a count]];
+  for (index = 0; index < [a count]; index++)
+    {
+      [rollQueue addObject: [[a objectAtIndex: index] name]];
+    }
+  [rollQueue sortUsingSelector: @selector(compare:)];
+  rollCommand = [cmd copy];
+  rollConsole = [f copy];
+  rollActive = [NSMutableDictionary new];
+  rollDone = [NSMutableArray new];
+  rollFailed = [NSMutableArray new];
+  rollWidth = hosts;
+  [self rollNext];
+  return [NSString stringWithFormat:
+    @"Rolling restart started on %u hosts, %u at a time.\n",
+    (unsigned)[a count], (unsigned)hosts];
+}
+
+- (oneway void) rolling: (NSString*)pattern
+	      succeeded: (BOOL)ok
+		     on: (id<Command>)s
+{
+  CommandInfo	*c = (CommandInfo*)[self findIn: commands byObject: s];
+
+  /* Only a report for the restart we sent counts; the host may also be
+   * running a restart that was started from a Console attached to it.
+   */
+  if (nil != c && [rollActive objectForKey: [c name]] == c
+    && [pattern isEqual: cmdWord(rollCommand, 1)])
+    {
+      [self rolled: [c name] succeeded: ok];
+    }
+}
+
+- (void) rollNext
+{
+  NSData	*dat;
+  NSString	*m;
+
+  if (nil == rollCommand)
+    {
+      return;
+    }
+  dat = [NSPropertyListSerialization
+    dataFromPropertyList: rollCommand
+    format: NSPropertyListBinaryFormat_v1_0
+    errorDescription: 0];
+  while ([rollActive count] < rollWidth && [rollQueue count] > 0)
+    {
+      NSString		*n = AUTORELEASE(RETAIN([rollQueue objectAtIndex: 0]));
+      CommandInfo	*c;
+
+      [rollQueue removeObjectAtIndex: 0];
+      c = (CommandInfo*)[self findIn: commands byName: n];
+      if (nil == c)
+	{
+	  continue;	// Host has gone away; nothing to restart there.
+	}
+      [rollActive setObject: c forKey: n];
+      NS_DURING
+	{
+	  [[c obj] command: dat to: nil from: rollConsole];
+	}
+      NS_HANDLER
+	{
+	  NSLog(@"Caught: %@", localException);
+	  [self rolled: n succeeded: NO];
+	}
+      NS_ENDHANDLER
+    }
+  if (nil == rollCommand || [rollActive count] > 0)
+    {
+      return;
+    }
+
+  /* Nothing left in progress, so the whole restart is over.
+   */
+  if ([rollFailed count] > 0)
+    {
+      m = [NSString stringWithFormat:
+	@"Rolling restart '%@' abandoned.  Done: %@  Failed: %@\n",
+	[rollCommand componentsJoinedByString: @" "],
+	[rollDone componentsJoinedByString: @", "],
+	[rollFailed componentsJoinedByString: @", "]];
+    }
+  else
+    {
+      m = [NSString stringWithFormat:
+	@"Rolling restart '%@' completed on %u hosts.\n",
+	[rollCommand componentsJoinedByString: @" "],
+	(unsigned)[rollDone count]];
+    }
+  [self information: m type: LT_CONSOLE to: rollConsole from: nil];
+  DESTROY(rollCommand);
+  DESTROY(rollConsole);
+  DESTROY(rollQueue);
+  DESTROY(rollActive);
+  DESTROY(rollDone);
+  DESTROY(rollFailed);
 }
 
 - (void) servers: (NSData*)d
@@ -2732,6 +3501,28 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
     }
 }
 
+/* Computes the digest of each section of the configuration once, so that
+ * the slices for all hosts may be compared with those last sent without
+ * examining their content again.
+ */
+- (void) sliceHashes
+{
+  NSEnumerator	*enumerator;
+  id		key;
+
+  if (nil == sectionHashes)
+    {
+      sectionHashes = [NSMutableDictionary new];
+    }
+  [sectionHashes removeAllObjects];
+  enumerator = [config keyEnumerator];
+  while (nil != (key = [enumerator nextObject]))
+    {
+      [sectionHashes setObject: [EcConfigDelta digest:
+	[config objectForKey: key]] forKey: key];
+    }
+}
+
 - (void) terminate: (NSTimer*)t
 {
   if (nil == terminating)
@@ -2840,6 +3631,8 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	    }
 	}
 
+      [self rollCheck];
+
       /*
        * We ping each client in turn.  If there are fewer than 4 clients,
        * we skip timeouts so that clients get pinged no more frequently
@@ -2894,8 +3687,36 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 
 - (id) recursiveInclude: (id)o
 {
-  id	tmp;
+  IncludeTree	*tree;
+  IncludeTree	*parent;
+  id		tmp;
+
+  if ([o isKindOfClass: [NSArray class]] == NO
+    && [o isKindOfClass: [NSDictionary class]] == NO)
+    {
+      tmp = [self tryInclude: o multi: 0];
+      return tmp;
+    }
+
+  /* If we have already expanded this array/dictionary (ie it comes from
+   * a file which has not changed) and none of the files it includes have
+   * changed, we can use the previous result.
+   */
+  tree = [includeTrees objectForKey: o];
+  if (tree != nil && YES == [self includeTreeValid: tree])
+    {
+      [self includeTreeUsed: tree];
+      if (includeBuilding != nil)
+	{
+	  [includeBuilding->children addObject: tree];
+	}
+      return AUTORELEASE(RETAIN(tree->result));
+    }
 
+  tree = [IncludeTree new];
+  tree->used = includeEpoch;
+  parent = includeBuilding;
+  includeBuilding = tree;
   if ([o isKindOfClass: [NSArray class]] == YES)
     {
       NSMutableArray	*n;
@@ -2930,9 +3751,9 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 		}
 	    }
 	}
-      return AUTORELEASE(n);
+      tree->result = n;
     }
-  else if ([o isKindOfClass: [NSDictionary class]] == YES)
+  else
     {
       NSMutableDictionary	*n;
       NSEnumerator		*e = [o keyEnumerator];
@@ -2958,20 +3779,38 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 		}
 	    }
 	}
-      return AUTORELEASE(n);
+      tree->result = n;
+    }
+  includeBuilding = parent;
+
+  /* A tree containing a failed include is not kept, so that it is retried
+   * (and the failure reported) on the next reload.
+   */
+  if (YES == tree->failed)
+    {
+      if (parent != nil)
+	{
+	  parent->failed = YES;
+	}
     }
   else
     {
-      tmp = [self tryInclude: o multi: 0];
-      return tmp;
+      [includeTrees setObject: tree forKey: o];
+      if (parent != nil)
+	{
+	  [parent->children addObject: tree];
+	}
     }
+  tmp = AUTORELEASE(RETAIN(tree->result));
+  RELEASE(tree);
+  return tmp;
 }
 
 - (id) getInclude: (id)s
 {
   NSString	*base = [self cmdDataDirectory];
   NSString	*file;
-  id		info;
+  IncludeFile	*f;
   NSRange	r;
 
   r = [s rangeOfCharacterFromSet: [NSCharacterSet whitespaceCharacterSet]];
@@ -2986,42 +3825,287 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
     {
       file = [base stringByAppendingPathComponent: file];
     }
-  if ([mgr isReadableFileAtPath: file] == NO)
+  f = [self includeFile: file];
+  if (nil == f->plist)
     {
       NSString	*e;
 
-      e = [NSString stringWithFormat: @"Unable to read file for '%@'\n", s];
+      if (nil == f->failure)
+	{
+	  e = [NSString stringWithFormat:
+	    @"Unable to read file for '%@'\n", s];
+	}
+      else
+	{
+	  e = [NSString stringWithFormat:
+	    @"Unable to parse for '%@' - %@\n", s, f->failure];
+	}
       ASSIGN(configIncludeFailed, e);
       [[self cmdLogFile: logname] printf: @"%@", configIncludeFailed];
+      if (includeBuilding != nil)
+	{
+	  includeBuilding->failed = YES;
+	}
       return nil;
     }
-  info = [NSString stringWithContentsOfFile: file];
-  if (info == nil)
+  if (includeBuilding != nil)
     {
-      NSString	*e;
+      [includeBuilding->files
+	setObject: [NSNumber numberWithUnsignedInt: f->generation]
+	   forKey: file];
+    }
+  return f->plist;
+}
 
-      e = [NSString stringWithFormat: @"Unable to load string for '%@'\n", s];
-      ASSIGN(configIncludeFailed, e);
-      [[self cmdLogFile: logname] printf: @"%@", configIncludeFailed];
-      return nil;
+- (void) includeBegin
+{
+  NSEnumerator	*e;
+  NSMutableArray	*a;
+  id		k;
+
+  /* Discard files and trees which were not used by the last reload
+   * (they are from parts of the configuration which have been removed
+   * or changed), then start a new reload.
+   */
+  a = [NSMutableArray array];
+  e = [includeTrees keyEnumerator];
+  while (nil != (k = [e nextObject]))
+    {
+      IncludeTree	*t = [includeTrees objectForKey: k];
+
+      if (t->used != includeEpoch)
+	{
+	  [a addObject: k];
+	}
+    }
+  e = [a objectEnumerator];
+  while (nil != (k = [e nextObject]))
+    {
+      [includeTrees removeObjectForKey: k];
     }
+
+  [a removeAllObjects];
+  e = [includeFiles keyEnumerator];
+  while (nil != (k = [e nextObject]))
+    {
+      IncludeFile	*f = [includeFiles objectForKey: k];
+
+      if (f->checked != includeEpoch)
+	{
+	  [a addObject: k];
+	}
+    }
+  if ([a count] > 0)
+    {
+      [includeFiles removeObjectsForKeys: a];
+      includeChanged = YES;
+    }
+  includeEpoch++;
+}
+
+- (IncludeFile*) includeFile: (NSString*)path
+{
+  IncludeFile	*f = [includeFiles objectForKey: path];
+  NSDictionary	*attr;
+  NSDate	*when;
+  NSData	*data;
+  NSString	*digest;
+  id		plist;
+
+  if (nil == f)
+    {
+      NSArray	*a = [includeCompiled objectForKey: path];
+
+      f = [IncludeFile new];
+      [includeFiles setObject: f forKey: path];
+      RELEASE(f);
+      if ([a isKindOfClass: [NSArray class]] && [a count] == 4)
+	{
+	  /* Use the contents cached at the last run, as long as the date
+	   * and size of the file show that it has not changed.
+	   */
+	  f->modified = [[NSDate alloc] initWithTimeIntervalSinceReferenceDate:
+	    [[a objectAtIndex: 0] doubleValue]];
+	  f->size = [[a objectAtIndex: 1] unsignedLongLongValue];
+	  f->digest = RETAIN([a objectAtIndex: 2]);
+	  f->plist = RETAIN([a objectAtIndex: 3]);
+	}
+    }
+  if (f->checked == includeEpoch)
+    {
+      return f;		// Already checked during this reload.
+    }
+  f->checked = includeEpoch;
+
+  attr = [mgr fileAttributesAtPath: path traverseLink: YES];
+  when = [attr fileModificationDate];
+  if (nil != f->plist && nil != f->modified
+    && [f->modified isEqual: when] && [attr fileSize] == f->size)
+    {
+      return f;		// Unchanged since last read.
+    }
+
+  includeChanged = YES;
+  if (nil == attr || nil == (data = [NSData dataWithContentsOfFile: path]))
+    {
+      DESTROY(f->modified);
+      DESTROY(f->digest);
+      DESTROY(f->plist);
+      DESTROY(f->failure);
+      f->generation++;
+      return f;
+    }
+
+  /* A file modified within the last couple of seconds may be modified
+   * again without its date changing, so we don't record the date and
+   * the file is checked again at the next reload.
+   */
+  if ([when timeIntervalSinceNow] < -2.0)
+    {
+      ASSIGN(f->modified, when);
+    }
+  else
+    {
+      DESTROY(f->modified);
+    }
+  f->size = [attr fileSize];
+
+  /* If the content is the same (eg the file was touched or rewritten
+   * unchanged) there is no need to parse it.
+   */
+  digest = [[data md5Digest] hexadecimalRepresentation];
+  if (nil != f->plist && [digest isEqual: f->digest])
+    {
+      return f;
+    }
+  ASSIGN(f->digest, digest);
+  f->generation++;
+
   NS_DURING
     {
-      info = [info propertyList];
+      plist = [NSPropertyListSerialization
+	propertyListWithData: data
+	options: NSPropertyListImmutable
+	format: 0
+	error: 0];
+      if (nil == plist)
+	{
+	  [NSException raise: NSGenericException
+		      format: @"Contents of file not a property list"];
+	}
+      ASSIGN(f->plist, plist);
+      DESTROY(f->failure);
     }
   NS_HANDLER
     {
-      NSString	*e;
-
-      e = [NSString stringWithFormat: @"Unable to parse for '%@' - %@\n",
-	s, localException];
-      ASSIGN(configIncludeFailed, e);
-      [[self cmdLogFile: logname] printf: @"%@", configIncludeFailed];
-      info = nil;
+      DESTROY(f->plist);
+      ASSIGN(f->failure, [localException reason]);
     }
   NS_ENDHANDLER
-  s = info;
-  return s;
+  return f;
+}
+
+- (void) includeSave
+{
+  NSMutableDictionary	*cache;
+  NSMutableDictionary	*sources;
+  NSEnumerator		*e;
+  NSString		*path;
+  NSString		*source;
+
+  if (NO == includeChanged && nil == includeCompiled)
+    {
+      return;
+    }
+
+  /* Write the parsed contents of all the files used (except any which
+   * have been modified too recently to trust their dates) along with a
+   * digest of their dates, sizes and contents.
+   */
+  cache = [NSMutableDictionary dictionaryWithCapacity: [includeFiles count]];
+  sources = [NSMutableDictionary dictionaryWithCapacity: [includeFiles count]];
+  e = [includeFiles keyEnumerator];
+  while (nil != (path = [e nextObject]))
+    {
+      IncludeFile	*f = [includeFiles objectForKey: path];
+      NSArray		*a;
+
+      if (nil == f->plist || nil == f->modified)
+	{
+	  continue;
+	}
+      a = [NSArray arrayWithObjects:
+	[NSNumber numberWithDouble:
+	  [f->modified timeIntervalSinceReferenceDate]],
+	[NSNumber numberWithUnsignedLongLong: f->size],
+	f->digest,
+	nil];
+      [sources setObject: a forKey: path];
+      a = [a arrayByAddingObject: f->plist];
+      [cache setObject: a forKey: path];
+    }
+  source = [EcConfigDelta digest: sources];
+
+  if (NO == [source isEqual: [includeCompiled source]])
+    {
+      path = [[self cmdDataDirectory]
+	stringByAppendingPathComponent: @"ControlConfig.map"];
+      if (NO == [EcConfigMap writeConfig: cache
+				 version: configVersion
+				  source: source
+				  toFile: path])
+	{
+	  [[self cmdLogFile: logname]
+	    printf: @"Unable to write config cache to %@\n", path];
+	}
+    }
+  DESTROY(includeCompiled);
+  includeChanged = NO;
+}
+
+- (BOOL) includeTreeValid: (IncludeTree*)t
+{
+  if (t->checked != includeEpoch)
+    {
+      NSEnumerator	*e;
+      NSString		*k;
+      IncludeTree	*c;
+
+      t->checked = includeEpoch;
+      t->valid = YES;
+      e = [t->files keyEnumerator];
+      while (YES == t->valid && nil != (k = [e nextObject]))
+	{
+	  IncludeFile	*f = [self includeFile: k];
+
+	  if (nil == f->plist || f->generation
+	    != [[t->files objectForKey: k] unsignedIntValue])
+	    {
+	      t->valid = NO;
+	    }
+	}
+      e = [t->children objectEnumerator];
+      while (YES == t->valid && nil != (c = [e nextObject]))
+	{
+	  t->valid = [self includeTreeValid: c];
+	}
+    }
+  return t->valid;
+}
+
+- (void) includeTreeUsed: (IncludeTree*)t
+{
+  if (t->used != includeEpoch)
+    {
+      NSEnumerator	*e = [t->children objectEnumerator];
+      IncludeTree	*c;
+
+      t->used = includeEpoch;
+      while (nil != (c = [e nextObject]))
+	{
+	  [self includeTreeUsed: c];
+	}
+    }
 }
 
 - (id) tryInclude: (id)s multi: (BOOL*)flag
@@ -3104,6 +4188,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	       type: LT_CONSOLE
 		 to: nil
 	       from: nil];
+  [self rollCheck];
   if (nil != terminating && 0 == [commands count])
     {
       [self cmdQuit: 0];
@@ -3153,6 +4238,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
   NSDictionary		*d;
   NSArray		*a;
   NSHost                *host;
+  IncludeFile		*f;
   NSString		*base;
   NSString		*path;
   NSString		*str;
@@ -3160,6 +4246,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
   unsigned		i;
   BOOL			changed = NO;
   Class			alerterClass = Nil;
+  NSTimeInterval	started = [NSDate timeIntervalSinceReferenceDate];
 
   host = [NSHost currentHost];
   str = [NSHost controlWellKnownName];
@@ -3177,6 +4264,12 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
     }
   base = [self cmdDataDirectory];
 
+  /* Files are only re-read if they have changed since the last reload,
+   * and only the parts of the configuration which include changed files
+   * are rebuilt.
+   */
+  [self includeBegin];
+
   /* The contents of AlertConfig.plist will override any configuration
    * of Alerter in the global ("*"."*") or Control server ("*"."")
    * sections of Control.plist.
@@ -3184,7 +4277,8 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
   path = [base stringByAppendingPathComponent: @"AlertConfig.plist"];
   if ([mgr isReadableFileAtPath: path] == YES)
     {
-      if ((d = [NSDictionary dictionaryWithContentsOfFile: path]) == nil
+      d = [self includeFile: path]->plist;
+      if ([d isKindOfClass: [NSDictionary class]] == NO
         || (d = [self recursiveInclude: d]) == nil)
         {
           [[self cmdLogFile: logname]
@@ -3203,8 +4297,8 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
     }
 
   path = [base stringByAppendingPathComponent: @"Operators.plist"];
-  if ([mgr isReadableFileAtPath: path] == NO
-    || (d = [NSDictionary dictionaryWithContentsOfFile: path]) == nil
+  d = [self includeFile: path]->plist;
+  if ([d isKindOfClass: [NSDictionary class]] == NO
     || (d = [self recursiveInclude: d]) == nil)
     {
       [[self cmdLogFile: logname]
@@ -3218,42 +4312,41 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	  changed = YES;
 	  RELEASE(operators);
 	  operators = [d mutableCopy];
+	  [self operatorsChanged];
 	}
     }
 
   DESTROY(configIncludeFailed);
   path = [base stringByAppendingPathComponent: @"Control.plist"];
-  if ([mgr isReadableFileAtPath: path] == NO
-    || (str = [NSString stringWithContentsOfFile: path]) == nil)
+  f = [self includeFile: path];
+  conf = f->plist;
+  if (nil == conf)
     {
       NSString	*e;
 
-      e = [NSString stringWithFormat:  @"Failed to load %@\n", path];
+      if (nil == f->failure)
+	{
+	  e = [NSString stringWithFormat:  @"Failed to load %@\n", path];
+	}
+      else
+	{
+	  e = [NSString stringWithFormat:  @"Failed to load %@ - %@\n",
+	    path, f->failure];
+	}
       ASSIGN(configFailed, e);
       [[self cmdLogFile: logname] printf: @"%@", configFailed];
       return NO;
     }
-
-  NS_DURING
-    {
-      conf = [str propertyList];
-      if ([conf isKindOfClass: [NSDictionary class]] == NO)
-	{
-	  [NSException raise: NSGenericException
-		      format: @"Contents of file not a dictionary"];
-	}
-    }
-  NS_HANDLER
+  if ([conf isKindOfClass: [NSDictionary class]] == NO)
     {
       NSString	*e;
 
       e = [NSString stringWithFormat:  @"Failed to load %@ - %@\n",
-	path, [localException reason]];
+	path, @"Contents of file not a dictionary"];
       ASSIGN(configFailed, e);
       [[self cmdLogFile: logname] printf: @"%@", configFailed];
       return NO;
     }
-  NS_ENDHANDLER
 
   if (nil != conf)
     {
@@ -3412,7 +4505,11 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 		  return NO;
 		}
 
+	      /* The expanded dictionary may be reused by the next reload,
+	       * so we modify a copy.
+	       */
 	      app = [self recursiveInclude: hostObj];
+	      app = AUTORELEASE([app mutableCopy]);
               if ([appKey isEqual: @""] || [appKey isEqual: @"Control"])
                 {
                   if (NO == [hostKey isEqual: @"*"])
@@ -3595,13 +4692,43 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	  [sink setMonitor: (id<EcAlarmMonitor>)alerter];
 	}
 
-      dict = [NSMutableDictionary dictionaryWithCapacity: 3];
-
       /*
        * Now per-host config dictionaries consisting of general and
-       * host-specific dictionaries.
+       * host-specific dictionaries.  Only hosts whose slice of the
+       * config has changed are updated, and each is sent as a delta
+       * against the version the Command server already has (if possible).
+       */
+      [self sliceHashes];
+      configVersion++;
+
+      /* With the ConfigTrace default set, each change carries a trace
+       * (see EC_CONFIG_TRACE) to which the Command servers and clients
+       * append their hops.  The trace is not part of the slice digest,
+       * so it never causes an update by itself.
        */
-      a = [NSArray arrayWithArray: commands];
+      if ([[self cmdDefaults] boolForKey: @"ConfigTrace"])
+	{
+	  NSDictionary	*hop;
+
+	  hop = [NSDictionary dictionaryWithObjectsAndKeys:
+	    [self cmdName], @"Name",
+	    [host wellKnownName], @"Host",
+	    [NSNumber numberWithDouble: started], @"Started",
+	    [NSNumber numberWithDouble:
+	      [NSDate timeIntervalSinceReferenceDate]], @"Sent",
+	    nil];
+	  ASSIGN(configTrace, ([NSDictionary dictionaryWithObjectsAndKeys:
+	    [NSString stringWithFormat: @"%@-%d-%llu", [host wellKnownName],
+	      [self processIdentifier], (unsigned long long)configVersion],
+	    @"Id",
+	    [NSArray arrayWithObject: hop], @"Hops",
+	    nil]));
+	}
+      else
+	{
+	  DESTROY(configTrace);
+	}
+      a = [commands allObjects];
       count = [a count];
       for (i = 0; i < count; i++)
 	{
@@ -3609,39 +4736,21 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 
 	  if ([commands indexOfObjectIdenticalTo: c] != NSNotFound)
 	    {
-	      id	o;
-	      NSHost	*h;
+	      NSString	*hash;
 
-	      [dict removeAllObjects];
-	      o = [config objectForKey: @"*"];
-	      if (o != nil)
-		{
-		  [dict setObject: o forKey: @"*"];
-		}
-	      h = [NSHost hostWithWellKnownName: [c name]];
-              if (nil == h)
-                {
-                  h = [NSHost hostWithName: [c name]];
-                }
-              // Configuration keys may be NSHost objects
-	      o = [config objectForKey: (NSString*)h];
-	      if (o != nil)
+	      dict = [self configSliceFor: [c name] hash: &hash];
+	      if ([hash isEqual: [c sliceHash]])
 		{
-		  [dict setObject: o forKey: [c name]];
+		  continue;	// Nothing changed for this host
 		}
-	      if (operators != nil)
+	      if (nil != configTrace)
 		{
-		  [dict setObject: operators forKey: @"Operators"];
+		  [dict setObject: configTrace forKey: EC_CONFIG_TRACE];
 		}
 	      NS_DURING
 		{
-		  NSData	*dat;
-
-		  dat = [NSPropertyListSerialization
-		    dataFromPropertyList: dict
-		    format: NSPropertyListBinaryFormat_v1_0
-		    errorDescription: 0];
-		  [[c obj] updateConfig: dat];
+		  [c updateConfig: dict version: configVersion];
+		  [c setSliceHash: hash];
 		}
 	      NS_HANDLER
 		{
@@ -3654,6 +4763,7 @@ static NSString*	cmdWord(NSArray* a, unsigned int pos)
 	}
     }
   DESTROY(configFailed);
+  [self includeSave];
 
   return changed;
 }
@@ -0,0 +1,112 @@
+/** Enterprise Control Configuration and Logging
+    -- shared memory heartbeats from client processes
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#ifndef	INCLUDED_ECHEARTBEAT_H
+#define	INCLUDED_ECHEARTBEAT_H
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+@class	NSString;
+
+/** <p>The Command server creates a heartbeat table for its host as a file
+ * which it and its client processes map into memory shared read-write.
+ * The table holds a fixed number of slots, each of which may be claimed
+ * by a process (using its process ID) and holds a counter and timestamp
+ * which that process updates from its main run loop several times a
+ * second.
+ * </p>
+ * <p>The Command server scans the table every second, so a process whose
+ * run loop has stopped turning is noticed within seconds and without any
+ * messages being sent, whereas the pings sent over Distributed Objects
+ * are infrequent and take minutes to show that a process is hung.
+ * </p>
+ * <p>The table is only ever used by processes on the same host, so its
+ * numbers are held in the native byte order.  A slot is claimed with an
+ * atomic compare-and-swap of its process ID, after which only the owning
+ * process writes the counter and timestamp.
+ * </p>
+ */
+@interface EcHeartbeat : NSObject
+{
+  NSString	*path;
+  void		*base;		/* Start of mapped table	*/
+  size_t	size;		/* Length of mapping		*/
+  unsigned	slots;		/* Number of slots in table	*/
+  unsigned	slot;		/* Slot owned by this process	*/
+  int		pid;		/* Our process ID		*/
+}
+
+/** Maps the table in the file at path (which must already exist and be
+ * valid) for use by a client process, or returns nil on failure.
+ */
++ (EcHeartbeat*) mapFile: (NSString*)path;
+
+/** Maps the table in the file at path for use by the Command server,
+ * creating a new table with the given number of slots if the file does
+ * not exist or is not a valid table.  An existing table is kept (so that
+ * processes which outlive a Command server go on using their slots).
+ * Returns nil on failure.
+ */
++ (EcHeartbeat*) mapFile: (NSString*)path slots: (unsigned)count;
+
+/** Called by a client process to update the counter and timestamp in its
+ * slot, claiming a free slot first if it does not have one.<br />
+ * Returns NO if there is no free slot.
+ */
+- (BOOL) beat;
+
+/** Returns the number of slots whose process ID is set.
+ */
+- (unsigned) count;
+
+/** Returns the path of the file holding the table.
+ */
+- (NSString*) path;
+
+/** Returns the ID of the process which has claimed the slot at index,
+ * or zero if the slot is free.  If the slot is in use, its counter and
+ * the time of the most recent beat are returned in *beats and *when.
+ */
+- (int) processAtSlot: (unsigned)index
+		beats: (uint64_t*)beats
+		 when: (NSTimeInterval*)when;
+
+/** Frees any slot claimed by the process with the given ID.
+ */
+- (void) releaseProcess: (int)p;
+
+/** Frees the slot at index.
+ */
+- (void) releaseSlot: (unsigned)index;
+
+/** Returns the number of slots in the table.
+ */
+- (unsigned) slots;
+
+@end
+
+#endif
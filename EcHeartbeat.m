@@ -0,0 +1,338 @@
+/** Enterprise Control Configuration and Logging
+    -- shared memory heartbeats from client processes
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/Foundation.h>
+
+#import "EcHeartbeat.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+/* The file starts with a header of BEAT_HEADER bytes -
+ *   the magic bytes 'ECHB'
+ *   the format number (32 bits)
+ *   the number of slots (32 bits)
+ *   reserved (32 bits)
+ *   the time the table was created (64 bits, microseconds since 1970)
+ * and padding to BEAT_HEADER bytes.  The header is followed by the slots,
+ * each of BEAT_SLOT bytes so that no two processes write to the same
+ * cache line as each other.
+ * All numbers are in the native byte order.
+ */
+#define	BEAT_MAGIC	"ECHB"
+#define	BEAT_FORMAT	1
+#define	BEAT_HEADER	64
+#define	BEAT_SLOT	64
+
+typedef struct {
+  char		magic[4];
+  uint32_t	format;
+  uint32_t	slots;
+  uint32_t	reserved;
+  uint64_t	created;
+} BeatHeader;
+
+typedef struct {
+  volatile int32_t	pid;		/* Owner (zero if free)		*/
+  uint32_t		reserved;
+  volatile uint64_t	beats;		/* Incremented by each beat	*/
+  volatile uint64_t	stamp;		/* Microseconds since 1970	*/
+} BeatSlot;
+
+static inline uint64_t
+beatStamp()
+{
+  struct timeval	tv;
+
+  gettimeofday(&tv, 0);
+  return (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+static inline BeatSlot*
+beatSlot(void *base, unsigned index)
+{
+  return (BeatSlot*)((char*)base + BEAT_HEADER + index * BEAT_SLOT);
+}
+
+/* Checks that the open file holds a valid table and maps it.
+ */
+static void*
+beatMap(int desc, unsigned *slots, size_t *size)
+{
+  struct stat	sb;
+  BeatHeader	h;
+  void		*m;
+
+  if (fstat(desc, &sb) < 0 || sb.st_size < BEAT_HEADER
+    || pread(desc, &h, sizeof(h), 0) != sizeof(h)
+    || memcmp(h.magic, BEAT_MAGIC, 4) != 0
+    || h.format != BEAT_FORMAT || 0 == h.slots
+    || (off_t)(BEAT_HEADER + h.slots * BEAT_SLOT) != sb.st_size)
+    {
+      return 0;
+    }
+  m = mmap(0, sb.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, desc, 0);
+  if (MAP_FAILED == m)
+    {
+      return 0;
+    }
+  *slots = h.slots;
+  *size = sb.st_size;
+  return m;
+}
+
+@implementation	EcHeartbeat
+
++ (EcHeartbeat*) mapFile: (NSString*)file
+{
+  EcHeartbeat	*hb;
+  void		*m;
+  unsigned	n;
+  size_t	l;
+  int		d;
+
+  if ((d = open([file fileSystemRepresentation], O_RDWR)) < 0)
+    {
+      return nil;
+    }
+  m = beatMap(d, &n, &l);
+  close(d);
+  if (0 == m)
+    {
+      return nil;
+    }
+  hb = [self new];
+  hb->path = [file copy];
+  hb->base = m;
+  hb->size = l;
+  hb->slots = n;
+  return AUTORELEASE(hb);
+}
+
++ (EcHeartbeat*) mapFile: (NSString*)file slots: (unsigned)count
+{
+  EcHeartbeat	*hb;
+  NSString	*tmp;
+  BeatHeader	h;
+  off_t		l;
+  int		d;
+
+  if (nil != (hb = [self mapFile: file]))
+    {
+      return hb;
+    }
+  if (0 == count)
+    {
+      return nil;
+    }
+
+  /* Build the new table in a temporary file and rename it into place, so
+   * a process mapping the file never sees it partly written.
+   */
+  tmp = [file stringByAppendingPathExtension: @"tmp"];
+  unlink([tmp fileSystemRepresentation]);
+  d = open([tmp fileSystemRepresentation], O_RDWR|O_CREAT|O_EXCL, 0600);
+  if (d < 0)
+    {
+      NSLog(@"Unable to create heartbeat table %@: %s", tmp, strerror(errno));
+      return nil;
+    }
+  memset(&h, '\0', sizeof(h));
+  memcpy(h.magic, BEAT_MAGIC, 4);
+  h.format = BEAT_FORMAT;
+  h.slots = count;
+  h.created = beatStamp();
+  l = BEAT_HEADER + count * BEAT_SLOT;
+  if (ftruncate(d, l) < 0 || pwrite(d, &h, sizeof(h), 0) != sizeof(h))
+    {
+      NSLog(@"Unable to write heartbeat table %@: %s", tmp, strerror(errno));
+      close(d);
+      unlink([tmp fileSystemRepresentation]);
+      return nil;
+    }
+  close(d);
+  if (rename([tmp fileSystemRepresentation],
+    [file fileSystemRepresentation]) < 0)
+    {
+      NSLog(@"Unable to rename heartbeat table %@: %s", tmp, strerror(errno));
+      unlink([tmp fileSystemRepresentation]);
+      return nil;
+    }
+  return [self mapFile: file];
+}
+
+- (BOOL) beat
+{
+  BeatSlot	*s;
+
+  if (slot >= slots || beatSlot(base, slot)->pid != pid)
+    {
+      unsigned	i;
+
+      /* We have no slot, or the Command server freed ours (eg because it
+       * lost its connection to us), so we look for a slot already holding
+       * our process ID before claiming a free one.
+       */
+      slot = slots;
+      for (i = 0; i < slots; i++)
+	{
+	  if (beatSlot(base, i)->pid == pid)
+	    {
+	      slot = i;
+	      break;
+	    }
+	}
+      for (i = 0; slot == slots && i < slots; i++)
+	{
+	  s = beatSlot(base, i);
+	  if (0 == s->pid && __sync_bool_compare_and_swap(&s->pid, 0, pid))
+	    {
+	      s->beats = 0;
+	      slot = i;
+	    }
+	}
+      if (slot == slots)
+	{
+	  return NO;
+	}
+    }
+  s = beatSlot(base, slot);
+  s->stamp = beatStamp();
+  s->beats++;
+  return YES;
+}
+
+- (unsigned) count
+{
+  unsigned	found = 0;
+  unsigned	i;
+
+  for (i = 0; i < slots; i++)
+    {
+      if (beatSlot(base, i)->pid != 0)
+	{
+	  found++;
+	}
+    }
+  return found;
+}
+
+- (void) dealloc
+{
+  if (0 != base)
+    {
+      munmap(base, size);
+      base = 0;
+    }
+  DESTROY(path);
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  return [NSString stringWithFormat: @"%@ %@ (%u of %u slots in use)",
+    [super description], path, [self count], slots];
+}
+
+- (id) init
+{
+  if (nil != (self = [super init]))
+    {
+      pid = (int)getpid();
+    }
+  return self;
+}
+
+- (NSString*) path
+{
+  return path;
+}
+
+- (int) processAtSlot: (unsigned)index
+		beats: (uint64_t*)beats
+		 when: (NSTimeInterval*)when
+{
+  BeatSlot	*s;
+  int		p;
+
+  if (index >= slots)
+    {
+      return 0;
+    }
+  s = beatSlot(base, index);
+  if ((p = s->pid) != 0)
+    {
+      *beats = s->beats;
+      *when = (NSTimeInterval)s->stamp / 1000000.0
+	- NSTimeIntervalSince1970;
+    }
+  return p;
+}
+
+- (void) releaseProcess: (int)p
+{
+  unsigned	i;
+
+  if (p <= 0)
+    {
+      return;
+    }
+  for (i = 0; i < slots; i++)
+    {
+      BeatSlot	*s = beatSlot(base, i);
+
+      if (s->pid == p)
+	{
+	  __sync_bool_compare_and_swap(&s->pid, p, 0);
+	}
+    }
+}
+
+- (void) releaseSlot: (unsigned)index
+{
+  if (index < slots)
+    {
+      BeatSlot	*s = beatSlot(base, index);
+      int	p = s->pid;
+
+      if (p != 0)
+	{
+	  __sync_bool_compare_and_swap(&s->pid, p, 0);
+	}
+    }
+}
+
+- (unsigned) slots
+{
+  return slots;
+}
+
+@end
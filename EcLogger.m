@@ -32,6 +32,7 @@
 
 #import "EcProcess.h"
 #import "EcLogger.h"
+#import "EcTrace.h"
 
 NSString* const EcLoggersDidChangeNotification
   = @"EcLoggersDidChangeNotification";
@@ -244,6 +245,7 @@ static NSArray          *modes;
     {
       BOOL	ok = YES;
 
+      EC_TRACE_BEGIN("EcLogger flush")
       if (LT_DEBUG != type)
         {
           if (nil == serverName)
@@ -348,6 +350,7 @@ static NSArray          *modes;
             }
         }
       RELEASE(str);
+      EC_TRACE_END
 
       [lock lock];
       inFlush = NO;
@@ -0,0 +1,157 @@
+/** Enterprise Control Configuration and Logging
+    -- metrics aggregation and archiving
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#ifndef	INCLUDED_ECMETRICS_H
+#define	INCLUDED_ECMETRICS_H
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+@class	NSArray;
+@class	NSDictionary;
+@class	NSLock;
+@class	NSMutableDictionary;
+@class	NSString;
+
+/** The number of buckets in a metric histogram.<br />
+ * Bucket zero counts samples less than one, bucket N (for N greater than
+ * zero) counts samples in the range 2^(N-1) up to (but not including) 2^N,
+ * and the last bucket also counts everything larger than that.
+ */
+#define	EC_METRIC_BUCKETS	32
+
+/** <p>An EcMetrics instance accumulates named counters and histograms in
+ * a thread-safe manner, and hands them on as a delta (the changes since
+ * the last delta was taken) in the form of a property list.
+ * </p>
+ * <p>A delta is a dictionary mapping each metric name to a dictionary
+ * describing the activity for that metric during the interval -
+ * </p>
+ * <deflist>
+ *   <term>C</term>
+ *   <desc>The count of additions to a counter or of samples added to a
+ *   histogram.</desc>
+ *   <term>S</term>
+ *   <desc>The sum of the values added.</desc>
+ *   <term>M</term>
+ *   <desc>The largest single value added.</desc>
+ *   <term>B</term>
+ *   <desc>For histograms only, an array of EC_METRIC_BUCKETS counts
+ *   of the samples falling into each bucket.</desc>
+ * </deflist>
+ * <p>Deltas are designed to be merged, so a delta from one process can be
+ * merged into the metrics of another (as the Command server does for the
+ * processes on its host) without losing information.
+ * </p>
+ */
+@interface EcMetrics : NSObject
+{
+  NSLock		*lock;
+  NSMutableDictionary	*series;
+}
+
+/** Returns the bucket number (in a histogram) for the supplied value.
+ */
++ (unsigned) bucketForValue: (double)value;
+
+/** Returns an estimate of the value below which the fraction (0.0 to 1.0)
+ * of samples in a histogram delta (one entry from a delta dictionary) lie.
+ * Returns zero if the entry is not a histogram.
+ */
++ (double) percentile: (double)fraction of: (NSDictionary*)entry;
+
+/** Adds value to the named counter.
+ */
+- (void) add: (double)value to: (NSString*)name;
+
+/** Returns YES if there is no activity recorded since the last delta.
+ */
+- (BOOL) isEmpty;
+
+/** Merges the entries of a delta (produced by -takeDelta) into the
+ * receiver.  If prefix is not nil, the name of each entry is prefixed
+ * by the prefix and a slash (so that the origin of the metric is recorded).
+ */
+- (void) merge: (NSDictionary*)delta prefix: (NSString*)prefix;
+
+/** Adds value as a sample to the named histogram.
+ */
+- (void) sample: (double)value for: (NSString*)name;
+
+/** Returns a delta describing all activity since the last time this method
+ * was called (and resets the receiver), or nil if there was no activity.
+ */
+- (NSDictionary*) takeDelta;
+@end
+
+/** <p>An EcMetricArchive instance manages a fixed size round-robin file
+ * holding the history of a single metric series.
+ * </p>
+ * <p>The file holds two archives, one with a ten second resolution
+ * covering a day, and one with a one minute resolution covering thirty
+ * days.  Each slot records the count, sum and maximum of the values
+ * recorded during the period it covers, so every update of the file is
+ * a fixed number of small writes and the file never grows once created.
+ * </p>
+ */
+@interface EcMetricArchive : NSObject
+{
+  NSString	*path;
+}
+
+/** Initialises the receiver to work with the file at the specified path.
+ * The file (and any missing directories) will be created when the first
+ * values are recorded.
+ */
+- (id) initWithPath: (NSString*)aPath;
+
+/** Returns the path of the file used by the receiver.
+ */
+- (NSString*) path;
+
+/** Records a delta entry (see EcMetrics) as having occurred at the
+ * specified time, merging it into the slots of each archive covering
+ * that time.<br />
+ * Returns NO if the file could not be created or updated.
+ */
+- (BOOL) record: (NSDictionary*)entry at: (NSTimeInterval)when;
+
+/** Returns the resolution (in seconds) of the slots returned by
+ * -samplesSince: for the specified start time.  This is the finest
+ * resolution for which the archive covers the whole period.
+ */
+- (NSTimeInterval) resolutionSince: (NSTimeInterval)since;
+
+/** Returns the recorded slots starting at or after the specified time
+ * (a time interval since 1970), in chronological order.<br />
+ * Each slot is a dictionary containing the count (C), sum (S) and maximum
+ * value (M) along with the start of the slot (T) as a time interval
+ * since 1970.
+ */
+- (NSArray*) samplesSince: (NSTimeInterval)since;
+@end
+
+#endif
@@ -0,0 +1,615 @@
+/** Enterprise Control Configuration and Logging
+    -- metrics aggregation and archiving
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/Foundation.h>
+
+#import "EcMetrics.h"
+
+#include <math.h>
+
+/* The accumulated values for a single metric.
+ */
+@interface	EcMetric : NSObject
+{
+@public
+  BOOL		histogram;
+  uint64_t	count;
+  double	sum;
+  double	max;
+  uint64_t	buckets[EC_METRIC_BUCKETS];
+}
+- (NSDictionary*) entry;
+- (void) merge: (NSDictionary*)entry;
+@end
+
+@implementation	EcMetric
+
+- (NSDictionary*) entry
+{
+  NSMutableDictionary	*d;
+
+  d = [NSMutableDictionary dictionaryWithCapacity: 4];
+  [d setObject: [NSNumber numberWithUnsignedLongLong: count] forKey: @"C"];
+  [d setObject: [NSNumber numberWithDouble: sum] forKey: @"S"];
+  [d setObject: [NSNumber numberWithDouble: max] forKey: @"M"];
+  if (YES == histogram)
+    {
+      NSNumber	*b[EC_METRIC_BUCKETS];
+      unsigned	i;
+
+      for (i = 0; i < EC_METRIC_BUCKETS; i++)
+	{
+	  b[i] = [NSNumber numberWithUnsignedLongLong: buckets[i]];
+	}
+      [d setObject: [NSArray arrayWithObjects: b count: EC_METRIC_BUCKETS]
+	    forKey: @"B"];
+    }
+  return d;
+}
+
+- (void) merge: (NSDictionary*)entry
+{
+  uint64_t	c = [[entry objectForKey: @"C"] unsignedLongLongValue];
+  double	m = [[entry objectForKey: @"M"] doubleValue];
+  NSArray	*b = [entry objectForKey: @"B"];
+
+  if (0 == count || m > max)
+    {
+      max = m;
+    }
+  count += c;
+  sum += [[entry objectForKey: @"S"] doubleValue];
+  if ([b isKindOfClass: [NSArray class]])
+    {
+      NSUInteger	n = [b count];
+      NSUInteger	i;
+
+      histogram = YES;
+      if (n > EC_METRIC_BUCKETS)
+	{
+	  n = EC_METRIC_BUCKETS;
+	}
+      for (i = 0; i < n; i++)
+	{
+	  buckets[i] += [[b objectAtIndex: i] unsignedLongLongValue];
+	}
+    }
+}
+
+@end
+
+
+@implementation	EcMetrics
+
++ (unsigned) bucketForValue: (double)value
+{
+  int	e;
+
+  if (!(value >= 1.0))
+    {
+      return 0;		// Small, negative, or not a number
+    }
+  (void)frexp(value, &e);
+  if (e >= EC_METRIC_BUCKETS)
+    {
+      e = EC_METRIC_BUCKETS - 1;
+    }
+  return (unsigned)e;
+}
+
++ (double) percentile: (double)fraction of: (NSDictionary*)entry
+{
+  NSArray	*b = [entry objectForKey: @"B"];
+  uint64_t	total = 0;
+  uint64_t	seen = 0;
+  double	want;
+  NSUInteger	n;
+  NSUInteger	i;
+
+  if (NO == [b isKindOfClass: [NSArray class]] || 0 == (n = [b count]))
+    {
+      return 0.0;
+    }
+  for (i = 0; i < n; i++)
+    {
+      total += [[b objectAtIndex: i] unsignedLongLongValue];
+    }
+  if (0 == total)
+    {
+      return 0.0;
+    }
+  if (fraction < 0.0) fraction = 0.0;
+  if (fraction > 1.0) fraction = 1.0;
+  want = fraction * total;
+  for (i = 0; i < n; i++)
+    {
+      uint64_t	c = [[b objectAtIndex: i] unsignedLongLongValue];
+
+      if (c > 0 && seen + c >= want)
+	{
+	  double	lo = (0 == i) ? 0.0 : ldexp(1.0, (int)i - 1);
+	  double	hi = ldexp(1.0, (int)i);
+	  double	val;
+
+	  /* Interpolate linearly within the bucket, but never report a
+	   * value larger than the largest sample actually seen.
+	   */
+	  val = lo + (hi - lo) * ((want - seen) / (double)c);
+	  if ([entry objectForKey: @"M"] != nil
+	    && val > [[entry objectForKey: @"M"] doubleValue])
+	    {
+	      val = [[entry objectForKey: @"M"] doubleValue];
+	    }
+	  return val;
+	}
+      seen += c;
+    }
+  return [[entry objectForKey: @"M"] doubleValue];
+}
+
+- (void) add: (double)value to: (NSString*)name
+{
+  EcMetric	*m;
+
+  [lock lock];
+  m = [series objectForKey: name];
+  if (nil == m)
+    {
+      m = [EcMetric new];
+      [series setObject: m forKey: name];
+      RELEASE(m);
+    }
+  if (0 == m->count || value > m->max)
+    {
+      m->max = value;
+    }
+  m->count++;
+  m->sum += value;
+  [lock unlock];
+}
+
+- (void) dealloc
+{
+  RELEASE(series);
+  RELEASE(lock);
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  NSMutableString	*s;
+  NSEnumerator		*e;
+  NSString		*k;
+
+  s = [NSMutableString stringWithString: [super description]];
+  [lock lock];
+  e = [[[series allKeys] sortedArrayUsingSelector: @selector(compare:)]
+    objectEnumerator];
+  while (nil != (k = [e nextObject]))
+    {
+      EcMetric	*m = [series objectForKey: k];
+
+      [s appendFormat: @"\n  %@ count: %"PRIu64" sum: %g max: %g",
+	k, m->count, m->sum, m->max];
+    }
+  [lock unlock];
+  return s;
+}
+
+- (id) init
+{
+  if (nil != (self = [super init]))
+    {
+      lock = [NSLock new];
+      series = [NSMutableDictionary new];
+    }
+  return self;
+}
+
+- (BOOL) isEmpty
+{
+  BOOL	result;
+
+  [lock lock];
+  result = ([series count] == 0) ? YES : NO;
+  [lock unlock];
+  return result;
+}
+
+- (void) merge: (NSDictionary*)delta prefix: (NSString*)prefix
+{
+  NSEnumerator	*e;
+  NSString	*k;
+
+  if (NO == [delta isKindOfClass: [NSDictionary class]])
+    {
+      return;
+    }
+  [lock lock];
+  e = [delta keyEnumerator];
+  while (nil != (k = [e nextObject]))
+    {
+      NSDictionary	*entry = [delta objectForKey: k];
+      NSString		*n = k;
+      EcMetric		*m;
+
+      if (NO == [entry isKindOfClass: [NSDictionary class]])
+	{
+	  continue;
+	}
+      if (nil != prefix)
+	{
+	  n = [NSString stringWithFormat: @"%@/%@", prefix, k];
+	}
+      m = [series objectForKey: n];
+      if (nil == m)
+	{
+	  m = [EcMetric new];
+	  [series setObject: m forKey: n];
+	  RELEASE(m);
+	}
+      [m merge: entry];
+    }
+  [lock unlock];
+}
+
+- (void) sample: (double)value for: (NSString*)name
+{
+  EcMetric	*m;
+
+  [lock lock];
+  m = [series objectForKey: name];
+  if (nil == m)
+    {
+      m = [EcMetric new];
+      [series setObject: m forKey: name];
+      RELEASE(m);
+    }
+  m->histogram = YES;
+  if (0 == m->count || value > m->max)
+    {
+      m->max = value;
+    }
+  m->count++;
+  m->sum += value;
+  m->buckets[[EcMetrics bucketForValue: value]]++;
+  [lock unlock];
+}
+
+- (NSDictionary*) takeDelta
+{
+  NSMutableDictionary	*d = nil;
+
+  [lock lock];
+  if ([series count] > 0)
+    {
+      NSEnumerator	*e = [series keyEnumerator];
+      NSString		*k;
+
+      d = [NSMutableDictionary dictionaryWithCapacity: [series count]];
+      while (nil != (k = [e nextObject]))
+	{
+	  EcMetric	*m = [series objectForKey: k];
+
+	  if (m->count > 0)
+	    {
+	      [d setObject: [m entry] forKey: k];
+	    }
+	}
+      [series removeAllObjects];
+    }
+  [lock unlock];
+  if ([d count] == 0)
+    {
+      d = nil;
+    }
+  return d;
+}
+
+@end
+
+
+/* The on-disk layout of an archive file is a header followed by the slots
+ * of each archive in turn.  Values are stored in native byte order since
+ * the files are only ever used on the host where they are written.
+ */
+#define	ARCHIVE_MAGIC	"EcRRA001"
+#define	ARCHIVE_COUNT	2
+
+typedef struct {
+  char		magic[8];
+  uint32_t	count;
+  uint32_t	resolution[ARCHIVE_COUNT];
+  uint32_t	slots[ARCHIVE_COUNT];
+  uint32_t	pad;
+} ArchiveHeader;
+
+typedef struct {
+  int64_t	stamp;		// Slot start (seconds since 1970) or zero
+  double	count;
+  double	sum;
+  double	max;
+} ArchiveSlot;
+
+static const uint32_t	archiveResolution[ARCHIVE_COUNT] = { 10, 60 };
+static const uint32_t	archiveSlots[ARCHIVE_COUNT] = { 8640, 43200 };
+
+static unsigned long long
+slotOffset(unsigned archive, uint32_t index)
+{
+  unsigned long long	offset = sizeof(ArchiveHeader);
+  unsigned		i;
+
+  for (i = 0; i < archive; i++)
+    {
+      offset += (unsigned long long)archiveSlots[i] * sizeof(ArchiveSlot);
+    }
+  return offset + (unsigned long long)index * sizeof(ArchiveSlot);
+}
+
+@implementation	EcMetricArchive
+
+- (void) dealloc
+{
+  RELEASE(path);
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  return [NSString stringWithFormat: @"%@ %@", [super description], path];
+}
+
+- (id) initWithPath: (NSString*)aPath
+{
+  if (nil != (self = [super init]))
+    {
+      ASSIGNCOPY(path, aPath);
+    }
+  return self;
+}
+
+/* Opens the archive file for updating, creating and initialising it
+ * if necessary.  Returns nil on failure.
+ */
+- (NSFileHandle*) _handleCreating: (BOOL)create
+{
+  NSFileManager	*mgr = [NSFileManager defaultManager];
+  NSFileHandle	*fh;
+  ArchiveHeader	h;
+  NSData	*d;
+
+  if (NO == [mgr fileExistsAtPath: path])
+    {
+      unsigned	i;
+
+      if (NO == create)
+	{
+	  return nil;
+	}
+      if (NO == [mgr createDirectoryAtPath:
+	[path stringByDeletingLastPathComponent]
+	withIntermediateDirectories: YES
+	attributes: nil
+	error: NULL])
+	{
+	  NSLog(@"Unable to create directory for metrics archive %@", path);
+	  return nil;
+	}
+      memset(&h, '\0', sizeof(h));
+      memcpy(h.magic, ARCHIVE_MAGIC, sizeof(h.magic));
+      h.count = ARCHIVE_COUNT;
+      for (i = 0; i < ARCHIVE_COUNT; i++)
+	{
+	  h.resolution[i] = archiveResolution[i];
+	  h.slots[i] = archiveSlots[i];
+	}
+      if (NO == [mgr createFileAtPath: path
+			     contents: [NSData dataWithBytes: &h
+						      length: sizeof(h)]
+			   attributes: nil])
+	{
+	  NSLog(@"Unable to create metrics archive %@", path);
+	  return nil;
+	}
+      fh = [NSFileHandle fileHandleForUpdatingAtPath: path];
+      /* Extend the file to its full size; the unwritten slots read as
+       * zero (empty) and most filesystems will not allocate space for
+       * them until they are used.
+       */
+      [fh truncateFileAtOffset: slotOffset(ARCHIVE_COUNT, 0)];
+      return fh;
+    }
+
+  fh = [NSFileHandle fileHandleForUpdatingAtPath: path];
+  if (nil == fh)
+    {
+      NSLog(@"Unable to open metrics archive %@", path);
+      return nil;
+    }
+  d = [fh readDataOfLength: sizeof(h)];
+  if ([d length] != sizeof(h))
+    {
+      NSLog(@"Short header in metrics archive %@", path);
+      return nil;
+    }
+  memcpy(&h, [d bytes], sizeof(h));
+  if (memcmp(h.magic, ARCHIVE_MAGIC, sizeof(h.magic)) != 0
+    || h.count != ARCHIVE_COUNT
+    || h.resolution[0] != archiveResolution[0]
+    || h.resolution[1] != archiveResolution[1]
+    || h.slots[0] != archiveSlots[0]
+    || h.slots[1] != archiveSlots[1])
+    {
+      NSLog(@"Bad header in metrics archive %@", path);
+      return nil;
+    }
+  return fh;
+}
+
+- (NSString*) path
+{
+  return path;
+}
+
+- (BOOL) record: (NSDictionary*)entry at: (NSTimeInterval)when
+{
+  NSFileHandle	*fh;
+  double	count = [[entry objectForKey: @"C"] doubleValue];
+  double	sum = [[entry objectForKey: @"S"] doubleValue];
+  double	max = [[entry objectForKey: @"M"] doubleValue];
+  int64_t	t = (int64_t)when;
+  unsigned	i;
+  BOOL		ok = YES;
+
+  if (t <= 0 || !(count > 0.0))
+    {
+      return YES;	// Nothing to record
+    }
+  if (nil == (fh = [self _handleCreating: YES]))
+    {
+      return NO;
+    }
+  NS_DURING
+    {
+      for (i = 0; i < ARCHIVE_COUNT; i++)
+	{
+	  int64_t		start = t - (t % archiveResolution[i]);
+	  uint32_t		index;
+	  unsigned long long	offset;
+	  ArchiveSlot		s;
+	  NSData		*d;
+
+	  index = (uint32_t)((t / archiveResolution[i]) % archiveSlots[i]);
+	  offset = slotOffset(i, index);
+	  [fh seekToFileOffset: offset];
+	  d = [fh readDataOfLength: sizeof(s)];
+	  if ([d length] == sizeof(s))
+	    {
+	      memcpy(&s, [d bytes], sizeof(s));
+	    }
+	  else
+	    {
+	      memset(&s, '\0', sizeof(s));
+	    }
+	  if (s.stamp != start)
+	    {
+	      /* The slot is empty or holds data from a previous cycle
+	       * round the archive, so we start it afresh.
+	       */
+	      s.stamp = start;
+	      s.count = 0.0;
+	      s.sum = 0.0;
+	      s.max = max;
+	    }
+	  else if (max > s.max)
+	    {
+	      s.max = max;
+	    }
+	  s.count += count;
+	  s.sum += sum;
+	  [fh seekToFileOffset: offset];
+	  [fh writeData: [NSData dataWithBytes: &s length: sizeof(s)]];
+	}
+    }
+  NS_HANDLER
+    {
+      NSLog(@"Problem updating metrics archive %@: %@", path, localException);
+      ok = NO;
+    }
+  NS_ENDHANDLER
+  [fh closeFile];
+  return ok;
+}
+
+- (NSTimeInterval) resolutionSince: (NSTimeInterval)since
+{
+  NSTimeInterval	now = [[NSDate date] timeIntervalSince1970];
+  unsigned		i;
+
+  for (i = 0; i < ARCHIVE_COUNT - 1; i++)
+    {
+      if (now - since
+	<= (NSTimeInterval)archiveResolution[i] * archiveSlots[i])
+	{
+	  break;
+	}
+    }
+  return (NSTimeInterval)archiveResolution[i];
+}
+
+static NSInteger
+compareSlots(id a, id b, void *context)
+{
+  return [(NSNumber*)[a objectForKey: @"T"]
+    compare: (NSNumber*)[b objectForKey: @"T"]];
+}
+
+- (NSArray*) samplesSince: (NSTimeInterval)since
+{
+  NSMutableArray	*result = [NSMutableArray array];
+  NSTimeInterval	res = [self resolutionSince: since];
+  NSFileHandle		*fh;
+  NSData		*d;
+  unsigned		archive;
+  const ArchiveSlot	*s;
+  uint32_t		n;
+  uint32_t		i;
+
+  for (archive = 0; archive < ARCHIVE_COUNT - 1; archive++)
+    {
+      if (archiveResolution[archive] == (uint32_t)res)
+	{
+	  break;
+	}
+    }
+  if (nil == (fh = [self _handleCreating: NO]))
+    {
+      return result;
+    }
+  n = archiveSlots[archive];
+  [fh seekToFileOffset: slotOffset(archive, 0)];
+  d = [fh readDataOfLength: n * sizeof(ArchiveSlot)];
+  [fh closeFile];
+  n = [d length] / sizeof(ArchiveSlot);
+  s = (const ArchiveSlot*)[d bytes];
+  for (i = 0; i < n; i++)
+    {
+      if (s[i].stamp > 0 && (NSTimeInterval)s[i].stamp >= since)
+	{
+	  [result addObject: [NSDictionary dictionaryWithObjectsAndKeys:
+	    [NSNumber numberWithDouble: (double)s[i].stamp], @"T",
+	    [NSNumber numberWithDouble: s[i].count], @"C",
+	    [NSNumber numberWithDouble: s[i].sum], @"S",
+	    [NSNumber numberWithDouble: s[i].max], @"M",
+	    nil]];
+	}
+    }
+  [result sortUsingFunction: compareSlots context: 0];
+  return result;
+}
+
+@end
@@ -0,0 +1,91 @@
+/** Enterprise Control Configuration and Logging
+    -- event driven watching for process termination
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#ifndef	INCLUDED_ECPIDWATCH_H
+#define	INCLUDED_ECPIDWATCH_H
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSRunLoop.h>
+
+/** <p>An EcPidWatch instance holds a process file descriptor (pidfd) for
+ * a process and watches it in the current run loop, so that the Command
+ * server learns of the end of a process as soon as it happens rather than
+ * by polling with kill().  Since the descriptor refers to the process
+ * itself rather than its process ID, there is no race with the ID being
+ * reused by a new process.
+ * </p>
+ * <p>The process need not be a child of the Command server, so processes
+ * which were started externally (and only registered with the Command
+ * server) or adopted from a previous Command server may be watched too.
+ * </p>
+ * <p>Process file descriptors are only available on Linux (5.3 or later).
+ * Elsewhere +watch:target:selector: returns nil and the caller must fall
+ * back to polling.
+ * </p>
+ */
+@interface EcPidWatch : NSObject <RunLoopEvents>
+{
+  int		pid;
+  int		descriptor;
+  id		target;		/* Not retained	*/
+  NSRunLoop	*loop;		/* Owning thread's run loop	*/
+  SEL		selector;
+  BOOL		exited;
+}
+
+/** Returns YES if process file descriptors can be used on this host.
+ */
++ (BOOL) available;
+
+/** Returns the number of processes currently being watched.
+ */
++ (unsigned) count;
+
+/** Returns an autoreleased instance watching the process with the given
+ * ID, which sends the selector (with the instance as its argument) to
+ * the target when the process ends.<br />
+ * Returns nil if the process does not exist or can not be watched.
+ */
++ (EcPidWatch*) watch: (int)p target: (id)t selector: (SEL)s;
+
+/** Returns YES if the process has ended.
+ */
+- (BOOL) hasExited;
+
+/** Stops watching the process (the target will not be told of its end).
+ * This must be called in the thread which created the watch (as must the
+ * final release, since -dealloc invalidates the watch), because the
+ * descriptor is removed from that thread's run loop and then closed.
+ */
+- (void) invalidate;
+
+/** Returns the ID of the watched process.
+ */
+- (int) processIdentifier;
+
+@end
+
+#endif
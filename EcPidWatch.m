@@ -0,0 +1,191 @@
+/** Enterprise Control Configuration and Logging
+    -- event driven watching for process termination
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/Foundation.h>
+
+#import "EcPidWatch.h"
+
+#import "config.h"
+
+#include <errno.h>
+#include <unistd.h>
+#if	defined(__linux__)
+#include <poll.h>
+#include <sys/syscall.h>
+#ifndef	SYS_pidfd_open
+#define	SYS_pidfd_open	434	/* The same on all architectures */
+#endif
+#define	HAVE_PIDFD	1
+#endif
+
+static unsigned	watching = 0;
+
+static int
+pidfdOpen(int pid)
+{
+#if	defined(HAVE_PIDFD)
+  return (int)syscall(SYS_pidfd_open, pid, 0);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+@implementation	EcPidWatch
+
++ (BOOL) available
+{
+  static int	state = -1;
+
+  if (state < 0)
+    {
+      int	fd = pidfdOpen(getpid());
+
+      if (fd < 0)
+	{
+	  state = 0;
+	}
+      else
+	{
+	  close(fd);
+	  state = 1;
+	}
+    }
+  return (state > 0) ? YES : NO;
+}
+
++ (unsigned) count
+{
+  return watching;
+}
+
++ (EcPidWatch*) watch: (int)p target: (id)t selector: (SEL)s
+{
+  EcPidWatch	*w;
+  int		fd;
+
+  if (p <= 0 || NO == [self available] || (fd = pidfdOpen(p)) < 0)
+    {
+      return nil;
+    }
+  w = [[self alloc] init];
+  w->pid = p;
+  w->descriptor = fd;
+  w->target = t;
+  w->selector = s;
+  w->loop = RETAIN([NSRunLoop currentRunLoop]);
+  watching++;
+  [w->loop addEvent: (void*)(uintptr_t)fd
+	       type: ET_RDESC
+	    watcher: w
+	    forMode: NSDefaultRunLoopMode];
+  return AUTORELEASE(w);
+}
+
+- (void) dealloc
+{
+  [self invalidate];
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  return [NSString stringWithFormat: @"%@ pid %d%@", [super description],
+    pid, (YES == exited) ? @" (exited)" : @""];
+}
+
+- (BOOL) hasExited
+{
+#if	defined(HAVE_PIDFD)
+  if (NO == exited && descriptor >= 0)
+    {
+      struct pollfd	pfd;
+
+      /* The descriptor becomes readable when the process ends.
+       */
+      pfd.fd = descriptor;
+      pfd.events = POLLIN;
+      pfd.revents = 0;
+      if (poll(&pfd, 1, 0) > 0)
+	{
+	  return YES;
+	}
+    }
+#endif
+  return exited;
+}
+
+- (id) init
+{
+  if (nil != (self = [super init]))
+    {
+      descriptor = -1;
+    }
+  return self;
+}
+
+/* Run loops are not thread-safe, so this is only called in the thread
+ * which owns the loop the descriptor was added to.
+ */
+- (void) invalidate
+{
+  target = nil;
+  if (descriptor >= 0)
+    {
+      [loop removeEvent: (void*)(uintptr_t)descriptor
+		   type: ET_RDESC
+		forMode: NSDefaultRunLoopMode
+		    all: YES];
+      close(descriptor);
+      descriptor = -1;
+      watching--;
+    }
+  DESTROY(loop);
+}
+
+- (int) processIdentifier
+{
+  return pid;
+}
+
+- (void) receivedEvent: (void*)data
+		  type: (RunLoopEventType)type
+		 extra: (void*)extra
+	       forMode: (NSString*)mode
+{
+  id	t = target;
+
+  /* The descriptor stays readable once the process has ended, so we
+   * stop watching it before telling the target.
+   */
+  RETAIN(self);
+  exited = YES;
+  [self invalidate];
+  [t performSelector: selector withObject: self];
+  RELEASE(self);
+}
+
+@end
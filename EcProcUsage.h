@@ -0,0 +1,214 @@
+/** Enterprise Control Configuration and Logging
+    -- resource usage of managed processes and of the host
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#ifndef	INCLUDED_ECPROCUSAGE_H
+#define	INCLUDED_ECPROCUSAGE_H
+
+#import <Foundation/NSObject.h>
+#import <Foundation/NSDate.h>
+
+@class	NSMutableDictionary;
+@class	NSString;
+
+/** Opens a /proc file (close on exec) to be re-read with EcProcRead().
+ * Returns the file descriptor, or -1 if the file could not be opened.
+ */
+extern int	EcProcOpen(const char *path);
+
+/** Reads the whole of the /proc file open on fd into buf, preceded by a
+ * newline so that every field name in the file may be found by searching
+ * for newline+name, and terminated by a nul.  Returns NO if the file could
+ * not be read (or fd is negative).
+ */
+extern BOOL	EcProcRead(int fd, char *buf, unsigned size);
+
+/** Returns the number following the first occurrence of name in buf, or
+ * zero if name is not present.
+ */
+extern uint64_t	EcProcField(const char *buf, const char *name);
+
+/** <p>An EcProcessUsage instance samples the CPU, memory and I/O usage of
+ * a single process from the /proc filesystem (its stat, statm and io
+ * files) so that the Command server can account for the processes it
+ * manages without any help from them.  This works just as well for a
+ * process which is hung or otherwise unable to report on itself.
+ * </p>
+ * <p>The files are opened when the instance is created and re-read from
+ * the start with pread() for each sample, so a sample costs three system
+ * calls.  An open /proc file refers to the process rather than to its
+ * process ID, so once the process has ended a sample fails rather than
+ * reporting on a new process which has been given the same ID.
+ * </p>
+ * <p>Rates (CPU and I/O) are for the interval between the two most
+ * recent samples.  On systems without /proc no instance can be created.
+ * </p>
+ */
+@interface EcProcessUsage : NSObject
+{
+  int			pid;
+  int			fds[3];		/* stat, statm and io	*/
+  NSTimeInterval	when;		/* Time of last sample	*/
+  NSTimeInterval	interval;	/* Since previous one	*/
+  uint64_t		ticks;		/* User plus system CPU	*/
+  uint64_t		readBytes;
+  uint64_t		writeBytes;
+  uint64_t		rss;		/* Resident bytes	*/
+  uint64_t		size;		/* Virtual bytes	*/
+  unsigned		threads;
+  char			state;
+  BOOL			hasIO;
+  double		cpu;		/* Percent of one CPU	*/
+  double		readRate;	/* Bytes per second	*/
+  double		writeRate;	/* Bytes per second	*/
+}
+
+/** Returns a new instance for the process with the given ID, having taken
+ * an initial sample, or nil if the process could not be sampled.
+ */
++ (EcProcessUsage*) usageFor: (int)p;
+
+/** Returns the percentage of a single CPU the process used during the
+ * last interval (may exceed 100 for a process with several threads).
+ */
+- (double) cpu;
+
+/** Returns YES if the I/O counts of the process are readable.
+ */
+- (BOOL) hasIO;
+
+/** Returns the length of the last interval, or zero after only a single
+ * sample has been taken (in which case there are no rates yet).
+ */
+- (NSTimeInterval) interval;
+
+/** Returns the ID of the process sampled.
+ */
+- (int) processIdentifier;
+
+/** Returns the number of bytes per second the process fetched from
+ * storage during the last interval.
+ */
+- (double) readRate;
+
+/** Returns the resident memory size of the process in bytes.
+ */
+- (uint64_t) rss;
+
+/** Takes a new sample.  Returns NO if the process no longer exists.
+ */
+- (BOOL) sample;
+
+/** Returns the virtual memory size of the process in bytes.
+ */
+- (uint64_t) size;
+
+/** Returns the scheduler state of the process (eg 'R' when running, 'S'
+ * when sleeping, 'D' when waiting for I/O and 'Z' for a zombie).
+ */
+- (char) state;
+
+/** Returns the number of threads in the process.
+ */
+- (unsigned) threads;
+
+/** Returns the number of bytes per second the process sent to storage
+ * during the last interval.
+ */
+- (double) writeRate;
+@end
+
+/** <p>An EcHostUsage instance samples host wide CPU, memory and disk usage
+ * from /proc/stat, /proc/meminfo and /proc/diskstats in the same way as
+ * EcProcessUsage does for a single process.
+ * </p>
+ * <p>Disk usage is reported for the busiest device (other than loop and
+ * ram devices), as the percentage of the last interval during which it
+ * had I/O in progress.  A device which is busy all of the time is
+ * saturated, whatever the rate of transfer.
+ * </p>
+ */
+@interface EcHostUsage : NSObject
+{
+  int			fds[3];		/* stat, meminfo, diskstats	*/
+  char			*buffer;	/* For reading diskstats	*/
+  unsigned		length;		/* Size of buffer		*/
+  NSTimeInterval	when;
+  NSTimeInterval	interval;
+  uint64_t		total;		/* All CPU ticks		*/
+  uint64_t		idle;
+  uint64_t		iowait;
+  uint64_t		memTotal;	/* Bytes			*/
+  uint64_t		memAvailable;	/* Bytes			*/
+  NSMutableDictionary	*disks;		/* Name -> milliseconds busy	*/
+  NSString		*diskName;	/* Busiest device		*/
+  unsigned		cpus;
+  double		cpuBusy;	/* Percent of all CPUs		*/
+  double		cpuWait;	/* Percent waiting for I/O	*/
+  double		diskBusy;	/* Percent busiest disk busy	*/
+}
+
+/** Returns the number of CPUs on the host.
+ */
+- (unsigned) cpus;
+
+/** Returns the percentage of the total CPU capacity of the host which
+ * was in use (not idle and not waiting for I/O) during the last interval.
+ */
+- (double) cpuBusy;
+
+/** Returns the percentage of the total CPU capacity of the host which
+ * was idle while waiting for I/O during the last interval.
+ */
+- (double) cpuWait;
+
+/** Returns the percentage of the last interval during which the busiest
+ * disk had I/O in progress.
+ */
+- (double) diskBusy;
+
+/** Returns the name of the busiest disk, or nil if none is known.
+ */
+- (NSString*) diskName;
+
+/** Returns the length of the last interval, or zero after only a single
+ * sample has been taken (in which case there are no rates yet).
+ */
+- (NSTimeInterval) interval;
+
+/** Returns the memory available for starting new processes, in bytes.
+ */
+- (uint64_t) memAvailable;
+
+/** Returns the total memory of the host, in bytes.
+ */
+- (uint64_t) memTotal;
+
+/** Takes a new sample.  Returns NO if /proc/stat is not readable.
+ */
+- (BOOL) sample;
+@end
+
+#endif
@@ -0,0 +1,485 @@
+/** Enterprise Control Configuration and Logging
+    -- resource usage of managed processes and of the host
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/Foundation.h>
+
+#import "EcProcUsage.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static double	clockTicks = 0.0;
+static uint64_t	pageSize = 0;
+
+int
+EcProcOpen(const char *path)
+{
+  int	fd = open(path, O_RDONLY);
+
+#if	defined(FD_CLOEXEC)
+  if (fd >= 0)
+    {
+      fcntl(fd, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+  return fd;
+}
+
+BOOL
+EcProcRead(int fd, char *buf, unsigned size)
+{
+  ssize_t	len;
+
+  if (fd < 0)
+    {
+      return NO;
+    }
+  buf[0] = '\n';
+  len = pread(fd, buf + 1, size - 2, 0);
+  if (len <= 0)
+    {
+      return NO;
+    }
+  buf[len + 1] = '\0';
+  return YES;
+}
+
+uint64_t
+EcProcField(const char *buf, const char *name)
+{
+  const char	*p = strstr(buf, name);
+
+  if (NULL == p)
+    {
+      return 0;
+    }
+  p += strlen(name);
+  return (uint64_t)strtoull(p, NULL, 10);
+}
+
+static void
+usageSetup()
+{
+  if (0 == pageSize)
+    {
+      clockTicks = 100.0;
+#if	defined(_SC_CLK_TCK)
+      clockTicks = (double)sysconf(_SC_CLK_TCK);
+#endif
+      pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    }
+}
+
+@implementation	EcProcessUsage
+
++ (EcProcessUsage*) usageFor: (int)p
+{
+  EcProcessUsage	*u;
+  char			path[64];
+
+  if (p <= 0)
+    {
+      return nil;
+    }
+  usageSetup();
+  u = AUTORELEASE([self new]);
+  u->pid = p;
+  snprintf(path, sizeof(path), "/proc/%d/stat", p);
+  u->fds[0] = EcProcOpen(path);
+  snprintf(path, sizeof(path), "/proc/%d/statm", p);
+  u->fds[1] = EcProcOpen(path);
+  snprintf(path, sizeof(path), "/proc/%d/io", p);
+  u->fds[2] = EcProcOpen(path);
+  if (NO == [u sample])
+    {
+      return nil;
+    }
+  return u;
+}
+
+- (double) cpu
+{
+  return cpu;
+}
+
+- (void) dealloc
+{
+  unsigned	i;
+
+  for (i = 0; i < 3; i++)
+    {
+      if (fds[i] >= 0)
+	{
+	  close(fds[i]);
+	  fds[i] = -1;
+	}
+    }
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  NSMutableString	*m;
+
+  m = [NSMutableString stringWithFormat:
+    @"CPU %.1f%%, RSS %.1fMB, size %.1fMB, %u threads, state %c",
+    cpu, rss / 1048576.0, size / 1048576.0, threads, state];
+  if (YES == hasIO)
+    {
+      [m appendFormat: @", disk read %.1fKB/s, write %.1fKB/s",
+	readRate / 1024.0, writeRate / 1024.0];
+    }
+  return m;
+}
+
+- (BOOL) hasIO
+{
+  return hasIO;
+}
+
+- (id) init
+{
+  if (nil != (self = [super init]))
+    {
+      fds[0] = fds[1] = fds[2] = -1;
+    }
+  return self;
+}
+
+- (NSTimeInterval) interval
+{
+  return interval;
+}
+
+- (int) processIdentifier
+{
+  return pid;
+}
+
+- (double) readRate
+{
+  return readRate;
+}
+
+- (uint64_t) rss
+{
+  return rss;
+}
+
+- (BOOL) sample
+{
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  char			buf[1024];
+  const char		*p;
+  char			s;
+  uint64_t		utime;
+  uint64_t		stime;
+  uint64_t		t;
+  uint64_t		pages;
+  uint64_t		resident;
+  uint64_t		rb = 0;
+  uint64_t		wb = 0;
+  BOOL			io = NO;
+
+  /* The command name in the stat file may contain spaces, so we parse
+   * from the last closing parenthesis.
+   */
+  if (NO == EcProcRead(fds[0], buf, sizeof(buf))
+    || NULL == (p = strrchr(buf, ')'))
+    || sscanf(p + 2, "%c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %"
+      SCNu64 " %" SCNu64 " %*d %*d %*d %*d %" SCNu64,
+      &s, &utime, &stime, &t) != 4)
+    {
+      return NO;
+    }
+  if (NO == EcProcRead(fds[1], buf, sizeof(buf))
+    || sscanf(buf + 1, "%" SCNu64 " %" SCNu64, &pages, &resident) != 2)
+    {
+      return NO;
+    }
+  if (YES == EcProcRead(fds[2], buf, sizeof(buf)))
+    {
+      io = YES;
+      rb = EcProcField(buf, "\nread_bytes:");
+      wb = EcProcField(buf, "\nwrite_bytes:");
+    }
+
+  if (when > 0.0 && now > when)
+    {
+      interval = now - when;
+      cpu = (utime + stime >= ticks)
+	? 100.0 * (utime + stime - ticks) / clockTicks / interval : 0.0;
+      if (YES == io && YES == hasIO)
+	{
+	  readRate = (rb >= readBytes)
+	    ? (double)(rb - readBytes) / interval : 0.0;
+	  writeRate = (wb >= writeBytes)
+	    ? (double)(wb - writeBytes) / interval : 0.0;
+	}
+      else
+	{
+	  readRate = writeRate = 0.0;
+	}
+    }
+  when = now;
+  state = s;
+  ticks = utime + stime;
+  threads = (unsigned)t;
+  size = pages * pageSize;
+  rss = resident * pageSize;
+  hasIO = io;
+  readBytes = rb;
+  writeBytes = wb;
+  return YES;
+}
+
+- (uint64_t) size
+{
+  return size;
+}
+
+- (char) state
+{
+  return state;
+}
+
+- (unsigned) threads
+{
+  return threads;
+}
+
+- (double) writeRate
+{
+  return writeRate;
+}
+
+@end
+
+
+@implementation	EcHostUsage
+
+- (unsigned) cpus
+{
+  return cpus;
+}
+
+- (double) cpuBusy
+{
+  return cpuBusy;
+}
+
+- (double) cpuWait
+{
+  return cpuWait;
+}
+
+- (void) dealloc
+{
+  unsigned	i;
+
+  for (i = 0; i < 3; i++)
+    {
+      if (fds[i] >= 0)
+	{
+	  close(fds[i]);
+	  fds[i] = -1;
+	}
+    }
+  if (0 != buffer)
+    {
+      free(buffer);
+      buffer = 0;
+    }
+  DESTROY(disks);
+  DESTROY(diskName);
+  [super dealloc];
+}
+
+- (NSString*) description
+{
+  NSMutableString	*m;
+
+  m = [NSMutableString stringWithFormat:
+    @"CPU %.1f%% busy (%.1f%% waiting for I/O) on %u CPUs,"
+    @" memory %.1fGB available of %.1fGB",
+    cpuBusy, cpuWait, cpus, memAvailable / 1073741824.0,
+    memTotal / 1073741824.0];
+  if (nil != diskName)
+    {
+      [m appendFormat: @", disk %@ %.1f%% busy", diskName, diskBusy];
+    }
+  return m;
+}
+
+- (double) diskBusy
+{
+  return diskBusy;
+}
+
+- (NSString*) diskName
+{
+  return diskName;
+}
+
+- (id) init
+{
+  if (nil != (self = [super init]))
+    {
+      usageSetup();
+      fds[0] = EcProcOpen("/proc/stat");
+      fds[1] = EcProcOpen("/proc/meminfo");
+      fds[2] = EcProcOpen("/proc/diskstats");
+      length = 65536;	// Room for diskstats of many devices
+      buffer = malloc(length);
+      disks = [NSMutableDictionary new];
+    }
+  return self;
+}
+
+- (NSTimeInterval) interval
+{
+  return interval;
+}
+
+- (uint64_t) memAvailable
+{
+  return memAvailable;
+}
+
+- (uint64_t) memTotal
+{
+  return memTotal;
+}
+
+- (BOOL) sample
+{
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  NSTimeInterval	elapsed = (when > 0.0) ? now - when : 0.0;
+  uint64_t		v[8];
+  uint64_t		t;
+  unsigned		i;
+
+  /* The first line of /proc/stat holds the totals for all CPUs (user,
+   * nice, system, idle, iowait, irq, softirq and steal) and is followed
+   * by a line for each CPU.
+   */
+  if (NO == EcProcRead(fds[0], buffer, length)
+    || sscanf(buffer + 1, "cpu %" SCNu64 " %" SCNu64 " %" SCNu64 " %"
+      SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64 " %" SCNu64,
+      &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &v[6], &v[7]) != 8)
+    {
+      return NO;
+    }
+  for (t = 0, i = 0; i < 8; i++)
+    {
+      t += v[i];
+    }
+  if (elapsed > 0.0 && t > total)
+    {
+      double	d = (double)(t - total);
+
+      cpuBusy = 100.0 * (d - (v[3] - idle) - (v[4] - iowait)) / d;
+      cpuWait = 100.0 * (v[4] - iowait) / d;
+      if (cpuBusy < 0.0) cpuBusy = 0.0;
+    }
+  total = t;
+  idle = v[3];
+  iowait = v[4];
+  cpus = (unsigned)sysconf(_SC_NPROCESSORS_ONLN);
+
+  if (YES == EcProcRead(fds[1], buffer, length))
+    {
+      memTotal = EcProcField(buffer, "\nMemTotal:") * 1024;
+      memAvailable = EcProcField(buffer, "\nMemAvailable:") * 1024;
+    }
+
+  /* Each line of /proc/diskstats holds the major and minor numbers and
+   * name of a device followed by its counters, the tenth of which is the
+   * number of milliseconds during which it has had I/O in progress.
+   */
+  if (YES == EcProcRead(fds[2], buffer, length))
+    {
+      double	busiest = 0.0;
+      NSString	*name = nil;
+      char	*line = buffer + 1;
+
+      while (*line != '\0')
+	{
+	  char		*end = strchr(line, '\n');
+	  char		dev[64];
+	  uint64_t	ms;
+
+	  if (NULL != end)
+	    {
+	      *end = '\0';
+	    }
+	  if (sscanf(line, "%*u %*u %63s %*u %*u %*u %*u %*u %*u %*u %*u %*u %"
+	    SCNu64, dev, &ms) == 2
+	    && strncmp(dev, "loop", 4) != 0 && strncmp(dev, "ram", 3) != 0)
+	    {
+	      NSString	*n = [NSString stringWithUTF8String: dev];
+	      NSNumber	*o = [disks objectForKey: n];
+
+	      if (nil != o && elapsed > 0.0)
+		{
+		  uint64_t	old = [o unsignedLongLongValue];
+		  double	busy;
+
+		  busy = (ms >= old) ? (ms - old) / 10.0 / elapsed : 0.0;
+		  if (busy > 100.0)
+		    {
+		      busy = 100.0;
+		    }
+		  if (nil == name || busy > busiest)
+		    {
+		      busiest = busy;
+		      name = n;
+		    }
+		}
+	      [disks setObject: [NSNumber numberWithUnsignedLongLong: ms]
+			forKey: n];
+	    }
+	  if (NULL == end)
+	    {
+	      break;
+	    }
+	  line = end + 1;
+	}
+      diskBusy = busiest;
+      ASSIGN(diskName, name);
+    }
+
+  interval = elapsed;
+  when = now;
+  return YES;
+}
+
+@end
@@ -107,6 +107,7 @@
 })
 
 
+@class	EcMetrics;
 @class	NSFileHandle;
 
 typedef enum    {
@@ -144,6 +145,29 @@ typedef enum    {
 - (oneway void) updateConfig: (in bycopy NSData*)info;
 @end
 
+/** The CmdConfigDelta protocol is implemented by processes which are able
+ * to accept configuration changes as a delta against the version of the
+ * configuration they last received (see [EcConfigDelta]).<br />
+ * A sender checks that the receiver responds to -updateConfigDelta:
+ * before sending a delta, and otherwise sends the full configuration
+ * using -updateConfig:
+ */
+@protocol	CmdConfigDelta
+- (oneway void) updateConfigDelta: (in bycopy NSData*)delta;
+@end
+
+/** The CmdConfigMapped protocol is implemented by processes which are able
+ * to read their configuration from the file published by the Command
+ * server for the whole host (see [EcConfigMap]).  The Command server uses
+ * -updateConfigMapped: to tell such a process that a new version of the
+ * file is available at the specified path.<br />
+ * The process parses its own sections of the file into its user defaults,
+ * so the configuration it uses is not shared with other processes.
+ */
+@protocol	CmdConfigMapped
+- (oneway void) updateConfigMapped: (in bycopy NSString*)path;
+@end
+
 @protocol       EcConfigForwarded;
 
 /** The EcConfigForwarding protocol is provided by a process to allow
@@ -312,6 +336,12 @@ typedef enum    {
 		       type: (EcLogType)t
 		         to: (NSString*)to
 		       from: (NSString*)from;
+/** Passes the metrics gathered on a host (a serialized property list
+ * containing the Start of the interval as a time since 1970 and the
+ * Series delta keyed by process/name) for archiving.
+ */
+- (oneway void) metrics: (in bycopy NSData*)delta
+		   from: (NSString*)host;
 - (bycopy NSData*) registerCommand: (id<Command>)c
 			      name: (NSString*)n;
 - (bycopy NSString*) registerConsole: (id<Console>)c
@@ -320,12 +350,91 @@ typedef enum    {
 - (oneway void) reply: (NSString*)msg
 		   to: (NSString*)n
 		 from: (NSString*)c;
+/** Tells Control that the rolling restart of the processes matching
+ * pattern on the host of the Command server s has finished, either
+ * successfully or by being abandoned.
+ */
+- (oneway void) rolling: (NSString*)pattern
+	      succeeded: (BOOL)ok
+		     on: (id<Command>)s;
 - (oneway void) servers: (in bycopy NSData*)a
 		     on: (id<Command>)s;
 - (oneway void) unmanage: (NSString*)name;
 - (void) unregister: (id)o;
 @end
 
+/** <p>An EcConfigSnapshot is an immutable view of the configuration of a
+ * process, as returned by the [EcProcess-ecConfigSnapshot] method.
+ * </p>
+ * <p>A new snapshot is published each time the user defaults of the
+ * process change (including when a new configuration arrives from the
+ * Command server).  Publication replaces the current snapshot with an
+ * atomic pointer swap, so threads reading configuration never wait for
+ * an update and always see all the values from a single update.
+ * </p>
+ */
+@interface EcConfigSnapshot : NSObject
+{
+  NSDictionary		*configuration;
+  NSDictionary		*defaults;
+  NSString		*prefix;
+  uint64_t		version;
+}
+
+/** Returns the configuration received from the Command server (as passed
+ * to the -cmdUpdate: method) when the snapshot was published.
+ */
+- (NSDictionary*) configuration;
+
+/** Returns the user defaults of the process (all domains merged) when the
+ * snapshot was published.
+ */
+- (NSDictionary*) defaults;
+
+/** Returns the value of the user default for key, looked up in the same
+ * way as [EcProcess-cmdDefaults] would (ie using the defaults prefix if
+ * a value for the prefixed key exists).
+ */
+- (id) objectForKey: (NSString*)key;
+
+/** Returns the version of the snapshot.  This starts at one and increases
+ * by one each time a snapshot is published.
+ */
+- (uint64_t) version;
+@end
+
+/** <p>The typed value slot of a user default, as returned by the
+ * +ecDefaultSlot: method.  The fields are resolved (using the same
+ * conversions as the corresponding NSUserDefaults methods) once when the
+ * value of the default changes, so a read does no key lookup, search of
+ * the defaults domains, or conversion of the value.
+ * </p>
+ * <p>The fields are updated one at a time, so they must not be read
+ * directly.  Use the EcDefaultSlotRead() function to take a consistent
+ * copy of them (from any thread).
+ * </p>
+ */
+typedef struct	{
+  BOOL		boolValue;	/* As returned by -boolForKey:	*/
+  NSInteger	integerValue;	/* As returned by -integerForKey:	*/
+  double	doubleValue;	/* As returned by -doubleForKey:	*/
+  NSString	*stringValue;	/* As returned by -stringForKey:	*/
+  uint64_t	version;	/* Odd while the slot is updated	*/
+} EcDefaultSlot;
+
+/** Copies the fields of slot into *value, all from the same update of the
+ * default (retrying if the slot is being updated), and returns the version
+ * of the update copied.  The stringValue in the copy is retained and
+ * autoreleased, so it remains valid even if the slot is updated again.<br />
+ * Each read therefore costs a few atomic operations (including claiming
+ * a hazard slot for the string), a retain and an autorelease, and may
+ * spin briefly while the default is being updated.  That is much cheaper
+ * than looking the default up by name, but is not free, so code in a
+ * tight loop should read the slot once outside the loop.
+ */
+extern uint64_t	EcDefaultSlotRead(const EcDefaultSlot *slot,
+  EcDefaultSlot *value);
+
 /*
  *	Useful functions -
  */
@@ -540,6 +649,22 @@ extern NSString*	cmdVersion(NSString *ver);
  *     but may be overridden by using the 'release' command in the
  *     Console program.
  *   </desc>
+ *   <term>EcStallAlarm</term>
+ *   <desc>
+ *     The number of milliseconds for which the main run loop may stall
+ *     (fail to service a heartbeat from the stall watchdog thread) before
+ *     an alarm is raised.  The alarm is cleared after five minutes without
+ *     stalls.  The default is 10000, and zero disables the alarm.
+ *   </desc>
+ *   <term>EcStallThreshold</term>
+ *   <desc>
+ *     The number of milliseconds for which the main run loop may stall
+ *     before the stall is recorded.  When the threshold is crossed the
+ *     stack of the main thread is captured (where the system supports it)
+ *     and logged as a warning along with the duration of the stall, and
+ *     the stall duration is added to the MainLoopStall metric.
+ *     The default is 1000, and zero disables the stall watchdog.
+ *   </desc>
  *   <term>EcTesting</term>
  *   <desc>
  *     This boolean value determines whether the server is running in
@@ -550,6 +675,15 @@ extern NSString*	cmdVersion(NSString *ver);
  *     may be overridden by using the 'testing' command in the
  *     Console program.
  *   </desc>
+ *   <term>EcTrace</term>
+ *   <desc>
+ *     This boolean value causes span tracing (see EcTrace.h) to be turned
+ *     on from the point the process starts, so that the time taken by
+ *     each phase of startup may be examined.  Tracing continues until
+ *     the 'trace stop' command is used in the Console (or the value is
+ *     set to NO), at which point the recorded spans are written to a file
+ *     in the debug logs directory.
+ *   </desc>
  *   <term>EcWellKnownHostNames</term>
  *   <desc>A dictionary mapping host aliases to well known names (the
  *   canonical values used by Command and Control) and/or real host names.
@@ -592,8 +726,8 @@ extern NSString*	cmdVersion(NSString *ver);
  *   specific alarms of different severity.
  * </p>
  */
-@interface EcProcess : NSObject <CmdClient,EcAlarmDestination,
-  EcConfigForwarding>
+@interface EcProcess : NSObject <CmdClient,CmdConfigDelta,CmdConfigMapped,
+  EcAlarmDestination,EcConfigForwarding>
 {
   /** Any method which is executing in the main thread (and needs to
    * return before a quit can be handled in the main thread) must
@@ -634,7 +768,10 @@ extern NSString*	cmdVersion(NSString *ver);
  */
 + (NSMutableDictionary*) ecInitialDefaults;
 
-/** Returns the lock used by the -ecDoLock and -ecUnLock methods.
+/** Returns the lock used by the -ecDoLock and -ecUnLock methods.<br />
+ * The lock records how often it is acquired, how long threads wait for
+ * it, and which code was holding it when they had to wait.  These figures
+ * may be examined using the 'locks' command from the Console.
  */
 + (NSRecursiveLock*) ecLock;
 
@@ -673,6 +810,18 @@ extern NSString*	cmdVersion(NSString *ver);
                     action: (SEL)cmd
                      value: (id)value;
 
+/** Returns the typed value slot for the named user default, for use on
+ * code paths where the cost of looking up the default by name matters.
+ * <br />
+ * The slot remains valid for the life of the process, so it may be
+ * obtained once (eg in +initialize) and then read using
+ * EcDefaultSlotRead() whenever the value is needed.<br />
+ * If the default has not been registered using the
+ * +ecRegisterDefault:withTypeText:andHelpText:action:value: method, a
+ * registration without help text is created for it.
+ */
++ (const EcDefaultSlot*) ecDefaultSlot: (NSString*)name;
+
 /** Convenience method to create the singleton EcProcess instance
  * using the initial configuration provided by the +ecInitialDefaults
  * method.<br />
@@ -1038,7 +1187,10 @@ extern NSString*	cmdVersion(NSString *ver);
 - (NSString*) ecMesg: (NSArray*)msg from: (NSString*)operator;
 
 /** Attempt to establish connection to Command server etc.
- * Return a proxy to that server if it is available.
+ * Return a proxy to that server if it is available.<br />
+ * After a failure (or when told to back off by the Command server) the
+ * next attempt is delayed using +[EcAdmission delayFor:after:] so that
+ * the processes on a host do not all reconnect at the same moment.
  */
 - (id) cmdNewServer;
 
@@ -1176,6 +1328,14 @@ extern NSString*	cmdVersion(NSString *ver);
  */
 - (NSUserDefaults*) cmdDefaults;
 
+/** Returns the current immutable snapshot of the configuration of the
+ * process.  This method may be called from any thread and neither locks
+ * nor waits for a configuration update in progress, so it is the best
+ * way for worker threads to read configuration.  A thread which needs
+ * several related values should obtain them all from one snapshot.
+ */
+- (EcConfigSnapshot*) ecConfigSnapshot;
+
 /** Returns the instance ID used for this process, or nil if there is none.
  */
 - (NSString*) cmdInstance;
@@ -1379,6 +1539,25 @@ extern NSString*	cmdVersion(NSString *ver);
  */
 - (void) ecHadOP: (NSDate*)when;
 
+/** Adds value to the counter metric with the specified name.<br />
+ * Metrics are collected by the Command server (in the responses to its
+ * regular pings), aggregated for the host, and passed on to the Control
+ * server where they are archived and may be queried from the Console
+ * using the 'metrics' command.<br />
+ * Metric names should not contain a slash character.
+ */
+- (void) ecMetric: (NSString*)name add: (double)value;
+
+/** Adds value as a sample to the histogram metric with the specified name
+ * (typically used for durations or sizes).<br />
+ * See -ecMetric:add: for details of how metrics are handled.
+ */
+- (void) ecMetric: (NSString*)name sample: (double)value;
+
+/** Returns the object used to accumulate the metrics of this process.
+ */
+- (EcMetrics*) ecMetrics;
+
 /** Called on the first timeout of a new day.<br />
  * The argument 'when' is the timestamp of the timeout.<br />
  * If you override this, don't forget to call the superclass
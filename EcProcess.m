@@ -26,6 +26,10 @@
 
    */
 
+#if	defined(__linux__) && !defined(_GNU_SOURCE)
+#define	_GNU_SOURCE	/* For REG_RIP etc and pthread_getattr_np() */
+#endif
+
 #import <Foundation/Foundation.h>
 
 #import <GNUstepBase/GSObjCRuntime.h>
@@ -141,6 +145,14 @@ setupTLS(NSUserDefaults *u)
 #import "EcUserDefaults.h"
 #import "EcBroadcastProxy.h"
 #import "EcMemoryLogger.h"
+#import "EcResourceLogger.h"
+#import "EcMetrics.h"
+#import "EcTrace.h"
+#import "EcConfigDelta.h"
+#import "EcConfigMap.h"
+#import "EcAdmission.h"
+#import "EcHeartbeat.h"
+#import "EcProcUsage.h"
 
 #include "config.h"
 
@@ -165,6 +177,9 @@ extern char *crypt(const char *key, const char *salt);
 #ifdef	HAVE_SYS_FCNTL_H
 #include <sys/fcntl.h>
 #endif
+#ifdef	HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
 #ifdef	HAVE_UNISTD_H
 #include <unistd.h>
 #endif
@@ -349,6 +364,7 @@ trim(char *str)
   SEL           cmd;            // method to update when default values change
   id            obj;            // The latest value of the default
   id            val;            // The fallback value of the default
+  EcDefaultSlot slot;           // The typed forms of obj
 }
 + (void) defaultsChanged: (NSUserDefaults*)defs;
 + (NSMutableString*) listHelp: (NSString*)key;
@@ -359,6 +375,8 @@ trim(char *str)
                   action: (SEL)cmd
                    value: (id)value;
 + (void) showHelp;
++ (EcDefaultSlot*) slotFor: (NSString*)name;
+- (void) resolve: (NSUserDefaults*)defs;
 @end
 
 /* Lock for controlling access to per-process singleton instance.
@@ -380,7 +398,9 @@ static NSString		*cmdUser = nil;
 static NSUserDefaults	*cmdDefs = nil;
 static NSString		*cmdDebugName = nil;
 static NSMutableDictionary	*cmdLogMap = nil;
+static NSRecursiveLock		*logLock = nil;	// Protects cmdLogMap
 static id<EcMemoryLogger>       cmdMemoryLogger = nil;
+static id<EcResourceLogger>     cmdResourceLogger = nil;
 static NSMutableArray     	*ecConfigClients = nil;
 
 static NSDate	*started = nil;	        /* Time object was created. */
@@ -869,15 +889,396 @@ static NSMutableSet	*cmdActions = nil;
 static id		cmdServer = nil;
 static id		cmdPTimer = nil;
 static NSDictionary	*cmdConf = nil;
+static NSDictionary	*cmdConfInfo = nil;	// As sent by Command server
+static uint64_t		cmdConfVersion = 0;	// Version of cmdConfInfo
+static NSDictionary	*cmdConfTrace = nil;	// Trace of last change
+static NSTimeInterval	cmdConfReceived = 0.0;	// When the change arrived
+static NSUInteger	cmdConfBytes = 0;	// Size of message carrying it
+static BOOL		cmdConfMapped = NO;	// Change was in a mapped file
 static NSDate		*cmdFirst = nil;
 static NSDate		*cmdLast = nil;
+static NSTimer		*cmdRTimer = nil;	// Retry connection to Command
+static NSTimeInterval	cmdRetryAt = 0.0;	// Earliest retry to Command
+static unsigned		cmdRetries = 0;		// Consecutive failures
+static BOOL		cmdAccepted = NO;	// Accepted by Command?
 static BOOL		cmdIsTransient = NO;
 static NSMutableSet	*cmdDebugModes = nil;
 static NSMutableDictionary	*cmdDebugKnown = nil;
 static NSMutableString	*replyBuffer = nil;
+static EcMetrics	*ecMetrics = nil;
+
+/* Stops tracing and writes any recorded spans into the debug logs
+ * directory, returning a message describing the outcome.
+ */
+static NSString*
+traceWrite()
+{
+  NSData	*data = EcTraceStop();
+  NSString	*name;
+  NSString	*path;
+
+  if (nil == data)
+    {
+      return @"Tracing was not active.";
+    }
+  name = [[NSCalendarDate date]
+    descriptionWithCalendarFormat: @"%Y%m%d%H%M%S"
+    timeZone: nil
+    locale: nil];
+  name = [NSString stringWithFormat: @"%@-%@.trace.json", cmdLogName(), name];
+  path = [cmdLogsDir(nil) stringByAppendingPathComponent: name];
+  if (NO == [data writeToFile: path atomically: YES])
+    {
+      return [NSString stringWithFormat: @"Unable to write trace to %@", path];
+    }
+  return [NSString stringWithFormat: @"Trace written to %@", path];
+}
+
+/* Lock protecting cmdConf and ecConfigClients.
+ */
+static NSLock		*confLock = nil;
+
+static NSDictionary*
+confSnapshot()
+{
+  NSDictionary	*d;
+
+  [confLock lock];
+  d = RETAIN(cmdConf);
+  [confLock unlock];
+  return AUTORELEASE(d);
+}
+
+@interface	EcConfigSnapshot (Private)
+- (id) initWithConfiguration: (NSDictionary*)c
+		    defaults: (NSDictionary*)d
+		      prefix: (NSString*)p
+		     version: (uint64_t)v;
+@end
+
+@implementation	EcConfigSnapshot
+
+- (NSDictionary*) configuration
+{
+  return configuration;
+}
+
+- (void) dealloc
+{
+  DESTROY(configuration);
+  DESTROY(defaults);
+  DESTROY(prefix);
+  [super dealloc];
+}
+
+- (NSDictionary*) defaults
+{
+  return defaults;
+}
+
+- (id) initWithConfiguration: (NSDictionary*)c
+		    defaults: (NSDictionary*)d
+		      prefix: (NSString*)p
+		     version: (uint64_t)v
+{
+  if (nil != (self = [super init]))
+    {
+      configuration = [c copy];
+      defaults = [d copy];
+      prefix = [p copy];
+      version = v;
+    }
+  return self;
+}
+
+- (id) objectForKey: (NSString*)key
+{
+  if (nil != prefix)
+    {
+      id	o;
+
+      if (NO == [key hasPrefix: prefix])
+	{
+	  o = [defaults objectForKey: [prefix stringByAppendingString: key]];
+	}
+      else
+	{
+	  o = [defaults objectForKey: key];
+	  key = [key substringFromIndex: [prefix length]];
+	}
+      if (nil != o)
+	{
+	  return o;
+	}
+    }
+  return [defaults objectForKey: key];
+}
+
+- (uint64_t) version
+{
+  return version;
+}
+
+@end
+
+/* Objects read by lock-free readers are protected by hazard slots.
+ * A reader claims a free slot, stores the pointer it loaded in the slot
+ * and then checks that the pointer has not been replaced before it
+ * retains the object.  A writer replaces the pointer (under confLock) and
+ * retires the old object, which is only released once no hazard slot
+ * holds it.  If every slot is in use, a reader falls back to taking
+ * confLock for its load and retain.
+ */
+#define	HAZARD_SLOTS	64
+#define	HAZARD_CLAIMED	((void*)1)
+
+static void		*hazards[HAZARD_SLOTS];
+static NSMutableArray	*retiredObjects = nil;	// Protected by confLock
+
+/* Loads the object at location into *result and protects it from being
+ * released until hazardDone() is called with the returned slot number.
+ * If every slot is in use this returns -1 with confLock locked instead.
+ */
+static int
+hazardProtect(id *location, id *result)
+{
+  unsigned	start;
+  unsigned	n;
+  id		o;
+
+  /* Start the search at a point depending on the stack of the calling
+   * thread, so that threads rarely compete for the same slot.
+   */
+  start = (unsigned)(((uintptr_t)&start >> 12) % HAZARD_SLOTS);
+  for (n = 0; n < HAZARD_SLOTS; n++)
+    {
+      unsigned	i = (start + n) % HAZARD_SLOTS;
+      void	*expected = NULL;
+
+      if (__atomic_compare_exchange_n(&hazards[i], &expected, HAZARD_CLAIMED,
+	NO, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+	{
+	  do
+	    {
+	      o = __atomic_load_n(location, __ATOMIC_SEQ_CST);
+	      __atomic_store_n(&hazards[i],
+		(nil == o) ? HAZARD_CLAIMED : (void*)o, __ATOMIC_SEQ_CST);
+	    }
+	  while (o != __atomic_load_n(location, __ATOMIC_SEQ_CST));
+	  *result = o;
+	  return (int)i;
+	}
+    }
+  [confLock lock];
+  *result = *location;
+  return -1;
+}
+
+static void
+hazardDone(int slot)
+{
+  if (slot < 0)
+    {
+      [confLock unlock];
+    }
+  else
+    {
+      __atomic_store_n(&hazards[slot], NULL, __ATOMIC_RELEASE);
+    }
+}
+
+static id
+hazardRetain(id *location)
+{
+  id	o;
+  int	slot = hazardProtect(location, &o);
+
+  RETAIN(o);
+  hazardDone(slot);
+  return AUTORELEASE(o);
+}
+
+/* Releases the retired objects which no reader holds.
+ * Must be called with confLock locked.
+ */
+static void
+hazardReclaim()
+{
+  NSUInteger	count = [retiredObjects count];
+
+  while (count-- > 0)
+    {
+      id	o = [retiredObjects objectAtIndex: count];
+      unsigned	i;
+
+      for (i = 0; i < HAZARD_SLOTS; i++)
+	{
+	  if (__atomic_load_n(&hazards[i], __ATOMIC_SEQ_CST) == (void*)o)
+	    {
+	      break;
+	    }
+	}
+      if (HAZARD_SLOTS == i)
+	{
+	  [retiredObjects removeObjectAtIndex: count];
+	}
+    }
+}
+
+/* Atomically replaces the object at location with o (retained) and
+ * retires the old object.  Must be called with confLock locked.
+ */
+static void
+hazardReplace(id *location, id o)
+{
+  id	old;
+
+  old = __atomic_exchange_n(location, RETAIN(o), __ATOMIC_SEQ_CST);
+  if (nil != old)
+    {
+      if (nil == retiredObjects)
+	{
+	  retiredObjects = [NSMutableArray new];
+	}
+      [retiredObjects addObject: old];
+      RELEASE(old);
+    }
+  hazardReclaim();
+}
+
+uint64_t
+EcDefaultSlotRead(const EcDefaultSlot *slot, EcDefaultSlot *value)
+{
+  EcDefaultSlot	*s = (EcDefaultSlot*)slot;
+  uint64_t	v;
+
+  for (;;)
+    {
+      v = __atomic_load_n(&s->version, __ATOMIC_ACQUIRE);
+      if (v & 1)
+	{
+	  continue;	// Being updated
+	}
+      __atomic_load(&s->boolValue, &value->boolValue, __ATOMIC_RELAXED);
+      __atomic_load(&s->integerValue, &value->integerValue, __ATOMIC_RELAXED);
+      __atomic_load(&s->doubleValue, &value->doubleValue, __ATOMIC_RELAXED);
+      value->stringValue = hazardRetain((id*)&s->stringValue);
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&s->version, __ATOMIC_RELAXED) == v)
+	{
+	  value->version = v;
+	  return v;
+	}
+    }
+}
+
+/* The current configuration snapshot.  Readers load and retain it using
+ * a hazard slot, without taking any lock.
+ */
+static EcConfigSnapshot	*currentSnapshot = nil;
+static uint64_t		snapshotVersion = 0;
+
+static EcConfigSnapshot*
+snapshotCurrent()
+{
+  return hazardRetain((id*)&currentSnapshot);
+}
+
+/* Builds a new snapshot from the current configuration and defaults and
+ * makes it current.  Publishers are serialised by confLock, which readers
+ * never use.  Returns NO (and publishes nothing) if neither the defaults
+ * nor the configuration differ from the current snapshot.
+ */
+static BOOL
+snapshotPublish(NSUserDefaults *defs)
+{
+  NSDictionary		*d = [defs dictionaryRepresentation];
+  NSString		*p = [defs defaultsPrefix];
+  EcConfigSnapshot	*s;
+  EcConfigSnapshot	*old;
+
+  [confLock lock];
+  old = currentSnapshot;
+  if (nil != old && [[old defaults] isEqual: d]
+    && ([old configuration] == cmdConf
+      || [[old configuration] isEqual: cmdConf]))
+    {
+      [confLock unlock];
+      return NO;
+    }
+  s = [[EcConfigSnapshot alloc] initWithConfiguration: cmdConf
+					     defaults: d
+					       prefix: p
+					      version: ++snapshotVersion];
+  hazardReplace((id*)&currentSnapshot, s);
+  RELEASE(s);
+  [confLock unlock];
+  return YES;
+}
+
+/* Lock protecting cmdDebugModes and cmdDebugKnown.  The debug modes are
+ * checked by every debug log call (from any thread), so each change to
+ * them publishes an immutable copy which is read without locking.
+ */
+static NSLock		*debugLock = nil;
+static NSSet		*debugSet = nil;	// Published cmdDebugModes
+
+/* Publishes the current debug modes.  Must be called with debugLock
+ * locked.
+ */
+static void
+debugPublish()
+{
+  NSSet	*s = [cmdDebugModes copy];
+
+  [confLock lock];
+  hazardReplace((id*)&debugSet, s);
+  [confLock unlock];
+  RELEASE(s);
+}
+
+static BOOL
+debugActive(NSString *mode)
+{
+  NSSet	*s;
+  int	slot = hazardProtect((id*)&debugSet, &s);
+  BOOL	active = (nil == [s member: mode]) ? NO : YES;
+
+  hazardDone(slot);
+  return active;
+}
+
+static NSDictionary*
+debugKnown()
+{
+  NSDictionary	*d;
+
+  [debugLock lock];
+  d = [cmdDebugKnown copy];
+  [debugLock unlock];
+  return AUTORELEASE(d);
+}
+
+static NSSet*
+debugModes()
+{
+  NSSet	*s;
+
+  [debugLock lock];
+  s = [cmdDebugModes copy];
+  [debugLock unlock];
+  return AUTORELEASE(s);
+}
 static SEL		cmdTimSelector = 0;
 static NSTimeInterval	cmdTimInterval = 60.0;
 
+/* Once registered with the Command server we update our slot in its
+ * heartbeat table several times a second, so that it can tell at once
+ * if our run loop stops.
+ */
+static EcHeartbeat	*cmdBeats = nil;
+static NSTimer		*cmdBeatTimer = nil;
+
 static NSMutableArray	*noNetConfig = nil;
 
 static NSMutableDictionary *servers = nil;
@@ -966,6 +1367,164 @@ static uint64_t	excRoll[10];    // last N values
 static uint64_t	memRoll[10];    // last N values
 #define	MEMCOUNT (sizeof(memRoll)/sizeof(*memRoll))
 
+/* Resource usage collection from the /proc/self filesystem.
+ * Each file is opened once (when first sampled, which is after any fork
+ * to run as a daemon) and re-read from the start using pread(), so that
+ * taking a sample costs four system calls.
+ */
+typedef struct	{
+  NSTimeInterval	when;
+  uint64_t		utime;		// User CPU in clock ticks
+  uint64_t		stime;		// System CPU in clock ticks
+  uint64_t		minflt;
+  uint64_t		majflt;
+  uint64_t		threads;
+  uint64_t		vcsw;		// Voluntary context switches
+  uint64_t		icsw;		// Involuntary context switches
+  uint64_t		rchar;
+  uint64_t		wchar;
+  uint64_t		rbytes;
+  uint64_t		wbytes;
+  uint64_t		delay;		// Run queue wait in nanoseconds
+  BOOL			hasIO;
+  BOOL			hasSched;
+} ResSample;
+
+static ResSample	resLast;		// Most recent sample
+static NSDictionary	*resRates = nil;	// Rates for last interval
+
+#if	defined(__linux__)
+static const char	*resNames[4] = {
+  "/proc/self/stat",
+  "/proc/self/status",
+  "/proc/self/io",
+  "/proc/self/schedstat"
+};
+static int		resFds[4] = { -2, -2, -2, -2 };
+
+/* Reads one of the files into buf (preceded by a newline so that every
+ * field name in the file may be found by searching for newline+name).
+ * Returns NO if the file is not available.
+ */
+static BOOL
+resRead(unsigned index, char *buf, unsigned size)
+{
+  if (-2 == resFds[index])
+    {
+      resFds[index] = EcProcOpen(resNames[index]);
+    }
+  if (NO == EcProcRead(resFds[index], buf, size))
+    {
+      if (resFds[index] >= 0)
+        {
+          close(resFds[index]);
+          resFds[index] = -1;	// Do not try again
+        }
+      return NO;
+    }
+  return YES;
+}
+#endif
+
+static BOOL
+resSample(ResSample *s)
+{
+#if	defined(__linux__)
+  char		buf[4096];
+  const char	*p;
+
+  memset(s, '\0', sizeof(*s));
+  s->when = [NSDate timeIntervalSinceReferenceDate];
+
+  /* The command name in /proc/self/stat may contain spaces, so we parse
+   * from the last closing parenthesis.
+   */
+  if (NO == resRead(0, buf, sizeof(buf))
+    || NULL == (p = strrchr(buf, ')'))
+    || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %" SCNu64 " %*u %"
+      SCNu64 " %*u %" SCNu64 " %" SCNu64 " %*d %*d %*d %*d %" SCNu64,
+      &s->minflt, &s->majflt, &s->utime, &s->stime, &s->threads) != 5)
+    {
+      return NO;
+    }
+  if (YES == resRead(1, buf, sizeof(buf)))
+    {
+      s->vcsw = EcProcField(buf, "\nvoluntary_ctxt_switches:");
+      s->icsw = EcProcField(buf, "\nnonvoluntary_ctxt_switches:");
+    }
+  if (YES == resRead(2, buf, sizeof(buf)))
+    {
+      s->hasIO = YES;
+      s->rchar = EcProcField(buf, "\nrchar:");
+      s->wchar = EcProcField(buf, "\nwchar:");
+      s->rbytes = EcProcField(buf, "\nread_bytes:");
+      s->wbytes = EcProcField(buf, "\nwrite_bytes:");
+    }
+  if (YES == resRead(3, buf, sizeof(buf)))
+    {
+      uint64_t	run;
+
+      if (sscanf(buf + 1, "%" SCNu64 " %" SCNu64, &run, &s->delay) == 2)
+        {
+          s->hasSched = YES;
+        }
+    }
+  return YES;
+#else
+  return NO;
+#endif
+}
+
+/* Returns the rates of change between two samples.
+ */
+static NSDictionary*
+resRatesBetween(ResSample *o, ResSample *n)
+{
+  NSMutableDictionary	*d;
+  NSTimeInterval	i = n->when - o->when;
+  double		ticks = 100.0;
+
+#if	defined(_SC_CLK_TCK)
+  ticks = (double)sysconf(_SC_CLK_TCK);
+#endif
+  if (i <= 0.0 || ticks <= 0.0)
+    {
+      return nil;
+    }
+#define	RATE(X)	[NSNumber numberWithDouble: \
+  (n->X >= o->X ? (double)(n->X - o->X) / i : 0.0)]
+  d = [NSMutableDictionary dictionaryWithCapacity: 16];
+  [d setObject: [NSNumber numberWithDouble: i] forKey: @"Interval"];
+  [d setObject: [NSNumber numberWithDouble:
+    100.0 * ((n->utime + n->stime) - (o->utime + o->stime)) / ticks / i]
+    forKey: @"CPU"];
+  [d setObject: [NSNumber numberWithDouble:
+    100.0 * (n->utime - o->utime) / ticks / i] forKey: @"CPUUser"];
+  [d setObject: [NSNumber numberWithDouble:
+    100.0 * (n->stime - o->stime) / ticks / i] forKey: @"CPUSystem"];
+  [d setObject: [NSNumber numberWithUnsignedLongLong: n->threads]
+    forKey: @"Threads"];
+  [d setObject: RATE(majflt) forKey: @"MajorFaults"];
+  [d setObject: RATE(minflt) forKey: @"MinorFaults"];
+  [d setObject: RATE(vcsw) forKey: @"VoluntarySwitches"];
+  [d setObject: RATE(icsw) forKey: @"InvoluntarySwitches"];
+  if (YES == o->hasSched && YES == n->hasSched)
+    {
+      [d setObject: [NSNumber numberWithDouble: (n->delay >= o->delay)
+        ? (double)(n->delay - o->delay) / 1000000.0 / i : 0.0]
+        forKey: @"RunDelay"];
+    }
+  if (YES == o->hasIO && YES == n->hasIO)
+    {
+      [d setObject: RATE(rchar) forKey: @"ReadChars"];
+      [d setObject: RATE(wchar) forKey: @"WriteChars"];
+      [d setObject: RATE(rbytes) forKey: @"ReadBytes"];
+      [d setObject: RATE(wbytes) forKey: @"WriteBytes"];
+    }
+#undef	RATE
+  return d;
+}
+
 static NSString*
 setMemAlarm(NSString *str)
 {
@@ -1036,169 +1595,963 @@ setMemBase()
     }
   else
     {
-      memWarn = memMinr = memMajr = memCrit = 0;
+      memWarn = memMinr = memMajr = memCrit = 0;
+    }
+}
+
+/* Returns the found command, or nil if none is found, or an empty string
+ * if there was a match but it was in the array of commands to be blockd.
+ */
+static NSString*
+findAction(NSString *cmd, NSArray *allow)
+{
+  NSString	*found = nil;
+  BOOL          match = NO;
+
+  cmd = [cmd lowercaseString];
+  [ecLock lock];
+  if (nil == (found = [cmdActions member: cmd])
+    || (allow && NO == [allow containsObject: found]))
+    {
+      NSEnumerator	*enumerator;
+      NSString		*name;
+
+      if (found)
+        {
+          found = nil;
+          match = YES;
+        }
+      enumerator = [cmdActions objectEnumerator];
+      while (nil != (name = [enumerator nextObject]))
+	{
+	  if (YES == [name hasPrefix: cmd])
+	    {
+              match = YES;
+              if (allow && NO == [allow containsObject: name])
+                {
+                  continue;     // This match is not allowed
+                }
+	      else if (nil == found)
+		{
+		  found = name;
+		}
+	      else
+		{
+		  found = nil;	// Ambiguous
+                  break;
+		}
+	    }
+	}
+    }
+  if (found)
+    {
+      cmd = [found retain];
+    }
+  else if (match)
+    {
+      cmd = @"";
+    }
+  else
+    {
+      cmd = nil;
+    }
+  [ecLock unlock];
+  return [cmd autorelease];
+}
+ 
+static NSString*
+ecCommandHost()
+{
+  NSString	*host;
+
+  host = [cmdDefs stringForKey: @"CommandHost"];
+  if (nil == host)
+    {
+      host = @"";	/* Local host 	*/
+    }
+  return host;
+}
+
+static NSString*
+ecCommandName()
+{
+  NSString	*name;
+
+  name = [cmdDefs stringForKey: @"CommandName"];
+  if (nil == name)
+    {
+      name = @"Command";
+    }
+  return name;
+}
+
+
+NSString	*cmdBasicDbg = @"basicMode";
+NSString	*cmdDefaultDbg = @"basicMode";  // Allow older code to link
+NSString	*cmdConnectDbg = @"connectMode";
+NSString	*cmdDetailDbg = @"detailMode";
+
+
+static int	comp_len = 0;
+
+static int
+comp(const char* s0, const char* s1)
+{
+  comp_len = 0;
+  if (s0 == 0) {
+      s0 = "";
+  }
+  if (s1 == 0) {
+      s1 = "";
+  }
+  while (*s0) {
+      if (*s0 != *s1) {
+	  char	c0 = islower(*s0) ? toupper(*s0) : *s0;
+	  char	c1 = islower(*s1) ? toupper(*s1) : *s1;
+
+	  if (c0 != c1) {
+	      if (c0 != '\0') {
+		  comp_len = -1; /* s0 is not a substring of s1.	*/
+	      }
+	      return(-1);
+	  }
+      }
+      comp_len++;
+      s0++;
+      s1++;
+  }
+  if (*s0 != *s1) {
+      return(-1);
+  }
+  return(0);
+}
+
+static NSString*
+findMode(NSDictionary* d, NSString* s)
+{
+  NSArray	*a = [d allKeys];
+  NSString	*o;
+  unsigned int	i;
+  const char	*s0 = [s UTF8String];
+  const char	*s1;
+  int		best_pos = -1;
+  int		best_len = 0;
+
+  for (i = 0; i < [a count]; i++)
+    {
+      o = (NSString*)[a objectAtIndex: i];
+      s1 =  [o UTF8String];
+      if (comp(s0, s1) == 0)
+	{
+	  return o;
+	}
+      if (comp_len > best_len)
+	{
+	  best_len = comp_len;
+	  best_pos = i;
+	}
+    }
+  if (best_pos >= 0)
+    {
+      return (NSString*)[a objectAtIndex: best_pos];
+    }
+  return nil;
+}
+
+/* Main run loop stall detection.
+ * A watchdog thread posts a heartbeat to the main thread and measures how
+ * late it is serviced.  If the heartbeat is outstanding for longer than the
+ * threshold, the watchdog interrupts the main thread with a signal whose
+ * handler records the stack of whatever is blocking the run loop.
+ */
+#if	defined(HAVE_EXECINFO_H)
+#include <execinfo.h>
+#endif
+#if	defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#endif
+#include <signal.h>
+
+#if	defined(HAVE_EXECINFO_H) && defined(HAVE_PTHREAD_H) && defined(SIGRTMIN) \
+  && defined(__linux__) \
+  && (defined(__x86_64__) || defined(__i386__) || defined(__aarch64__))
+#define	EC_STALL_STACK	1
+#include <semaphore.h>
+#include <ucontext.h>
+#define	STALL_FRAMES	64
+#define	STALL_SIGNAL	(SIGRTMIN + 3)
+#define	STALL_IDLE	0	// No capture wanted (or capture complete)
+#define	STALL_WANTED	1	// Signal sent, handler not yet run
+#define	STALL_BUSY	2	// Handler is filling stallFrames
+static pthread_t		stallMain;
+static uintptr_t		stallLow;	// Bounds of the main thread stack
+static uintptr_t		stallHigh;
+static void			*stallFrames[STALL_FRAMES];
+static int			stallDepth = 0;
+static int			stallState = STALL_IDLE;
+static sem_t			stallDone;	// Posted when frames are ready
+
+/* The handler may only make async-signal-safe calls, so rather than use
+ * backtrace() (which may allocate or take locks) it takes the interrupted
+ * program counter and frame pointer from the signal context and follows
+ * the chain of frame pointers, never reading outside the main thread's
+ * stack.  Code built without frame pointers ends the chain early, but the
+ * interrupted location is always recorded.
+ */
+static void
+stallHandler(int sig, siginfo_t *info, void *context)
+{
+  ucontext_t	*uc = (ucontext_t*)context;
+  uintptr_t	fp;
+  int		depth = 0;
+  int		expected = STALL_WANTED;
+
+  if (!__atomic_compare_exchange_n(&stallState, &expected, STALL_BUSY,
+    NO, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    {
+      return;	// The watchdog gave up waiting for us
+    }
+#if	defined(__x86_64__)
+  stallFrames[depth++] = (void*)uc->uc_mcontext.gregs[REG_RIP];
+  fp = (uintptr_t)uc->uc_mcontext.gregs[REG_RBP];
+#elif	defined(__i386__)
+  stallFrames[depth++] = (void*)uc->uc_mcontext.gregs[REG_EIP];
+  fp = (uintptr_t)uc->uc_mcontext.gregs[REG_EBP];
+#else
+  stallFrames[depth++] = (void*)uc->uc_mcontext.pc;
+  fp = (uintptr_t)uc->uc_mcontext.regs[29];
+#endif
+  /* Each frame holds the caller's frame pointer followed by the return
+   * address, and frames must move up the stack.
+   */
+  while (depth < STALL_FRAMES && fp >= stallLow
+    && fp < stallHigh - 2 * sizeof(void*) && 0 == fp % sizeof(void*))
+    {
+      uintptr_t	next = ((uintptr_t*)fp)[0];
+      void	*ret = ((void**)fp)[1];
+
+      if (NULL == ret)
+	{
+	  break;
+	}
+      stallFrames[depth++] = ret;
+      if (next <= fp)
+	{
+	  break;
+	}
+      fp = next;
+    }
+  stallDepth = depth;
+  __atomic_store_n(&stallState, STALL_IDLE, __ATOMIC_RELEASE);
+  sem_post(&stallDone);
+}
+#endif
+
+static NSLock		*stallLock = nil;
+static NSThread		*stallThread = nil;	// The current watchdog
+static NSTimeInterval	stallThreshold = 1.0;	// Zero means disabled
+static NSTimeInterval	stallAlarm = 10.0;	// Zero means no alarm
+static NSTimeInterval	stallPosted = 0.0;	// Outstanding heartbeat
+static NSTimeInterval	stallWorst = 0.0;	// Longest stall seen
+static NSTimeInterval	stallEnded = 0.0;	// End of latest stall
+static NSTimeInterval	stallLogged = 0.0;	// Time of latest log
+static NSUInteger	stallCount = 0;		// Number of stalls seen
+static NSUInteger	stallQuiet = 0;		// Stalls not logged
+static NSString		*stallStack = nil;	// Stack of current stall
+static NSString		*stallLatest = nil;	// Latest stack captured
+static BOOL		stallCaptured = NO;	// Capture attempted
+static BOOL		stallRaised = NO;	// Alarm is active
+
+@interface	EcStallWatchdog : NSObject
++ (void) beat: (id)ignored;
++ (void) capture;
++ (NSString*) report;
++ (void) run: (id)ignored;
++ (void) setAlarm: (NSTimeInterval)limit;
++ (void) setThreshold: (NSTimeInterval)limit;
++ (void) start;
+@end
+
+@implementation	EcStallWatchdog
+
++ (void) initialize
+{
+  if (nil == stallLock)
+    {
+      stallLock = [NSLock new];
+    }
+}
+
+/* Called in the main thread when the heartbeat is serviced.
+ */
++ (void) beat: (id)ignored
+{
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  NSTimeInterval	late;
+  NSString		*stack = nil;
+  BOOL			stalled = NO;
+
+  [stallLock lock];
+  late = now - stallPosted;
+  stallPosted = 0.0;
+  stallCaptured = YES;
+  if (stallThreshold > 0.0 && late >= stallThreshold)
+    {
+      stalled = YES;
+      stallCount++;
+      stallEnded = now;
+      if (late > stallWorst)
+        {
+          stallWorst = late;
+        }
+      if (nil != stallStack)
+        {
+          ASSIGN(stallLatest, stallStack);
+          stack = AUTORELEASE(RETAIN(stallStack));
+        }
+    }
+  [stallLock unlock];
+
+  [ecMetrics sample: late * 1000.0 for: @"MainLoopLatency"];
+  if (NO == stalled)
+    {
+      if (YES == stallRaised && now - stallEnded >= 300.0)
+        {
+          EcAlarm	*a;
+
+          a = [EcAlarm alarmForManagedObject: nil
+            at: nil
+            withEventType: EcAlarmEventTypeQualityOfService
+            probableCause: EcAlarmResponseTimeExcessive
+            specificProblem: @"Main run loop stalled"
+            perceivedSeverity: EcAlarmSeverityCleared
+            proposedRepairAction: nil
+            additionalText: nil];
+          [EcProc alarm: a];
+          stallRaised = NO;
+        }
+      return;
+    }
+
+  [ecMetrics sample: late * 1000.0 for: @"MainLoopStall"];
+  if (now - stallLogged >= 10.0)
+    {
+      NSString	*skipped = @"";
+
+      if (stallQuiet > 0)
+        {
+          skipped = [NSString stringWithFormat:
+            @" (%lu shorter stalls not logged)", (unsigned long)stallQuiet];
+        }
+      if (nil == stack)
+        {
+          stack = @" (stack not captured)";
+        }
+      [EcProc cmdWarn: @"Main run loop stalled for %.3f seconds%@,"
+        @" main thread stack:%@", late, skipped, stack];
+      stallLogged = now;
+      stallQuiet = 0;
+    }
+  else
+    {
+      stallQuiet++;
+    }
+
+  if (stallAlarm > 0.0 && late >= stallAlarm && NO == stallRaised)
+    {
+      EcAlarm	*a;
+
+      a = [EcAlarm alarmForManagedObject: nil
+        at: nil
+        withEventType: EcAlarmEventTypeQualityOfService
+        probableCause: EcAlarmResponseTimeExcessive
+        specificProblem: @"Main run loop stalled"
+        perceivedSeverity: EcAlarmSeverityMinor
+        proposedRepairAction:
+        _(@"Examine the main thread stack logged in the debug log to"
+          @" find the operation blocking the run loop.")
+        additionalText: [NSString stringWithFormat:
+          @"Main run loop did not respond for %.3f seconds", late]];
+      [EcProc alarm: a];
+      stallRaised = YES;
+    }
+}
+
+/* Called in the watchdog thread to obtain the stack of the main thread
+ * while it is stalled.
+ */
++ (void) capture
+{
+#if	defined(EC_STALL_STACK)
+  struct timespec	ts;
+  int			expected = STALL_WANTED;
+  int			i;
+
+  stallDepth = 0;
+  __atomic_store_n(&stallState, STALL_WANTED, __ATOMIC_RELEASE);
+  if (0 != pthread_kill(stallMain, STALL_SIGNAL))
+    {
+      __atomic_store_n(&stallState, STALL_IDLE, __ATOMIC_RELAXED);
+      return;
+    }
+
+  /* Wait up to 100ms for the handler to run.  If it has not started by
+   * then we withdraw the request, but once it has started it must be
+   * allowed to finish before we read the frames.
+   */
+  clock_gettime(CLOCK_REALTIME, &ts);
+  ts.tv_nsec += 100000000;
+  if (ts.tv_nsec >= 1000000000)
+    {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000;
+    }
+  while ((i = sem_timedwait(&stallDone, &ts)) < 0 && EINTR == errno)
+    ;
+  if (i < 0)
+    {
+      if (__atomic_compare_exchange_n(&stallState, &expected, STALL_IDLE,
+	NO, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+	{
+	  return;	// The main thread never took the signal
+	}
+      while (sem_wait(&stallDone) < 0 && EINTR == errno)
+	;
+    }
+  __atomic_thread_fence(__ATOMIC_ACQUIRE);
+  if (stallDepth > 0)
+    {
+      char	**symbols = backtrace_symbols(stallFrames, stallDepth);
+
+      if (NULL != symbols)
+        {
+          NSMutableString	*m;
+
+          /* The first frame is where the main thread was interrupted.
+           */
+          m = [NSMutableString stringWithCapacity: 2048];
+          for (i = 0; i < stallDepth; i++)
+            {
+              [m appendFormat: @"\n  %s", symbols[i]];
+            }
+          free(symbols);
+          [stallLock lock];
+          ASSIGNCOPY(stallStack, m);
+          [stallLock unlock];
+        }
+    }
+#endif
+}
+
++ (NSString*) report
+{
+  NSMutableString	*m = [NSMutableString stringWithCapacity: 1024];
+
+  [stallLock lock];
+  if (stallThreshold <= 0.0)
+    {
+      [m appendString: @"Main run loop stall detection disabled.\n"];
+    }
+  else if (0 == stallCount)
+    {
+      [m appendFormat: @"Main run loop stalls (over %g ms): none.\n",
+        stallThreshold * 1000.0];
+    }
+  else
+    {
+      [m appendFormat: @"Main run loop stalls (over %g ms): %lu,"
+        @" longest %.3f seconds, latest at %@\n",
+        stallThreshold * 1000.0, (unsigned long)stallCount, stallWorst,
+        [NSDate dateWithTimeIntervalSinceReferenceDate: stallEnded]];
+      if (nil != stallLatest)
+        {
+          [m appendFormat: @"Latest main thread stack captured:%@\n",
+            stallLatest];
+        }
+    }
+  [stallLock unlock];
+  return m;
+}
+
+/* The body of the watchdog thread.
+ */
++ (void) run: (id)ignored
+{
+  NSThread	*me = [NSThread currentThread];
+  NSArray	*modes;
+  BOOL		running = YES;
+
+  modes = [[NSArray alloc] initWithObjects: NSDefaultRunLoopMode, nil];
+  while (YES == running)
+    {
+      NSTimeInterval	interval = 1.0;
+      BOOL		capture = NO;
+      BOOL		post = NO;
+
+      ENTER_POOL
+      NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+
+      [stallLock lock];
+      if (me != stallThread || stallThreshold <= 0.0)
+        {
+          running = NO;
+        }
+      else
+        {
+          /* Check four times per threshold period so that a stall is
+           * caught close to the point where it crosses the threshold.
+           */
+          interval = stallThreshold / 4.0;
+          if (interval > 1.0) interval = 1.0;
+          if (interval < 0.01) interval = 0.01;
+          if (0.0 == stallPosted)
+            {
+              stallPosted = now;
+              stallCaptured = NO;
+              DESTROY(stallStack);
+              post = YES;
+            }
+          else if (NO == stallCaptured && now - stallPosted >= stallThreshold)
+            {
+              stallCaptured = YES;
+              capture = YES;
+            }
+        }
+      [stallLock unlock];
+      if (YES == post)
+        {
+          [self performSelectorOnMainThread: @selector(beat:)
+                                 withObject: nil
+                              waitUntilDone: NO
+                                      modes: modes];
+        }
+      if (YES == capture)
+        {
+          [self capture];
+        }
+      LEAVE_POOL
+      if (YES == running)
+        {
+          [NSThread sleepForTimeInterval: interval];
+        }
+    }
+  RELEASE(modes);
+}
+
++ (void) setAlarm: (NSTimeInterval)limit
+{
+  [stallLock lock];
+  stallAlarm = (limit > 0.0 ? limit : 0.0);
+  [stallLock unlock];
+}
+
++ (void) setThreshold: (NSTimeInterval)limit
+{
+  [stallLock lock];
+  stallThreshold = (limit > 0.0 ? limit : 0.0);
+  if (0.0 == stallThreshold)
+    {
+      DESTROY(stallThread);     // Watchdog will terminate
+      stallPosted = 0.0;
+    }
+  [stallLock unlock];
+}
+
+/* Called in the main thread (once the run loop is active) to start the
+ * watchdog if it is enabled and not already running.
+ */
++ (void) start
+{
+  [stallLock lock];
+  if (nil == stallThread && stallThreshold > 0.0)
+    {
+#if	defined(EC_STALL_STACK)
+      static BOOL	installed = NO;
+
+      if (NO == installed)
+        {
+          struct sigaction	sa;
+          pthread_attr_t	attr;
+          void			*addr;
+          size_t		size;
+
+          /* The handler only follows frame pointers within the stack of
+           * the main thread, so we need its bounds.
+           */
+          stallMain = pthread_self();
+          if (0 == pthread_getattr_np(stallMain, &attr))
+            {
+              if (0 == pthread_attr_getstack(&attr, &addr, &size))
+                {
+                  stallLow = (uintptr_t)addr;
+                  stallHigh = stallLow + size;
+                }
+              pthread_attr_destroy(&attr);
+            }
+          sem_init(&stallDone, 0, 0);
+          memset(&sa, '\0', sizeof(sa));
+          sa.sa_sigaction = stallHandler;
+          sa.sa_flags = SA_RESTART | SA_SIGINFO;
+          sigemptyset(&sa.sa_mask);
+          sigaction(STALL_SIGNAL, &sa, 0);
+          installed = YES;
+        }
+#endif
+      stallPosted = 0.0;
+      stallThread = [[NSThread alloc] initWithTarget: self
+                                            selector: @selector(run:)
+                                              object: nil];
+      [stallThread setName: @"EcStallWatchdog"];
+      [stallThread start];
+    }
+  [stallLock unlock];
+}
+
+@end
+
+/* Contention profiling for ecLock.
+ * All the counters are updated while the lock is held, so they need no
+ * protection of their own.  The call site of the outermost acquisition is
+ * recorded so that a thread which has to wait can find out which code was
+ * holding the lock.
+ */
+#define	EC_LOCK_SITES	32
+
+typedef struct	{
+  void			*site;		// Return address of the holder
+  uint64_t		count;		// Number of waits caused
+  NSTimeInterval	wait;		// Total wait caused
+} LockSite;
+
+@interface	EcProfiledLock : NSRecursiveLock
+{
+  void			*holder;	// Call site of outermost lock
+  unsigned		depth;		// Recursion depth of holder
+  uint64_t		acquired;	// Outermost acquisitions
+  uint64_t		contended;	// Acquisitions which had to wait
+  NSTimeInterval	waited;		// Total time spent waiting
+  NSTimeInterval	worst;		// Longest single wait
+  NSTimeInterval	since;		// Start of profiling period
+  uint64_t		buckets[EC_METRIC_BUCKETS];	// Waits in microseconds
+  LockSite		sites[EC_LOCK_SITES];
+}
+- (void) lockFrom: (void*)site;
+- (NSString*) report;
+- (void) reset;
+@end
+
+@implementation	EcProfiledLock
+
+static inline void
+lockAcquired(EcProfiledLock *l, void *site)
+{
+  if (0 == l->depth++)
+    {
+      __atomic_store_n(&l->holder, site, __ATOMIC_RELAXED);
+      l->acquired++;
+    }
+}
+
+- (id) init
+{
+  if (nil != (self = [super init]))
+    {
+      since = [NSDate timeIntervalSinceReferenceDate];
+    }
+  return self;
+}
+
+- (void) lock
+{
+  [self lockFrom: __builtin_return_address(0)];
+}
+
+/* Acquires the lock, attributing the acquisition to the given call site
+ * (used where the lock is taken on behalf of a caller, as in -ecDoLock).
+ */
+- (void) lockFrom: (void*)site
+{
+  if (NO == [super tryLock])
+    {
+      void		*blocker = __atomic_load_n(&holder, __ATOMIC_RELAXED);
+      NSTimeInterval	start = [NSDate timeIntervalSinceReferenceDate];
+      NSTimeInterval	delay;
+      unsigned		i;
+
+      [super lock];
+      delay = [NSDate timeIntervalSinceReferenceDate] - start;
+      contended++;
+      waited += delay;
+      if (delay > worst)
+        {
+          worst = delay;
+        }
+      buckets[[EcMetrics bucketForValue: delay * 1000000.0]]++;
+      /* The holder may not have recorded its site yet (or may have been
+       * releasing the lock when we looked), in which case we don't know
+       * who caused the wait.  A NULL entry would also end the table.
+       */
+      for (i = 0; NULL != blocker && i < EC_LOCK_SITES; i++)
+        {
+          if (sites[i].site == blocker || NULL == sites[i].site)
+            {
+              sites[i].site = blocker;
+              sites[i].count++;
+              sites[i].wait += delay;
+              break;
+            }
+        }
+      [ecMetrics sample: delay * 1000000.0 for: @"EcLockWait"];
+    }
+  lockAcquired(self, site);
+}
+
+- (BOOL) lockBeforeDate: (NSDate*)limit
+{
+  void	*site = __builtin_return_address(0);
+
+  if (YES == [super lockBeforeDate: limit])
+    {
+      lockAcquired(self, site);
+      return YES;
     }
+  return NO;
 }
 
-/* Returns the found command, or nil if none is found, or an empty string
- * if there was a match but it was in the array of commands to be blockd.
- */
-static NSString*
-findAction(NSString *cmd, NSArray *allow)
+- (NSString*) report
 {
-  NSString	*found = nil;
-  BOOL          match = NO;
+  NSMutableString	*m = [NSMutableString stringWithCapacity: 1024];
+  NSMutableArray	*b;
+  NSDictionary		*entry;
+  LockSite		copy[EC_LOCK_SITES];
+  NSTimeInterval	period;
+  unsigned		count = 0;
+  unsigned		i;
 
-  cmd = [cmd lowercaseString];
-  [ecLock lock];
-  if (nil == (found = [cmdActions member: cmd])
-    || (allow && NO == [allow containsObject: found]))
+  /* Take a copy of the statistics so we can format them without holding
+   * the lock (and distorting the figures).  We use the underlying lock
+   * directly so that reporting does not count in its own figures.
+   */
+  [super lock];
+  period = [NSDate timeIntervalSinceReferenceDate] - since;
+  b = [NSMutableArray arrayWithCapacity: EC_METRIC_BUCKETS];
+  for (i = 0; i < EC_METRIC_BUCKETS; i++)
+    {
+      [b addObject: [NSNumber numberWithUnsignedLongLong: buckets[i]]];
+    }
+  entry = [NSDictionary dictionaryWithObjectsAndKeys:
+    [NSNumber numberWithUnsignedLongLong: contended], @"C",
+    [NSNumber numberWithDouble: worst * 1000000.0], @"M",
+    b, @"B",
+    nil];
+  [m appendFormat: @"ecLock over the last %.0f seconds:\n", period];
+  [m appendFormat: @"  %llu acquisitions, %llu had to wait (%.2f%%)\n",
+    (unsigned long long)acquired, (unsigned long long)contended,
+    (acquired > 0) ? (100.0 * contended) / acquired : 0.0];
+  [m appendFormat: @"  total wait %.6f seconds, longest wait %.6f seconds\n",
+    waited, worst];
+  while (count < EC_LOCK_SITES && NULL != sites[count].site)
+    {
+      copy[count] = sites[count];
+      count++;
+    }
+  [super unlock];
+
+  if (0 == count)
+    {
+      return m;
+    }
+  [m appendFormat: @"  wait percentiles (microseconds):"
+    @" 50%% %.0f, 90%% %.0f, 99%% %.0f\n",
+    [EcMetrics percentile: 0.50 of: entry],
+    [EcMetrics percentile: 0.90 of: entry],
+    [EcMetrics percentile: 0.99 of: entry]];
+  [m appendString: @"  waits by call site holding the lock:\n"];
+
+  /* Sort by the number of waits caused (the table is tiny).
+   */
+  for (i = 1; i < count; i++)
     {
-      NSEnumerator	*enumerator;
-      NSString		*name;
+      LockSite	s = copy[i];
+      unsigned	j = i;
 
-      if (found)
+      while (j > 0 && copy[j - 1].count < s.count)
         {
-          found = nil;
-          match = YES;
+          copy[j] = copy[j - 1];
+          j--;
         }
-      enumerator = [cmdActions objectEnumerator];
-      while (nil != (name = [enumerator nextObject]))
-	{
-	  if (YES == [name hasPrefix: cmd])
-	    {
-              match = YES;
-              if (allow && NO == [allow containsObject: name])
-                {
-                  continue;     // This match is not allowed
-                }
-	      else if (nil == found)
-		{
-		  found = name;
-		}
-	      else
-		{
-		  found = nil;	// Ambiguous
-                  break;
-		}
-	    }
-	}
+      copy[j] = s;
     }
-  if (found)
+  for (i = 0; i < count; i++)
     {
-      cmd = [found retain];
+      NSString	*where = nil;
+
+#if	defined(HAVE_EXECINFO_H)
+      char	**symbols = backtrace_symbols(&copy[i].site, 1);
+
+      if (NULL != symbols)
+        {
+          where = [NSString stringWithUTF8String: symbols[0]];
+          free(symbols);
+        }
+#endif
+      if (nil == where)
+        {
+          where = [NSString stringWithFormat: @"%p", copy[i].site];
+        }
+      [m appendFormat: @"  %10llu %12.6f  %@\n",
+        (unsigned long long)copy[i].count, copy[i].wait, where];
     }
-  else if (match)
+  return m;
+}
+
+- (void) reset
+{
+  [super lock];
+  acquired = 0;
+  contended = 0;
+  waited = 0.0;
+  worst = 0.0;
+  since = [NSDate timeIntervalSinceReferenceDate];
+  memset(buckets, '\0', sizeof(buckets));
+  memset(sites, '\0', sizeof(sites));
+  [super unlock];
+}
+
+- (BOOL) tryLock
+{
+  void	*site = __builtin_return_address(0);
+
+  if (YES == [super tryLock])
     {
-      cmd = @"";
+      lockAcquired(self, site);
+      return YES;
     }
-  else
+  return NO;
+}
+
+- (void) unlock
+{
+  if (depth > 0 && 0 == --depth)
     {
-      cmd = nil;
+      __atomic_store_n(&holder, NULL, __ATOMIC_RELAXED);
     }
-  [ecLock unlock];
-  return [cmd autorelease];
+  [super unlock];
 }
- 
-static NSString*
-ecCommandHost()
+
+@end
+
+/* Proxy returned by -server: while tracing is active, so that each
+ * message sent to the server is recorded as a span named after its
+ * selector (the runtime keeps selector names for the life of the process).
+ * Class and equality checks are answered for the server proxy, and the
+ * RemoteServer keeps the traced proxy so that repeated calls to -server:
+ * return the same object (as they do when tracing is not active).
+ */
+@interface EcTracedProxy : NSProxy
 {
-  NSString	*host;
+  id	target;
+}
++ (id) proxyFor: (id)anObject;
++ (id) proxyFor: (id)anObject reusing: (id)old;
+@end
 
-  host = [cmdDefs stringForKey: @"CommandHost"];
-  if (nil == host)
+@implementation EcTracedProxy
+
++ (id) proxyFor: (id)anObject
+{
+  EcTracedProxy	*p;
+
+  if (nil == anObject || NO == EcTraceActive)
     {
-      host = @"";	/* Local host 	*/
+      return anObject;
     }
-  return host;
+  p = [self alloc];
+  p->target = RETAIN(anObject);
+  return AUTORELEASE(p);
 }
 
-static NSString*
-ecCommandName()
+/* Returns old if it is a traced proxy for anObject, otherwise the same
+ * as +proxyFor:
+ */
++ (id) proxyFor: (id)anObject reusing: (id)old
 {
-  NSString	*name;
-
-  name = [cmdDefs stringForKey: @"CommandName"];
-  if (nil == name)
+  if (nil != old && object_getClass(old) == self
+    && ((EcTracedProxy*)old)->target == anObject)
     {
-      name = @"Command";
+      return old;
     }
-  return name;
+  return [self proxyFor: anObject];
 }
 
+- (Class) class
+{
+  return [target class];
+}
 
-NSString	*cmdBasicDbg = @"basicMode";
-NSString	*cmdDefaultDbg = @"basicMode";  // Allow older code to link
-NSString	*cmdConnectDbg = @"connectMode";
-NSString	*cmdDetailDbg = @"detailMode";
-
+- (BOOL) conformsToProtocol: (Protocol*)aProtocol
+{
+  return [target conformsToProtocol: aProtocol];
+}
 
-static int	comp_len = 0;
+- (void) dealloc
+{
+  DESTROY(target);
+  [super dealloc];
+}
 
-static int
-comp(const char* s0, const char* s1)
+- (NSString*) description
 {
-  comp_len = 0;
-  if (s0 == 0) {
-      s0 = "";
-  }
-  if (s1 == 0) {
-      s1 = "";
-  }
-  while (*s0) {
-      if (*s0 != *s1) {
-	  char	c0 = islower(*s0) ? toupper(*s0) : *s0;
-	  char	c1 = islower(*s1) ? toupper(*s1) : *s1;
+  return [target description];
+}
 
-	  if (c0 != c1) {
-	      if (c0 != '\0') {
-		  comp_len = -1; /* s0 is not a substring of s1.	*/
-	      }
-	      return(-1);
-	  }
-      }
-      comp_len++;
-      s0++;
-      s1++;
-  }
-  if (*s0 != *s1) {
-      return(-1);
-  }
-  return(0);
+- (void) forwardInvocation: (NSInvocation*)anInvocation
+{
+  EC_TRACE_BEGIN(sel_getName([anInvocation selector]))
+  [anInvocation invokeWithTarget: target];
+  EC_TRACE_END
 }
 
-static NSString*
-findMode(NSDictionary* d, NSString* s)
+- (NSUInteger) hash
 {
-  NSArray	*a = [d allKeys];
-  NSString	*o;
-  unsigned int	i;
-  const char	*s0 = [s UTF8String];
-  const char	*s1;
-  int		best_pos = -1;
-  int		best_len = 0;
+  return [target hash];
+}
 
-  for (i = 0; i < [a count]; i++)
+- (BOOL) isEqual: (id)other
+{
+  if (other == self)
     {
-      o = (NSString*)[a objectAtIndex: i];
-      s1 =  [o UTF8String];
-      if (comp(s0, s1) == 0)
-	{
-	  return o;
-	}
-      if (comp_len > best_len)
-	{
-	  best_len = comp_len;
-	  best_pos = i;
-	}
+      return YES;
     }
-  if (best_pos >= 0)
+  if (nil != other && object_getClass(other) == [EcTracedProxy class])
     {
-      return (NSString*)[a objectAtIndex: best_pos];
+      other = ((EcTracedProxy*)other)->target;
     }
-  return nil;
+  return [target isEqual: other];
+}
+
+- (BOOL) isKindOfClass: (Class)aClass
+{
+  return [target isKindOfClass: aClass];
+}
+
+- (BOOL) isMemberOfClass: (Class)aClass
+{
+  return [target isMemberOfClass: aClass];
+}
+
+- (NSMethodSignature*) methodSignatureForSelector: (SEL)aSelector
+{
+  return [target methodSignatureForSelector: aSelector];
+}
+
+- (BOOL) respondsToSelector: (SEL)aSelector
+{
+  return [target respondsToSelector: aSelector];
 }
 
+@end
+
 /*
  * Auxiliary object representing a remote server a subclass might need
  * to connect to.  This class is for EcProcess.m internal use. 
@@ -1217,6 +2570,9 @@ findMode(NSDictionary* d, NSString* s)
 
   /* The real object representing the remote server. */
   id proxy;
+  /* Traced proxies returned for it (keyed by broadcast receiver index,
+     or -1 for the server itself) while tracing is active. */
+  NSMutableDictionary *traced;
   /* An object responding to cmdMadeConnectionToServer: and/or 
      cmdLostConnectionToServer: */
   id delegate;
@@ -1238,6 +2594,11 @@ findMode(NSDictionary* d, NSString* s)
  * that object. 
  */
 - (id) proxy;
+/*
+ * Return the proxy (or the proxy for the numbered receiver of a multiple
+ * server if index is not negative) wrapped for tracing if that is active.
+ */
+- (id) tracedProxy: (int)index;
 /*
  * Internal connection management methods
  */
@@ -1287,6 +2648,7 @@ findMode(NSDictionary* d, NSString* s)
   DESTROY(host);
   DESTROY(multiple);
   DESTROY(proxy);
+  DESTROY(traced);
   [[NSNotificationCenter defaultCenter] removeObserver: self];
   [super dealloc];
 }
@@ -1302,6 +2664,7 @@ findMode(NSDictionary* d, NSString* s)
     {
       ASSIGNCOPY(name, string);
       DESTROY(proxy);
+      [traced removeAllObjects];
     }
 }
 
@@ -1316,6 +2679,7 @@ findMode(NSDictionary* d, NSString* s)
     {
       ASSIGNCOPY(host, string);
       DESTROY(proxy);
+      [traced removeAllObjects];
     }
 }
 
@@ -1330,6 +2694,7 @@ findMode(NSDictionary* d, NSString* s)
     {
       ASSIGNCOPY(multiple, config);
       DESTROY(proxy);
+      [traced removeAllObjects];
     }
 }
 
@@ -1385,6 +2750,35 @@ findMode(NSDictionary* d, NSString* s)
   return proxy;
 }
 
+- (id) tracedProxy: (int)index
+{
+  NSNumber	*key;
+  id		p = [self proxy];
+  id		old;
+  id		t;
+
+  if (index >= 0)
+    {
+      p = [p BCPproxy: index];
+    }
+  if (nil == p || NO == EcTraceActive)
+    {
+      return p;
+    }
+  if (nil == traced)
+    {
+      traced = [NSMutableDictionary new];
+    }
+  key = [NSNumber numberWithInt: index];
+  old = [traced objectForKey: key];
+  t = [EcTracedProxy proxyFor: p reusing: old];
+  if (t != old)
+    {
+      [traced setObject: t forKey: key];
+    }
+  return t;
+}
+
 - (id) connectionBecameInvalid: (NSNotification*)notification
 {
   id connection = [notification object];
@@ -1408,6 +2802,7 @@ findMode(NSDictionary* d, NSString* s)
 	    }
 	  RELEASE (proxy);
 	  proxy = nil;
+	  [traced removeAllObjects];
 	}
     }
   else    
@@ -1529,14 +2924,22 @@ findMode(NSDictionary* d, NSString* s)
 @interface      EcProcess (Defaults)
 - (void) _defMemory: (id)val;
 - (void) _defRelease: (id)val;
+- (void) _defStallAlarm: (id)val;
+- (void) _defStallThreshold: (id)val;
+- (void) _defTrace: (id)val;
 - (void) _defTesting: (id)val;
 @end
 
 @interface	EcProcess (Private)
 - (void) cmdMesgrelease: (NSArray*)msg;
 - (void) cmdMesgtesting: (NSArray*)msg;
+- (void) _beat: (NSTimer*)timer;
+- (void) _beatStart;
+- (void) _cmdRetry: (NSTimer*)timer;
+- (void) _cmdRetrySchedule;
 - (void) _fdCheck;
 - (void) _memCheck;
+- (void) _resCheck;
 - (NSString*) _moveLog: (NSString*)name to: (NSDate*)when;
 - (void) _timedOut: (NSTimer*)timer;
 - (void) _update: (NSMutableDictionary*)info;
@@ -1555,8 +2958,13 @@ findMode(NSDictionary* d, NSString* s)
       DESTROY(auditLogger);
       DESTROY(cmdActions);
       DESTROY(cmdConf);
+      DESTROY(cmdConfInfo);
+      DESTROY(cmdConfTrace);
+      DESTROY(currentSnapshot);
+      DESTROY(retiredObjects);
       DESTROY(cmdDebugKnown);
       DESTROY(cmdDebugModes);
+      DESTROY(debugSet);
       DESTROY(cmdDebugName);
       DESTROY(cmdDefs);
       DESTROY(cmdFirst);
@@ -1570,6 +2978,7 @@ findMode(NSDictionary* d, NSString* s)
       DESTROY(dataDir);
       DESTROY(debugLogger);
       DESTROY(ecLock);
+      DESTROY(ecMetrics);
       DESTROY(errorLogger);
       DESTROY(homeDir);
       DESTROY(hostName);
@@ -1580,11 +2989,20 @@ findMode(NSDictionary* d, NSString* s)
       DESTROY(userDir);
       DESTROY(warningLogger);
       DESTROY(cmdMemoryLogger);
+      DESTROY(cmdResourceLogger);
+      DESTROY(resRates);
     }
 }
 
 
 - (Class) _memoryLoggerClassFromBundle: (NSString*)bundleName
+{
+  return [self _loggerClassFromBundle: bundleName
+                             protocol: @protocol(EcMemoryLogger)];
+}
+
+- (Class) _loggerClassFromBundle: (NSString*)bundleName
+                        protocol: (Protocol*)proto
 {
   NSString *path = nil;
   Class c = Nil;
@@ -1614,11 +3032,11 @@ findMode(NSDictionary* d, NSString* s)
       [self cmdWarn: @"Could not load principal class from %@ at %@.",
         bundleName, path];
     }
-  else if (NO == [c conformsToProtocol: @protocol(EcMemoryLogger)])
+  else if (NO == [c conformsToProtocol: proto])
     {
       [self cmdWarn:
-       @"%@ does not implement the EcMemoryLogger protocol", 
-        NSStringFromClass(c)];
+       @"%@ does not implement the %s protocol", 
+        NSStringFromClass(c), protocol_getName(proto)];
       c = Nil;
     }
   return c;
@@ -1775,6 +3193,7 @@ findMode(NSDictionary* d, NSString* s)
   [ecLock lock];
   if (NO == prepared)
     {
+      uint64_t		traceStart = EcTraceNow();
       NSProcessInfo	*pinfo;
       NSFileManager	*mgr;
       NSEnumerator	*enumerator;
@@ -1843,6 +3262,14 @@ findMode(NSDictionary* d, NSString* s)
             }
         }
 
+      /* Tracing from startup must be turned on before we do anything
+       * significant.
+       */
+      if (YES == [cmdDefs boolForKey: @"Trace"])
+        {
+          EcTraceStart();
+        }
+
       setupTLS(cmdDefs);
       cmdUser = EC_EFFECTIVE_USER;
       if (nil == cmdUser)
@@ -1962,6 +3389,7 @@ findMode(NSDictionary* d, NSString* s)
 	    {
 	      id	obj = [defs objectForKey: str];
 
+	      [debugLock lock];
 	      if ([cmdDebugKnown objectForKey: key] == nil)
 		{
 		  [cmdDebugKnown setObject: key forKey: key];
@@ -1984,6 +3412,8 @@ findMode(NSDictionary* d, NSString* s)
 			}
 		    }
 		}
+	      debugPublish();
+	      [debugLock unlock];
 	    }
 	}
 
@@ -2153,6 +3583,7 @@ findMode(NSDictionary* d, NSString* s)
       [[NSProcessInfo processInfo] setProcessName: cmdName];
 
       prepared = YES;
+      EcTraceSpan("ecPrepareWithDefaults:", traceStart, EcTraceNow());
     }
   [ecLock unlock];
   return defs;
@@ -2161,6 +3592,11 @@ findMode(NSDictionary* d, NSString* s)
 
 
 
++ (const EcDefaultSlot*) ecDefaultSlot: (NSString*)name
+{
+  return [EcDefaultRegistration slotFor: name];
+}
+
 + (void) ecRegisterDefault: (NSString*)name
               withTypeText: (NSString*)type
                andHelpText: (NSString*)help
@@ -2244,6 +3680,11 @@ static NSString	*noFiles = @"No log files to archive";
   return cmdDefs;
 }
 
+- (EcConfigSnapshot*) ecConfigSnapshot
+{
+  return snapshotCurrent();
+}
+
 /* This method handles the final stage of a configuration update either
  * from the Control server or via the local NSUserDefaults system.
  * If no error has occurred so far, we call the method to check/apply
@@ -2254,6 +3695,7 @@ static NSString	*noFiles = @"No log files to archive";
 - (void) _checkUpdate
 {
   NSString      *err;
+  NSUInteger    c;
 
   if (nil == configError)
     {
@@ -2275,15 +3717,17 @@ static NSString	*noFiles = @"No log files to archive";
   /* Forward new config to any listening clients.
    * Remove any clients to which forwarding failed.
    */
-  if ([ecConfigClients count] > 0)
+  [confLock lock];
+  c = [ecConfigClients count];
+  [confLock unlock];
+  if (c > 0)
     {
       NSDictionary      *d = [cmdDefs dictionaryRepresentation];
       NSMutableArray    *a;
-      NSUInteger        c;
 
-      [self ecDoLock];
+      [confLock lock];
       a = [ecConfigClients mutableCopy];
-      [self ecUnLock];
+      [confLock unlock];
       c = [a count];
       while (c-- > 0)
         {
@@ -2304,12 +3748,12 @@ static NSString	*noFiles = @"No log files to archive";
         }
       if ((c = [a count]) > 0)
         {
-          [self ecDoLock];
+          [confLock lock];
           while (c-- > 0)
             {
               [ecConfigClients removeObjectIdenticalTo: [a objectAtIndex: c]];
             }
-          [self ecUnLock];
+          [confLock unlock];
         }
       RELEASE(a);
     }
@@ -2335,7 +3779,10 @@ static NSString	*noFiles = @"No log files to archive";
       NSLog(@"NSUserDefaults change during process shutdown ... ignored.");
       return;   // Ignore defaults changes during shutdown.
     }
-  if (nil == configError)
+  /* The notification is posted whenever the defaults are set, even if
+   * to the same values, so we only re-evaluate if something changed.
+   */
+  if (YES == snapshotPublish(cmdDefs) && nil == configError)
     {
       NS_DURING
         [self cmdDefaultsChanged: n];
@@ -2385,7 +3832,7 @@ static NSString	*noFiles = @"No log files to archive";
     {
       NSFileHandle	*hdl;
 
-      [ecLock lock];
+      [logLock lock];
       hdl = [cmdLogMap objectForKey: cmdDebugName];
       if (hdl != nil)
 	{
@@ -2399,11 +3846,12 @@ static NSString	*noFiles = @"No log files to archive";
 	    }
 	  [self ecLogEnd: cmdDebugName to: nil];
 	}
-      [ecLock unlock];
+      [logLock unlock];
       cmdKillDebug = (NO == cmdKillDebug ? YES : NO);
       [self cmdLogFile: cmdDebugName];
     }
 
+  [debugLock lock];
   enumerator = [cmdDebugKnown keyEnumerator];
   while (nil != (mode = [enumerator nextObject]))
     {
@@ -2418,6 +3866,8 @@ static NSString	*noFiles = @"No log files to archive";
 	  [cmdDebugModes removeObject: mode];
 	}
     }
+  debugPublish();
+  [debugLock unlock];
 
   dict = [cmdDefs dictionaryForKey: @"WellKnownHostNames"];
   if (nil != dict)
@@ -2608,7 +4058,7 @@ static NSString	*noFiles = @"No log files to archive";
 
       name = [name lastPathComponent];
 
-      [self ecDoLock];
+      [logLock lock];
       hdl = [cmdLogMap objectForKey: name];
       if (hdl != nil)
         {
@@ -2633,7 +4083,7 @@ static NSString	*noFiles = @"No log files to archive";
            */
           [cmdLogMap removeObjectForKey: name];
         }
-      [self ecUnLock];
+      [logLock unlock];
     }
   return status;
 }
@@ -2654,7 +4104,7 @@ static NSString	*noFiles = @"No log files to archive";
       return nil;
     }
   name = [name lastPathComponent];
-  [self ecDoLock];
+  [logLock lock];
   hdl = [cmdLogMap objectForKey: name];
   if (nil == hdl)
     {
@@ -2703,7 +4153,7 @@ static NSString	*noFiles = @"No log files to archive";
 
       if (hdl == nil)
 	{
-	  [self ecUnLock];
+	  [logLock unlock];
 	  return nil;
 	}
 
@@ -2735,7 +4185,7 @@ static NSString	*noFiles = @"No log files to archive";
 	}
     }
   [hdl retain];
-  [self ecUnLock];
+  [logLock unlock];
   return [hdl autorelease];
 }
 
@@ -2849,6 +4299,11 @@ static BOOL     ecDidAwakenCompletely = NO;
       [cmdPTimer invalidate];
       cmdPTimer = nil;
     }
+  if (cmdRTimer != nil)
+    {
+      [cmdRTimer invalidate];
+      cmdRTimer = nil;
+    }
 
   status = ecQuitStatus;
   if (0 == status)
@@ -2920,7 +4375,9 @@ static BOOL     ecDidAwakenCompletely = NO;
   /* The very last thing we do is to close down the log filed so they
    * are archived to the correct directory for the current date.
    */
+  [logLock lock];
   keys = [cmdLogMap allKeys];
+  [logLock unlock];
   now = [NSDate date];
   for (index = 0; index < [keys count]; index++)
     {
@@ -3339,9 +4796,9 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 
 - (oneway void) ecCancelConfigFwdTo: (id<EcConfigForwarded>)client
 {
-  [self ecDoLock];
+  [confLock lock];
   [ecConfigClients removeObjectIdenticalTo: client];
-  [self ecUnLock];
+  [confLock unlock];
 }
 
 - (NSString*) ecCopyright
@@ -3351,14 +4808,14 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 
 - (void) ecDoLock
 {
-  [ecLock lock];
+  [(EcProfiledLock*)ecLock lockFrom: __builtin_return_address(0)];
 }
 
 - (bycopy NSDictionary*) ecSetupConfigFwdTo: (id<EcConfigForwarded>)client
 {
   NSDictionary  *config = nil;
 
-  [self ecDoLock];
+  [confLock lock];
   /* Ensure the array exists; do this before -indexOfObjectIdenticalTo: as
    * calling the method on a nil arraqy would always return 0.
    */
@@ -3370,8 +4827,8 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
     {
       [ecConfigClients addObject: client];
     }
+  [confLock unlock];
   config = [cmdDefs dictionaryRepresentation];
-  [self ecUnLock];
   return config;
 }
 
@@ -3395,11 +4852,15 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
   if (nil == ecLock)
     {
       setupTLS([NSUserDefaults standardUserDefaults]);
-      ecLock = [NSRecursiveLock new];
+      ecLock = [EcProfiledLock new];
+      confLock = [NSLock new];
+      debugLock = [NSLock new];
+      logLock = [NSRecursiveLock new];
       dateClass = [NSDate class];
       cDateClass = [NSCalendarDate class];
       stringClass = [NSString class];
       cmdLogMap = [[NSMutableDictionary alloc] initWithCapacity: 4];
+      ecMetrics = [EcMetrics new];
 
       cmdDebugModes = [[NSMutableSet alloc] initWithCapacity: 4];
       cmdDebugKnown = [[NSMutableDictionary alloc] initWithCapacity: 4];
@@ -3412,6 +4873,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 			forKey: cmdDetailDbg];
 
       [cmdDebugModes addObject: cmdBasicDbg];
+      debugPublish();
 
       [self ecRegisterDefault: @"Memory"
                  withTypeText: @"YES/NO"
@@ -3423,6 +4885,21 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
                   andHelpText: @"Turn on double release checks (debug)"
                        action: @selector(_defRelease:)
                         value: @"NO"];
+      [self ecRegisterDefault: @"StallAlarm"
+                 withTypeText: @"milliseconds"
+                  andHelpText: @"Main run loop stall raising an alarm (0 = off)"
+                       action: @selector(_defStallAlarm:)
+                        value: @"10000"];
+      [self ecRegisterDefault: @"StallThreshold"
+                 withTypeText: @"milliseconds"
+                  andHelpText: @"Main run loop stall logged with stack (0 = off)"
+                       action: @selector(_defStallThreshold:)
+                        value: @"1000"];
+      [self ecRegisterDefault: @"Trace"
+                 withTypeText: @"YES/NO"
+                  andHelpText: @"Record trace spans (from startup if set)"
+                       action: @selector(_defTrace:)
+                        value: @"NO"];
       [self ecRegisterDefault: @"Testing"
                  withTypeText: @"YES/NO"
                   andHelpText: @"Run in test mode (if supported)"
@@ -3499,9 +4976,14 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
       DESTROY(cmdServer);
       NSLog(@"lost connection %p to command server\n", connection);
       /*
-       *	Cause timeout to go off really soon so we will try to
-       *	re-establish the link to the server.
+       *	Every process on the host sees the Command server go away
+       *	at the same moment, so the first attempt to re-establish
+       *	the link is jittered, then the timeout is triggered to
+       *	schedule it.
        */
+      cmdRetries = 0;
+      cmdRetryAt = [NSDate timeIntervalSinceReferenceDate]
+	+ [EcAdmission delayFor: cmdLogName() after: 0];
       [self triggerCmdTimeout];
     }
   else
@@ -3532,8 +5014,12 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 - (NSString*) ecArchive: (NSDate*)when
 {
   NSString	*status = @"";
+  NSArray	*names;
 
-  if ([cmdLogMap count] == 0)
+  [logLock lock];
+  names = [cmdLogMap allKeys];
+  [logLock unlock];
+  if ([names count] == 0)
     {
       status = noFiles;
     }
@@ -3542,9 +5028,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
       NSEnumerator	*enumerator;
       NSString		*name;
 
-      [self ecDoLock];
-      enumerator = [[cmdLogMap allKeys] objectEnumerator];
-      [self ecUnLock];
+      enumerator = [names objectEnumerator];
 
       while ((name = [enumerator nextObject]) != nil)
 	{
@@ -3586,7 +5070,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 
 - (void) cmdDbg: (NSString*)type msg: (NSString*)fmt arguments: (va_list)args
 {
-  if (nil != [cmdDebugModes member: type])
+  if (YES == debugActive(type))
     {
       if (nil == debugLogger)
 	{
@@ -3607,7 +5091,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 
 - (void) cmdDebug: (NSString*)fmt arguments: (va_list)args
 {
-  if (nil != [cmdDebugModes member: cmdBasicDbg])
+  if (YES == debugActive(cmdBasicDbg))
     {
       if (nil == debugLogger)
 	{
@@ -3696,12 +5180,17 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
   if (NO == connecting)
     {
       /*
-       * Use the 'cmdLast' variable to ensure that we don't try to
-       * check memory usage or connect to the command server more
-       * than once every 10 sec.
+       * Use the 'cmdRetryAt' variable to ensure that after a failure we
+       * don't try to connect to the command server again until the
+       * (jittered, exponentially increasing) retry time.  Destroying
+       * 'cmdLast' permits an immediate attempt.
        */
-      if (cmdLast == nil || [cmdLast timeIntervalSinceNow] < -10.0)
+      if (cmdLast == nil
+	|| [NSDate timeIntervalSinceReferenceDate] >= cmdRetryAt)
 	{
+	  NSTimeInterval	hint = 0.0;
+	  BOOL			failed = NO;
+
 	  connecting = YES;
 
 	  ASSIGN(cmdLast, [dateClass date]);
@@ -3710,55 +5199,63 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 	      ASSIGN(cmdFirst, cmdLast);
 	    }
 
-	  if (nil == cmdServer && YES == [self cmdIsClient])
+	  if ((nil == cmdServer || NO == cmdAccepted)
+	    && YES == [self cmdIsClient])
 	    {
 	      NSString	*name = nil;
 	      NSString	*host = nil;
-	      id	proxy;
+	      BOOL	reuse = (nil == cmdServer) ? NO : YES;
+	      id	proxy = cmdServer;
 
-	      NS_DURING
+	      if (NO == reuse)
 		{
-                  NSSocketPortNameServer        *ns;
-
-		  host = ecCommandHost();
-		  name = ecCommandName();
-
-                  ns = [NSSocketPortNameServer sharedInstance];
-		  proxy = [NSConnection
-		    rootProxyForConnectionWithRegisteredName: name
-							host: host
-                                             usingNameServer: ns];
-		  [proxy setProtocolForProxy: @protocol(Command)];
-		  if (nil == proxy)
-		    {
-		      NSLog(@"Unable to connect to Command server");
-		    }
-		  else
+		  NS_DURING
 		    {
-		      NSConnection	*connection;
-
-		      ASSIGN(cmdServer, proxy);
-		      connection = [cmdServer connectionForProxy];
-		      [connection enableMultipleThreads];
-		      if (nil == alarmDestination)
+		      NSSocketPortNameServer        *ns;
+
+		      host = ecCommandHost();
+		      name = ecCommandName();
+
+		      ns = [NSSocketPortNameServer sharedInstance];
+		      EC_TRACE_BEGIN("connect to Command")
+		      proxy = [NSConnection
+			rootProxyForConnectionWithRegisteredName: name
+							    host: host
+						 usingNameServer: ns];
+		      EC_TRACE_END
+		      [proxy setProtocolForProxy: @protocol(Command)];
+		      if (nil == proxy)
+			{
+			  NSLog(@"Unable to connect to Command server");
+			}
+		      else
 			{
-			  alarmDestination = [EcAlarmDestination new];
+			  NSConnection	*connection;
+
+			  ASSIGN(cmdServer, proxy);
+			  cmdAccepted = NO;
+			  connection = [cmdServer connectionForProxy];
+			  [connection enableMultipleThreads];
+			  if (nil == alarmDestination)
+			    {
+			      alarmDestination = [EcAlarmDestination new];
+			    }
+			  [[self ecAlarmDestination] setDestination: cmdServer];
+			  [[NSNotificationCenter defaultCenter]
+			    addObserver: self
+			       selector: @selector(cmdConnectionBecameInvalid:)
+				   name: NSConnectionDidDieNotification
+				 object: connection];
 			}
-		      [[self ecAlarmDestination] setDestination: cmdServer];
-		      [[NSNotificationCenter defaultCenter]
-			addObserver: self
-			   selector: @selector(cmdConnectionBecameInvalid:)
-			       name: NSConnectionDidDieNotification
-			     object: connection];
 		    }
+		  NS_HANDLER
+		    {
+		      proxy = nil;
+		      NSLog(@"Exception connecting to Command server %@ on %@):"
+			@" %@", name, host, localException);
+		    }
+		  NS_ENDHANDLER
 		}
-	      NS_HANDLER
-		{
-		  proxy = nil;
-		  NSLog(@"Exception connecting to Command server %@ on %@): %@",
-		    name, host, localException);
-		}
-	      NS_ENDHANDLER
 
 	      /* We only register and fetch new configuration information
 	       * if we are NOT in the process of shutting down: a process
@@ -3773,10 +5270,12 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 		    {
 		      NSData	*d;
 
+                      EC_TRACE_BEGIN("registerClient:identifier:name:transient:")
 		      d = [proxy registerClient: self
                                      identifier: [self processIdentifier]
 					   name: cmdLogName()
 				      transient: cmdIsTransient];
+                      EC_TRACE_END
 		      r = [NSPropertyListSerialization
 			propertyListWithData: d
 			options: NSPropertyListMutableContainers
@@ -3785,18 +5284,34 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 		    }
 		  NS_HANDLER
 		    {
-		      r = [NSMutableDictionary dictionaryWithCapacity: 1];
-		      [r setObject: [localException reason]
-			    forKey: @"rejected"];
 		      NSLog(@"Caught exception registering with Command: %@",
 			localException);
+		      if (YES == reuse)
+			{
+			  /* The connection we were holding on to while
+			   * told to back off has failed; start afresh.
+			   */
+			  [[self ecAlarmDestination] setDestination: nil];
+			  DESTROY(cmdServer);
+			  r = nil;
+			}
+		      else
+			{
+			  r = [NSMutableDictionary dictionaryWithCapacity: 1];
+			  [r setObject: [localException reason]
+				forKey: @"rejected"];
+			}
 		    }
 		  NS_ENDHANDLER
 
 		  /* We could be rejected or told to back off,
 		   * otherwise we continue as normal.
 		   */
-		  if ([r objectForKey: @"rejected"] != nil)
+		  if (nil == r)
+		    {
+		      failed = YES;
+		    }
+		  else if ([r objectForKey: @"rejected"] != nil)
 		    {
 		      NSString  *shutdown;
 
@@ -3812,12 +5327,20 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 		    }
 		  else if ([r objectForKey: @"back-off"] != nil)
 		    {
+		      /* We keep the connection (for logging) but must
+		       * register again later.  The Command server may
+		       * tell us when it will have a place for us.
+		       */
+		      hint = [[r objectForKey: @"retry"] doubleValue];
+		      failed = YES;
 		      NSLog(@"Unable to register with Command server ..."
-			@" back-off");
+			@" back-off (%@)", [r objectForKey: @"back-off"]);
 		    }
 		  else
 		    {
+		      cmdAccepted = YES;
 		      [self _update: r];
+		      [self _beatStart];
 
                       /* If we just connected to the command server,
                        * and we have a registered connection, then we
@@ -3830,7 +5353,39 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
                         }
 		    }
 		}
+	      else if (nil == proxy)
+		{
+		  failed = YES;
+		}
+	    }
+
+	  if (YES == failed && 0.0 == beganQuitting)
+	    {
+	      NSTimeInterval	delay;
+
+	      /* Use our own backoff, but wait at least as long as the
+	       * Command server asked (plus a little jitter so that all
+	       * the processes it deferred do not return together).
+	       */
+	      delay = [EcAdmission delayFor: cmdLogName() after: cmdRetries];
+	      if (hint > 0.0)
+		{
+		  delay = hint
+		    + 0.1 * [EcAdmission jitterFor: cmdLogName() count: 0];
+		}
+	      if (cmdRetries < 32)
+		{
+		  cmdRetries++;
+		}
+	      cmdRetryAt = [NSDate timeIntervalSinceReferenceDate] + delay;
+	      [self _cmdRetrySchedule];
+	    }
+	  else if (YES == cmdAccepted)
+	    {
+	      cmdRetries = 0;
+	      cmdRetryAt = 0.0;
 	    }
+
 	  connecting = NO;
 	  if (nil == cmdLast && nil == cmdServer && YES == [self cmdIsClient])
 	    {
@@ -3969,6 +5524,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
   [cmdDefs purgeSettings];
 
   [self _memCheck];
+  [self _resCheck];
 }
 
 - (void) ecHadIP: (NSDate*)when
@@ -3995,6 +5551,21 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
     }
 }
 
+- (void) ecMetric: (NSString*)name add: (double)value
+{
+  [ecMetrics add: value to: name];
+}
+
+- (void) ecMetric: (NSString*)name sample: (double)value
+{
+  [ecMetrics sample: value for: name];
+}
+
+- (EcMetrics*) ecMetrics
+{
+  return ecMetrics;
+}
+
 - (NSUInteger) ecNotLeaked
 {
   return 0;
@@ -4093,6 +5664,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
   if (nil == cmdServer)
     {
       DESTROY(cmdLast);		// Allow immediate retry
+      cmdRetries = 0;
       [self cmdNewServer];
     }
 
@@ -4156,19 +5728,14 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
     }
   else
     {
-      NS_DURING
-	[cmdServer registerClient: self
-                       identifier: [self processIdentifier]
-			     name: cmdLogName()
-			transient: cmdIsTransient];
-      NS_HANDLER
-	DESTROY(cmdServer);
-      NS_ENDHANDLER
-      if (nil == cmdServer)
-	{
-	  DESTROY(cmdLast);		// Allow immediate retry
-	  [self cmdNewServer];
-	}
+      /* Register again (using any existing connection) and handle the
+       * response as for a new connection, so that if the Command server
+       * tells us to back off we will retry when it has a place for us.
+       */
+      cmdAccepted = NO;
+      DESTROY(cmdLast);		// Allow immediate retry
+      cmdRetries = 0;
+      [self cmdNewServer];
     }
 }
 
@@ -4210,8 +5777,12 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 
 - (void) setCmdDebug: (NSString*)mode withDescription: (NSString*)desc
 {
+  BOOL	active;
+
+  active = [cmdDefs boolForKey: [@"Debug-" stringByAppendingString: mode]];
+  [debugLock lock];
   [cmdDebugKnown setObject: desc forKey: mode];
-  if (YES == [cmdDefs boolForKey: [@"Debug-" stringByAppendingString: mode]])
+  if (YES == active)
     {
       [cmdDebugModes addObject: mode];
     }
@@ -4219,6 +5790,8 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
     {
       [cmdDebugModes removeObject: mode];
     }
+  debugPublish();
+  [debugLock unlock];
 }
 
 - (void) setCmdTimeout: (SEL)sel
@@ -4258,13 +5831,12 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 
 - (BOOL) cmdDebugMode: (NSString*)mode
 {
-  if ([cmdDebugModes member: mode] == nil)
-    return NO;
-  return YES;
+  return debugActive(mode);
 }
 
 - (void) cmdDebugMode: (NSString*)mode active: (BOOL)flag
 {
+  [debugLock lock];
   if ((mode = findMode(cmdDebugKnown, mode)) != nil)
     {
       if (flag == YES && [cmdDebugModes member: mode] == nil)
@@ -4275,7 +5847,9 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 	{
 	  [cmdDebugModes removeObject: mode];
 	}
+      debugPublish();
     }
+  [debugLock unlock];
 }
 
 - (oneway void) cmdGnip: (id <CmdPing>)from
@@ -4591,7 +6165,9 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
     {
       NS_DURING
 	{
+	  EC_TRACE_BEGIN("reply:to:from:")
 	  [cmdServer reply: val to: name from: ecFullName()];
+	  EC_TRACE_END
 	}
       NS_HANDLER
 	{
@@ -4787,7 +6363,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 	  [self cmdPrintf: @"is used to activate one of the "];
 	  [self cmdPrintf: @"debug modes listed below.\n\n"];
 
-	  [self cmdPrintf: @"%@\n", cmdDebugKnown];
+	  [self cmdPrintf: @"%@\n", debugKnown()];
 	}
       else if (YES == cmdKillDebug)
 	{
@@ -4802,7 +6378,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 
           if ([mode caseInsensitiveCompare: @"default"] == NSOrderedSame)
             {
-	      NSEnumerator	*enumerator = [cmdDebugKnown keyEnumerator];
+	      NSEnumerator	*enumerator = [debugKnown() keyEnumerator];
 
 	      while (nil != (mode = [enumerator nextObject]))
 		{
@@ -4813,7 +6389,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
             }
           else if ([mode caseInsensitiveCompare: @"all"] == NSOrderedSame)
 	    {
-	      NSEnumerator	*enumerator = [cmdDebugKnown keyEnumerator];
+	      NSEnumerator	*enumerator = [debugKnown() keyEnumerator];
               NSMutableArray    *already = [NSMutableArray array];
               NSMutableArray    *changed = [NSMutableArray array];
               NSMutableArray    *blocked = [NSMutableArray array];
@@ -4823,7 +6399,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 		  key = [@"Debug-" stringByAppendingString: mode];
 		  key = [cmdDefs key: key];
                   
-		  if ([cmdDebugModes member: mode])
+		  if ([debugModes() member: mode])
 		    {
                       [already addObject: mode];
 		    }
@@ -4856,11 +6432,11 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
           else
             {
 	      [self cmdPrintf: @"debug mode '%@' ", mode];
-	      if ((mode = findMode(cmdDebugKnown, mode)) == nil)
+	      if ((mode = findMode(debugKnown(), mode)) == nil)
 		{
 		  [self cmdPrintf: @"is not known.\n"];
 		}
-	      else if ([cmdDebugModes member: mode])
+	      else if ([debugModes() member: mode])
                 {
                   [self cmdPrintf: @"is already active.\n"];
                 }
@@ -4886,13 +6462,13 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 	{
 	  [self cmdPrintf: @"%@\n", [EcLogger loggerForType: LT_DEBUG]];
 	  [self cmdPrintf: @"Current active debug modes -\n"];
-	  if ([cmdDebugModes count] == 0)
+	  if ([debugModes() count] == 0)
 	    {
 	      [self cmdPrintf: @"\nNone.\n"];
 	    }
 	  else
 	    {
-	      [self cmdPrintf: @"%@\n", cmdDebugModes];
+	      [self cmdPrintf: @"%@\n", debugModes()];
 	    }
 	}
     }
@@ -5281,7 +6857,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 	  [self cmdPrintf: @" used to deactivate one of the\n"];
 	  [self cmdPrintf: @"debug modes listed below.\n"];
 	  [self cmdPrintf: @"\n"];
-	  [self cmdPrintf: @"%@\n", cmdDebugKnown];
+	  [self cmdPrintf: @"%@\n", debugKnown()];
 	}
       else if ([msg count] > 1)
 	{
@@ -5291,7 +6867,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 
           if ([mode caseInsensitiveCompare: @"default"] == NSOrderedSame)
             {
-	      NSEnumerator	*enumerator = [cmdDebugKnown keyEnumerator];
+	      NSEnumerator	*enumerator = [debugKnown() keyEnumerator];
 
 	      while (nil != (mode = [enumerator nextObject]))
 		{
@@ -5303,7 +6879,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
             }
           else if ([mode caseInsensitiveCompare: @"all"] == NSOrderedSame)
 	    {
-	      NSEnumerator	*enumerator = [cmdDebugKnown keyEnumerator];
+	      NSEnumerator	*enumerator = [debugKnown() keyEnumerator];
               NSMutableArray    *already = [NSMutableArray array];
               NSMutableArray    *changed = [NSMutableArray array];
               NSMutableArray    *blocked = [NSMutableArray array];
@@ -5313,7 +6889,7 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 		  key = [@"Debug-" stringByAppendingString: mode];
 		  key = [cmdDefs key: key];
                   
-		  if ([cmdDebugModes member: mode] == nil)
+		  if ([debugModes() member: mode] == nil)
 		    {
                       [already addObject: mode];
 		    }
@@ -5346,11 +6922,11 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 	  else
 	    {
 	      [self cmdPrintf: @"debug mode '%@' ", mode];
-	      if ((mode = findMode(cmdDebugKnown, mode)) == nil)
+	      if ((mode = findMode(debugKnown(), mode)) == nil)
 		{
 		  [self cmdPrintf: @"is not known.\n"];
 		}
-              else if ([cmdDebugModes member: mode] == nil)
+              else if ([debugModes() member: mode] == nil)
                 {
                   [self cmdPrintf: @"already inactive.\n"];
                 }
@@ -5374,13 +6950,13 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
 	}
       else
 	{
-	  NSArray	*a = [cmdDebugKnown allKeys];
+	  NSArray	*a = [debugKnown() allKeys];
 	  NSMutableSet	*s = [NSMutableSet setWithArray: a];
 
 	  /*
 	   * Find items known but not active.
 	   */
-	  [s minusSet: cmdDebugModes];
+	  [s minusSet: debugModes()];
 	  [self cmdPrintf: @"Current inactive debug modes -\n"];
 	  if (a == 0)
 	    {
@@ -5394,6 +6970,88 @@ NSLog(@"Ignored attempt to set timer interval to %g ... using 10.0", interval);
     }
 }
 
+- (void) cmdMesglocks: (NSArray*)msg
+{
+  if ([msg count] == 0)
+    {
+      [self cmdPrintf: @"reports contention on the process wide lock"];
+      return;
+    }
+
+  if ([[msg objectAtIndex: 0] caseInsensitiveCompare: @"help"]
+    == NSOrderedSame)
+    {
+      [self cmdPrintf: @"reports contention on the process wide lock\n"];
+      [self cmdPrintf: @"(used by -ecDoLock and -ecUnLock), giving the\n"];
+      [self cmdPrintf: @"number of acquisitions, how many had to wait,\n"];
+      [self cmdPrintf: @"the distribution of wait times, and the code\n"];
+      [self cmdPrintf: @"which was holding the lock when waits occurred.\n"];
+      [self cmdPrintf: @"'locks reset' discards the figures gathered so far\n"];
+      return;
+    }
+
+  if ([msg count] > 1
+    && [[msg objectAtIndex: 1] caseInsensitiveCompare: @"reset"]
+    == NSOrderedSame)
+    {
+      [(EcProfiledLock*)ecLock reset];
+      [self cmdPrintf: @"Lock statistics reset.\n"];
+      return;
+    }
+  [self cmdPrintf: @"%@", [(EcProfiledLock*)ecLock report]];
+}
+
+- (void) cmdMesgtrace: (NSArray*)msg
+{
+  NSString	*cmd;
+
+  if ([msg count] == 0)
+    {
+      [self cmdPrintf: @"records timing spans for performance analysis"];
+      return;
+    }
+
+  if ([[msg objectAtIndex: 0] caseInsensitiveCompare: @"help"]
+    == NSOrderedSame)
+    {
+      [self cmdPrintf: @"records timing spans for performance analysis\n"];
+      [self cmdPrintf: @"'trace start' discards any earlier spans and\n"];
+      [self cmdPrintf: @"begins recording.\n"];
+      [self cmdPrintf: @"'trace stop' ends recording and writes the spans\n"];
+      [self cmdPrintf: @"to a file in the debug logs directory, in the\n"];
+      [self cmdPrintf: @"Chrome trace-event format.\n"];
+      [self cmdPrintf: @"'trace' reports whether recording is active.\n"];
+      [self cmdPrintf: @"Setting the Trace default records from startup.\n"];
+      return;
+    }
+
+  cmd = ([msg count] > 1) ? [msg objectAtIndex: 1] : @"";
+  if ([cmd caseInsensitiveCompare: @"start"] == NSOrderedSame)
+    {
+      if (YES == EcTraceActive)
+        {
+          [self cmdPrintf: @"Tracing is already active.\n"];
+        }
+      else if (YES == EcTraceStart())
+        {
+          [self cmdPrintf: @"Tracing started.\n"];
+        }
+      else
+        {
+          [self cmdPrintf: @"Tracing is not supported on this system.\n"];
+        }
+    }
+  else if ([cmd caseInsensitiveCompare: @"stop"] == NSOrderedSame)
+    {
+      [self cmdPrintf: @"%@\n", traceWrite()];
+    }
+  else
+    {
+      [self cmdPrintf: @"Tracing is %@.\n",
+        (YES == EcTraceActive) ? @"active" : @"not active"];
+    }
+}
+
 - (void) cmdMesgmemory: (NSArray*)msg
 {
   if ([msg count] == 0)
@@ -5834,6 +7492,41 @@ With two parameters ('list' and a class),\n\
 	    }
 	}
 
+      [self cmdPrintf: @"%@", [EcStallWatchdog report]];
+
+      if (nil != resRates)
+	{
+	  NSDictionary	*r = resRates;
+
+	  [self cmdPrintf: @"Resource usage (per second over %.0f seconds):\n"
+	    @"  CPU %.1f%% (user %.1f%%, system %.1f%%), threads %@\n"
+	    @"  context switches %.1f voluntary, %.1f involuntary\n"
+	    @"  page faults %.1f major, %.1f minor\n",
+	    [[r objectForKey: @"Interval"] doubleValue],
+	    [[r objectForKey: @"CPU"] doubleValue],
+	    [[r objectForKey: @"CPUUser"] doubleValue],
+	    [[r objectForKey: @"CPUSystem"] doubleValue],
+	    [r objectForKey: @"Threads"],
+	    [[r objectForKey: @"VoluntarySwitches"] doubleValue],
+	    [[r objectForKey: @"InvoluntarySwitches"] doubleValue],
+	    [[r objectForKey: @"MajorFaults"] doubleValue],
+	    [[r objectForKey: @"MinorFaults"] doubleValue]];
+	  if (nil != [r objectForKey: @"RunDelay"])
+	    {
+	      [self cmdPrintf: @"  waiting for CPU %.3fms\n",
+		[[r objectForKey: @"RunDelay"] doubleValue]];
+	    }
+	  if (nil != [r objectForKey: @"ReadBytes"])
+	    {
+	      [self cmdPrintf: @"  I/O read %.0f bytes (%.0f from storage),"
+		@" written %.0f bytes (%.0f to storage)\n",
+		[[r objectForKey: @"ReadChars"] doubleValue],
+		[[r objectForKey: @"ReadBytes"] doubleValue],
+		[[r objectForKey: @"WriteChars"] doubleValue],
+		[[r objectForKey: @"WriteBytes"] doubleValue]];
+	    }
+	}
+
       if (hasLSAN())
 	{
 	  [self cmdPrintf: @"Unknown memory usage:  built with asan/lsan.\n"];
@@ -5927,6 +7620,26 @@ With two parameters ('list' and a class),\n\
   ecIsQuitting();
   [self cmdDbg: cmdConnectDbg msg: @"cmdPing: %lx sequence: %u extra: %lx",
     (unsigned long)from, num, (unsigned long)data];
+  if (from == cmdServer)
+    {
+      NSDictionary	*delta = [ecMetrics takeDelta];
+
+      /* The response to a ping from the Command server carries any metrics
+       * gathered since the previous ping, so that the Command server can
+       * aggregate them for the host without polling each process.
+       */
+      if (nil != delta)
+	{
+	  NSData	*d;
+
+	  d = [NSPropertyListSerialization
+	    dataFromPropertyList: delta
+	    format: NSPropertyListBinaryFormat_v1_0
+	    errorDescription: 0];
+	  [from cmdGnip: self sequence: num extra: d];
+	  return;
+	}
+    }
   [from cmdGnip: self sequence: num extra: nil];
 }
 
@@ -5970,8 +7683,15 @@ With two parameters ('list' and a class),\n\
 
 - (void) cmdUpdate: (NSMutableDictionary*)info
 {
-  ASSIGNCOPY(cmdConf, info);
-  [cmdDefs setConfiguration: cmdConf];
+  NSDictionary	*conf = [info copy];
+  NSDictionary	*old;
+
+  [confLock lock];
+  old = cmdConf;
+  cmdConf = conf;
+  [confLock unlock];
+  RELEASE(old);
+  [cmdDefs setConfiguration: conf];
 }
 
 - (NSString*) cmdUpdated
@@ -6049,6 +7769,8 @@ With two parameters ('list' and a class),\n\
 
 - (id) initWithDefaults: (NSDictionary*) defs
 {
+  uint64_t	traceStart = EcTraceNow();
+
   [ecLock lock];
   initAt = [NSDate timeIntervalSinceReferenceDate];
   if (nil != EcProc)
@@ -6253,6 +7975,7 @@ With two parameters ('list' and a class),\n\
 	selector: @selector(_defaultsChanged:)
 	name: NSUserDefaultsDidChangeNotification
 	object: [NSUserDefaults standardUserDefaults]];
+      snapshotPublish(cmdDefs);
 
       [[NSNotificationCenter defaultCenter]
 	addObserver: self
@@ -6311,6 +8034,7 @@ With two parameters ('list' and a class),\n\
               exit(0);
             }
         }
+      EcTraceSpan("initWithDefaults:", traceStart, EcTraceNow());
     }
 
   return self;
@@ -6344,18 +8068,89 @@ With two parameters ('list' and a class),\n\
 
 - (oneway void) updateConfig: (in bycopy NSData*)info
 {
-  id	plist = [NSPropertyListSerialization
+  id	plist;
+
+  cmdConfReceived = [NSDate timeIntervalSinceReferenceDate];
+  cmdConfBytes = [info length];
+  cmdConfMapped = NO;
+  plist = [NSPropertyListSerialization
     propertyListWithData: info
     options: NSPropertyListMutableContainers
     format: 0
     error: 0];
-
   if (nil != plist)
     {
       [self _update: plist];
     }
 }
 
+- (oneway void) updateConfigDelta: (in bycopy NSData*)delta
+{
+  NSMutableDictionary	*d;
+  NSMutableDictionary	*info;
+
+  cmdConfReceived = [NSDate timeIntervalSinceReferenceDate];
+  cmdConfBytes = [delta length];
+  cmdConfMapped = NO;
+  d = [NSPropertyListSerialization
+    propertyListWithData: delta
+    options: NSPropertyListMutableContainers
+    format: 0
+    error: 0];
+  info = [EcConfigDelta apply: d to: cmdConfInfo version: cmdConfVersion];
+  if (nil == info)
+    {
+      /* We don't have the version the delta was made against, so we
+       * need the Command server to send us the full configuration.
+       */
+      NSLog(@"Unable to apply config delta from %llu (have %llu)",
+        [[d objectForKey: @"Base"] unsignedLongLongValue],
+        (unsigned long long)cmdConfVersion);
+      NS_DURING
+        [cmdServer requestConfigFor: self];
+      NS_HANDLER
+        NSLog(@"Requesting config from Command server: %@", localException);
+      NS_ENDHANDLER
+      return;
+    }
+  [info setObject: [d objectForKey: @"Version"] forKey: EC_CONFIG_VERSION];
+  [self _update: info];
+}
+
+- (oneway void) updateConfigMapped: (in bycopy NSString*)path
+{
+  EcConfigMap		*map;
+  NSMutableDictionary	*info;
+
+  cmdConfReceived = [NSDate timeIntervalSinceReferenceDate];
+  cmdConfBytes = 0;
+  cmdConfMapped = YES;
+  map = [EcConfigMap mapFile: path];
+  if (nil == map)
+    {
+      NSLog(@"Unable to map config from %@", path);
+      NS_DURING
+        [cmdServer requestConfigFor: self];
+      NS_HANDLER
+        NSLog(@"Requesting config from Command server: %@", localException);
+      NS_ENDHANDLER
+      return;
+    }
+  if ([map version] == cmdConfVersion)
+    {
+      return;   // Already up to date
+    }
+
+  /* Only the sections used by this process are parsed from the file.
+   * The parsed values are private to this process (our defaults must
+   * hold real objects), so only the file pages themselves are shared.
+   */
+  info = [EcConfigMap configurationFor: cmdLogName() in: map];
+  [info setObject: [NSNumber numberWithUnsignedLongLong: [map version]]
+           forKey: EC_CONFIG_VERSION];
+  [self _update: info];
+}
+
 - (id) server: (NSString *)serverName
 {
   RemoteServer *server;
@@ -6368,7 +8163,7 @@ With two parameters ('list' and a class),\n\
       return nil;
     }
   
-  return [server proxy];
+  return [server tracedProxy: -1];
 }
 
 - (id) server: (NSString *)serverName forNumber: (NSString*)num
@@ -6411,14 +8206,14 @@ With two parameters ('list' and a class),\n\
 	  if (val >= [[d objectForKey: @"Low"] intValue]
 	    && val <= [[d objectForKey: @"High"] intValue])
 	    {
-	      return [[server proxy] BCPproxy: count];
+	      return [server tracedProxy: (int)count];
 	    }
 	}
       [self cmdError: @"Attempt to get %@ server for number %@ with bad config",
 	serverName, num];
       return nil;
     }
-  return [server proxy];
+  return [server tracedProxy: -1];
 }
 
 - (BOOL) isServerMultiple: (NSString *)serverName
@@ -6576,6 +8371,94 @@ With two parameters ('list' and a class),\n\
     }
 }
 
+- (void) _ensureResLogger
+{
+  NSString	*bundle = [cmdDefs stringForKey: @"ResourceLoggerBundle"];
+  Class		cls = Nil;
+
+  if (nil == bundle)
+    {
+      DESTROY(cmdResourceLogger);
+      return;
+    }
+  cls = NSClassFromString(bundle);
+  if ((Nil == cls)
+      || (NO == [cls conformsToProtocol: @protocol(EcResourceLogger)]))
+    {
+      cls = [self _loggerClassFromBundle: bundle
+                                protocol: @protocol(EcResourceLogger)];
+    }
+  if (Nil == cls)
+    {
+      DESTROY(cmdResourceLogger);
+      return;
+    }
+  if (NO == [cmdResourceLogger isKindOfClass: cls])
+    {
+      DESTROY(cmdResourceLogger);
+    }
+  if (nil == cmdResourceLogger)
+    {
+      NS_DURING
+        {
+          cmdResourceLogger = [cls new];
+        }
+      NS_HANDLER
+        {
+          [self cmdWarn: @"Exception creating resource logger: %@",
+             localException];
+        }
+      NS_ENDHANDLER
+    }
+}
+
+- (void) _cmdRetry: (NSTimer*)timer
+{
+  cmdRTimer = nil;
+  if (NO == ecIsQuitting())
+    {
+      [self cmdNewServer];
+    }
+}
+
+/* Sets a timer to retry connecting to (or registering with) the Command
+ * server at the time in cmdRetryAt.  Using our own timer rather than the
+ * regular timeout means that processes retry at their jittered times
+ * rather than all together at the start of a ten second period.
+ */
+- (void) _cmdRetrySchedule
+{
+  NSTimeInterval	when;
+
+  if (NO == [NSThread isMainThread])
+    {
+      [self performSelectorOnMainThread: _cmd
+                             withObject: nil
+                          waitUntilDone: NO];
+      return;
+    }
+  if (cmdRTimer != nil)
+    {
+      [cmdRTimer invalidate];
+      cmdRTimer = nil;
+    }
+  if (cmdRetryAt <= 0.0 || YES == ecIsQuitting() || NO == [self cmdIsClient]
+    || (nil != cmdServer && YES == cmdAccepted))
+    {
+      return;
+    }
+  when = cmdRetryAt - [NSDate timeIntervalSinceReferenceDate];
+  if (when < 0.001)
+    {
+      when = 0.001;
+    }
+  cmdRTimer = [NSTimer scheduledTimerWithTimeInterval: when
+					       target: self
+					     selector: @selector(_cmdRetry:)
+					     userInfo: nil
+					      repeats: NO];
+}
+
 - (void) _fdCheck
 {
   unsigned 	cur = 0;
@@ -6664,6 +8547,60 @@ With two parameters ('list' and a class),\n\
   fdMax = max;
 }
 
+- (void) _resCheck
+{
+  ResSample	sample;
+  NSDictionary	*rates;
+
+  if (NO == resSample(&sample))
+    {
+      return;
+    }
+  if (0.0 == resLast.when)
+    {
+      resLast = sample;		// First sample ... no rates yet.
+      return;
+    }
+  rates = resRatesBetween(&resLast, &sample);
+  resLast = sample;
+  if (nil == rates)
+    {
+      return;
+    }
+  ASSIGN(resRates, rates);
+
+  [ecMetrics sample: [[rates objectForKey: @"CPU"] doubleValue]
+                for: @"CPUPercent"];
+  [ecMetrics sample: [[rates objectForKey: @"InvoluntarySwitches"] doubleValue]
+                for: @"InvoluntarySwitches"];
+  [ecMetrics sample: [[rates objectForKey: @"MajorFaults"] doubleValue]
+                for: @"MajorFaults"];
+  if (nil != [rates objectForKey: @"ReadBytes"])
+    {
+      NSTimeInterval	i = [[rates objectForKey: @"Interval"] doubleValue];
+
+      [ecMetrics add: [[rates objectForKey: @"ReadBytes"] doubleValue] * i
+                  to: @"IOReadBytes"];
+      [ecMetrics add: [[rates objectForKey: @"WriteBytes"] doubleValue] * i
+                  to: @"IOWriteBytes"];
+    }
+
+  [self _ensureResLogger];
+  if (nil != cmdResourceLogger)
+    {
+      NS_DURING
+        {
+          [cmdResourceLogger process: self didUseResources: rates];
+        }
+      NS_HANDLER
+        {
+          [self cmdWarn: @"Exception logging resource usage to bundle: %@",
+            localException];
+        }
+      NS_ENDHANDLER
+    }
+}
+
 - (void) _memCheck
 {
   if (NO == hasLSAN())
@@ -7099,6 +9036,46 @@ With two parameters ('list' and a class),\n\
   return status;
 }
 
+- (void) _beat: (NSTimer*)timer
+{
+  [cmdBeats beat];
+}
+
+- (void) _beatStart
+{
+  NSString	*path;
+
+  /* Map the table afresh each time we register, since a new Command
+   * server may have replaced it.
+   */
+  path = [cmdDataDir() stringByAppendingPathComponent: @"Heartbeat.map"];
+  ASSIGN(cmdBeats, [EcHeartbeat mapFile: path]);
+  if (nil == cmdBeats)
+    {
+      [cmdBeatTimer invalidate];
+      cmdBeatTimer = nil;
+    }
+  else
+    {
+      [cmdBeats beat];
+      if (nil == cmdBeatTimer)
+	{
+	  /* Beat in the reply mode too, as we still answer messages while
+	   * waiting for a reply.
+	   */
+	  cmdBeatTimer = [NSTimer timerWithTimeInterval: 0.25
+						 target: self
+					       selector: @selector(_beat:)
+					       userInfo: nil
+						repeats: YES];
+	  [[NSRunLoop currentRunLoop] addTimer: cmdBeatTimer
+				       forMode: NSDefaultRunLoopMode];
+	  [[NSRunLoop currentRunLoop] addTimer: cmdBeatTimer
+				       forMode: NSConnectionReplyMode];
+	}
+    }
+}
+
 - (void) _timedOut: (NSTimer*)timer
 {
   static BOOL	inProgress = NO;
@@ -7179,6 +9156,23 @@ With two parameters ('list' and a class),\n\
               if (YES == newTenSecond)
                 {
                   [self cmdNewServer];
+                  /* The run loop is active now, so stall detection
+                   * may start (or restart if it was re-enabled).
+                   */
+                  [EcStallWatchdog start];
+
+                  /* Release any replaced configuration which a reader
+                   * was still holding when it was retired.
+                   */
+                  [confLock lock];
+                  hazardReclaim();
+                  [confLock unlock];
+                }
+              if (nil == cmdServer && nil == cmdRTimer)
+                {
+                  /* Lost the Command server; retry at our own time.
+                   */
+                  [self _cmdRetrySchedule];
                 }
               if (YES == newMinute)
                 {
@@ -7242,6 +9236,14 @@ With two parameters ('list' and a class),\n\
       return;   // Ignore config updates while quitting
     }
 
+  EC_TRACE_BEGIN(nil == confSnapshot() ? "_update: (first)" : "_update:")
+
+  /* Keep the information as sent (and its version) so that later updates
+   * may be sent as deltas against it.
+   */
+  cmdConfVersion = [EcConfigDelta takeVersion: info];
+  ASSIGN(cmdConfInfo, info);
+
   /* The configuration should contain information about any operators
    * who are allowed to issue commands to this process.
    */
@@ -7294,20 +9296,47 @@ With two parameters ('list' and a class),\n\
         }
     }
 
-  if (nil == cmdConf || [cmdConf isEqual: newConfig] == NO)
+  dict = confSnapshot();
+  if (nil == dict || [dict isEqual: newConfig] == NO)
     {
       DESTROY(configError);
       configInProgress = YES;
       NS_DURING
+        EC_TRACE_BEGIN("cmdUpdate:")
         [self cmdUpdate: newConfig];
+        EC_TRACE_END
       NS_HANDLER
         NSLog(@"Problem before updating config (in cmdUpdate:) %@",
           localException);
         ASSIGN(configError, @"the -cmdUpdate: method raised an exception");
       NS_ENDHANDLER
       configInProgress = NO;
+      EC_TRACE_BEGIN("_defaultsChanged:")
       [self _defaultsChanged: nil];
+      EC_TRACE_END
     }
+
+  /* If this change is being traced, record our hop so that the trace
+   * can be collected using EcTestGetConfig().
+   */
+  dict = [info objectForKey: EC_CONFIG_TRACE];
+  if ([dict isKindOfClass: [NSDictionary class]]
+    && NO == [[dict objectForKey: @"Id"]
+      isEqual: [cmdConfTrace objectForKey: @"Id"]])
+    {
+      dict = [EcConfigDelta trace: dict addHop:
+        [NSDictionary dictionaryWithObjectsAndKeys:
+          cmdLogName(), @"Name",
+          [[NSHost currentHost] wellKnownName], @"Host",
+          [NSNumber numberWithDouble: cmdConfReceived], @"Received",
+          [NSNumber numberWithUnsignedInteger: cmdConfBytes], @"Bytes",
+          [NSNumber numberWithBool: cmdConfMapped], @"Mapped",
+          [NSNumber numberWithDouble:
+            [NSDate timeIntervalSinceReferenceDate]], @"Applied",
+          nil]];
+      ASSIGN(cmdConfTrace, dict);
+    }
+  EC_TRACE_END
 }
 
 @end
@@ -7336,7 +9365,16 @@ With two parameters ('list' and a class),\n\
 
 - (bycopy NSData*) ecTestConfigForKey: (in bycopy NSString*)key
 {
-  id    result = [cmdDefs objectForKey: key];
+  id    result;
+
+  if ([key isEqual: EC_CONFIG_TRACE])
+    {
+      result = cmdConfTrace;
+    }
+  else
+    {
+      result = [cmdDefs objectForKey: key];
+    }
 
   if (nil != result)
     {
@@ -7389,6 +9427,25 @@ With two parameters ('list' and a class),\n\
 {
   [NSObject enableDoubleReleaseCheck: [val boolValue]];
 }
+- (void) _defStallAlarm: (id)val
+{
+  [EcStallWatchdog setAlarm: [val doubleValue] / 1000.0];
+}
+- (void) _defStallThreshold: (id)val
+{
+  [EcStallWatchdog setThreshold: [val doubleValue] / 1000.0];
+}
+- (void) _defTrace: (id)val
+{
+  if (YES == [val boolValue])
+    {
+      EcTraceStart();
+    }
+  else if (YES == EcTraceActive)
+    {
+      NSLog(@"%@", traceWrite());
+    }
+}
 - (void) _defTesting: (id)val
 {
   cmdFlagTesting = [val boolValue];
@@ -7423,6 +9480,7 @@ static NSMutableDictionary      *regDefs = nil;
               ASSIGNCOPY(d->obj, o);
               o = d->obj;
               c = d->cmd;
+              [d resolve: defs];
             }
         }
       [ecLock unlock];
@@ -7660,15 +9718,65 @@ static NSMutableDictionary      *regDefs = nil;
   GSPrintf(stderr, @"%@", [self listHelp: @""]);
 }
 
++ (EcDefaultSlot*) slotFor: (NSString*)name
+{
+  EcDefaultRegistration *d;
+  EcDefaultSlot         *s;
+
+  [ecLock lock];
+  d = [regDefs objectForKey: name];
+  if (nil == d)
+    {
+      d = [EcDefaultRegistration new];
+      ASSIGNCOPY(d->name, name);
+      [regDefs setObject: d forKey: d->name];
+      RELEASE(d);
+      if (nil != cmdDefs)
+        {
+          ASSIGNCOPY(d->obj, [cmdDefs objectForKey: name]);
+          [d resolve: cmdDefs];
+        }
+    }
+  s = &d->slot;
+  [ecLock unlock];
+  return s;
+}
+
 - (void) dealloc
 {
   RELEASE(name);
   RELEASE(type);
   RELEASE(help);
   RELEASE(obj);
+  RELEASE(slot.stringValue);
   [super dealloc];
 }
 
+/* Converts the new value of the default to each of the typed forms.
+ * The slot is updated as a sequence lock: the version is odd while the
+ * fields are being written, so readers retry rather than see a mixture of
+ * old and new values.  The old string is retired rather than released,
+ * as a thread may be reading it from the slot.
+ */
+- (void) resolve: (NSUserDefaults*)defs
+{
+  NSString      *str = [[defs stringForKey: name] copy];
+  BOOL          b = [defs boolForKey: name];
+  NSInteger     i = [defs integerForKey: name];
+  double        d = [defs doubleForKey: name];
+
+  [confLock lock];
+  __atomic_store_n(&slot.version, slot.version + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  __atomic_store(&slot.boolValue, &b, __ATOMIC_RELAXED);
+  __atomic_store(&slot.integerValue, &i, __ATOMIC_RELAXED);
+  __atomic_store(&slot.doubleValue, &d, __ATOMIC_RELAXED);
+  hazardReplace((id*)&slot.stringValue, str);
+  __atomic_store_n(&slot.version, slot.version + 1, __ATOMIC_RELEASE);
+  [confLock unlock];
+  RELEASE(str);
+}
+
 @end
 
 
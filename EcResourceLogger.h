@@ -0,0 +1,80 @@
+/** Enterprise Control Configuration and Logging
+    -- resource logger protocol
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/NSObject.h>
+
+@class EcProcess;
+@class NSDictionary;
+
+/**
+ * This protocol should be implemented by classes that want to receive
+ * callbacks about the CPU, scheduling and I/O usage of the process.
+ * This feature is enabled by setting the ResourceLoggerBundle user
+ * default to a bundle whose principal class implements this protocol.
+ */
+@protocol EcResourceLogger <NSObject>
+/**
+ * This callback is issued once per minute (on systems providing the
+ * /proc/self filesystem) with a dictionary describing resource usage
+ * during the last interval.  The keys are -
+ * <deflist>
+ *   <term>Interval</term>
+ *   <desc>The length of the interval in seconds.</desc>
+ *   <term>CPU</term>
+ *   <desc>The percentage of a single CPU used (user plus system).</desc>
+ *   <term>CPUUser</term>
+ *   <desc>The percentage of a single CPU used in user mode.</desc>
+ *   <term>CPUSystem</term>
+ *   <desc>The percentage of a single CPU used in system mode.</desc>
+ *   <term>Threads</term>
+ *   <desc>The number of threads at the end of the interval.</desc>
+ *   <term>MajorFaults</term>
+ *   <desc>Page faults requiring I/O per second.</desc>
+ *   <term>MinorFaults</term>
+ *   <desc>Page faults not requiring I/O per second.</desc>
+ *   <term>VoluntarySwitches</term>
+ *   <desc>Context switches per second where the process blocked.</desc>
+ *   <term>InvoluntarySwitches</term>
+ *   <desc>Context switches per second where the process was
+ *   preempted.</desc>
+ *   <term>RunDelay</term>
+ *   <desc>Milliseconds per second spent runnable but waiting for a
+ *   CPU.</desc>
+ *   <term>ReadChars</term>
+ *   <desc>Bytes per second passed to read system calls.</desc>
+ *   <term>WriteChars</term>
+ *   <desc>Bytes per second passed to write system calls.</desc>
+ *   <term>ReadBytes</term>
+ *   <desc>Bytes per second fetched from storage.</desc>
+ *   <term>WriteBytes</term>
+ *   <desc>Bytes per second sent to storage.</desc>
+ * </deflist>
+ * Keys are omitted if the information is not available (for instance
+ * /proc/self/io may not be readable).
+ */
+- (void) process: (EcProcess*)process
+ didUseResources: (NSDictionary*)rates;
+@end
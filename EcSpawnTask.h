@@ -0,0 +1,118 @@
+/** Enterprise Control Configuration and Logging
+    -- lightweight launching of managed processes
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#ifndef	INCLUDED_ECSPAWNTASK_H
+#define	INCLUDED_ECSPAWNTASK_H
+
+#import <Foundation/NSTask.h>
+#import <Foundation/NSDate.h>
+
+@class	EcPidWatch;
+@class	NSArray;
+@class	NSDictionary;
+@class	NSMutableData;
+@class	NSString;
+
+/** <p>The EcSpawnTask class is used by the Command server in place of the
+ * standard NSTask to launch the processes it manages.  It is configured
+ * and used exactly like an NSTask (and posts NSTaskDidTerminateNotification
+ * when the process ends), but the work done for each launch is kept to a
+ * minimum:
+ * </p>
+ * <list>
+ *   <item>The argument and environment arrays passed to the process are
+ *   built once and shared by later launches with the same program,
+ *   arguments and environment (see -shareImage:).</item>
+ *   <item>The child is created with vfork() (where available) so that the
+ *   address space of the Command server is not copied, and does only the
+ *   minimum of async-signal-safe work before executing the program.</item>
+ *   <item>Each child is watched using a process file descriptor (see
+ *   EcPidWatch) so that its end is noticed at once, without relying on
+ *   the NSTask machinery.  Where those are not available the outstanding
+ *   children are polled with waitpid() instead.</item>
+ * </list>
+ * <p>The child may also be given a CPU affinity, a nice level and
+ * resource limits before the program is executed.
+ * </p>
+ */
+@interface EcSpawnTask : NSTask
+{
+  NSMutableData		*image;		/* Packed path, argv and envp	*/
+  NSArray		*affinity;	/* CPU numbers or nil		*/
+  NSDictionary		*limits;	/* Resource name -> limit	*/
+  int			niceness;
+  BOOL			niceSet;
+  int			pid;
+  int			status;
+  BOOL			launched;
+  BOOL			terminated;
+  BOOL			signalled;
+  BOOL			cored;
+  EcPidWatch		*watch;		/* Watches for end of child	*/
+  NSTimeInterval	latency;	/* Time taken to start program	*/
+}
+
+/** Returns a description of the launches performed since the Command
+ * server started: the number of launches and the rate over the last
+ * minute, and the time taken from fork to exec (average, maximum and
+ * most recent).
+ */
++ (NSString*) statistics;
+
+/** Returns YES if the process was killed by a signal and dumped core.
+ */
+- (BOOL) coreDumped;
+
+/** Returns the time taken to create the child process and have it start
+ * executing the program, or zero if the task has not been launched.
+ */
+- (NSTimeInterval) latency;
+
+/** Sets the CPUs (an array of CPU numbers) the child may run on.
+ * This is ignored on systems which do not support sched_setaffinity().
+ */
+- (void) setAffinity: (NSArray*)cpus;
+
+/** Sets resource limits for the child.  The keys are the names of the
+ * resources without the RLIMIT_ prefix (AS, CORE, CPU, DATA, FSIZE,
+ * MEMLOCK, NOFILE, NPROC, RSS, STACK) and the values are numbers, or the
+ * string 'unlimited'.  Both the soft and hard limits are set.
+ */
+- (void) setLimits: (NSDictionary*)limits;
+
+/** Sets the nice level for the child.
+ */
+- (void) setNice: (int)level;
+
+/** If the other task has the same launch path, arguments and environment
+ * as the receiver, the receiver uses the argument and environment arrays
+ * the other task has already built.
+ */
+- (void) shareImage: (EcSpawnTask*)other;
+
+@end
+
+#endif
@@ -0,0 +1,767 @@
+/** Enterprise Control Configuration and Logging
+    -- lightweight launching of managed processes
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#if	defined(__linux__) && !defined(_GNU_SOURCE)
+#define	_GNU_SOURCE	/* For sched_setaffinity(), close_range() and pipe2() */
+#endif
+
+#import <Foundation/Foundation.h>
+
+#import "EcPidWatch.h"
+#import "EcSpawnTask.h"
+
+#import "config.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#ifdef	HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+#ifdef	HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+#ifdef	HAVE_PTHREAD_H
+#include <pthread.h>
+#define	SIGMASK	pthread_sigmask
+#else
+#define	SIGMASK	sigprocmask
+#endif
+
+/* The program path and the argument and environment arrays passed to
+ * execve(), packed into a single buffer with the strings they point to.
+ */
+typedef struct {
+  char	*path;
+  char	**argv;
+  char	**envp;
+} SpawnImage;
+
+/* The steps in the child which may fail, reported to the parent along
+ * with the errno value.
+ */
+static const char	*stages[] = {
+  "execve", "chdir", "setpriority", "setrlimit", "sched_setaffinity"
+};
+
+#ifdef	HAVE_SYS_RESOURCE_H
+static struct {
+  NSString	*name;
+  int		resource;
+} resources[] = {
+#ifdef	RLIMIT_AS
+  { @"AS", RLIMIT_AS },
+#endif
+  { @"CORE", RLIMIT_CORE },
+  { @"CPU", RLIMIT_CPU },
+  { @"DATA", RLIMIT_DATA },
+  { @"FSIZE", RLIMIT_FSIZE },
+#ifdef	RLIMIT_MEMLOCK
+  { @"MEMLOCK", RLIMIT_MEMLOCK },
+#endif
+  { @"NOFILE", RLIMIT_NOFILE },
+#ifdef	RLIMIT_NPROC
+  { @"NPROC", RLIMIT_NPROC },
+#endif
+#ifdef	RLIMIT_RSS
+  { @"RSS", RLIMIT_RSS },
+#endif
+  { @"STACK", RLIMIT_STACK },
+};
+#define	RESOURCE_COUNT	(sizeof(resources) / sizeof(*resources))
+#endif
+
+/* Everything the child needs between fork and exec, prepared by the
+ * parent.  The child only reads this.
+ */
+typedef struct {
+  SpawnImage		*img;
+  const char		*dir;
+  int			fdIn;
+  int			fdOut;
+  int			fdErr;
+  int			ep;		// Write end of the error pipe
+  sigset_t		mask;		// Signal mask to restore
+  int			maxfd;		// Used if close_range() fails
+#ifdef	HAVE_SYS_RESOURCE_H
+  BOOL			niceSet;
+  int			niceness;
+  int			limitCount;
+  int			limitResource[RESOURCE_COUNT];
+  struct rlimit		limitValue[RESOURCE_COUNT];
+#endif
+#ifdef	HAVE_SCHED_SETAFFINITY
+  BOOL			affinity;
+  cpu_set_t		cpus;
+#endif
+} SpawnChild;
+
+/* Runs in the child and never returns.  This is a separate function so
+ * that, after vfork(), all the child's variables live in a stack frame of
+ * its own rather than in the frame of -launch, which the parent is still
+ * using.  On failure the step and errno are written to the error pipe.
+ */
+static void spawnChild(const SpawnChild *c)
+  __attribute__((noinline, noreturn));
+
+static void
+spawnChild(const SpawnChild *c)
+{
+  int		report[2];
+  int		i;
+
+  for (i = 1; i < NSIG; i++)
+    {
+      signal(i, SIG_DFL);
+    }
+  sigprocmask(SIG_SETMASK, &c->mask, 0);
+  setsid();
+  if (c->fdIn >= 0 && c->fdIn != 0) dup2(c->fdIn, 0);
+  if (c->fdOut >= 0 && c->fdOut != 1) dup2(c->fdOut, 1);
+  if (c->fdErr >= 0 && c->fdErr != 2) dup2(c->fdErr, 2);
+  /* The C library may provide close_range() on a kernel without it
+   * (before 5.9), so we fall back to closing each descriptor.
+   */
+#ifdef	HAVE_CLOSE_RANGE
+  if ((c->ep > 3 && close_range(3, c->ep - 1, 0) < 0)
+    || close_range(c->ep + 1, ~0U, 0) < 0)
+#endif
+    {
+      for (i = 3; i < c->maxfd; i++)
+	{
+	  if (i != c->ep) close(i);
+	}
+    }
+  report[0] = 1;
+  if (0 == c->dir || chdir(c->dir) == 0)
+    {
+      report[0] = 2;
+#ifdef	HAVE_SYS_RESOURCE_H
+      if (NO == c->niceSet || setpriority(PRIO_PROCESS, 0, c->niceness) == 0)
+	{
+	  report[0] = 3;
+	  for (i = 0; i < c->limitCount; i++)
+	    {
+	      if (setrlimit(c->limitResource[i], &c->limitValue[i]) < 0)
+		{
+		  break;
+		}
+	    }
+	  if (i == c->limitCount)
+#endif
+	    {
+	      report[0] = 4;
+#ifdef	HAVE_SCHED_SETAFFINITY
+	      if (NO == c->affinity
+		|| sched_setaffinity(0, sizeof(c->cpus), &c->cpus) == 0)
+#endif
+		{
+		  report[0] = 0;
+		  execve(c->img->path, c->img->argv, c->img->envp);
+		}
+	    }
+#ifdef	HAVE_SYS_RESOURCE_H
+	}
+#endif
+    }
+  report[1] = errno;
+  if (write(c->ep, report, sizeof(report)) < 0)
+    {
+      ;	// Nothing more we can do
+    }
+  _exit(127);
+}
+
+/* The children which have not yet been reaped (pid -> task), and the
+ * timer used to poll for the termination of any we can not watch.
+ */
+static NSMapTable	*active = 0;
+static NSTimer		*reaper = nil;
+
+/* Launch statistics.  The times of recent launches are kept in a ring
+ * so that we can report the rate over the last minute.
+ */
+#define	RECENT	256
+static NSTimeInterval	recent[RECENT];
+static unsigned		recentIndex = 0;
+static unsigned		spawnCount = 0;
+static NSTimeInterval	latencyTotal = 0.0;
+static NSTimeInterval	latencyMax = 0.0;
+static NSTimeInterval	latencyLast = 0.0;
+
+static NSMutableData*
+buildImage(NSString *path, NSArray *args, NSDictionary *env)
+{
+  NSUInteger	argc = [args count];
+  NSUInteger	envc = [env count];
+  NSUInteger	count = 1 + argc + envc;
+  const char	*str[count];
+  size_t	len[count];
+  size_t	size;
+  NSEnumerator	*e;
+  NSString	*k;
+  NSMutableData	*d;
+  SpawnImage	*img;
+  char		*buf;
+  NSUInteger	i;
+  NSUInteger	n = 0;
+
+  str[n++] = [path fileSystemRepresentation];
+  for (i = 0; i < argc; i++)
+    {
+      str[n++] = [[[args objectAtIndex: i] description] UTF8String];
+    }
+  e = [env keyEnumerator];
+  while (nil != (k = [e nextObject]))
+    {
+      str[n++] = [[NSString stringWithFormat: @"%@=%@",
+	k, [env objectForKey: k]] UTF8String];
+    }
+
+  /* The argv array has the path as its first element and a terminating
+   * null pointer, the envp array just the terminating null pointer.
+   */
+  size = sizeof(SpawnImage) + (argc + 2 + envc + 1) * sizeof(char*);
+  for (i = 0; i < count; i++)
+    {
+      len[i] = strlen(str[i]) + 1;
+      size += len[i];
+    }
+  d = [NSMutableData dataWithLength: size];
+  img = (SpawnImage*)[d mutableBytes];
+  img->argv = (char**)(img + 1);
+  img->envp = img->argv + argc + 2;
+  buf = (char*)(img->envp + envc + 1);
+  for (i = 0; i < count; i++)
+    {
+      memcpy(buf, str[i], len[i]);
+      if (0 == i)
+	{
+	  img->path = buf;
+	  img->argv[0] = buf;
+	}
+      else if (i <= argc)
+	{
+	  img->argv[i] = buf;
+	}
+      else
+	{
+	  img->envp[i - argc - 1] = buf;
+	}
+      buf += len[i];
+    }
+  return d;
+}
+
+/* Returns the descriptor the child should use for one of its standard
+ * streams, or -1 if it should inherit ours.
+ */
+static int
+childDescriptor(id obj, BOOL input)
+{
+  if ([obj isKindOfClass: [NSPipe class]])
+    {
+      obj = input ? [obj fileHandleForReading] : [obj fileHandleForWriting];
+    }
+  if ([obj isKindOfClass: [NSFileHandle class]])
+    {
+      return [obj fileDescriptor];
+    }
+  return -1;
+}
+
+/* Closes the parent's copy of the child's end of a pipe.
+ */
+static void
+closeChildEnd(id obj, BOOL input)
+{
+  if ([obj isKindOfClass: [NSPipe class]])
+    {
+      if (YES == input)
+	{
+	  [[obj fileHandleForReading] closeFile];
+	}
+      else
+	{
+	  [[obj fileHandleForWriting] closeFile];
+	}
+    }
+}
+
+@interface	EcSpawnTask (Private)
++ (void) _reap: (NSTimer*)t;
+- (void) _exited: (int)waitStatus;
+- (void) _pidExited: (EcPidWatch*)w;
+- (BOOL) _poll;
+- (void) _startReaper;
+@end
+
+@implementation	EcSpawnTask
+
++ (NSString*) statistics
+{
+  NSTimeInterval	now = [NSDate timeIntervalSinceReferenceDate];
+  unsigned		lastMinute = 0;
+  unsigned		i;
+
+  for (i = 0; i < RECENT; i++)
+    {
+      if (recent[i] > 0.0 && now - recent[i] <= 60.0)
+	{
+	  lastMinute++;
+	}
+    }
+  return [NSString stringWithFormat: @"%u launched (%u in the last minute)"
+    @", fork to exec %.2fms average, %.2fms max, %.2fms last",
+    spawnCount, lastMinute,
+    (spawnCount > 0) ? latencyTotal * 1000.0 / spawnCount : 0.0,
+    latencyMax * 1000.0, latencyLast * 1000.0];
+}
+
+- (BOOL) coreDumped
+{
+  return cored;
+}
+
+- (void) dealloc
+{
+  [watch invalidate];
+  DESTROY(watch);
+  DESTROY(image);
+  DESTROY(affinity);
+  DESTROY(limits);
+  [super dealloc];
+}
+
+- (void) interrupt
+{
+  if (YES == launched && NO == terminated)
+    {
+      if (kill(-pid, SIGINT) < 0)
+	{
+	  kill(pid, SIGINT);
+	}
+    }
+}
+
+- (BOOL) isRunning
+{
+  if (NO == launched)
+    {
+      return NO;
+    }
+  if (NO == terminated)
+    {
+      [self _poll];
+    }
+  return (NO == terminated) ? YES : NO;
+}
+
+- (NSTimeInterval) latency
+{
+  return latency;
+}
+
+- (void) launch
+{
+  NSString		*path;
+  SpawnChild		child;
+  int			ep[2];
+  int			report[2];
+  ssize_t		got;
+  sigset_t		all;
+  struct sigaction	sa;
+  NSTimeInterval	start;
+
+  if (YES == launched)
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"task has already been launched"];
+    }
+  if (nil == (path = [self validatedLaunchPath]))
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"launch path '%@' is not valid", [self launchPath]];
+    }
+
+  /* Everything the child needs is prepared now, since between fork and
+   * exec it may only make async-signal-safe calls.
+   */
+  if (nil == image)
+    {
+      NSDictionary	*env = [self environment];
+
+      if (nil == env)
+	{
+	  env = [[NSProcessInfo processInfo] environment];
+	}
+      ASSIGN(image, buildImage(path, [self arguments], env));
+    }
+  memset(&child, '\0', sizeof(child));
+  child.img = (SpawnImage*)[image mutableBytes];
+  if ([[self currentDirectoryPath] length] > 0)
+    {
+      child.dir = [[self currentDirectoryPath] fileSystemRepresentation];
+    }
+  child.fdIn = childDescriptor([self standardInput], YES);
+  child.fdOut = childDescriptor([self standardOutput], NO);
+  child.fdErr = childDescriptor([self standardError], NO);
+  child.maxfd = (int)sysconf(_SC_OPEN_MAX);
+
+#ifdef	HAVE_SYS_RESOURCE_H
+  child.niceSet = niceSet;
+  child.niceness = niceness;
+  if (nil != limits)
+    {
+      unsigned	i;
+
+      for (i = 0; i < RESOURCE_COUNT; i++)
+	{
+	  id	v = [limits objectForKey: resources[i].name];
+
+	  if (nil != v)
+	    {
+	      rlim_t	r;
+
+	      if ([v isKindOfClass: [NSString class]]
+		&& [v caseInsensitiveCompare: @"unlimited"] == NSOrderedSame)
+		{
+		  r = RLIM_INFINITY;
+		}
+	      else
+		{
+		  r = (rlim_t)[v longLongValue];
+		}
+	      child.limitResource[child.limitCount] = resources[i].resource;
+	      child.limitValue[child.limitCount].rlim_cur = r;
+	      child.limitValue[child.limitCount].rlim_max = r;
+	      child.limitCount++;
+	    }
+	}
+    }
+#endif
+#ifdef	HAVE_SCHED_SETAFFINITY
+  CPU_ZERO(&child.cpus);
+  if (nil != affinity)
+    {
+      NSUInteger	i;
+
+      child.affinity = YES;
+      for (i = 0; i < [affinity count]; i++)
+	{
+	  int	c = [[affinity objectAtIndex: i] intValue];
+
+	  if (c >= 0 && c < CPU_SETSIZE)
+	    {
+	      CPU_SET(c, &child.cpus);
+	    }
+	}
+    }
+#endif
+
+  /* If child signals are ignored the system discards the exit status of
+   * our children, so we must make sure they are not.
+   */
+  if (sigaction(SIGCHLD, 0, &sa) == 0 && SIG_IGN == sa.sa_handler)
+    {
+      signal(SIGCHLD, SIG_DFL);
+    }
+
+  /* The child reports failure by writing the failed step and errno to a
+   * pipe which is closed when it successfully executes the program.
+   * Where possible the pipe is created close-on-exec, so that no program
+   * started by another thread can inherit it.
+   */
+#ifdef	HAVE_PIPE2
+  if (pipe2(ep, O_CLOEXEC) < 0)
+#else
+  if (pipe(ep) < 0)
+#endif
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"unable to create pipe (%s)", strerror(errno)];
+    }
+#ifndef	HAVE_PIPE2
+  fcntl(ep[0], F_SETFD, FD_CLOEXEC);
+  fcntl(ep[1], F_SETFD, FD_CLOEXEC);
+#endif
+  child.ep = ep[1];
+
+  /* No signal handler may run in the child while it shares our memory.
+   */
+  sigfillset(&all);
+  SIGMASK(SIG_SETMASK, &all, &child.mask);
+  start = [NSDate timeIntervalSinceReferenceDate];
+#if	defined(HAVE_VFORK) && defined(__linux__)
+  pid = vfork();
+#else
+  pid = fork();
+#endif
+  if (0 == pid)
+    {
+      spawnChild(&child);
+    }
+  SIGMASK(SIG_SETMASK, &child.mask, 0);
+  close(ep[1]);
+  if (pid < 0)
+    {
+      int	e = errno;
+
+      close(ep[0]);
+      pid = 0;
+      [NSException raise: NSInvalidArgumentException
+		  format: @"unable to fork (%s)", strerror(e)];
+    }
+  do
+    {
+      got = read(ep[0], report, sizeof(report));
+    }
+  while (got < 0 && EINTR == errno);
+  close(ep[0]);
+  latency = [NSDate timeIntervalSinceReferenceDate] - start;
+  if (sizeof(report) == got)
+    {
+      int	s;
+
+      while (waitpid(pid, &s, 0) < 0 && EINTR == errno)
+	;
+      pid = 0;
+      [NSException raise: NSInvalidArgumentException
+		  format: @"%s failed in child (%s)",
+	stages[report[0]], strerror(report[1])];
+    }
+
+  launched = YES;
+  closeChildEnd([self standardInput], YES);
+  closeChildEnd([self standardOutput], NO);
+  closeChildEnd([self standardError], NO);
+
+  spawnCount++;
+  latencyLast = latency;
+  latencyTotal += latency;
+  if (latency > latencyMax)
+    {
+      latencyMax = latency;
+    }
+  recent[recentIndex++ % RECENT] = start;
+
+  if (0 == active)
+    {
+      active = NSCreateMapTable(NSIntegerMapKeyCallBacks,
+	NSObjectMapValueCallBacks, 0);
+    }
+  NSMapInsert(active, (void*)(intptr_t)pid, (void*)self);
+  ASSIGN(watch,
+    [EcPidWatch watch: pid target: self selector: @selector(_pidExited:)]);
+  if (nil == watch)
+    {
+      [self _startReaper];
+    }
+}
+
+- (int) processIdentifier
+{
+  return pid;
+}
+
+- (BOOL) resume
+{
+  if (YES == launched && NO == terminated)
+    {
+      return (kill(pid, SIGCONT) == 0) ? YES : NO;
+    }
+  return NO;
+}
+
+- (void) setAffinity: (NSArray*)cpus
+{
+  ASSIGNCOPY(affinity, cpus);
+}
+
+- (void) setLimits: (NSDictionary*)l
+{
+  ASSIGNCOPY(limits, l);
+}
+
+- (void) setNice: (int)level
+{
+  niceness = level;
+  niceSet = YES;
+}
+
+- (void) shareImage: (EcSpawnTask*)other
+{
+  if (nil != other && self != other && nil != other->image
+    && [[self launchPath] isEqual: [other launchPath]]
+    && [[self arguments] isEqual: [other arguments]]
+    && [[self environment] isEqual: [other environment]])
+    {
+      ASSIGN(image, other->image);
+    }
+}
+
+- (BOOL) suspend
+{
+  if (YES == launched && NO == terminated)
+    {
+      return (kill(pid, SIGSTOP) == 0) ? YES : NO;
+    }
+  return NO;
+}
+
+- (void) terminate
+{
+  if (YES == launched && NO == terminated)
+    {
+      if (kill(-pid, SIGTERM) < 0)
+	{
+	  kill(pid, SIGTERM);
+	}
+    }
+}
+
+- (NSTaskTerminationReason) terminationReason
+{
+  if (NO == launched || YES == [self isRunning])
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"task has not terminated"];
+    }
+  return (YES == signalled) ? NSTaskTerminationReasonUncaughtSignal
+    : NSTaskTerminationReasonExit;
+}
+
+- (int) terminationStatus
+{
+  if (NO == launched || YES == [self isRunning])
+    {
+      [NSException raise: NSInvalidArgumentException
+		  format: @"task has not terminated"];
+    }
+  return status;
+}
+
+@end
+
+@implementation	EcSpawnTask (Private)
+
++ (void) _reap: (NSTimer*)t
+{
+  NSArray	*a = NSAllMapTableValues(active);
+  NSUInteger	i;
+
+  for (i = 0; i < [a count]; i++)
+    {
+      [[a objectAtIndex: i] _poll];
+    }
+  if (0 == NSCountMapTable(active))
+    {
+      [reaper invalidate];
+      reaper = nil;
+    }
+}
+
+- (void) _exited: (int)waitStatus
+{
+  RETAIN(self);
+  NSMapRemove(active, (void*)(intptr_t)pid);
+  [watch invalidate];
+  DESTROY(watch);
+  terminated = YES;
+  if (WIFSIGNALED(waitStatus))
+    {
+      signalled = YES;
+      status = WTERMSIG(waitStatus);
+#ifdef	WCOREDUMP
+      cored = WCOREDUMP(waitStatus) ? YES : NO;
+#endif
+    }
+  else
+    {
+      status = WEXITSTATUS(waitStatus);
+    }
+  [[NSNotificationCenter defaultCenter]
+    postNotificationName: NSTaskDidTerminateNotification
+		  object: self];
+  RELEASE(self);
+}
+
+- (void) _pidExited: (EcPidWatch*)w
+{
+  if (NO == terminated && NO == [self _poll])
+    {
+      [self _startReaper];	// Should not happen; the child is a zombie
+    }
+}
+
+- (BOOL) _poll
+{
+  int	result;
+  int	s = 0;
+
+  do
+    {
+      result = waitpid(pid, &s, WNOHANG);
+    }
+  while (result < 0 && EINTR == errno);
+  if (0 == result)
+    {
+      return NO;	// Still running
+    }
+  if (result < 0)
+    {
+      /* Someone else collected the child, so its status is lost.
+       * We must not report that as a clean exit, so we use 255.
+       */
+      NSLog(@"Unable to collect status of process %d (%s)",
+	pid, strerror(errno));
+#ifdef	W_EXITCODE
+      s = W_EXITCODE(255, 0);
+#else
+      s = 255 << 8;
+#endif
+    }
+  [self _exited: s];
+  return YES;
+}
+
+- (void) _startReaper
+{
+  if (nil == reaper)
+    {
+      reaper = [NSTimer scheduledTimerWithTimeInterval: 0.1
+	target: [EcSpawnTask class]
+	selector: @selector(_reap:)
+	userInfo: nil
+	repeats: YES];
+    }
+}
+
+@end
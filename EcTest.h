@@ -77,7 +77,9 @@ EcTestConnect(NSString *name, NSString *host, NSTimeInterval timeout);
 
 /** This function gets process configuration for the specified key
  * and deserialises it to a property list object (returned) or nil
- * if no value is configured for the specified key.
+ * if no value is configured for the specified key.<br />
+ * If the key is EC_CONFIG_TRACE the result is the trace of the last
+ * traced configuration change applied by the process (see EcConfigDelta.h).
  */
 extern id
 EcTestGetConfig(id<EcTest> process, NSString *key);
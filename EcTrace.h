@@ -0,0 +1,95 @@
+/** Enterprise Control Configuration and Logging
+    -- lightweight span tracing
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#ifndef	INCLUDED_ECTRACE_H
+#define	INCLUDED_ECTRACE_H
+
+#import <Foundation/NSObject.h>
+
+@class	NSData;
+
+/** <p>Span tracing records the start time and duration of named sections
+ * of code into a ring buffer belonging to the thread executing the code,
+ * so that recording needs no locking.  When tracing is not active the
+ * cost of a span is a test of the EcTraceActive flag, so spans may be
+ * left compiled into production code.
+ * </p>
+ * <p>The EcProcess class provides the 'trace' console command to start
+ * and stop tracing, and writes the collected spans into the debug logs
+ * directory in the Chrome trace-event JSON format (which may be viewed
+ * using chrome://tracing or similar tools).
+ * </p>
+ * <p>A span is normally marked using the EC_TRACE_BEGIN() and EC_TRACE_END
+ * macros, which must be used as a pair at the same level of scope (in the
+ * same way as ENTER_POOL and LEAVE_POOL).  If control leaves the block
+ * other than by reaching EC_TRACE_END (eg by an exception or a return),
+ * the span is simply not recorded.
+ * </p>
+ * <p>While tracing is active, the -server: and -server:forNumber: methods
+ * of EcProcess return a proxy which records each message sent to the
+ * server as a span named after the method.  Messages sent through a
+ * server proxy obtained before tracing started are not recorded.
+ * </p>
+ */
+
+/** Set while tracing is active.
+ */
+extern BOOL	EcTraceActive;
+
+/** Returns a monotonic timestamp in microseconds.
+ */
+extern uint64_t	EcTraceNow(void);
+
+/** Records a span with the given name (which must be a string constant,
+ * as only the pointer is stored) starting and ending at the timestamps
+ * obtained from EcTraceNow().  Does nothing if tracing is not active.
+ */
+extern void	EcTraceSpan(const char *name, uint64_t start, uint64_t end);
+
+/** Discards any previously recorded spans and starts tracing.<br />
+ * Returns NO if tracing is not supported on this system.
+ */
+extern BOOL	EcTraceStart(void);
+
+/** Stops tracing and returns the recorded spans as Chrome trace-event
+ * JSON data, or nil if tracing was not active.
+ */
+extern NSData	*EcTraceStop(void);
+
+/** Begins a traced span with the specified name (a string constant).
+ */
+#define	EC_TRACE_BEGIN(name) {\
+  const char	*_ecTraceName = (name);\
+  uint64_t	_ecTraceStart = (EcTraceActive ? EcTraceNow() : 0);
+
+/** Ends the span begun by the matching EC_TRACE_BEGIN().
+ */
+#define	EC_TRACE_END \
+  if (0 != _ecTraceStart)\
+    EcTraceSpan(_ecTraceName, _ecTraceStart, EcTraceNow());\
+}
+
+#endif
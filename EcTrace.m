@@ -0,0 +1,321 @@
+/** Enterprise Control Configuration and Logging
+    -- lightweight span tracing
+
+   Copyright (C) 2026 Free Software Foundation, Inc.
+
+   Date: October 2026
+
+   This file is part of the GNUstep project.
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Library General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, write to the Free
+   Software Foundation, Inc., 51 Franklin Street, Fifth Floor,
+   Boston, MA 02111 USA.
+
+   */
+
+#import <Foundation/Foundation.h>
+
+#import "EcProcess.h"
+#import "EcTrace.h"
+
+#include "config.h"
+
+#ifdef	HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef	HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#if	defined(HAVE_PTHREAD_H)
+#include <pthread.h>
+#endif
+#include <sched.h>
+#include <time.h>
+
+BOOL	EcTraceActive = NO;
+
+uint64_t
+EcTraceNow(void)
+{
+#if	defined(CLOCK_MONOTONIC)
+  struct timespec	ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#else
+  return (uint64_t)([NSDate timeIntervalSinceReferenceDate] * 1000000.0);
+#endif
+}
+
+#if	defined(HAVE_PTHREAD_H)
+
+/* The number of spans kept for each thread.  Once the ring is full the
+ * oldest spans are overwritten.
+ */
+#define	TRACE_EVENTS	8192
+
+typedef struct	{
+  const char	*name;
+  uint64_t	start;
+  uint64_t	duration;
+} TraceEvent;
+
+typedef struct	TraceRing {
+  struct TraceRing	*next;
+  NSUInteger		tid;
+  BOOL			dead;		// Owning thread has exited
+  int			busy;		// Owner is recording a span
+  uint64_t		count;		// Spans recorded since start
+  char			name[64];	// Name of owning thread
+  TraceEvent		events[TRACE_EVENTS];
+} TraceRing;
+
+static pthread_mutex_t	traceMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t	traceKey;
+static BOOL		traceKeyMade = NO;
+static TraceRing	*traceRings = 0;
+
+static void
+traceThreadExit(void *ring)
+{
+  pthread_mutex_lock(&traceMutex);
+  ((TraceRing*)ring)->dead = YES;
+  pthread_mutex_unlock(&traceMutex);
+}
+
+/* Create the ring for the current thread.  This is the only place where
+ * recording a span involves locking or messaging.
+ */
+static TraceRing*
+traceRing()
+{
+  TraceRing	*ring = (TraceRing*)calloc(1, sizeof(TraceRing));
+  NSThread	*t;
+  NSString	*n;
+
+  if (0 == ring)
+    {
+      return 0;
+    }
+  ring->tid = ecNativeThreadID();
+  t = [NSThread currentThread];
+  n = [t name];
+  if (YES == [t isMainThread])
+    {
+      n = @"main";
+    }
+  else if ([n length] == 0)
+    {
+      n = [NSString stringWithFormat: @"thread %lu", (unsigned long)ring->tid];
+    }
+  strncpy(ring->name, [n UTF8String], sizeof(ring->name) - 1);
+  pthread_mutex_lock(&traceMutex);
+  ring->next = traceRings;
+  traceRings = ring;
+  pthread_mutex_unlock(&traceMutex);
+  pthread_setspecific(traceKey, ring);
+  return ring;
+}
+
+void
+EcTraceSpan(const char *name, uint64_t start, uint64_t end)
+{
+  TraceRing	*ring;
+  TraceEvent	*e;
+
+  if (NO == EcTraceActive)
+    {
+      return;
+    }
+  if (0 == (ring = (TraceRing*)pthread_getspecific(traceKey))
+    && 0 == (ring = traceRing()))
+    {
+      return;
+    }
+
+  /* Mark the ring busy before checking that tracing is still active, so
+   * that EcTraceStop() either sees us busy and waits for us, or we see
+   * that tracing has stopped and leave the ring alone.
+   */
+  __atomic_store_n(&ring->busy, 1, __ATOMIC_SEQ_CST);
+  if (YES == __atomic_load_n(&EcTraceActive, __ATOMIC_SEQ_CST))
+    {
+      e = &ring->events[ring->count % TRACE_EVENTS];
+      e->name = name;
+      e->start = start;
+      e->duration = (end > start) ? end - start : 0;
+      __atomic_store_n(&ring->count, ring->count + 1, __ATOMIC_RELEASE);
+    }
+  __atomic_store_n(&ring->busy, 0, __ATOMIC_RELEASE);
+}
+
+BOOL
+EcTraceStart(void)
+{
+  TraceRing	**link;
+
+  pthread_mutex_lock(&traceMutex);
+  if (NO == traceKeyMade)
+    {
+      if (0 != pthread_key_create(&traceKey, traceThreadExit))
+        {
+          pthread_mutex_unlock(&traceMutex);
+          return NO;
+        }
+      traceKeyMade = YES;
+    }
+  if (NO == EcTraceActive)
+    {
+      /* Discard the rings of threads which have gone, and empty the rest.
+       */
+      link = &traceRings;
+      while (*link != 0)
+        {
+          TraceRing	*ring = *link;
+
+          if (YES == ring->dead)
+            {
+              *link = ring->next;
+              free(ring);
+            }
+          else
+            {
+              ring->count = 0;
+              link = &ring->next;
+            }
+        }
+      __atomic_store_n(&EcTraceActive, YES, __ATOMIC_SEQ_CST);
+    }
+  pthread_mutex_unlock(&traceMutex);
+  return YES;
+}
+
+static void
+traceName(NSMutableString *m, const char *name)
+{
+  [m appendString: @"\""];
+  while (*name != '\0')
+    {
+      char	c = *name++;
+
+      if ('"' == c || '\\' == c)
+        {
+          [m appendFormat: @"\\%c", c];
+        }
+      else if ((unsigned char)c < ' ')
+        {
+          [m appendFormat: @"\\u%04x", (unsigned)c];
+        }
+      else
+        {
+          [m appendFormat: @"%c", c];
+        }
+    }
+  [m appendString: @"\""];
+}
+
+NSData*
+EcTraceStop(void)
+{
+  NSMutableString	*m;
+  TraceRing		*ring;
+  BOOL			first = YES;
+  int			pid = (int)getpid();
+
+  pthread_mutex_lock(&traceMutex);
+  if (NO == EcTraceActive)
+    {
+      pthread_mutex_unlock(&traceMutex);
+      return nil;
+    }
+  __atomic_store_n(&EcTraceActive, NO, __ATOMIC_SEQ_CST);
+
+  /* Wait for any thread which was recording a span when tracing stopped,
+   * so that no ring changes while we read it.
+   */
+  for (ring = traceRings; ring != 0; ring = ring->next)
+    {
+      while (0 != __atomic_load_n(&ring->busy, __ATOMIC_ACQUIRE))
+        {
+          sched_yield();
+        }
+    }
+
+  m = [NSMutableString stringWithCapacity: 1024 * 1024];
+  [m appendString: @"{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n"];
+  for (ring = traceRings; ring != 0; ring = ring->next)
+    {
+      uint64_t	n = __atomic_load_n(&ring->count, __ATOMIC_ACQUIRE);
+      uint64_t	i = 0;
+
+      if (0 == n)
+        {
+          continue;
+        }
+      if (NO == first)
+        {
+          [m appendString: @",\n"];
+        }
+      first = NO;
+      [m appendFormat: @"{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,"
+        @"\"tid\":%lu,\"args\":{\"name\":", pid, (unsigned long)ring->tid];
+      traceName(m, ring->name);
+      [m appendString: @"}}"];
+
+      /* If the ring has wrapped, the oldest surviving span is the one
+       * which would be overwritten next.
+       */
+      if (n > TRACE_EVENTS)
+        {
+          i = n - TRACE_EVENTS;
+        }
+      while (i < n)
+        {
+          TraceEvent	*e = &ring->events[i++ % TRACE_EVENTS];
+
+          [m appendString: @",\n{\"name\":"];
+          traceName(m, e->name);
+          [m appendFormat: @",\"cat\":\"ec\",\"ph\":\"X\",\"ts\":%llu,"
+            @"\"dur\":%llu,\"pid\":%d,\"tid\":%lu}",
+            (unsigned long long)e->start, (unsigned long long)e->duration,
+            pid, (unsigned long)ring->tid];
+        }
+    }
+  pthread_mutex_unlock(&traceMutex);
+  [m appendString: @"\n]}\n"];
+  return [m dataUsingEncoding: NSUTF8StringEncoding];
+}
+
+#else	/* HAVE_PTHREAD_H */
+
+void
+EcTraceSpan(const char *name, uint64_t start, uint64_t end)
+{
+  return;
+}
+
+BOOL
+EcTraceStart(void)
+{
+  return NO;
+}
+
+NSData*
+EcTraceStop(void)
+{
+  return nil;
+}
+
+#endif	/* HAVE_PTHREAD_H */
+